@@ -16,11 +16,12 @@
 #include "anopol_definitions.h"
 
 static anopol::anopolContext* context;
-std::array<VkWriteDescriptorSet, 4> GLOBAL_PIPELINE_DESCRIPTOR_SETS{};
+std::array<VkWriteDescriptorSet, 5> GLOBAL_PIPELINE_DESCRIPTOR_SETS{};
 VkDescriptorSetLayoutBinding GLOBAL_TEXTURE_BINDING{};
 VkDescriptorSetLayoutBinding GLOBAL_INSTANCE_BINDING{};
 VkDescriptorSetLayoutBinding GLOBAL_UNIFORM_BUFFER_BINDING{};
 VkDescriptorSetLayoutBinding GLOBAL_BATCHING_BINDING{};
+VkDescriptorSetLayoutBinding GLOBAL_BATCH_INSTANCE_BINDING{};
 VkDescriptorSetLayout        GLOBAL_ANOPOL_DESCRIPTOR_SET_LAYOUT{};
 
 anopol::descriptorSets* ANOPOL_DESCRIPTOR_SETS;
@@ -28,18 +29,30 @@ anopol::descriptorSets* ANOPOL_DESCRIPTOR_SETS;
 #include "src/pipeline/lighting.h"
 #include "src/math/math.h"
 
+#include "ll/cpu_zones.h"
 #include "ll/mem.h"
 #include "ll/internal.h"
+#include "ll/command_recorder.h"
+#include "ll/staging.h"
+#include "ll/growable_buffer.h"
+#include "ll/parallel_recorder.h"
+#include "ll/pipeline_cache.h"
+#include "ll/gpu_profiler.h"
+#include "ll/hiz_pyramid.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "src/core/texture/stb_image.h"
 #include "src/core/texture/material.h"
 #include "src/core/texture/texture.h"
+#include "src/core/texture/texture_table.h"
 
 #include "src/structs/shadow.h"
 
+#include "src/core/vertex_layout.h"
 #include "src/core/vertex.h"
+#include "src/core/mesh_optimize.h"
 
+#include "src/core/buffer/quantization_table.h"
 #include "src/core/buffer/vertex_buffer.h"
 #include "src/core/buffer/index_buffer.h"
 #include "src/core/buffer/instance_buffer.h"
@@ -54,13 +67,17 @@ anopol::descriptorSets* ANOPOL_DESCRIPTOR_SETS;
 #include "src/core/buffer/uniform_buffer.h"
 
 #if defined(__APPLE__)
-#define APPLE_USE_METAL_GPU_HELPERS
-//#define APPLE_USE_OPENCL_GPU_HELPERS
 #include "src/batch/bgpu/mac/macos_batch_combine_wrapper.h"
 #endif
 
 #include "src/batch/mesh_combine_structs.h"
 #include "src/batch/mesh_combine.h"
+#include "src/batch/gpu_cull.h"
+#include "src/batch/gpu_merge.h"
+#include "src/batch/cpu_cull.h"
+#include "src/batch/instance_cull.h"
+#include "src/batch/batch_heap.h"
+#include "src/batch/combine_tasks.h"
 #include "src/batch/batch.h"
 #include "src/batch/dynamic_upload.h"
 
@@ -79,13 +96,58 @@ anopol::descriptorSets* ANOPOL_DESCRIPTOR_SETS;
 
 namespace anopol {
 
-void initialize() {
+// Seconds since the first call; glfwGetTime is unavailable in headless runs that never call glfwInit
+double elapsedTime() {
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Fills in the folders left empty with the first of the executable's folder, the working directory
+// and the checkout these headers were compiled from, or a parent of one, that has shaders/main
+void resolveResourceFolders(runSettings& settings, const char* executable = nullptr) {
+    
+    if (!settings.shaderFolder.empty() && !settings.assetFolder.empty()) return;
+    
+    std::vector<std::filesystem::path> candidates;
+    std::error_code error;
+    
+    if (executable != nullptr) candidates.push_back(std::filesystem::absolute(executable, error).parent_path());
+    candidates.push_back(std::filesystem::current_path(error));
+    candidates.push_back(std::filesystem::absolute(__FILE__, error).parent_path());
+    
+    std::filesystem::path root;
+    for (std::filesystem::path candidate : candidates) {
+        for (; !candidate.empty(); candidate = candidate.parent_path()) {
+            if (std::filesystem::is_directory(candidate / "shaders" / "main", error)) {
+                root = candidate;
+                break;
+            }
+            if (candidate == candidate.parent_path()) break;
+        }
+        if (!root.empty()) break;
+    }
+    if (root.empty()) anopol_assert("No shaders/main next to the executable or in a parent folder; pass --shaders and --assets");
     
-    context = static_cast<anopolContext*>(malloc(1 * sizeof(anopolContext)));
+    if (settings.shaderFolder.empty()) settings.shaderFolder = (root / "shaders" / "main").string();
+    if (settings.assetFolder.empty())  settings.assetFolder  = root.string();
+}
+
+//------------------------------------------------------------------------------------------//
+// Context: window (or headless targets), device, staging, caches and global descriptors
+//------------------------------------------------------------------------------------------//
+
+void createContext(const runSettings& settings) {
     
-    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+    context = new anopolContext();
+    context->headless = settings.headless;
     
-    context->window = glfwCreateWindow(1200, 800, "Anopol", nullptr, nullptr);
+    if (settings.headless) {
+        context->extent = { settings.width, settings.height };
+    }
+    else {
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+        context->window = glfwCreateWindow(settings.width, settings.height, "Anopol", nullptr, nullptr);
+    }
     
     VkApplicationInfo app{};
     app.sType                       = VK_STRUCTURE_TYPE_APPLICATION_INFO;
@@ -93,10 +155,10 @@ void initialize() {
     app.pEngineName                 = "Anopol";
     app.applicationVersion          = VK_MAKE_VERSION(1, 0, 0);
     app.engineVersion               = VK_MAKE_VERSION(1, 0, 0);
-    app.apiVersion                  = VK_API_VERSION_1_0;
+    app.apiVersion                  = VK_API_VERSION_1_2;
     
-    uint32_t extensionCount;
-    const char** extensions = glfwGetRequiredInstanceExtensions(&extensionCount);
+    uint32_t extensionCount = 0;
+    const char** extensions = settings.headless ? nullptr : glfwGetRequiredInstanceExtensions(&extensionCount);
     
     std::vector<const char*> requiredExtensions;
     for (int i = 0; i < extensionCount; i++) {
@@ -127,16 +189,20 @@ void initialize() {
     
     if (vkCreateInstance(&instanceInfo, nullptr, &context->instance) != VK_SUCCESS) anopol_assert("Couldn't create VkInstance");
     
-    glfwCreateWindowSurface(context->instance, context->window, nullptr, &context->surface);
+    if (!settings.headless) glfwCreateWindowSurface(context->instance, context->window, nullptr, &context->surface);
     
     anopol::camera::Camera::initialize();
-    glfwSetCursorPosCallback(context->window, anopol::camera::cursor_position_callback);
+    if (!settings.headless) glfwSetCursorPosCallback(context->window, anopol::camera::cursor_position_callback);
     
     anopol::ll::initializeVulkanDependenices();
+    anopol::ll::initializeStaging();
+    anopol::ll::initializePipelineCache();
+    anopol::ll::gpuProfiler.Initialize();
+    anopol::render::quantizationTable.Initialize();
     
     
     ANOPOL_DESCRIPTOR_SETS = static_cast<anopol::descriptorSets*>(malloc(1 * sizeof(anopol::descriptorSets)));
-    std::array<VkDescriptorPoolSize, 4> poolSizes{};
+    std::array<VkDescriptorPoolSize, 5> poolSizes{};
     
     poolSizes[0].type                   = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER; // Uniform Buffer
     poolSizes[0].descriptorCount        = (uint32_t)anopol_max_frames;
@@ -146,6 +212,8 @@ void initialize() {
     poolSizes[2].descriptorCount        = (uint32_t)anopol_max_frames;
     poolSizes[3].type                   = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER; // Texture Buffer
     poolSizes[3].descriptorCount        = 1024;
+    poolSizes[4].type                   = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER; // Batch Instance Indirection
+    poolSizes[4].descriptorCount        = (uint32_t)anopol_max_frames;
     
     VkDescriptorPoolCreateInfo poolCreateInfo{};
     poolCreateInfo.sType            = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
@@ -170,17 +238,22 @@ void initialize() {
     GLOBAL_BATCHING_BINDING.descriptorType              = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
     GLOBAL_BATCHING_BINDING.stageFlags                  = VK_SHADER_STAGE_VERTEX_BIT;
     
+    GLOBAL_BATCH_INSTANCE_BINDING.binding               = 5;
+    GLOBAL_BATCH_INSTANCE_BINDING.descriptorCount       = 1;
+    GLOBAL_BATCH_INSTANCE_BINDING.descriptorType        = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    GLOBAL_BATCH_INSTANCE_BINDING.stageFlags            = VK_SHADER_STAGE_VERTEX_BIT;
+    
     GLOBAL_TEXTURE_BINDING.binding                      = 4;
     GLOBAL_TEXTURE_BINDING.descriptorCount              = anopol_max_textures;
     GLOBAL_TEXTURE_BINDING.descriptorType               = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     GLOBAL_TEXTURE_BINDING.stageFlags                   = VK_SHADER_STAGE_FRAGMENT_BIT;
     GLOBAL_TEXTURE_BINDING.pImmutableSamplers           = nullptr;
     
-    VkDescriptorSetLayoutBinding bindings[] = {GLOBAL_INSTANCE_BINDING, GLOBAL_UNIFORM_BUFFER_BINDING, GLOBAL_BATCHING_BINDING, GLOBAL_TEXTURE_BINDING};
+    VkDescriptorSetLayoutBinding bindings[] = {GLOBAL_INSTANCE_BINDING, GLOBAL_UNIFORM_BUFFER_BINDING, GLOBAL_BATCHING_BINDING, GLOBAL_TEXTURE_BINDING, GLOBAL_BATCH_INSTANCE_BINDING};
     
     VkDescriptorSetLayoutCreateInfo layoutInfo{};
     layoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = 4;
+    layoutInfo.bindingCount = 5;
     layoutInfo.pBindings    = bindings;
     
     if (vkCreateDescriptorSetLayout(context->device, &layoutInfo, nullptr, &GLOBAL_ANOPOL_DESCRIPTOR_SET_LAYOUT) != VK_SUCCESS) anopol_assert("Failed to create descriptor");
@@ -195,37 +268,102 @@ void initialize() {
     
     ANOPOL_DESCRIPTOR_SETS->descriptorSets.resize(anopol_max_frames);
     if (vkAllocateDescriptorSets(context->device, &descriptorAllocationInfo, ANOPOL_DESCRIPTOR_SETS->descriptorSets.data()) != VK_SUCCESS) anopol_assert("Failed to allocate descriptor sets");
+}
+
+void destroyContext() {
+    
+    vkDestroyDescriptorPool(context->device, ANOPOL_DESCRIPTOR_SETS->descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(context->device, GLOBAL_ANOPOL_DESCRIPTOR_SET_LAYOUT, nullptr);
+    free(ANOPOL_DESCRIPTOR_SETS);
+    
+    anopol::render::quantizationTable.Destroy();
+    anopol::ll::gpuProfiler.Destroy();
+    anopol::ll::destroyPipelineCache();
+    anopol::ll::destroyStaging();
+    anopol::ll::freeMemory();
+}
+
+//------------------------------------------------------------------------------------------//
+// Main loop
+//------------------------------------------------------------------------------------------//
+
+void initialize(runSettings settings = runSettings()) {
     
+    double startupTime = elapsedTime();
+    resolveResourceFolders(settings);
+    createContext(settings);
     
-    anopol::pipeline::Pipeline pipeline = anopol::pipeline::Pipeline::CreatePipeline("/Users/dmitriwamback/Documents/Projects/anopol/anopol/shaders/main");
+    anopol::pipeline::sceneWorkload workload{};
+    workload.assetFolder = settings.assetFolder;
     
-    double previousTime = glfwGetTime();
-    double previousDeltaTime = glfwGetTime();
+    anopol::pipeline::Pipeline pipeline = anopol::pipeline::Pipeline::CreatePipeline(settings.shaderFolder, workload);
+    
+    // Cold vs warm start: compare these across two launches, the second one reading the saved cache
+    std::cout << "Startup: " << (elapsedTime() - startupTime) * 1000.0 << " ms"
+              << " | pipeline cache " << (anopol::ll::pipelineCacheStats.loaded ? "hit" : "miss")
+              << " (" << anopol::ll::pipelineCacheStats.loadedBytes << " bytes, " << anopol::ll::pipelineCacheStats.loadMilliseconds << " ms to load)"
+              << " | " << anopol::ll::pipelineCacheStats.pipelinesCreated << " pipelines in " << anopol::ll::pipelineCacheStats.creationMilliseconds << " ms\n";
+    
+    double previousTime = elapsedTime();
+    double previousDeltaTime = elapsedTime();
     int frameCount = 0;
     
-    while (!glfwWindowShouldClose(context->window)) {
+    double loopStart = elapsedTime();
+    uint32_t renderedFrames = 0;
+    [[maybe_unused]] bool zoneDumpHeld = false;
+    
+    auto running = [&]() {
+        if (!settings.headless) return !glfwWindowShouldClose(context->window);
+        if (settings.frameCount > 0 && renderedFrames >= settings.frameCount) return false;
+        if (settings.duration > 0.0 && elapsedTime() - loopStart >= settings.duration) return false;
+        return true;
+    };
+    
+    while (running()) {
         pipeline.currentFrame = (pipeline.currentFrame + 1) % anopol_max_frames;
         
         glm::vec4 movement = glm::vec4(0.0f);
 
-        movement.z = glfwGetKey(context->window, GLFW_KEY_A) == GLFW_PRESS ?  0.05f : 0;
-        movement.w = glfwGetKey(context->window, GLFW_KEY_D) == GLFW_PRESS ? -0.05f : 0;
-        movement.x = glfwGetKey(context->window, GLFW_KEY_W) == GLFW_PRESS ?  0.05f : 0;
-        movement.y = glfwGetKey(context->window, GLFW_KEY_S) == GLFW_PRESS ? -0.05f : 0;
+        if (!settings.headless) {
+            movement.z = glfwGetKey(context->window, GLFW_KEY_A) == GLFW_PRESS ?  0.05f : 0;
+            movement.w = glfwGetKey(context->window, GLFW_KEY_D) == GLFW_PRESS ? -0.05f : 0;
+            movement.x = glfwGetKey(context->window, GLFW_KEY_W) == GLFW_PRESS ?  0.05f : 0;
+            movement.y = glfwGetKey(context->window, GLFW_KEY_S) == GLFW_PRESS ? -0.05f : 0;
+        }
         
         anopol::camera::camera.update(movement);
         
-        glfwPollEvents();
+        if (!settings.headless) {
+            glfwPollEvents();
+            
+#if defined(ANOPOL_CPU_ZONES)
+            bool dumpZones = glfwGetKey(context->window, GLFW_KEY_F9) == GLFW_PRESS;
+            if (dumpZones && !zoneDumpHeld) anopol::ll::writeCpuTrace(settings.zoneTracePath.empty() ? "anopol_zones.json" : settings.zoneTracePath);
+            zoneDumpHeld = dumpZones;
+#endif
+        }
         pipeline.Bind("test");
         
-        double currentTime = glfwGetTime();
+        double currentTime = elapsedTime();
         frameCount++;
+        renderedFrames++;
         
-        std::cout << anopol::camera::camera.cameraPosition.x << " " << anopol::camera::camera.cameraPosition.y << " " << anopol::camera::camera.cameraPosition.z << '\n';
+        if (!settings.headless) {
+            std::cout << anopol::camera::camera.cameraPosition.x << " " << anopol::camera::camera.cameraPosition.y << " " << anopol::camera::camera.cameraPosition.z << '\n';
+        }
         
-        if (currentTime - previousTime >= 1.0) {
+        if (!settings.headless && currentTime - previousTime >= 1.0) {
 
-            glfwSetWindowTitle(context->window, ("Anopol FPS: " + std::to_string(frameCount)).c_str());
+            anopol::ll::memoryStatistics memory = anopol::ll::queryMemoryStatistics();
+            
+            std::string title = "Anopol FPS: " + std::to_string(frameCount) +
+                                " | GPU memory: " + std::to_string(memory.blockCount) + " blocks, " +
+                                std::to_string(memory.bytesUsed / (1024 * 1024)) + "/" + std::to_string(memory.bytesReserved / (1024 * 1024)) + " MB, " +
+                                std::to_string(static_cast<int>(memory.fragmentation * 100.0f)) + "% fragmented" +
+                                " | CPU " + std::to_string(anopol::ll::gpuProfiler.Average("cpu frame")) + " ms" +
+                                " | GPU " + std::to_string(anopol::ll::gpuProfiler.Average("frame")) + " ms";
+            
+            glfwSetWindowTitle(context->window, title.c_str());
 
             frameCount = 0;
             previousTime = currentTime;
@@ -233,19 +371,36 @@ void initialize() {
                 
         debugTime += 0.1f;
         
-        double currentDeltatime = glfwGetTime();
+        double currentDeltatime = elapsedTime();
         deltaTime = (currentDeltatime - previousDeltaTime);
         previousDeltaTime = currentDeltatime;
+        
+        anopol::ll::gpuProfiler.RecordCpuFrame(deltaTime * 1000.0);
     }
     
     vkDeviceWaitIdle(context->device);
     
-    pipeline.CleanUp();
-    vkDestroyDescriptorPool(context->device, ANOPOL_DESCRIPTOR_SETS->descriptorPool, nullptr);
-    vkDestroyDescriptorSetLayout(context->device, GLOBAL_ANOPOL_DESCRIPTOR_SET_LAYOUT, nullptr);
-    free(ANOPOL_DESCRIPTOR_SETS);
+    if (settings.headless) {
+        double seconds = elapsedTime() - loopStart;
+        std::cout << "Headless: " << renderedFrames << " frames in " << seconds << " s"
+                  << " | " << (renderedFrames > 0 ? seconds * 1000.0 / renderedFrames : 0.0) << " ms/frame"
+                  << " | " << (seconds > 0.0 ? renderedFrames / seconds : 0.0) << " fps\n";
+        std::cout << anopol::ll::gpuProfiler.Report();
+    }
     
-    anopol::ll::freeMemory();
+    if (!settings.tracePath.empty() && !anopol::ll::gpuProfiler.WriteChromeTrace(settings.tracePath)) {
+        std::cerr << "Failed to write trace to " << settings.tracePath << '\n';
+    }
+#if defined(ANOPOL_CPU_ZONES)
+    if (!settings.zoneTracePath.empty() && !anopol::ll::writeCpuTrace(settings.zoneTracePath)) {
+        std::cerr << "Failed to write zones to " << settings.zoneTracePath << '\n';
+    }
+#else
+    if (!settings.zoneTracePath.empty()) std::cerr << "No zones written to " << settings.zoneTracePath << ": built without ANOPOL_CPU_ZONES\n";
+#endif
+    
+    pipeline.CleanUp();
+    destroyContext();
 }
 }
 
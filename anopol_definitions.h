@@ -6,6 +6,8 @@
 //
 
 #include <map>
+#include <algorithm>
+#include <unordered_map>
 #include <vector>
 #include <string>
 #include <optional>
@@ -15,6 +17,21 @@
 #include <thread>
 #include <mutex>
 #include <future>
+#include <functional>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <atomic>
+#include <memory>
+#include <limits>
+#include <filesystem>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
@@ -37,6 +54,8 @@
 #define anopol_max_cascades         4
 #define deltaTimeMultiplier         30.0f
 #define anopol_max_textures         8
+#define anopol_max_bindless_textures 4096
+#define anopol_max_materials        4096
 
 #define golden_ratio                static_cast<float>((1 + sqrt(5)) / 2.0f)
 #define inverse_golden_ratio        1.0f / golden_ratio
@@ -54,17 +73,34 @@ struct anopolContext {
     VkDevice            device;
     
     VkQueue             graphicsQueue,
-                        presentQueue;
+                        presentQueue,
+                        transferQueue;
     
     VkSurfaceKHR        surface;
     VkSwapchainKHR      swapchain;
     VkExtent2D          extent;
     VkFormat            format;
     
-    GLFWwindow*         window;
+    GLFWwindow*         window = nullptr;
     VkDebugUtilsMessengerEXT debug;
     
+    bool                headless = false; // No window, surface or swapchain; frames go to an offscreen ring
+    
     std::mutex graphicsQueueMutex;
+    std::mutex transferQueueMutex;
+};
+
+// How anopol::initialize runs: windowed until closed, or headless for a fixed frame count and/or duration
+struct runSettings {
+    bool        headless    = false;
+    uint32_t    width       = 1200,
+                height      = 800;
+    uint32_t    frameCount  = 0;    // 0 = unbounded
+    double      duration    = 0.0;  // Seconds, 0 = unbounded
+    std::string tracePath;          // Chrome trace of GPU scopes and CPU frames, written on exit when set
+    std::string zoneTracePath;      // Chrome trace of CPU zones (ANOPOL_CPU_ZONES), written on exit and on F9
+    std::string shaderFolder;       // Holds spirv/; empty finds shaders/main, see resolveResourceFolders
+    std::string assetFolder;        // Holds textures/ and models/; empty finds them like shaderFolder
 };
 
 struct swapchainDetails {
@@ -80,7 +116,8 @@ struct descriptorSets {
 
 struct queueFamily {
     std::optional<uint32_t> graphicsFamily,
-                            presentQueue;
+                            presentQueue,
+                            transferFamily;
 };
 
 const std::vector<const char*> validationLayers = {
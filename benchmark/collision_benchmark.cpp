@@ -0,0 +1,356 @@
+//
+//  collision_benchmark.cpp
+//  anopol
+//
+//  Created by Dmitri Wamback on 2026-10-17.
+//
+
+#include "../anopol.h"
+#include <algorithm>
+#include <random>
+
+//------------------------------------------------------------------------------------------//
+// Collision microbenchmark
+//
+// Times the CPU collision, picking and frustum culling kernels in isolation. No context or device is
+// created: renderables only carry their CPU vertices and the camera global keeps its
+// default collider. Every kernel runs over the same seeded inputs, so two builds can be
+// compared directly. Allocations are counted by replacing the global operator new below.
+// The replacement applies to the whole program, which is what makes the counts include
+// allocations inside GJK and EPA, so it must stay in this executable and out of any header.
+// Iteration histograms come from lastCollisionCounters.
+//
+// --queries Q --points P (vertices per generated convex shape) --seed S --output results.json
+//------------------------------------------------------------------------------------------//
+
+std::atomic<uint64_t> allocationCount{0};
+
+void* operator new(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size == 0 ? 1 : size)) return memory;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, size_t) noexcept { std::free(memory); }
+
+#define benchmark_histogram_size 17     // Iterations 0..15, then 16 or more
+
+struct kernelResult {
+    std::string name;
+    uint32_t    queries         = 0;
+    double      nsPerQuery      = 0.0;
+    double      allocsPerQuery  = 0.0;
+    uint32_t    hits            = 0;    // Collisions or ray hits, to catch a kernel that silently stopped working
+    std::array<uint32_t, benchmark_histogram_size> gjkHistogram{};
+    std::array<uint32_t, benchmark_histogram_size> epaHistogram{};
+    bool        hasHistograms   = false;
+};
+
+double volatile benchmarkSink = 0.0;   // Keeps results alive so the kernels are not optimized out
+
+// query(i) returns true on a hit; histograms are read from lastCollisionCounters when requested
+template<typename Query>
+kernelResult measure(const char* name, uint32_t queries, bool histograms, Query&& query) {
+
+    kernelResult result{};
+    result.name             = name;
+    result.queries          = queries;
+    result.hasHistograms    = histograms;
+
+    for (uint32_t i = 0; i < std::min<uint32_t>(queries, 256); i++) query(i);
+
+    uint64_t allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+    auto start = std::chrono::steady_clock::now();
+
+    for (uint32_t i = 0; i < queries; i++) {
+        if (query(i)) result.hits++;
+
+        if (histograms) {
+            result.gjkHistogram[std::min<uint32_t>(anopol::collision::lastCollisionCounters.gjkIterations, benchmark_histogram_size - 1)]++;
+            result.epaHistogram[std::min<uint32_t>(anopol::collision::lastCollisionCounters.epaIterations, benchmark_histogram_size - 1)]++;
+        }
+    }
+
+    double nanoseconds = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    uint64_t allocations = allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+
+    result.nsPerQuery       = queries > 0 ? nanoseconds / queries : 0.0;
+    result.allocsPerQuery   = queries > 0 ? static_cast<double>(allocations) / queries : 0.0;
+    return result;
+}
+
+//------------------------------------------------------------------------------------------//
+// Inputs
+//------------------------------------------------------------------------------------------//
+
+// Points on a jittered sphere; GJK only sees the support function, so the hull is implicit
+anopol::render::Renderable* createConvexShape(std::mt19937& random, uint32_t pointCount, glm::vec3 position) {
+
+    std::uniform_real_distribution<float> jitter(0.9f, 1.1f);
+    std::uniform_real_distribution<float> angle(0.0f, 360.0f);
+
+    anopol::render::Renderable* shape = anopol::render::Renderable::Create();
+    shape->vertices.clear();
+
+    for (uint32_t i = 0; i < pointCount; i++) {
+
+        // Fibonacci sphere
+        float y     = 1.0f - 2.0f * (i + 0.5f) / pointCount;
+        float r     = std::sqrt(std::max(0.0f, 1.0f - y * y));
+        float theta = i * 2.399963229f;
+
+        glm::vec3 point = glm::vec3(std::cos(theta) * r, y, std::sin(theta) * r) * 0.5f * jitter(random);
+        shape->vertices.push_back(anopol::render::Vertex{point, glm::vec3(0.0f), glm::vec2(0.0f)});
+    }
+
+    shape->position = position;
+    shape->scale    = glm::vec3(2.0f);
+    shape->rotation = glm::vec3(angle(random), angle(random), angle(random));
+    return shape;
+}
+
+// Cubes on a grid with random rotations, spaced so that roughly half of the neighbours touch
+std::vector<anopol::render::Renderable*> createCubeField(std::mt19937& random, uint32_t side) {
+
+    std::uniform_real_distribution<float> angle(0.0f, 360.0f);
+    std::uniform_real_distribution<float> offset(-0.25f, 0.25f);
+
+    std::vector<anopol::render::Renderable*> field;
+
+    for (uint32_t i = 0; i < side; i++) {
+        for (uint32_t j = 0; j < side; j++) {
+            anopol::render::Renderable* cube = anopol::render::Renderable::Create();
+            cube->position = glm::vec3(i * 1.1f + offset(random), offset(random), j * 1.1f + offset(random));
+            cube->rotation = glm::vec3(angle(random), angle(random), angle(random));
+            field.push_back(cube);
+        }
+    }
+    return field;
+}
+
+glm::vec3 randomDirection(std::mt19937& random) {
+
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+
+    glm::vec3 direction = glm::vec3(normal(random), normal(random), normal(random));
+    return glm::length(direction) > 0.0f ? glm::normalize(direction) : glm::vec3(0.0f, 1.0f, 0.0f);
+}
+
+//------------------------------------------------------------------------------------------//
+// Report
+//------------------------------------------------------------------------------------------//
+
+void printResult(const kernelResult& result) {
+
+    printf("%-24s %10.1f ns/query %8.2f allocs/query %8u/%u hits\n",
+           result.name.c_str(), result.nsPerQuery, result.allocsPerQuery, result.hits, result.queries);
+
+    if (!result.hasHistograms) return;
+
+    auto printHistogram = [](const char* label, const std::array<uint32_t, benchmark_histogram_size>& histogram) {
+        printf("    %s iterations:", label);
+        for (uint32_t i = 0; i < benchmark_histogram_size; i++) {
+            if (histogram[i] == 0) continue;
+            printf(" %u%s:%u", i, i == benchmark_histogram_size - 1 ? "+" : "", histogram[i]);
+        }
+        printf("\n");
+    };
+    printHistogram("GJK", result.gjkHistogram);
+    printHistogram("EPA", result.epaHistogram);
+}
+
+bool writeResults(const std::string& path, const std::vector<kernelResult>& results) {
+
+    std::ofstream file(path, std::ios::trunc);
+    if (!file.is_open()) return false;
+
+    auto writeHistogram = [&](const std::array<uint32_t, benchmark_histogram_size>& histogram) {
+        file << "[";
+        for (uint32_t i = 0; i < benchmark_histogram_size; i++) file << (i > 0 ? ", " : "") << histogram[i];
+        file << "]";
+    };
+
+    file << "{\n  \"kernels\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+
+        const kernelResult& result = results[i];
+
+        char line[256];
+        snprintf(line, sizeof(line), "    {\"name\": \"%s\", \"queries\": %u, \"nsPerQuery\": %.2f, \"allocsPerQuery\": %.3f, \"hits\": %u",
+                 result.name.c_str(), result.queries, result.nsPerQuery, result.allocsPerQuery, result.hits);
+        file << line;
+
+        if (result.hasHistograms) {
+            file << ", \"gjkIterations\": ";
+            writeHistogram(result.gjkHistogram);
+            file << ", \"epaIterations\": ";
+            writeHistogram(result.epaHistogram);
+        }
+        file << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    file << "  ]\n}\n";
+
+    return static_cast<bool>(file);
+}
+
+int main(int argc, const char * argv[]) {
+
+    uint32_t    queries     = 100000,
+                pointCount  = 64,
+                seed        = 1;
+    std::string outputPath;
+
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if      (argument == "--queries" && hasValue)   queries     = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (argument == "--points" && hasValue)    pointCount  = std::max<uint32_t>(4, static_cast<uint32_t>(std::stoul(argv[++i])));
+        else if (argument == "--seed" && hasValue)      seed        = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (argument == "--output" && hasValue)    outputPath  = argv[++i];
+    }
+
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+    // Convex shape pairs at distances around the touching point
+    const uint32_t shapeCount = 256;
+    std::vector<anopol::render::Renderable*> shapesA, shapesB;
+    for (uint32_t i = 0; i < shapeCount; i++) {
+        shapesA.push_back(createConvexShape(random, pointCount, glm::vec3(0.0f)));
+        shapesB.push_back(createConvexShape(random, pointCount, randomDirection(random) * (1.6f + 0.8f * unit(random))));
+    }
+
+    std::vector<anopol::render::Renderable*> field = createCubeField(random, 32);
+
+    std::vector<std::pair<uint32_t, uint32_t>> fieldPairs;
+    for (uint32_t i = 0; i < field.size(); i++) {
+        if ((i + 1) % 32 != 0)      fieldPairs.emplace_back(i, i + 1);
+        if (i + 32 < field.size())  fieldPairs.emplace_back(i, i + 32);
+    }
+
+    std::vector<glm::vec3> directions(4096);
+    for (glm::vec3& direction : directions) direction = randomDirection(random);
+
+    // Collider vertices and terminating simplices precomputed so Support and EPA are timed alone
+    std::vector<std::vector<anopol::render::Vertex>> colliderA, colliderB;
+    std::vector<std::vector<glm::vec3>> points;
+    for (uint32_t i = 0; i < shapeCount; i++) {
+        colliderA.push_back(shapesA[i]->GetColliderVertices());
+        colliderB.push_back(shapesB[i]->GetColliderVertices());
+
+        std::vector<glm::vec3> shapePoints;
+        for (const anopol::render::Vertex& vertex : colliderA.back()) shapePoints.push_back(vertex.vertex);
+        points.push_back(shapePoints);
+    }
+
+    std::vector<std::pair<uint32_t, anopol::collision::Simplex>> intersecting;
+    for (uint32_t i = 0; i < shapeCount; i++) {
+        anopol::collision::Simplex simplex;
+        if (anopol::collision::GJKSimplex(colliderA[i], colliderB[i], simplex)) intersecting.emplace_back(i, simplex);
+    }
+
+    // Rays from above the field aimed at random cubes
+    std::vector<anopol::camera::Ray> rays;
+    std::vector<uint32_t> rayTargets;
+    for (uint32_t i = 0; i < 4096; i++) {
+        uint32_t target = random() % field.size();
+        glm::vec3 origin = field[target]->position + glm::vec3(unit(random) * 4.0f, 10.0f, unit(random) * 4.0f);
+        rays.push_back({origin, glm::normalize(field[target]->position + glm::vec3(unit(random), 0.0f, unit(random)) * 0.4f - origin)});
+        rayTargets.push_back(target);
+    }
+
+    // Spheres scattered around a camera at the origin looking down -z
+    anopol::camera::Camera cullCamera = anopol::camera::Camera();
+    cullCamera.cameraPosition   = glm::vec3(0.0f);
+    cullCamera.lookDirection    = glm::vec3(0.0f, 0.0f, -1.0f);
+    cullCamera.right            = glm::vec3(1.0f, 0.0f, 0.0f);
+    cullCamera.aspect           = 1.5f;
+    cullCamera.near             = 0.1f;
+    cullCamera.far              = 500.0f;
+    
+    anopol::camera::Frustum frustum = anopol::camera::CreateFrustumPlanes(cullCamera);
+    std::array<glm::vec4, 6> planes = anopol::camera::PlaneEquations(frustum);
+    
+    anopol::batch::boundingSpheres spheres;
+    std::vector<glm::vec3> sphereCenters;
+    for (uint32_t i = 0; i < 65536; i++) {
+        sphereCenters.push_back(glm::vec3(unit(random), unit(random), unit(random)) * 600.0f);
+        spheres.Push(sphereCenters.back(), 5.0f);
+    }
+    
+    std::vector<kernelResult> results;
+
+    results.push_back(measure("GetFurthestPoint", queries, false, [&](uint32_t i) {
+        glm::vec3 point = anopol::collision::GetFurthestPoint(points[i % shapeCount], directions[i % directions.size()]);
+        benchmarkSink = benchmarkSink + point.x;
+        return false;
+    }));
+
+    results.push_back(measure("Support", queries, false, [&](uint32_t i) {
+        glm::vec3 point = anopol::collision::Support(colliderA[i % shapeCount], directions[i % directions.size()]);
+        benchmarkSink = benchmarkSink + point.x;
+        return false;
+    }));
+
+    results.push_back(measure("GJKCollision (convex)", queries, true, [&](uint32_t i) {
+        return anopol::collision::GJKCollision(shapesA[i % shapeCount], shapesB[i % shapeCount]).collided;
+    }));
+
+    results.push_back(measure("GJKCollision (cubes)", queries, true, [&](uint32_t i) {
+        const auto& [a, b] = fieldPairs[i % fieldPairs.size()];
+        return anopol::collision::GJKCollision(field[a], field[b]).collided;
+    }));
+
+    if (!intersecting.empty()) {
+        results.push_back(measure("EPA", queries, true, [&](uint32_t i) {
+            auto [shape, simplex] = intersecting[i % intersecting.size()];
+            anopol::collision::lastCollisionCounters = {};
+            anopol::collision::collision result = anopol::collision::EPA(simplex, colliderA[shape], colliderB[shape]);
+            benchmarkSink = benchmarkSink + result.depth;
+            return result.collided;
+        }));
+    }
+
+    results.push_back(measure("GJKCollisionWithCamera", queries, true, [&](uint32_t i) {
+        anopol::render::Renderable* cube = field[i % field.size()];
+        anopol::camera::camera.cameraPosition = cube->position + directions[i % directions.size()] * 1.5f;
+        return anopol::collision::GJKCollisionWithCamera(cube).collided;
+    }));
+
+    results.push_back(measure("RayIntersectTriangle", queries, false, [&](uint32_t i) {
+        anopol::render::Renderable* cube = field[rayTargets[i % rays.size()]];
+        const std::vector<anopol::render::Vertex>& vertices = cube->vertices;
+        uint32_t triangle = (i % (vertices.size() / 3)) * 3;
+        return anopol::camera::RayIntersectTriangle(rays[i % rays.size()],
+                                                    vertices[triangle].vertex + cube->position,
+                                                    vertices[triangle + 1].vertex + cube->position,
+                                                    vertices[triangle + 2].vertex + cube->position,
+                                                    cube).has_value();
+    }));
+
+    results.push_back(measure("Raycast", queries, false, [&](uint32_t i) {
+        return anopol::camera::Raycast(rays[i % rays.size()], field[rayTargets[i % rays.size()]]).has_value();
+    }));
+
+    results.push_back(measure("isSphereInFrustum", queries, false, [&](uint32_t i) {
+        return anopol::camera::isSphereInFrustum(sphereCenters[i % sphereCenters.size()], glm::vec3(1.0f), glm::mat4(1.0f), 5.0f, frustum);
+    }));
+
+    // Eight spheres per query; hits counts blocks with at least one visible sphere
+    results.push_back(measure("cullSphereBlock (x8)", queries, false, [&](uint32_t i) {
+        return anopol::batch::cullSphereBlock(planes, spheres, i % spheres.Blocks()) != 0;
+    }));
+
+    for (const kernelResult& result : results) printResult(result);
+
+    if (!outputPath.empty() && !writeResults(outputPath, results)) {
+        std::cerr << "Failed to write benchmark results to " << outputPath << '\n';
+        return 1;
+    }
+}
@@ -0,0 +1,270 @@
+//
+//  combine_benchmark.cpp
+//  anopol
+//
+//  Created by Dmitri Wamback on 2026-10-17.
+//
+
+#include "../anopol.h"
+#include <algorithm>
+#include <random>
+
+//------------------------------------------------------------------------------------------//
+// Combine benchmark
+//
+// Times Batch::Combine over the same seeded renderables twice per repeat. The serial run
+// uses one thread, the parallel run uses --threads. Each run gets a fresh batch on a
+// headless device. Both batches must come out identical, so a mismatch is reported
+// instead of a speedup.
+//
+// --renderables N --unique U (distinct geometries, cycled over the renderables)
+// --threads T (0 for every hardware thread) --repeats R --seed S --output results.json
+//
+// --merge merge.spv instead checks the GPU merge: the renderables are combined in two
+// halves into a batch merging on the GPU and into one copying on the CPU, and the merged
+// buffers are read back and compared with the CPU batch's copies. The second half grows
+// the buffers after the first merge. Needs no more than a software device.
+//------------------------------------------------------------------------------------------//
+
+// Cubes whose corners are jittered per geometry, so the batch keeps U distinct meshes
+std::vector<anopol::render::Renderable*> createRenderables(uint32_t count, uint32_t unique, uint32_t seed) {
+
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> jitter(-0.1f, 0.1f);
+    std::uniform_real_distribution<float> angle(0.0f, 360.0f);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    anopol::render::Renderable* cube = anopol::render::Renderable::Create();
+    std::vector<std::vector<anopol::render::Vertex>> geometries(std::max(1u, unique), cube->vertices);
+    delete cube;
+
+    for (size_t g = 1; g < geometries.size(); g++) {
+        for (anopol::render::Vertex& vertex : geometries[g]) vertex.vertex += glm::vec3(jitter(random), jitter(random), jitter(random));
+    }
+
+    int length = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(count))));
+    std::vector<anopol::render::Renderable*> renderables;
+    renderables.reserve(count);
+
+    for (uint32_t i = 0; i < count; i++) {
+        anopol::render::Renderable* renderable = anopol::render::Renderable::Create();
+        renderable->vertices = geometries[i % geometries.size()];
+        renderable->position = glm::vec3((static_cast<int>(i) % length - length / 2) * 15.0f, 0.0f, (static_cast<int>(i) / length - length / 2) * 15.0f);
+        renderable->scale    = glm::vec3(10.0f);
+        renderable->rotation = glm::vec3(angle(random));
+        renderable->color    = glm::vec3(unit(random), unit(random), unit(random));
+        renderables.push_back(renderable);
+    }
+    return renderables;
+}
+
+struct combineRun {
+    double      milliseconds = 0.0;
+    std::vector<anopol::batch::batchIndirectTransformation> transformations;
+    std::vector<anopol::render::gpuVertex> vertices;
+    std::vector<uint32_t> indices, objectMeshes;
+};
+
+combineRun runCombine(const std::vector<anopol::render::Renderable*>& renderables, uint32_t threads) {
+
+    anopol::batch::Batch batch = anopol::batch::Batch::Create();
+    batch.combineThreads = threads;
+    batch.meshCombineGroup.Reserve(static_cast<uint32_t>(renderables.size()), 0);
+    batch.Append(renderables);
+
+    combineRun run{};
+    auto start = std::chrono::steady_clock::now();
+    batch.Combine();
+    run.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    run.transformations = batch.transformations;
+    run.vertices        = batch.batchVertices;
+    run.indices         = batch.batchIndices;
+    run.objectMeshes    = batch.objectMeshes;
+
+    anopol::ll::submitUploads(true);
+
+    // The renderables are shared between runs and owned here
+    batch.meshCombineGroup.renderables.clear();
+    batch.Dealloc();
+    return run;
+}
+
+bool sameResult(const combineRun& a, const combineRun& b) {
+
+    auto sameBytes = [](const auto& x, const auto& y) {
+        return x.size() == y.size() && (x.empty() || memcmp(x.data(), y.data(), sizeof(x[0]) * x.size()) == 0);
+    };
+    return sameBytes(a.transformations, b.transformations) && sameBytes(a.vertices, b.vertices) &&
+           sameBytes(a.indices, b.indices) && a.objectMeshes == b.objectMeshes;
+}
+
+// Device local contents, copied out through a host visible buffer
+template<typename T>
+std::vector<T> readBack(VkBuffer buffer, VkDeviceSize size) {
+
+    std::vector<T> contents(static_cast<size_t>(size / sizeof(T)));
+    if (contents.empty()) return contents;
+
+    VkBuffer staging;
+    anopol::ll::allocation memory;
+    anopol::ll::createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging, memory);
+
+    VkCommandBuffer commandBuffer = anopol::ll::beginSingleCommandBuffer();
+
+    VkMemoryBarrier barrier{};
+    barrier.sType           = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask   = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask   = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                         1, &barrier, 0, nullptr, 0, nullptr);
+
+    VkBufferCopy region{};
+    region.size = size;
+    vkCmdCopyBuffer(commandBuffer, buffer, staging, 1, &region);
+
+    barrier.srcAccessMask   = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask   = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    anopol::ll::endSingleCommandBuffer(commandBuffer);
+
+    memcpy(contents.data(), memory.mapped, sizeof(T) * contents.size());
+    anopol::ll::freeBuffer(staging, memory);
+    return contents;
+}
+
+// Combines in two halves, merging after each when `merge` is set
+void combineHalves(anopol::batch::Batch& batch, const std::vector<anopol::render::Renderable*>& renderables, bool merge) {
+
+    size_t half = renderables.size() / 2;
+
+    for (auto [first, last] : {std::pair{size_t(0), half}, std::pair{half, renderables.size()}}) {
+        batch.Append(std::vector<anopol::render::Renderable*>(renderables.begin() + first, renderables.begin() + last));
+        batch.Combine();
+        anopol::ll::submitUploads(true);
+
+        if (!merge) continue;
+
+        VkCommandBuffer commandBuffer = anopol::ll::beginSingleCommandBuffer();
+        batch.Merge(commandBuffer, 0);
+        anopol::ll::endSingleCommandBuffer(commandBuffer);
+    }
+}
+
+// 0 when the merged buffers match the CPU batch's copies byte for byte
+int compareMerge(const std::vector<anopol::render::Renderable*>& renderables, const std::string& mergeShader) {
+
+    VkShaderModule shader = anopol::pipeline::Pipeline::CreateShaderModule(anopol::pipeline::Pipeline::LoadShaderContent(mergeShader));
+
+    anopol::batch::Batch cpuBatch = anopol::batch::Batch::Create();
+    anopol::batch::Batch gpuBatch = anopol::batch::Batch::Create();
+    gpuBatch.EnableGpuMerge(shader);
+    vkDestroyShaderModule(context->device, shader, nullptr);
+
+    combineHalves(cpuBatch, renderables, false);
+    combineHalves(gpuBatch, renderables, true);
+
+    std::vector<anopol::render::gpuVertex> vertices = readBack<anopol::render::gpuVertex>(gpuBatch.vertexBuffer.buffer, gpuBatch.vertexBuffer.size);
+    std::vector<uint32_t> indices = readBack<uint32_t>(gpuBatch.indexBuffer.buffer, gpuBatch.indexBuffer.size);
+
+    auto sameBytes = [](const auto& x, const auto& y) {
+        return x.size() == y.size() && (x.empty() || memcmp(x.data(), y.data(), sizeof(x[0]) * x.size()) == 0);
+    };
+    bool identical = sameBytes(vertices, cpuBatch.batchVertices) && sameBytes(indices, cpuBatch.batchIndices);
+
+    printf("GPU merge of %zu renderables: %zu vertices, %zu indices, %s\n", renderables.size(), vertices.size(), indices.size(),
+           identical ? "identical to the CPU copy" : "differs from the CPU copy");
+
+    for (anopol::batch::Batch* batch : {&cpuBatch, &gpuBatch}) {
+        batch->meshCombineGroup.renderables.clear();
+        batch->Dealloc();
+    }
+    return identical ? 0 : 1;
+}
+
+int main(int argc, const char * argv[]) {
+
+    uint32_t    renderableCount = 40000,
+                unique          = 64,
+                threads         = 0,
+                repeats         = 5,
+                seed            = 1;
+    std::string outputPath      = "anopol_combine_benchmark.json",
+                mergeShader;
+
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if      (argument == "--renderables" && hasValue)   renderableCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (argument == "--unique" && hasValue)        unique          = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (argument == "--threads" && hasValue)       threads         = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (argument == "--repeats" && hasValue)       repeats         = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (argument == "--seed" && hasValue)          seed            = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (argument == "--output" && hasValue)        outputPath      = argv[++i];
+        else if (argument == "--merge" && hasValue)         mergeShader     = argv[++i];
+    }
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+
+    anopol::runSettings settings{};
+    settings.headless = true;
+    anopol::createContext(settings);
+
+    std::vector<anopol::render::Renderable*> renderables = createRenderables(renderableCount, unique, seed);
+
+    if (!mergeShader.empty()) {
+        int result = compareMerge(renderables, mergeShader);
+        for (anopol::render::Renderable* renderable : renderables) delete renderable;
+        anopol::destroyContext();
+        return result;
+    }
+
+    // The first run only warms the allocator and the staging ring
+    runCombine(renderables, 1);
+
+    std::vector<double> serialMilliseconds, parallelMilliseconds;
+    bool identical = true;
+
+    for (uint32_t repeat = 0; repeat < repeats; repeat++) {
+
+        combineRun serial   = runCombine(renderables, 1);
+        combineRun parallel = runCombine(renderables, threads);
+
+        identical = identical && sameResult(serial, parallel);
+        serialMilliseconds.push_back(serial.milliseconds);
+        parallelMilliseconds.push_back(parallel.milliseconds);
+    }
+
+    auto median = [](std::vector<double>& samples) {
+        std::sort(samples.begin(), samples.end());
+        return samples.empty() ? 0.0 : samples[samples.size() / 2];
+    };
+
+    double serialMedian   = median(serialMilliseconds);
+    double parallelMedian = median(parallelMilliseconds);
+    double speedup        = parallelMedian > 0.0 ? serialMedian / parallelMedian : 0.0;
+
+    printf("Combine of %u renderables (%u unique): 1 thread %.3f ms, %u threads %.3f ms, %.2fx%s\n",
+           renderableCount, unique, serialMedian, threads, parallelMedian, speedup, identical ? "" : " (results differ)");
+
+    std::ofstream file(outputPath, std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Failed to write benchmark results to " << outputPath << '\n';
+    }
+    else {
+        char line[512];
+        snprintf(line, sizeof(line),
+                 "{\n  \"renderables\": %u,\n  \"unique\": %u,\n  \"threads\": %u,\n  \"repeats\": %u,\n  \"seed\": %u,\n"
+                 "  \"serialMilliseconds\": %.4f,\n  \"parallelMilliseconds\": %.4f,\n  \"speedup\": %.4f,\n  \"identical\": %s\n}\n",
+                 renderableCount, unique, threads, repeats, seed, serialMedian, parallelMedian, speedup, identical ? "true" : "false");
+        file << line;
+
+        std::cout << "Benchmark written to " << outputPath << '\n';
+    }
+
+    for (anopol::render::Renderable* renderable : renderables) delete renderable;
+    anopol::destroyContext();
+
+    return identical ? 0 : 1;
+}
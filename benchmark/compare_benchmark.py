@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+#
+#  compare_benchmark.py
+#  anopol
+#
+#  Created by Dmitri Wamback on 2026-10-17.
+#
+
+#------------------------------------------------------------------------------------------#
+# Compares a scene_benchmark result against a stored baseline
+#
+# Fails (exit 1) when any metric below is worse than the baseline by more than the
+# tolerance, or when the two runs used different scenes. Every metric is lower-is-better.
+# Differences under --min-delta are noise on any machine and never fail.
+#
+# compare_benchmark.py results.json [--baseline baseline.json] [--tolerance 0.10]
+#                      [--min-delta 0.05] [--update]
+#
+# --update replaces the baseline with the results instead of comparing; run it on the
+# reference machine after an intended change and commit the new baseline.
+#------------------------------------------------------------------------------------------#
+
+import argparse
+import json
+import os
+import shutil
+import sys
+
+# Path into the JSON, and whether a relative tolerance applies (byte counts must match exactly)
+metrics = [
+    (("frameMilliseconds", "p50"),          True),
+    (("frameMilliseconds", "p90"),          True),
+    (("frameMilliseconds", "p99"),          True),
+    (("combineMilliseconds", "p50"),        True),
+    (("combineMilliseconds", "p99"),        True),
+    (("collisionMilliseconds", "p50"),      True),
+    (("collisionMilliseconds", "p99"),      True),
+    (("gpuFrameMilliseconds",),             True),
+    (("initialCombineMilliseconds",),       True),
+    (("startupMilliseconds",),              True),
+    (("uploadBytes", "perFrame"),           False),
+    (("batch", "geometryBytes"),            False),
+]
+
+def lookup(results, path):
+    for key in path:
+        if not isinstance(results, dict) or key not in results: return None
+        results = results[key]
+    return results
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare scene_benchmark results against a baseline")
+    parser.add_argument("results")
+    parser.add_argument("--baseline", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "baseline.json"))
+    parser.add_argument("--tolerance", type=float, default=0.10, help="Allowed relative regression, 0.10 = 10%%")
+    parser.add_argument("--min-delta", type=float, default=0.05, help="Milliseconds a timing may grow by regardless of the tolerance")
+    parser.add_argument("--update", action="store_true", help="Store the results as the new baseline")
+    arguments = parser.parse_args()
+
+    if arguments.update:
+        shutil.copyfile(arguments.results, arguments.baseline)
+        print(f"Baseline updated from {arguments.results}")
+        return 0
+
+    if not os.path.exists(arguments.baseline):
+        print(f"No baseline at {arguments.baseline}; create one with --update on the reference machine")
+        return 1
+
+    with open(arguments.results) as file: results = json.load(file)
+    with open(arguments.baseline) as file: baseline = json.load(file)
+
+    if results.get("scene") != baseline.get("scene") or results.get("frames") != baseline.get("frames"):
+        print("Scene or frame count differs from the baseline, the results are not comparable")
+        print(f"  baseline: {baseline.get('scene')}, {baseline.get('frames')} frames")
+        print(f"  results:  {results.get('scene')}, {results.get('frames')} frames")
+        return 1
+
+    regressions = 0
+    for path, relative in metrics:
+
+        name = ".".join(path)
+        old, new = lookup(baseline, path), lookup(results, path)
+        if old is None or new is None:
+            print(f"  {name:<32} missing")
+            continue
+
+        allowed = old * (1.0 + arguments.tolerance) if relative else old
+        if relative: allowed = max(allowed, old + arguments.min_delta)
+
+        change = (new - old) / old * 100.0 if old != 0 else 0.0
+        failed = new > allowed
+        regressions += failed
+
+        print(f"  {name:<32} {old:>14.4f} -> {new:>14.4f}  {change:+7.1f}%{'  REGRESSION' if failed else ''}")
+
+    if regressions > 0:
+        print(f"{regressions} metric(s) regressed beyond {arguments.tolerance * 100.0:.0f}%")
+        return 1
+
+    print("No regressions")
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
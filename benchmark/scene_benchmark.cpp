@@ -0,0 +1,239 @@
+//
+//  scene_benchmark.cpp
+//  anopol
+//
+//  Created by Dmitri Wamback on 2026-10-17.
+//
+
+#include "../anopol.h"
+#include <algorithm>
+#include <deque>
+
+//------------------------------------------------------------------------------------------//
+// Reproducible scene benchmark
+//
+// Builds a procedural scene, renders it headless along a fixed camera path and writes the
+// results as JSON. Same arguments and seed, same frames: compare_benchmark.py checks the
+// output against benchmark/baseline.json and fails on regressions beyond a tolerance.
+//
+// --renderables N --assets M --instances K --spawn-rate R (renderables per frame, may be < 1)
+// --chunk-size C (batch chunk cell edge, 0 for one batch) --animated A (renderables moved per frame)
+// --lifetime L (frames before a spawned renderable is removed again, 0 keeps them)
+// --frames F --warmup W --width W --height H --seed S --asset file.obj --shaders folder --asset-folder folder
+// --output results.json
+//------------------------------------------------------------------------------------------//
+
+struct percentiles {
+    double mean = 0.0, p50 = 0.0, p90 = 0.0, p99 = 0.0, max = 0.0;
+};
+
+percentiles computePercentiles(std::vector<double> samples) {
+
+    percentiles result{};
+    if (samples.empty()) return result;
+
+    std::sort(samples.begin(), samples.end());
+
+    auto at = [&](double p) {
+        size_t index = static_cast<size_t>(std::ceil(p * samples.size())) - 1;
+        return samples[std::min(index, samples.size() - 1)];
+    };
+
+    double sum = 0.0;
+    for (double sample : samples) sum += sample;
+
+    result.mean = sum / samples.size();
+    result.p50  = at(0.50);
+    result.p90  = at(0.90);
+    result.p99  = at(0.99);
+    result.max  = samples.back();
+    return result;
+}
+
+void writePercentiles(std::ofstream& file, const char* name, const percentiles& p, size_t count) {
+
+    char line[256];
+    snprintf(line, sizeof(line), "  \"%s\": {\"count\": %zu, \"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f}",
+             name, count, p.mean, p.p50, p.p90, p.p99, p.max);
+    file << line;
+}
+
+void writeMeshOptimization(std::ofstream& file, const char* name, const anopol::render::meshOptimization& optimization) {
+
+    char line[256];
+    snprintf(line, sizeof(line), "    \"%s\": {\"meshes\": %u, \"triangles\": %llu, \"vertices\": [%llu, %llu], \"acmr\": [%.4f, %.4f]}",
+             name, optimization.meshes, static_cast<unsigned long long>(optimization.triangles),
+             static_cast<unsigned long long>(optimization.verticesBefore), static_cast<unsigned long long>(optimization.verticesAfter),
+             optimization.AcmrBefore(), optimization.AcmrAfter());
+    file << line;
+}
+
+int main(int argc, const char * argv[]) {
+
+    anopol::pipeline::sceneWorkload workload{};
+    workload.seed = 1;
+
+    anopol::runSettings settings{};
+    settings.headless = true;
+
+    uint32_t    frames          = 600,
+                warmup          = 60,
+                lifetime        = 0;
+    double      spawnRate       = 0.0;
+    std::string outputPath      = "anopol_benchmark.json";
+
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if      (argument == "--renderables" && hasValue)   workload.renderableCount    = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (argument == "--assets" && hasValue)        workload.assetCount         = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (argument == "--instances" && hasValue)     workload.instancesPerAsset  = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (argument == "--seed" && hasValue)          workload.seed               = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (argument == "--asset" && hasValue)         workload.assetPath          = argv[++i];
+        else if (argument == "--chunk-size" && hasValue)    workload.chunkSize          = std::stof(argv[++i]);
+        else if (argument == "--animated" && hasValue)      workload.animatedCount      = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (argument == "--spawn-rate" && hasValue)    spawnRate                   = std::stod(argv[++i]);
+        else if (argument == "--lifetime" && hasValue)      lifetime                    = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (argument == "--frames" && hasValue)        frames                      = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (argument == "--warmup" && hasValue)        warmup                      = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (argument == "--width" && hasValue)         settings.width              = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (argument == "--height" && hasValue)        settings.height             = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (argument == "--shaders" && hasValue)       settings.shaderFolder       = argv[++i];
+        else if (argument == "--asset-folder" && hasValue)  settings.assetFolder        = argv[++i];
+        else if (argument == "--output" && hasValue)        outputPath                  = argv[++i];
+    }
+
+    anopol::resolveResourceFolders(settings, argv[0]);
+    workload.assetFolder = settings.assetFolder;
+
+    double startupTime = anopol::elapsedTime();
+    anopol::createContext(settings);
+
+    anopol::pipeline::Pipeline pipeline = anopol::pipeline::Pipeline::CreatePipeline(settings.shaderFolder, workload);
+    double startupMilliseconds = (anopol::elapsedTime() - startupTime) * 1000.0;
+
+    uint64_t sceneStagedBytes = anopol::ll::stagedBytes;
+
+    // Fixed path: one orbit around the scene over the measured frames, slowly bobbing in height
+    float radius = std::max(50.0f, std::sqrt(static_cast<float>(workload.renderableCount)) * workload.renderableSpacing * 0.35f);
+
+    auto placeCamera = [&](uint32_t frame, uint32_t frameTotal) {
+
+        float t = frameTotal == 0 ? 0.0f : static_cast<float>(frame) / frameTotal;
+        float angle = t * 2.0f * 3.141592653f;
+
+        anopol::camera::camera.cameraPosition = glm::vec3(std::cos(angle) * radius, 40.0f + 20.0f * std::sin(angle * 2.0f), std::sin(angle) * radius);
+        anopol::camera::camera.yaw   = angle + 3.141592653f;     // Looking back at the origin
+        anopol::camera::camera.pitch = -0.3f;
+    };
+
+    std::vector<double> frameMilliseconds, collisionMilliseconds;
+    frameMilliseconds.reserve(frames);
+    collisionMilliseconds.reserve(frames);
+
+    double spawnAccumulator = 0.0;
+    uint32_t spawned = 0, despawned = 0;
+    std::deque<std::pair<uint32_t, anopol::render::Renderable*>> alive;     // Spawn frame, renderable
+    uint64_t measuredStagedBytes = 0;
+
+    for (uint32_t frame = 0; frame < warmup + frames; frame++) {
+
+        bool measured = frame >= warmup;
+        if (frame == warmup) {
+            measuredStagedBytes = anopol::ll::stagedBytes;
+            pipeline.statistics.combineMilliseconds.clear();
+        }
+
+        double frameStart = anopol::elapsedTime();
+
+        pipeline.currentFrame = (pipeline.currentFrame + 1) % anopol_max_frames;
+        placeCamera(measured ? frame - warmup : 0, frames);
+        anopol::camera::camera.update(glm::vec4(0.0f));
+
+        // Mimics clicking: Append + Combine in front of the camera at a steady rate
+        spawnAccumulator += spawnRate;
+        while (spawnAccumulator >= 1.0) {
+            anopol::render::Renderable* renderable = pipeline.SpawnRenderable(anopol::camera::camera.cameraPosition + anopol::camera::camera.lookDirection * 14.0f);
+            if (lifetime > 0) alive.push_back({frame, renderable});
+            spawnAccumulator -= 1.0;
+            spawned++;
+        }
+        
+        // Despawns are timed with the spawns, so the batch settles at spawnRate * lifetime extra objects
+        while (!alive.empty() && frame - alive.front().first >= lifetime) {
+            pipeline.DespawnRenderable(alive.front().second);
+            alive.pop_front();
+            despawned++;
+        }
+
+        pipeline.Bind("benchmark");
+
+        double milliseconds = (anopol::elapsedTime() - frameStart) * 1000.0;
+        deltaTime = milliseconds / 1000.0;
+        anopol::ll::gpuProfiler.RecordCpuFrame(milliseconds);
+
+        if (measured) {
+            frameMilliseconds.push_back(milliseconds);
+            collisionMilliseconds.push_back(pipeline.statistics.collisionMilliseconds);
+        }
+    }
+
+    vkDeviceWaitIdle(context->device);
+    measuredStagedBytes = anopol::ll::stagedBytes - measuredStagedBytes;
+
+    std::ofstream file(outputPath, std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Failed to write benchmark results to " << outputPath << '\n';
+    }
+    else {
+        char line[512];
+
+        file << "{\n";
+        snprintf(line, sizeof(line),
+                 "  \"scene\": {\"renderables\": %u, \"assets\": %u, \"instancesPerAsset\": %u, \"spawnRate\": %.4f, \"seed\": %u, \"chunkSize\": %.2f, \"animated\": %u, \"width\": %u, \"height\": %u},\n",
+                 workload.renderableCount, workload.assetCount, workload.instancesPerAsset, spawnRate, workload.seed, workload.chunkSize, workload.animatedCount, settings.width, settings.height);
+        file << line;
+        snprintf(line, sizeof(line), "  \"frames\": %u,\n  \"warmupFrames\": %u,\n  \"spawned\": %u,\n  \"despawned\": %u,\n  \"lifetime\": %u,\n",
+                 frames, warmup, spawned, despawned, lifetime);
+        file << line;
+        snprintf(line, sizeof(line), "  \"batch\": {\"liveObjects\": %zu, \"geometryBytes\": %llu},\n",
+                 pipeline.testBatch.LiveObjects(), static_cast<unsigned long long>(pipeline.testBatch.GeometryBytes()));
+        file << line;
+
+        // Before and after the optimization stage, see mesh_optimize.h
+        anopol::render::meshOptimization assetOptimization{};
+        for (anopol::render::Asset* asset : pipeline.assets) assetOptimization.Add(asset->optimization);
+
+        file << "  \"meshOptimization\": {\n";
+        writeMeshOptimization(file, "batch", pipeline.testBatch.optimization);
+        file << ",\n";
+        writeMeshOptimization(file, "assets", assetOptimization);
+        file << "\n  },\n";
+
+        snprintf(line, sizeof(line), "  \"startupMilliseconds\": %.4f,\n  \"initialCombineMilliseconds\": %.4f,\n",
+                 startupMilliseconds, pipeline.statistics.initialCombineMilliseconds);
+        file << line;
+
+        writePercentiles(file, "frameMilliseconds", computePercentiles(frameMilliseconds), frameMilliseconds.size());
+        file << ",\n";
+        writePercentiles(file, "combineMilliseconds", computePercentiles(pipeline.statistics.combineMilliseconds), pipeline.statistics.combineMilliseconds.size());
+        file << ",\n";
+        writePercentiles(file, "collisionMilliseconds", computePercentiles(collisionMilliseconds), collisionMilliseconds.size());
+        file << ",\n";
+
+        snprintf(line, sizeof(line), "  \"gpuFrameMilliseconds\": %.4f,\n", anopol::ll::gpuProfiler.Average("frame"));
+        file << line;
+        snprintf(line, sizeof(line), "  \"uploadBytes\": {\"scene\": %llu, \"measured\": %llu, \"perFrame\": %.1f}\n",
+                 static_cast<unsigned long long>(sceneStagedBytes),
+                 static_cast<unsigned long long>(measuredStagedBytes),
+                 frames > 0 ? static_cast<double>(measuredStagedBytes) / frames : 0.0);
+        file << line;
+        file << "}\n";
+
+        std::cout << "Benchmark written to " << outputPath << '\n';
+    }
+
+    pipeline.CleanUp();
+    anopol::destroyContext();
+}
@@ -0,0 +1,251 @@
+//
+//  command_recorder.h
+//  anopol
+//
+//  Created by Dmitri Wamback on 2026-10-17.
+//
+
+#ifndef command_recorder_h
+#define command_recorder_h
+
+namespace anopol::ll {
+
+//------------------------------------------------------------------------------------------//
+// Command Recorder
+//
+// Collects layout transitions, barriers and copies and records them in one go, either
+// into a command buffer the caller already has open (Record) or into a single one-shot
+// submit (Flush). Adjacent barriers are merged into one vkCmdPipelineBarrier and
+// adjacent copies between the same resources into one copy command with several regions.
+//------------------------------------------------------------------------------------------//
+
+class CommandRecorder {
+public:
+    void Transition(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, bool crossQueue = false);
+    void Barrier(VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+    void CopyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size, VkDeviceSize srcOffset = 0, VkDeviceSize dstOffset = 0);
+    void CopyBufferToImage(VkBuffer buffer, VkDeviceSize bufferOffset, VkImage image, uint32_t width, uint32_t height);
+
+    bool Empty() const;
+    void Clear();
+
+    template<typename Visit>
+    void ForEachBufferCopy(Visit visit) const;      // visit(source, destination) per collected buffer copy
+
+    void Record(VkCommandBuffer commandBuffer);
+    void Flush();
+
+private:
+    enum commandType {
+        barrierCommand,
+        copyBufferCommand,
+        copyBufferToImageCommand
+    };
+
+    struct command {
+        commandType             type;
+
+        VkPipelineStageFlags    srcStage = 0, dstStage = 0;
+        VkAccessFlags           srcAccess = 0, dstAccess = 0;
+        bool                    hasImageBarrier = false;
+        VkImageMemoryBarrier    imageBarrier{};
+
+        VkBuffer                srcBuffer = VK_NULL_HANDLE, dstBuffer = VK_NULL_HANDLE;
+        VkImage                 dstImage = VK_NULL_HANDLE;
+        VkBufferCopy            bufferCopy{};
+        VkBufferImageCopy       imageCopy{};
+    };
+
+    std::vector<command>                commands;
+
+    bool pr_Overlaps(const VkBufferCopy& region, bool sameBuffer, bool belowDstEnd) const;
+
+    std::vector<VkImageMemoryBarrier>   imageBarriers;
+    std::vector<VkBufferCopy>           bufferCopies;
+    std::vector<VkBufferImageCopy>      imageCopies;
+};
+
+void CommandRecorder::Transition(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, bool crossQueue) {
+
+    command transition{};
+    transition.type             = barrierCommand;
+    transition.imageBarrier     = imageLayoutBarrier(image, format, oldLayout, newLayout, transition.srcStage, transition.dstStage, crossQueue);
+    transition.hasImageBarrier  = true;
+
+    commands.push_back(transition);
+}
+
+void CommandRecorder::Barrier(VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+
+    command barrier{};
+    barrier.type        = barrierCommand;
+    barrier.srcStage    = srcStage;
+    barrier.srcAccess   = srcAccess;
+    barrier.dstStage    = dstStage;
+    barrier.dstAccess   = dstAccess;
+
+    commands.push_back(barrier);
+}
+
+void CommandRecorder::CopyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size, VkDeviceSize srcOffset, VkDeviceSize dstOffset) {
+
+    if (size == 0) return;
+
+    command copy{};
+    copy.type                   = copyBufferCommand;
+    copy.srcBuffer              = src;
+    copy.dstBuffer              = dst;
+    copy.bufferCopy.srcOffset   = srcOffset;
+    copy.bufferCopy.dstOffset   = dstOffset;
+    copy.bufferCopy.size        = size;
+
+    commands.push_back(copy);
+}
+
+void CommandRecorder::CopyBufferToImage(VkBuffer buffer, VkDeviceSize bufferOffset, VkImage image, uint32_t width, uint32_t height) {
+
+    command copy{};
+    copy.type       = copyBufferToImageCommand;
+    copy.srcBuffer  = buffer;
+    copy.dstImage   = image;
+    copy.imageCopy  = bufferImageCopyRegion(bufferOffset, width, height);
+
+    commands.push_back(copy);
+}
+
+template<typename Visit>
+void CommandRecorder::ForEachBufferCopy(Visit visit) const {
+    for (const command& entry : commands) {
+        if (entry.type == copyBufferCommand) visit(entry.srcBuffer, entry.dstBuffer);
+    }
+}
+
+bool CommandRecorder::Empty() const {
+    return commands.empty();
+}
+
+void CommandRecorder::Clear() {
+    commands.clear();
+}
+
+void CommandRecorder::Record(VkCommandBuffer commandBuffer) {
+
+    size_t i = 0;
+    while (i < commands.size()) {
+
+        const command& first = commands[i];
+        size_t j = i;
+
+        switch (first.type) {
+
+            case barrierCommand: {
+
+                VkPipelineStageFlags srcStage = 0, dstStage = 0;
+                VkMemoryBarrier memoryBarrier{};
+                memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+                bool hasMemoryBarrier = false;
+
+                imageBarriers.clear();
+                for (; j < commands.size() && commands[j].type == barrierCommand; j++) {
+
+                    srcStage |= commands[j].srcStage;
+                    dstStage |= commands[j].dstStage;
+
+                    if (commands[j].hasImageBarrier) {
+                        imageBarriers.push_back(commands[j].imageBarrier);
+                    }
+                    else {
+                        memoryBarrier.srcAccessMask |= commands[j].srcAccess;
+                        memoryBarrier.dstAccessMask |= commands[j].dstAccess;
+                        hasMemoryBarrier = true;
+                    }
+                }
+
+                vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0,
+                                     hasMemoryBarrier ? 1 : 0, hasMemoryBarrier ? &memoryBarrier : nullptr,
+                                     0, nullptr,
+                                     static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+                break;
+            }
+
+            case copyBufferCommand: {
+
+                // Regions of one copy command may not overlap, so a region writing what an earlier
+                // one in the group wrote or read (or reading what it wrote) starts a new command
+                bufferCopies.clear();
+                bool overlap = false;
+                VkDeviceSize dstEnd = 0;
+                for (; j < commands.size() && commands[j].type == copyBufferCommand &&
+                       commands[j].srcBuffer == first.srcBuffer && commands[j].dstBuffer == first.dstBuffer; j++) {
+
+                    const VkBufferCopy& region = commands[j].bufferCopy;
+                    if (!bufferCopies.empty() && pr_Overlaps(region, first.srcBuffer == first.dstBuffer, region.dstOffset < dstEnd)) {
+                        overlap = true;
+                        break;
+                    }
+                    dstEnd = std::max(dstEnd, region.dstOffset + region.size);
+                    bufferCopies.push_back(region);
+                }
+
+                vkCmdCopyBuffer(commandBuffer, first.srcBuffer, first.dstBuffer, static_cast<uint32_t>(bufferCopies.size()), bufferCopies.data());
+
+                if (overlap) {
+                    VkMemoryBarrier memoryBarrier{};
+                    memoryBarrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+                    memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                    memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+                    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                                         1, &memoryBarrier, 0, nullptr, 0, nullptr);
+                }
+                break;
+            }
+
+            case copyBufferToImageCommand: {
+
+                imageCopies.clear();
+                for (; j < commands.size() && commands[j].type == copyBufferToImageCommand &&
+                       commands[j].srcBuffer == first.srcBuffer && commands[j].dstImage == first.dstImage; j++) {
+                    imageCopies.push_back(commands[j].imageCopy);
+                }
+
+                vkCmdCopyBufferToImage(commandBuffer, first.srcBuffer, first.dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(imageCopies.size()), imageCopies.data());
+                break;
+            }
+        }
+        i = j;
+    }
+
+    Clear();
+}
+
+// Against the regions already in bufferCopies. Uploads mostly append in increasing order, so
+// the regions are only searched when the new one starts below the furthest destination so far
+bool CommandRecorder::pr_Overlaps(const VkBufferCopy& region, bool sameBuffer, bool belowDstEnd) const {
+
+    auto intersects = [](VkDeviceSize aOffset, VkDeviceSize bOffset, VkDeviceSize aSize, VkDeviceSize bSize) {
+        return aOffset < bOffset + bSize && bOffset < aOffset + aSize;
+    };
+
+    if (!belowDstEnd && !sameBuffer) return false;
+
+    for (const VkBufferCopy& other : bufferCopies) {
+        if (intersects(region.dstOffset, other.dstOffset, region.size, other.size)) return true;
+        if (sameBuffer && (intersects(region.dstOffset, other.srcOffset, region.size, other.size) ||
+                           intersects(region.srcOffset, other.dstOffset, region.size, other.size))) return true;
+    }
+    return false;
+}
+
+void CommandRecorder::Flush() {
+
+    if (Empty()) return;
+
+    VkCommandBuffer commandBuffer = beginSingleCommandBuffer();
+    Record(commandBuffer);
+    endSingleCommandBuffer(commandBuffer);
+}
+
+}
+
+#endif /* command_recorder_h */
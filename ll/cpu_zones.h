@@ -0,0 +1,180 @@
+//
+//  cpu_zones.h
+//  anopol
+//
+//  Created by Dmitri Wamback on 2026-10-17.
+//
+
+#ifndef cpu_zones_h
+#define cpu_zones_h
+
+// Define ANOPOL_CPU_ZONES before including anopol.h to record zones; without it anopol_zone expands to nothing
+//#define ANOPOL_CPU_ZONES
+
+#define anopol_zone_ring_size 16384 // Events kept per thread, power of two
+
+#define anopol_zone_concat_inner(a, b) a##b
+#define anopol_zone_concat(a, b) anopol_zone_concat_inner(a, b)
+
+#if defined(ANOPOL_CPU_ZONES)
+#define anopol_zone(name) anopol::ll::cpuZone anopol_zone_concat(anopolZone, __LINE__)(name)
+#else
+#define anopol_zone(name) do {} while (0)
+#endif
+
+namespace anopol::ll {
+
+#if defined(ANOPOL_CPU_ZONES)
+
+//------------------------------------------------------------------------------------------//
+// CPU zones
+//
+// anopol_zone("name") times the rest of the enclosing scope. Each thread writes its zones
+// into its own ring without taking a lock: the owning thread is the only writer. Every slot
+// is a small seqlock: its fields are relaxed atomics, and its sequence is cleared before
+// they are written and set to the event's index + 1 after. writeCpuTrace() copies every
+// ring from the outside and keeps a slot only when its sequence was the expected one both
+// before and after reading the fields, so events overwritten mid-copy are dropped. Threads
+// from std::async come and go every frame, so a ring outlives its thread and is handed to
+// the next thread that starts recording. Zone names must be string literals.
+//------------------------------------------------------------------------------------------//
+
+struct zoneEvent {
+    const char* name;
+    uint64_t    start;      // Nanoseconds since zoneEpoch
+    uint64_t    end;
+    uint32_t    threadId;
+};
+
+struct zoneSlot {
+    std::atomic<uint64_t>       sequence{0};    // Event index + 1, 0 while written
+    std::atomic<const char*>    name{nullptr};
+    std::atomic<uint64_t>       start{0}, end{0};
+    std::atomic<uint32_t>       threadId{0};
+};
+
+struct zoneRing {
+    std::array<zoneSlot, anopol_zone_ring_size>     slots;
+    std::atomic<uint64_t>                           head{0};
+    std::atomic<bool>                               inUse{true};
+};
+
+const std::chrono::steady_clock::time_point zoneEpoch = std::chrono::steady_clock::now();
+
+std::mutex                              zoneRegistryMutex;
+std::vector<std::shared_ptr<zoneRing>>  zoneRings;
+std::atomic<uint32_t>                   zoneThreadCounter{0};
+
+uint64_t zoneTimestamp() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - zoneEpoch).count());
+}
+
+// Claims a ring left behind by a finished thread, or registers a new one
+std::shared_ptr<zoneRing> acquireZoneRing() {
+
+    std::lock_guard<std::mutex> lock(zoneRegistryMutex);
+
+    for (std::shared_ptr<zoneRing>& ring : zoneRings) {
+        bool expected = false;
+        if (ring->inUse.compare_exchange_strong(expected, true)) return ring;
+    }
+
+    zoneRings.push_back(std::make_shared<zoneRing>());
+    return zoneRings.back();
+}
+
+struct threadZoneRing {
+    std::shared_ptr<zoneRing>   ring        = acquireZoneRing();
+    uint32_t                    threadId    = zoneThreadCounter++;
+
+    ~threadZoneRing() {
+        ring->inUse.store(false, std::memory_order_release);
+    }
+};
+
+thread_local threadZoneRing currentZoneRing;
+
+void recordZone(const char* name, uint64_t start, uint64_t end) {
+
+    zoneRing& ring = *currentZoneRing.ring;
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    zoneSlot& slot = ring.slots[head & (anopol_zone_ring_size - 1)];
+
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.start.store(start, std::memory_order_relaxed);
+    slot.end.store(end, std::memory_order_relaxed);
+    slot.threadId.store(currentZoneRing.threadId, std::memory_order_relaxed);
+
+    slot.sequence.store(head + 1, std::memory_order_release);
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+class cpuZone {
+public:
+    explicit cpuZone(const char* name) : name(name), start(zoneTimestamp()) {}
+    ~cpuZone() { recordZone(name, start, zoneTimestamp()); }
+
+    cpuZone(const cpuZone&) = delete;
+    cpuZone& operator=(const cpuZone&) = delete;
+
+private:
+    const char* name;
+    uint64_t    start;
+};
+
+// Chrome trace / Perfetto JSON of everything still held in the rings
+bool writeCpuTrace(const std::string& path) {
+
+    std::vector<zoneEvent> events;
+    {
+        std::lock_guard<std::mutex> lock(zoneRegistryMutex);
+
+        for (const std::shared_ptr<zoneRing>& ring : zoneRings) {
+
+            uint64_t head  = ring->head.load(std::memory_order_acquire);
+            uint64_t first = head > anopol_zone_ring_size ? head - anopol_zone_ring_size : 0;
+
+            for (uint64_t i = first; i < head; i++) {
+
+                const zoneSlot& slot = ring->slots[i & (anopol_zone_ring_size - 1)];
+
+                // Lapped or being rewritten by the owning thread
+                if (slot.sequence.load(std::memory_order_acquire) != i + 1) continue;
+
+                zoneEvent event{slot.name.load(std::memory_order_relaxed), slot.start.load(std::memory_order_relaxed),
+                                slot.end.load(std::memory_order_relaxed), slot.threadId.load(std::memory_order_relaxed)};
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.sequence.load(std::memory_order_relaxed) != i + 1) continue;
+
+                events.push_back(event);
+            }
+        }
+    }
+
+    std::ofstream file(path, std::ios::trunc);
+    if (!file.is_open()) return false;
+
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"CPU\"}}";
+
+    for (const zoneEvent& event : events) {
+
+        char line[256];
+        snprintf(line, sizeof(line), ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                 event.name, event.threadId, event.start / 1e3, (event.end - event.start) / 1e3);
+        file << line;
+    }
+    file << "\n]}\n";
+
+    return static_cast<bool>(file);
+}
+
+#endif
+
+}
+
+#endif /* cpu_zones_h */
@@ -0,0 +1,310 @@
+//
+//  gpu_profiler.h
+//  anopol
+//
+//  Created by Dmitri Wamback on 2026-10-17.
+//
+
+#ifndef gpu_profiler_h
+#define gpu_profiler_h
+
+#define anopol_profiler_max_queries         1024
+#define anopol_profiler_average_window      120
+#define anopol_profiler_max_trace_events    200000
+
+namespace anopol::ll {
+
+//------------------------------------------------------------------------------------------//
+// GPU profiler
+//
+// Named scopes write a pair of timestamps into the query pool of the frame being recorded.
+// There is one pool per frame in flight. BeginFrame() is called once that frame's fence
+// has been waited on, so the results it reads back from the previous use of the pool are
+// already available and reading them never stalls. The pool is then reset in the new
+// command buffer. Scopes may be opened from any thread and inside secondaries. Scopes
+// sharing a name are summed per frame and kept as rolling averages over the last
+// anopol_profiler_average_window frames. Every resolved scope is also kept as a
+// Chrome trace event (chrome://tracing, Perfetto).
+//------------------------------------------------------------------------------------------//
+
+class GpuProfiler {
+public:
+    void Initialize();
+    void Destroy();
+
+    void BeginFrame(VkCommandBuffer commandBuffer, uint32_t frame);
+    uint32_t Begin(VkCommandBuffer commandBuffer, const char* name); // name must be a string literal
+    void End(VkCommandBuffer commandBuffer, uint32_t scope);
+
+    void RecordCpuFrame(double milliseconds);
+
+    bool Enabled() const;
+    double Average(const std::string& name);
+    std::string Report();
+    bool WriteChromeTrace(const std::string& path);
+
+private:
+    struct scope {
+        const char* name;
+        uint32_t    beginQuery;
+        uint32_t    endQuery;
+    };
+
+    struct framePool {
+        VkQueryPool         queryPool   = VK_NULL_HANDLE;
+        std::vector<scope>  scopes;
+        uint32_t            queryCount  = 0;
+        bool                recorded    = false;
+    };
+
+    struct rollingAverage {
+        std::array<double, anopol_profiler_average_window> samples{};
+        uint32_t    count   = 0,
+                    next    = 0;
+        double      sum     = 0.0;
+
+        void Push(double value);
+        double Value() const;
+    };
+
+    struct traceEvent {
+        const char* name;
+        double      start;      // Microseconds
+        double      duration;   // Microseconds
+        uint32_t    track;      // 0 = GPU, 1 = CPU
+    };
+
+    std::array<framePool, anopol_max_frames>    pools;
+    uint32_t                                    frame = 0;
+
+    bool                                        enabled = false;
+    double                                      timestampPeriod = 1.0;  // Nanoseconds per tick
+    uint64_t                                    timestampMask = ~0ull;
+    uint64_t                                    gpuOrigin = 0;
+    bool                                        hasGpuOrigin = false;
+    double                                      cpuCursor = 0.0;
+
+    std::mutex                                  mutex;
+    std::map<std::string, rollingAverage>       averages;
+    std::vector<traceEvent>                     traceEvents;
+    std::vector<uint64_t>                       results;
+
+    void pr_Resolve(framePool& pool);
+    void pr_Trace(const char* name, double start, double duration, uint32_t track);
+};
+
+GpuProfiler gpuProfiler;
+
+void GpuProfiler::rollingAverage::Push(double value) {
+
+    if (count == samples.size()) sum -= samples[next];
+    else count++;
+
+    samples[next] = value;
+    sum += value;
+    next = (next + 1) % samples.size();
+}
+
+double GpuProfiler::rollingAverage::Value() const {
+    return count == 0 ? 0.0 : sum / count;
+}
+
+void GpuProfiler::Initialize() {
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(context->physicalDevice, &properties);
+
+    uint32_t familyCount;
+    vkGetPhysicalDeviceQueueFamilyProperties(context->physicalDevice, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(context->physicalDevice, &familyCount, families.data());
+
+    // Queues without timestamp support report zero valid bits; the profiler then stays a no-op
+    uint32_t validBits = families[deviceQueueFamilies.graphicsFamily.value()].timestampValidBits;
+    enabled = validBits > 0 && properties.limits.timestampPeriod > 0.0f;
+    if (!enabled) return;
+
+    timestampPeriod = properties.limits.timestampPeriod;
+    timestampMask   = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+    VkQueryPoolCreateInfo queryPoolInfo{};
+    queryPoolInfo.sType         = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType     = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount    = anopol_profiler_max_queries;
+
+    for (framePool& pool : pools) {
+        if (vkCreateQueryPool(context->device, &queryPoolInfo, nullptr, &pool.queryPool) != VK_SUCCESS) anopol_assert("Failed to create timestamp query pool");
+    }
+}
+
+void GpuProfiler::Destroy() {
+
+    for (framePool& pool : pools) {
+        if (pool.queryPool != VK_NULL_HANDLE) vkDestroyQueryPool(context->device, pool.queryPool, nullptr);
+        pool = framePool();
+    }
+    enabled = false;
+}
+
+bool GpuProfiler::Enabled() const {
+    return enabled;
+}
+
+void GpuProfiler::BeginFrame(VkCommandBuffer commandBuffer, uint32_t frame) {
+
+    if (!enabled) return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    this->frame = frame;
+    framePool& pool = pools[frame];
+
+    if (pool.recorded) pr_Resolve(pool);
+
+    vkCmdResetQueryPool(commandBuffer, pool.queryPool, 0, anopol_profiler_max_queries);
+    pool.scopes.clear();
+    pool.queryCount = 0;
+    pool.recorded   = true;
+}
+
+uint32_t GpuProfiler::Begin(VkCommandBuffer commandBuffer, const char* name) {
+
+    if (!enabled) return UINT32_MAX;
+
+    uint32_t index, beginQuery;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        framePool& pool = pools[frame];
+
+        if (pool.queryCount + 2 > anopol_profiler_max_queries) return UINT32_MAX;
+
+        beginQuery  = pool.queryCount;
+        index       = static_cast<uint32_t>(pool.scopes.size());
+
+        pool.scopes.push_back({name, beginQuery, beginQuery + 1});
+        pool.queryCount += 2;
+    }
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, pools[frame].queryPool, beginQuery);
+    return index;
+}
+
+void GpuProfiler::End(VkCommandBuffer commandBuffer, uint32_t scope) {
+
+    if (!enabled || scope == UINT32_MAX) return;
+
+    uint32_t endQuery;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        endQuery = pools[frame].scopes[scope].endQuery;
+    }
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, pools[frame].queryPool, endQuery);
+}
+
+void GpuProfiler::pr_Resolve(framePool& pool) {
+
+    if (pool.queryCount == 0) return;
+
+    // Value and availability per query; anything not available is dropped rather than waited on
+    results.assign(pool.queryCount * 2, 0);
+    vkGetQueryPoolResults(context->device,
+                          pool.queryPool,
+                          0,
+                          pool.queryCount,
+                          results.size() * sizeof(uint64_t),
+                          results.data(),
+                          2 * sizeof(uint64_t),
+                          VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+    std::map<std::string, double> frameTotals;
+
+    for (const scope& s : pool.scopes) {
+
+        if (results[s.beginQuery * 2 + 1] == 0 || results[s.endQuery * 2 + 1] == 0) continue;
+
+        uint64_t begin  = results[s.beginQuery * 2] & timestampMask;
+        uint64_t end    = results[s.endQuery * 2] & timestampMask;
+        if (end < begin) continue;
+
+        if (!hasGpuOrigin) {
+            gpuOrigin       = begin;
+            hasGpuOrigin    = true;
+        }
+
+        double milliseconds = static_cast<double>(end - begin) * timestampPeriod / 1e6;
+        frameTotals[s.name] += milliseconds;
+
+        if (begin >= gpuOrigin) {
+            pr_Trace(s.name, static_cast<double>(begin - gpuOrigin) * timestampPeriod / 1e3, milliseconds * 1e3, 0);
+        }
+    }
+
+    for (const auto& [name, milliseconds] : frameTotals) {
+        averages[name].Push(milliseconds);
+    }
+}
+
+void GpuProfiler::pr_Trace(const char* name, double start, double duration, uint32_t track) {
+    if (traceEvents.size() < anopol_profiler_max_trace_events) traceEvents.push_back({name, start, duration, track});
+}
+
+// CPU frames go on their own track; the CPU and GPU clocks are not correlated
+void GpuProfiler::RecordCpuFrame(double milliseconds) {
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    averages["cpu frame"].Push(milliseconds);
+    pr_Trace("cpu frame", cpuCursor, milliseconds * 1e3, 1);
+    cpuCursor += milliseconds * 1e3;
+}
+
+double GpuProfiler::Average(const std::string& name) {
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = averages.find(name);
+    return it == averages.end() ? 0.0 : it->second.Value();
+}
+
+std::string GpuProfiler::Report() {
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::string report;
+    for (const auto& [name, average] : averages) {
+
+        char line[128];
+        snprintf(line, sizeof(line), "%-16s %8.3f ms\n", name.c_str(), average.Value());
+        report += line;
+    }
+    return report;
+}
+
+bool GpuProfiler::WriteChromeTrace(const std::string& path) {
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::ofstream file(path, std::ios::trunc);
+    if (!file.is_open()) return false;
+
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"GPU\"}},\n";
+    file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"CPU\"}}";
+
+    // Scope names are string literals chosen by the engine, so they need no escaping
+    for (const traceEvent& event : traceEvents) {
+
+        char line[256];
+        snprintf(line, sizeof(line), ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%u,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f}",
+                 event.name, event.track, event.start, event.duration);
+        file << line;
+    }
+    file << "\n]}\n";
+
+    return static_cast<bool>(file);
+}
+
+}
+
+#endif /* gpu_profiler_h */
@@ -0,0 +1,162 @@
+//
+//  growable_buffer.h
+//  anopol
+//
+//  Created by Dmitri Wamback on 2026-10-17.
+//
+
+#ifndef growable_buffer_h
+#define growable_buffer_h
+
+#define anopol_growable_buffer_min_capacity (64 * 1024)
+
+namespace anopol::ll {
+
+//------------------------------------------------------------------------------------------//
+// Growable buffer
+//
+// Device-local buffer filled from the front through the staging ring. Append() stages only
+// the bytes it is given. When the capacity runs out the buffer at least doubles. The live
+// range is then copied into the new buffer on the GPU, inside the same upload batch, and
+// the old buffer is retired. The handle changes on growth, so callers read `buffer` when
+// recording instead of caching it. Buffers the graphics queue writes itself grow through
+// Reserve(bytes, commandBuffer), whose copy runs in order with those writes instead.
+//------------------------------------------------------------------------------------------//
+
+class GrowableBuffer {
+public:
+    VkBuffer            buffer          = VK_NULL_HANDLE;
+    allocation          memory{};
+    VkDeviceSize        size            = 0,    // Bytes in use
+                        capacity        = 0;
+    VkBufferUsageFlags  usage           = 0;
+    uploadToken         pendingUpload   = 0;
+
+    static GrowableBuffer Create(VkBufferUsageFlags usage, VkDeviceSize initialCapacity = 0);
+    void Reserve(VkDeviceSize bytes);
+    void Reserve(VkDeviceSize bytes, VkCommandBuffer commandBuffer);
+    uploadToken Append(const void* data, VkDeviceSize bytes);
+    uploadToken Write(VkDeviceSize offset, const void* data, VkDeviceSize bytes);
+    void Destroy();
+};
+
+GrowableBuffer GrowableBuffer::Create(VkBufferUsageFlags usage, VkDeviceSize initialCapacity) {
+
+    GrowableBuffer growableBuffer = GrowableBuffer();
+    growableBuffer.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+    if (initialCapacity > 0) growableBuffer.Reserve(initialCapacity);
+    return growableBuffer;
+}
+
+void GrowableBuffer::Reserve(VkDeviceSize bytes) {
+
+    if (bytes <= capacity) return;
+
+    VkDeviceSize newCapacity = std::max<VkDeviceSize>({bytes, capacity * 2, anopol_growable_buffer_min_capacity});
+
+    VkBuffer newBuffer;
+    allocation newMemory;
+    createBuffer(newCapacity, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, newBuffer, newMemory);
+
+    if (buffer != VK_NULL_HANDLE) {
+
+        std::lock_guard<std::recursive_mutex> lock(stagingMutex);
+
+        // Earlier copies in this batch may still be writing the old buffer
+        if (size > 0) {
+            uploadRecorder().Barrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+            uploadRecorder().CopyBuffer(buffer, newBuffer, size);
+            pendingUpload = lastUploadToken();
+        }
+        retireBuffer(buffer, memory);
+    }
+
+    buffer      = newBuffer;
+    memory      = newMemory;
+    capacity    = newCapacity;
+}
+
+// The copy is recorded into a graphics command buffer, after compute or transfer writes
+// recorded into it or submitted before it. An upload batch goes out ahead of the frame being
+// recorded and would copy the old buffer before those writes land
+void GrowableBuffer::Reserve(VkDeviceSize bytes, VkCommandBuffer commandBuffer) {
+
+    if (bytes <= capacity) return;
+    if (buffer == VK_NULL_HANDLE || size == 0) return Reserve(bytes);
+
+    VkDeviceSize newCapacity = std::max<VkDeviceSize>({bytes, capacity * 2, anopol_growable_buffer_min_capacity});
+
+    VkBuffer newBuffer;
+    allocation newMemory;
+    createBuffer(newCapacity, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, newBuffer, newMemory);
+
+    VkMemoryBarrier barrier{};
+    barrier.sType           = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask   = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask   = VK_ACCESS_TRANSFER_READ_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                         1, &barrier, 0, nullptr, 0, nullptr);
+
+    VkBufferCopy region{};
+    region.size = size;
+    vkCmdCopyBuffer(commandBuffer, buffer, newBuffer, 1, &region);
+
+    barrier.srcAccessMask   = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask   = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0,
+                         1, &barrier, 0, nullptr, 0, nullptr);
+
+    // The frame being recorded reads it, so it is freed once that frame has completed
+    retireBuffer(buffer, memory);
+
+    buffer      = newBuffer;
+    memory      = newMemory;
+    capacity    = newCapacity;
+}
+
+uploadToken GrowableBuffer::Append(const void* data, VkDeviceSize bytes) {
+
+    if (bytes == 0) return pendingUpload;
+
+    Reserve(size + bytes);
+
+    pendingUpload = stageBuffer(data, bytes, buffer, size);
+    size += bytes;
+
+    return pendingUpload;
+}
+
+// Overwrites bytes already in use, or extends the live range when writing past it
+uploadToken GrowableBuffer::Write(VkDeviceSize offset, const void* data, VkDeviceSize bytes) {
+
+    if (bytes == 0) return pendingUpload;
+
+    Reserve(offset + bytes);
+
+    // An earlier copy in this batch may have written the same range
+    if (offset < size) {
+        std::lock_guard<std::recursive_mutex> lock(stagingMutex);
+        uploadRecorder().Barrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+    }
+    pendingUpload = stageBuffer(data, bytes, buffer, offset);
+    size = std::max(size, offset + bytes);
+
+    return pendingUpload;
+}
+
+void GrowableBuffer::Destroy() {
+
+    if (buffer != VK_NULL_HANDLE) freeBuffer(buffer, memory);
+
+    buffer      = VK_NULL_HANDLE;
+    memory      = allocation();
+    size        = 0;
+    capacity    = 0;
+}
+
+}
+
+#endif /* growable_buffer_h */
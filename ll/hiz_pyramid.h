@@ -0,0 +1,331 @@
+//
+//  hiz_pyramid.h
+//  anopol
+//
+//  Created by Dmitri Wamback on 2026-10-17.
+//
+
+#ifndef hiz_pyramid_h
+#define hiz_pyramid_h
+
+#define anopol_hiz_workgroup_size   8
+
+namespace anopol::ll {
+
+//------------------------------------------------------------------------------------------//
+// Hi-Z pyramid
+//
+// Full mip chain of the depth buffer where every texel holds the farthest depth under it,
+// built by hiz_downsample.comp after the main pass. An object whose nearest depth is
+// behind the farthest depth of the (at most 2x2) texels covering it at the right level is
+// hidden. The pyramid stays in VK_IMAGE_LAYOUT_GENERAL and remembers the view-projection
+// its depth was rendered with, so the next frame can test against it before drawing.
+//------------------------------------------------------------------------------------------//
+
+typedef struct hizPushConstants {
+    glm::ivec2  sourceSize;
+    glm::ivec2  destinationSize;
+    int32_t     copy;           // Level 0 is a straight copy of the depth buffer
+} hizPushConstants;
+
+class HiZPyramid {
+public:
+    VkImage         image   = VK_NULL_HANDLE;
+    allocation      memory{};
+    VkImageView     view    = VK_NULL_HANDLE;   // Every level, for sampling with texelFetch
+    VkSampler       sampler = VK_NULL_HANDLE;
+    uint32_t        width = 0, height = 0, levels = 0;
+
+    bool            built = false;              // Holds a depth buffer
+    glm::mat4       viewProjection = glm::mat4(1.0f);
+
+    void Initialize(VkShaderModule downsample);
+    void Build(VkCommandBuffer commandBuffer, const glm::mat4& viewProjection);
+    void Destroy();
+
+    // Without the downsample shader the image still exists, so descriptors can point at it
+    bool Enabled() const { return pipeline != VK_NULL_HANDLE; }
+
+private:
+    std::vector<VkImageView>        levelViews;
+    std::vector<VkDescriptorSet>    descriptorSets;     // Level i reads level i - 1, level 0 the depth buffer
+
+    VkDescriptorPool        descriptorPool      = VK_NULL_HANDLE;
+    VkDescriptorSetLayout   descriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout        pipelineLayout      = VK_NULL_HANDLE;
+    VkPipeline              pipeline            = VK_NULL_HANDLE;
+
+    void pr_DepthBarrier(VkCommandBuffer commandBuffer, bool toShader);
+};
+
+HiZPyramid hizPyramid;
+
+void HiZPyramid::Initialize(VkShaderModule downsample) {
+
+    width   = context->extent.width;
+    height  = context->extent.height;
+    levels  = static_cast<uint32_t>(std::floor(std::log2(static_cast<float>(std::max(width, height))))) + 1;
+
+    //------------------------------------------------------------------------------------------//
+    // Image, views and sampler
+    //------------------------------------------------------------------------------------------//
+
+    createImage(width, height, VK_FORMAT_R32_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, memory, 1, levels);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType                              = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image                              = image;
+    viewInfo.viewType                           = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format                             = VK_FORMAT_R32_SFLOAT;
+    viewInfo.subresourceRange.aspectMask        = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.baseMipLevel      = 0;
+    viewInfo.subresourceRange.levelCount        = levels;
+    viewInfo.subresourceRange.baseArrayLayer    = 0;
+    viewInfo.subresourceRange.layerCount        = 1;
+
+    if (vkCreateImageView(context->device, &viewInfo, nullptr, &view) != VK_SUCCESS) anopol_assert("Failed to create Hi-Z view");
+
+    levelViews.resize(levels);
+    for (uint32_t level = 0; level < levels; level++) {
+        viewInfo.subresourceRange.baseMipLevel  = level;
+        viewInfo.subresourceRange.levelCount    = 1;
+        if (vkCreateImageView(context->device, &viewInfo, nullptr, &levelViews[level]) != VK_SUCCESS) anopol_assert("Failed to create Hi-Z level view");
+    }
+
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType           = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter       = VK_FILTER_NEAREST;
+    samplerInfo.minFilter       = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode      = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU    = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV    = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW    = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.minLod          = 0.0f;
+    samplerInfo.maxLod          = static_cast<float>(levels);
+
+    if (vkCreateSampler(context->device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS) anopol_assert("Failed to create Hi-Z sampler");
+
+    // Descriptors that point at the pyramid are valid from the start, even before the first build
+    VkCommandBuffer commandBuffer = beginSingleCommandBuffer();
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout                       = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout                       = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image                           = image;
+    barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount     = levels;
+    barrier.subresourceRange.layerCount     = 1;
+    barrier.dstAccessMask                   = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    endSingleCommandBuffer(commandBuffer);
+
+    if (downsample == VK_NULL_HANDLE) return;
+
+    //------------------------------------------------------------------------------------------//
+    // Descriptors: 0 source (sampled), 1 destination (storage)
+    //------------------------------------------------------------------------------------------//
+
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+    bindings[0].binding         = 0;
+    bindings[0].descriptorCount = 1;
+    bindings[0].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[0].stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[1].binding         = 1;
+    bindings[1].descriptorCount = 1;
+    bindings[1].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[1].stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings    = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(context->device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) anopol_assert("Failed to create Hi-Z descriptor set layout");
+
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0].type               = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[0].descriptorCount    = levels;
+    poolSizes[1].type               = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSizes[1].descriptorCount    = levels;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType          = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount  = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes     = poolSizes.data();
+    poolInfo.maxSets        = levels;
+
+    if (vkCreateDescriptorPool(context->device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) anopol_assert("Failed to create Hi-Z descriptor pool");
+
+    std::vector<VkDescriptorSetLayout> layouts(levels, descriptorSetLayout);
+    descriptorSets.resize(levels);
+
+    VkDescriptorSetAllocateInfo allocationInfo{};
+    allocationInfo.sType                = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocationInfo.descriptorPool       = descriptorPool;
+    allocationInfo.descriptorSetCount   = levels;
+    allocationInfo.pSetLayouts          = layouts.data();
+
+    if (vkAllocateDescriptorSets(context->device, &allocationInfo, descriptorSets.data()) != VK_SUCCESS) anopol_assert("Failed to allocate Hi-Z descriptor sets");
+
+    for (uint32_t level = 0; level < levels; level++) {
+
+        VkDescriptorImageInfo sourceInfo{};
+        sourceInfo.sampler      = sampler;
+        sourceInfo.imageView    = level == 0 ? depthImageView : levelViews[level - 1];
+        sourceInfo.imageLayout  = level == 0 ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+        VkDescriptorImageInfo destinationInfo{};
+        destinationInfo.imageView   = levelViews[level];
+        destinationInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        std::array<VkWriteDescriptorSet, 2> writes{};
+        writes[0].sType             = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[0].dstSet            = descriptorSets[level];
+        writes[0].dstBinding        = 0;
+        writes[0].descriptorType    = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[0].descriptorCount   = 1;
+        writes[0].pImageInfo        = &sourceInfo;
+        writes[1].sType             = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[1].dstSet            = descriptorSets[level];
+        writes[1].dstBinding        = 1;
+        writes[1].descriptorType    = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        writes[1].descriptorCount   = 1;
+        writes[1].pImageInfo        = &destinationInfo;
+
+        vkUpdateDescriptorSets(context->device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+
+    //------------------------------------------------------------------------------------------//
+    // Pipeline
+    //------------------------------------------------------------------------------------------//
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags    = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset        = 0;
+    pushConstantRange.size          = sizeof(hizPushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType                    = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount           = 1;
+    pipelineLayoutInfo.pSetLayouts              = &descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount   = 1;
+    pipelineLayoutInfo.pPushConstantRanges      = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(context->device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) anopol_assert("Failed to create Hi-Z pipeline layout");
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType          = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType    = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage    = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module   = downsample;
+    pipelineInfo.stage.pName    = "main";
+    pipelineInfo.layout         = pipelineLayout;
+
+    if (createComputePipelines(1, &pipelineInfo, &pipeline) != VK_SUCCESS) anopol_assert("Couldn't create Hi-Z pipeline");
+}
+
+// Depth goes to a read-only layout for the copy into level 0, then back for the next pass
+void HiZPyramid::pr_DepthBarrier(VkCommandBuffer commandBuffer, bool toShader) {
+
+    VkFormat depthFormat = findDepthFormat();
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout                       = toShader ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    barrier.newLayout                       = toShader ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image                           = depthImage;
+    barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_DEPTH_BIT | (hasStencilComponent(depthFormat) ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+    barrier.subresourceRange.levelCount     = 1;
+    barrier.subresourceRange.layerCount     = 1;
+    barrier.srcAccessMask                   = toShader ? VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT : VK_ACCESS_SHADER_READ_BIT;
+    barrier.dstAccessMask                   = toShader ? VK_ACCESS_SHADER_READ_BIT : VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    VkPipelineStageFlags fragmentTests = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer,
+                         toShader ? fragmentTests : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         toShader ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : fragmentTests,
+                         0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+void HiZPyramid::Build(VkCommandBuffer commandBuffer, const glm::mat4& viewProjection) {
+
+    if (!Enabled()) return;
+
+    uint32_t scope = gpuProfiler.Begin(commandBuffer, "hi-z");
+
+    pr_DepthBarrier(commandBuffer, true);
+
+    // Earlier culling passes may still be reading the previous pyramid
+    VkMemoryBarrier memoryBarrier{};
+    memoryBarrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+    glm::ivec2 sourceSize = glm::ivec2(width, height);
+
+    for (uint32_t level = 0; level < levels; level++) {
+
+        glm::ivec2 destinationSize = level == 0 ? sourceSize : glm::max(sourceSize / 2, glm::ivec2(1));
+
+        hizPushConstants pushConstants{};
+        pushConstants.sourceSize        = sourceSize;
+        pushConstants.destinationSize   = destinationSize;
+        pushConstants.copy              = level == 0 ? 1 : 0;
+
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[level], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(hizPushConstants), &pushConstants);
+        vkCmdDispatch(commandBuffer,
+                      (destinationSize.x + anopol_hiz_workgroup_size - 1) / anopol_hiz_workgroup_size,
+                      (destinationSize.y + anopol_hiz_workgroup_size - 1) / anopol_hiz_workgroup_size, 1);
+
+        // The next level, or the late culling pass, reads what was just written
+        memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+        sourceSize = destinationSize;
+    }
+
+    pr_DepthBarrier(commandBuffer, false);
+
+    gpuProfiler.End(commandBuffer, scope);
+
+    this->viewProjection = viewProjection;
+    built = true;
+}
+
+void HiZPyramid::Destroy() {
+
+    if (pipeline != VK_NULL_HANDLE) {
+        vkDestroyPipeline(context->device, pipeline, nullptr);
+        vkDestroyPipelineLayout(context->device, pipelineLayout, nullptr);
+        vkDestroyDescriptorPool(context->device, descriptorPool, nullptr);
+        vkDestroyDescriptorSetLayout(context->device, descriptorSetLayout, nullptr);
+        pipeline = VK_NULL_HANDLE;
+    }
+
+    for (VkImageView levelView : levelViews) vkDestroyImageView(context->device, levelView, nullptr);
+    levelViews.clear();
+
+    if (image != VK_NULL_HANDLE) {
+        vkDestroySampler(context->device, sampler, nullptr);
+        vkDestroyImageView(context->device, view, nullptr);
+        freeImage(image, memory);
+    }
+    built = false;
+}
+
+}
+
+#endif /* hiz_pyramid_h */
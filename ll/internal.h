@@ -12,18 +12,22 @@ namespace anopol::ll {
 
 std::vector<VkImage> swapchainImages;
 std::vector<VkImageView> swapchainImageViews;
+std::vector<allocation> headlessImageMemory;
 
 std::vector<VkCommandBuffer> commandbuffers = std::vector<VkCommandBuffer>();
 VkRenderPass renderpass;
 
-VkCommandPool   commandPool;
+VkCommandPool   commandPool, transferCommandPool;
+queueFamily     deviceQueueFamilies;
+bool            drawIndirectCountSupported = false;     // vkCmdDrawIndirectCount, optional in Vulkan 1.2
+bool            bindlessUpdateAfterBind = false;        // Texture table descriptors written while bound, optional in Vulkan 1.2
 VkImage         depthImage;
-VkDeviceMemory  depthImageMemory;
+allocation      depthImageMemory;
 VkImageView     depthImageView, textureImageView;
 
 struct msaaMultisampling {
     VkImage         image;
-    VkDeviceMemory  mem;
+    allocation      mem;
     VkImageView     view;
 };
 msaaMultisampling multisampling;
@@ -109,15 +113,21 @@ void endSingleCommandBuffer(VkCommandBuffer commandBuffer, VkFence fence = VK_NU
     submit.commandBufferCount   = 1;
     submit.pCommandBuffers      = &commandBuffer;
     
-    vkQueueSubmit(context->graphicsQueue, 1, &submit, fence);
+    // Wait on this submit only rather than idling the whole queue
+    bool ownsFence = fence == VK_NULL_HANDLE;
+    if (ownsFence) {
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        vkCreateFence(context->device, &fenceInfo, nullptr, &fence);
+    }
     
-    if (fence != VK_NULL_HANDLE) {
-        vkWaitForFences(context->device, 1, &fence, VK_TRUE, UINT64_MAX);
-    } 
-    else {
-        vkQueueWaitIdle(context->graphicsQueue);
+    {
+        std::lock_guard<std::mutex> queueLock(context->graphicsQueueMutex);
+        vkQueueSubmit(context->graphicsQueue, 1, &submit, fence);
     }
+    vkWaitForFences(context->device, 1, &fence, VK_TRUE, UINT64_MAX);
     
+    if (ownsFence) vkDestroyFence(context->device, fence, nullptr);
     vkFreeCommandBuffers(context->device, commandPool, 1, &commandBuffer);
 }
 
@@ -125,9 +135,12 @@ void endSingleCommandBuffer(VkCommandBuffer commandBuffer, VkFence fence = VK_NU
 // Image Layout Transition
 //------------------------------------------------------------------------------------------//
 
-void imageLayoutTransition(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout) {
-    
-    VkCommandBuffer commandBuffer = beginSingleCommandBuffer();
+bool isDepthFormat(VkFormat format) {
+    return format == VK_FORMAT_D16_UNORM || format == VK_FORMAT_X8_D24_UNORM_PACK32 || format == VK_FORMAT_D32_SFLOAT ||
+           format == VK_FORMAT_D16_UNORM_S8_UINT || hasStencilComponent(format);
+}
+
+VkImageMemoryBarrier imageLayoutBarrier(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, VkPipelineStageFlags& src, VkPipelineStageFlags& dst, bool crossQueue = false) {
     
     VkImageMemoryBarrier imageMemoryBarrier{};
     imageMemoryBarrier.sType                            = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -141,7 +154,7 @@ void imageLayoutTransition(VkImage image, VkFormat format, VkImageLayout oldLayo
     imageMemoryBarrier.subresourceRange.baseArrayLayer  = 0;
     imageMemoryBarrier.subresourceRange.layerCount      = 1;
     
-    if (newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
+    if (isDepthFormat(format)) {
         imageMemoryBarrier.subresourceRange.aspectMask  = VK_IMAGE_ASPECT_DEPTH_BIT;
 
         if (hasStencilComponent(format)) {
@@ -152,7 +165,6 @@ void imageLayoutTransition(VkImage image, VkFormat format, VkImageLayout oldLayo
         imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     }
     
-    VkPipelineStageFlags src, dst;
     if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
         
         imageMemoryBarrier.srcAccessMask = 0;
@@ -175,57 +187,69 @@ void imageLayoutTransition(VkImage image, VkFormat format, VkImageLayout oldLayo
         src = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
         dst = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
     }
+    else if (oldLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+        
+        imageMemoryBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        src = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dst = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    }
     else {
         anopol_assert("Unsupported layout");
     }
-    vkCmdPipelineBarrier(commandBuffer, src, dst, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
     
-    endSingleCommandBuffer(commandBuffer);
+    // Recorded on the transfer queue: the consuming submit's semaphore wait provides the visibility instead
+    if (crossQueue) {
+        imageMemoryBarrier.dstAccessMask = 0;
+        dst = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+    }
+    return imageMemoryBarrier;
+}
+
+void imageLayoutTransition(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, bool crossQueue = false) {
+    
+    VkPipelineStageFlags src, dst;
+    VkImageMemoryBarrier imageMemoryBarrier = imageLayoutBarrier(image, format, oldLayout, newLayout, src, dst, crossQueue);
+    
+    vkCmdPipelineBarrier(commandBuffer, src, dst, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
 }
 
 //------------------------------------------------------------------------------------------//
 // Buffers
 //------------------------------------------------------------------------------------------//
 
-void createBuffer(VkDeviceSize size, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+void createBuffer(VkDeviceSize size, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags properties, VkBuffer& buffer, allocation& bufferMemory) {
     VkBufferCreateInfo bufferInfo{};
     bufferInfo.sType        = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     bufferInfo.size         = size;
     bufferInfo.usage        = usageFlags;
     bufferInfo.sharingMode  = VK_SHARING_MODE_EXCLUSIVE;
+    
+    if (usageFlags & (VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT)) {
+        applyQueueSharing(bufferInfo.sharingMode, bufferInfo.queueFamilyIndexCount, bufferInfo.pQueueFamilyIndices);
+    }
 
     if (vkCreateBuffer(context->device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) anopol_assert("Failed to create buffer");
 
     VkMemoryRequirements mem;
     vkGetBufferMemoryRequirements(context->device, buffer, &mem);
 
-    VkMemoryAllocateInfo allocationInfo{};
-    allocationInfo.sType            = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocationInfo.allocationSize   = mem.size;
-    allocationInfo.memoryTypeIndex  = findMemoryType(mem.memoryTypeBits, properties);
-
-    if (vkAllocateMemory(context->device, &allocationInfo, nullptr, &bufferMemory) != VK_SUCCESS) anopol_assert("Failed to allocate memory");
-    vkBindBufferMemory(context->device, buffer, bufferMemory, 0);
+    bufferMemory = allocateMemory(mem, properties, true);
+    vkBindBufferMemory(context->device, buffer, bufferMemory.memory, bufferMemory.offset);
 }
 
-void memCopyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size, VkFence fence = VK_NULL_HANDLE) {
-    
-    VkCommandBuffer commandBuffer = beginSingleCommandBuffer();
+void freeBuffer(VkBuffer& buffer, allocation& bufferMemory) {
     
-    VkBufferCopy copy{};
-    copy.size = size;
-    vkCmdCopyBuffer(commandBuffer, src, dst, 1, &copy);
-    
-    endSingleCommandBuffer(commandBuffer, fence);
+    vkDestroyBuffer(context->device, buffer, nullptr);
+    freeAllocation(bufferMemory);
+    buffer = VK_NULL_HANDLE;
 }
 
-void memCopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
-    
-    VkCommandBuffer commandBuffer = beginSingleCommandBuffer();
+VkBufferImageCopy bufferImageCopyRegion(VkDeviceSize bufferOffset, uint32_t width, uint32_t height) {
     
     VkBufferImageCopy region{};
     
-    region.bufferOffset                     = 0;
+    region.bufferOffset                     = bufferOffset;
     region.bufferRowLength                  = 0;
     region.bufferImageHeight                = 0;
     
@@ -239,9 +263,13 @@ void memCopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32
         width, height, 1
     };
     
-    vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+    return region;
+}
+
+void memCopyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize bufferOffset, VkImage image, uint32_t width, uint32_t height) {
     
-    endSingleCommandBuffer(commandBuffer);
+    VkBufferImageCopy region = bufferImageCopyRegion(bufferOffset, width, height);
+    vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
 }
 
 VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags flags, VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D, uint32_t numLayers = 1, uint32_t arrayLayer = 0) {
@@ -267,7 +295,7 @@ VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags f
 // Image
 //------------------------------------------------------------------------------------------//
 
-void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory, uint32_t arrayLayers = 1) {
+void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, allocation& imageMemory, uint32_t arrayLayers = 1, uint32_t mipLevels = 1) {
     
     VkImageCreateInfo imageCreateInfo{};
     imageCreateInfo.sType           = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -275,7 +303,7 @@ void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling
     imageCreateInfo.extent.width    = width;
     imageCreateInfo.extent.height   = height;
     imageCreateInfo.extent.depth    = 1;
-    imageCreateInfo.mipLevels       = 1;
+    imageCreateInfo.mipLevels       = mipLevels;
     imageCreateInfo.arrayLayers     = arrayLayers;
     imageCreateInfo.format          = format;
     imageCreateInfo.tiling          = tiling;
@@ -283,20 +311,25 @@ void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling
     imageCreateInfo.usage           = usage;
     imageCreateInfo.samples         = VK_SAMPLE_COUNT_1_BIT;
     imageCreateInfo.sharingMode     = VK_SHARING_MODE_EXCLUSIVE;
+    
+    if (usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT) {
+        applyQueueSharing(imageCreateInfo.sharingMode, imageCreateInfo.queueFamilyIndexCount, imageCreateInfo.pQueueFamilyIndices);
+    }
 
     if (vkCreateImage(context->device, &imageCreateInfo, nullptr, &image) != VK_SUCCESS) anopol_assert("Failed to create image");
 
     VkMemoryRequirements mem;
     vkGetImageMemoryRequirements(context->device, image, &mem);
 
-    VkMemoryAllocateInfo allocationInfo{};
-    allocationInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocationInfo.allocationSize = mem.size;
-    allocationInfo.memoryTypeIndex = findMemoryType(mem.memoryTypeBits, properties);
-
-    if (vkAllocateMemory(context->device, &allocationInfo, nullptr, &imageMemory) != VK_SUCCESS) anopol_assert("failed to allocate image memory!");
+    imageMemory = allocateMemory(mem, properties, tiling == VK_IMAGE_TILING_LINEAR);
+    vkBindImageMemory(context->device, image, imageMemory.memory, imageMemory.offset);
+}
 
-    vkBindImageMemory(context->device, image, imageMemory, 0);
+void freeImage(VkImage& image, allocation& imageMemory) {
+    
+    vkDestroyImage(context->device, image, nullptr);
+    freeAllocation(imageMemory);
+    image = VK_NULL_HANDLE;
 }
 
 //------------------------------------------------------------------------------------------//
@@ -310,10 +343,14 @@ VkFormat findDepthFormat() {
 void createDepth() {
     
     VkFormat depthFormat = findDepthFormat();
-    createImage(context->extent.width, context->extent.height, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageMemory);
+    
+    // Sampled as well: the Hi-Z pyramid is built from it
+    createImage(context->extent.width, context->extent.height, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageMemory);
     depthImageView = createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
     
-    imageLayoutTransition(depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+    VkCommandBuffer commandBuffer = beginSingleCommandBuffer();
+    imageLayoutTransition(commandBuffer, depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+    endSingleCommandBuffer(commandBuffer);
 }
 
 //------------------------------------------------------------------------------------------//
@@ -331,22 +368,33 @@ queueFamily findQueueFamily(VkPhysicalDevice device) {
     families.resize(familyCount);
     vkGetPhysicalDeviceQueueFamilyProperties(device, &familyCount, families.data());
     
-    int i = 0;
-    for (const auto& queue : families) {
+    std::optional<uint32_t> transferOnly, nonGraphicsTransfer;
+    
+    for (uint32_t i = 0; i < familyCount; i++) {
         
-        if (queue.queueFlags & VK_QUEUE_GRAPHICS_BIT) family.graphicsFamily = i;
+        VkQueueFlags flags = families[i].queueFlags;
         
-        VkBool32 present;
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, context->surface, &present);
-        if (present) {
-            family.presentQueue = i;
+        // Headless: nothing is presented, so the graphics family stands in for the present family
+        VkBool32 present = context->headless;
+        if (!context->headless) vkGetPhysicalDeviceSurfaceSupportKHR(device, i, context->surface, &present);
+        
+        if ((flags & VK_QUEUE_GRAPHICS_BIT) && !family.graphicsFamily.has_value()) {
+            family.graphicsFamily = i;
+            if (present) family.presentQueue = i;
         }
+        if (present && !family.presentQueue.has_value()) family.presentQueue = i;
         
-        if (family.graphicsFamily.has_value() && family.presentQueue.has_value()) {
-            return family;
+        // A family without graphics is a DMA engine that can copy while the graphics queue renders
+        if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT)) {
+            if (!(flags & VK_QUEUE_COMPUTE_BIT) && !transferOnly.has_value()) transferOnly = i;
+            if (!nonGraphicsTransfer.has_value()) nonGraphicsTransfer = i;
         }
-        i++;
     }
+    
+    if      (transferOnly.has_value())          family.transferFamily = transferOnly;
+    else if (nonGraphicsTransfer.has_value())   family.transferFamily = nonGraphicsTransfer;
+    else                                        family.transferFamily = family.graphicsFamily;
+    
     return family;
 }
 
@@ -384,12 +432,26 @@ bool isPhysicalDeviceSuitable(VkPhysicalDevice device) {
     vkGetPhysicalDeviceProperties(device, &properties);
     vkGetPhysicalDeviceFeatures(device, &features);
     
-    swapchainDetails details = querySwapchainDetails(device);
-    
-    bool adequate = false;
-    adequate = !details.formats.empty() && !details.presentModes.empty();
+    bool adequate = context->headless;
+    if (!context->headless) {
+        swapchainDetails details = querySwapchainDetails(device);
+        adequate = !details.formats.empty() && !details.presentModes.empty();
+    }
     queueFamily family = findQueueFamily(device);
-    return family.graphicsFamily.has_value() && family.presentQueue.has_value() && adequate;
+    
+    VkPhysicalDeviceVulkan12Features vulkan12Features{};
+    vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    
+    VkPhysicalDeviceFeatures2 features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &vulkan12Features;
+    vkGetPhysicalDeviceFeatures2(device, &features2);
+    
+    // The texture table is one partially bound, non-uniformly indexed sampler array
+    bool bindless = vulkan12Features.runtimeDescriptorArray && vulkan12Features.descriptorBindingPartiallyBound &&
+                    vulkan12Features.shaderSampledImageArrayNonUniformIndexing;
+    
+    return family.graphicsFamily.has_value() && family.presentQueue.has_value() && vulkan12Features.timelineSemaphore && bindless && adequate;
 }
 
 VkPhysicalDevice findPhysicalDevice(std::vector<VkPhysicalDevice> devices) {
@@ -414,9 +476,9 @@ void createDevice() {
     std::vector<VkDeviceQueueCreateInfo> queueInfo;
     queueFamily family = findQueueFamily(context->physicalDevice);
     
-    for (uint32_t qFamily : std::set<uint32_t>{family.graphicsFamily.value(), family.presentQueue.value()}) {
-        
-        float priority = 1.0f;
+    float priority = 1.0f;
+    
+    for (uint32_t qFamily : std::set<uint32_t>{family.graphicsFamily.value(), family.presentQueue.value(), family.transferFamily.value()}) {
         
         VkDeviceQueueCreateInfo queueCreateInfo{};
         queueCreateInfo.sType               = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
@@ -430,14 +492,45 @@ void createDevice() {
     VkPhysicalDeviceFeatures features{};
     features.multiDrawIndirect = VK_TRUE;
     
+    VkPhysicalDeviceVulkan12Features supported12Features{};
+    supported12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    
+    VkPhysicalDeviceFeatures2 supportedFeatures{};
+    supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supportedFeatures.pNext = &supported12Features;
+    vkGetPhysicalDeviceFeatures2(context->physicalDevice, &supportedFeatures);
+    
+    drawIndirectCountSupported = supported12Features.drawIndirectCount == VK_TRUE;
+    bindlessUpdateAfterBind    = supported12Features.descriptorBindingSampledImageUpdateAfterBind == VK_TRUE &&
+                                 supported12Features.descriptorBindingUpdateUnusedWhilePending == VK_TRUE;
+    
+    VkPhysicalDeviceVulkan12Features vulkan12Features{};
+    vulkan12Features.sType              = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    vulkan12Features.timelineSemaphore  = VK_TRUE;
+    vulkan12Features.drawIndirectCount  = drawIndirectCountSupported ? VK_TRUE : VK_FALSE;
+    
+    vulkan12Features.runtimeDescriptorArray                         = VK_TRUE;
+    vulkan12Features.descriptorBindingPartiallyBound                = VK_TRUE;
+    vulkan12Features.shaderSampledImageArrayNonUniformIndexing      = VK_TRUE;
+    vulkan12Features.descriptorBindingSampledImageUpdateAfterBind   = bindlessUpdateAfterBind ? VK_TRUE : VK_FALSE;
+    vulkan12Features.descriptorBindingUpdateUnusedWhilePending      = bindlessUpdateAfterBind ? VK_TRUE : VK_FALSE;
+    
+    // Headless devices (e.g. lavapipe on CI) are not required to expose VK_KHR_swapchain
+    std::vector<const char*> extensions;
+    for (const char* extension : deviceExtensions) {
+        if (context->headless && strcmp(extension, VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0) continue;
+        extensions.push_back(extension);
+    }
+    
     VkDeviceCreateInfo deviceInfo{};
     
     deviceInfo.sType                    = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    deviceInfo.pNext                    = &vulkan12Features;
     deviceInfo.pQueueCreateInfos        = queueInfo.data();
-    deviceInfo.queueCreateInfoCount     = 1;
+    deviceInfo.queueCreateInfoCount     = static_cast<uint32_t>(queueInfo.size());
     deviceInfo.pEnabledFeatures         = &features;
-    deviceInfo.ppEnabledExtensionNames  = deviceExtensions.data();
-    deviceInfo.enabledExtensionCount    = (uint32_t)deviceExtensions.size();
+    deviceInfo.ppEnabledExtensionNames  = extensions.data();
+    deviceInfo.enabledExtensionCount    = (uint32_t)extensions.size();
     
     if (vkCreateDevice(context->physicalDevice, &deviceInfo, nullptr, &context->device) != VK_SUCCESS) {
         anopol_assert("Couldn't create logical device");
@@ -445,6 +538,27 @@ void createDevice() {
     
     vkGetDeviceQueue(context->device, family.graphicsFamily.value(), 0, &context->graphicsQueue);
     vkGetDeviceQueue(context->device, family.presentQueue.value(), 0, &context->presentQueue);
+    vkGetDeviceQueue(context->device, family.transferFamily.value(), 0, &context->transferQueue);
+    
+    deviceQueueFamilies = family;
+}
+
+bool hasDedicatedTransferQueue() {
+    return deviceQueueFamilies.transferFamily != deviceQueueFamilies.graphicsFamily;
+}
+
+// Resources written by the transfer queue and read by the graphics queue are shared concurrently instead of transferring ownership
+void applyQueueSharing(VkSharingMode& sharingMode, uint32_t& familyCount, const uint32_t*& families) {
+    
+    static uint32_t sharedFamilies[2];
+    
+    if (!hasDedicatedTransferQueue()) return;
+    
+    sharedFamilies[0]   = deviceQueueFamilies.graphicsFamily.value();
+    sharedFamilies[1]   = deviceQueueFamilies.transferFamily.value();
+    sharingMode         = VK_SHARING_MODE_CONCURRENT;
+    familyCount         = 2;
+    families            = sharedFamilies;
 }
 
 //------------------------------------------------------------------------------------------//
@@ -561,6 +675,51 @@ void createSwapchain() {
     }
 }
 
+//------------------------------------------------------------------------------------------//
+// Headless targets
+//
+// Stand-in for the swapchain when there is no surface: a ring of anopol_max_frames color
+// images at context->extent, exposed through swapchainImages / swapchainImageViews so the
+// framebuffers and the frame loop do not need to know the difference. Frame i renders into
+// image i, which is free again once that frame's in-flight fence has signalled.
+//------------------------------------------------------------------------------------------//
+
+void createHeadlessTargets() {
+    
+    context->format = findSupportedFormat({VK_FORMAT_B8G8R8A8_SRGB, VK_FORMAT_R8G8B8A8_SRGB, VK_FORMAT_B8G8R8A8_UNORM, VK_FORMAT_R8G8B8A8_UNORM},
+                                          VK_IMAGE_TILING_OPTIMAL,
+                                          VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT);
+    
+    swapchainImages.resize(anopol_max_frames);
+    swapchainImageViews.resize(anopol_max_frames);
+    headlessImageMemory.resize(anopol_max_frames);
+    
+    for (uint32_t i = 0; i < anopol_max_frames; i++) {
+        
+        createImage(context->extent.width,
+                    context->extent.height,
+                    context->format,
+                    VK_IMAGE_TILING_OPTIMAL,
+                    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                    swapchainImages[i],
+                    headlessImageMemory[i]);
+        
+        swapchainImageViews[i] = createImageView(swapchainImages[i], context->format, VK_IMAGE_ASPECT_COLOR_BIT);
+    }
+}
+
+// Window size when there is one, otherwise the headless extent
+void surfaceSize(int& width, int& height) {
+    
+    if (context->headless) {
+        width   = static_cast<int>(context->extent.width);
+        height  = static_cast<int>(context->extent.height);
+        return;
+    }
+    glfwGetWindowSize(context->window, &width, &height);
+}
+
 //------------------------------------------------------------------------------------------//
 // Initializer
 //------------------------------------------------------------------------------------------//
@@ -581,7 +740,10 @@ void initializeVulkanDependenices() {
     msaaSamples = getSampleCount();
     
     createDevice();
-    createSwapchain();
+    initializeAllocator();
+    
+    if (context->headless)  createHeadlessTargets();
+    else                    createSwapchain();
     
     queueFamily family = anopol::ll::findQueueFamily(context->physicalDevice);
     VkCommandPoolCreateInfo poolCreateInfo{};
@@ -593,6 +755,12 @@ void initializeVulkanDependenices() {
                             &poolCreateInfo, nullptr,
                             &commandPool) != VK_SUCCESS) throw std::runtime_error("CommandPool");
     
+    poolCreateInfo.queueFamilyIndex = family.transferFamily.value();
+    
+    if (vkCreateCommandPool(context->device,
+                            &poolCreateInfo, nullptr,
+                            &transferCommandPool) != VK_SUCCESS) throw std::runtime_error("CommandPool");
+    
     createDepth();
 }
 
@@ -603,17 +771,21 @@ void initializeVulkanDependenices() {
 void freeMemory() {
     
     vkDestroyCommandPool(context->device, commandPool, nullptr);
+    vkDestroyCommandPool(context->device, transferCommandPool, nullptr);
     vkDestroyImageView(context->device, depthImageView, nullptr);
-    vkDestroyImage(context->device, depthImage, nullptr);
-    vkFreeMemory(context->device, depthImageMemory, nullptr);
+    freeImage(depthImage, depthImageMemory);
     
+    destroyAllocator();
     vkDestroyDevice(context->device, nullptr);
     
-    vkDestroySurfaceKHR(context->instance, context->surface, nullptr);
+    if (!context->headless) vkDestroySurfaceKHR(context->instance, context->surface, nullptr);
     vkDestroyInstance(context->instance, nullptr);
-    glfwDestroyWindow(context->window);
-    glfwTerminate();
-    free(context);
+    
+    if (context->window != nullptr) {
+        glfwDestroyWindow(context->window);
+        glfwTerminate();
+    }
+    delete context;
 }
 
 void freeSwapchain() {
@@ -621,6 +793,14 @@ void freeSwapchain() {
     for (VkImageView imageView : swapchainImageViews) {
         vkDestroyImageView(context->device, imageView, nullptr);
     }
+    
+    if (context->headless) {
+        for (size_t i = 0; i < swapchainImages.size(); i++) {
+            freeImage(swapchainImages[i], headlessImageMemory[i]);
+        }
+        headlessImageMemory.clear();
+        return;
+    }
     vkDestroySwapchainKHR(context->device, context->swapchain, nullptr);
 }
 
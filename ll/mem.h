@@ -8,19 +8,354 @@
 #ifndef mem_h
 #define mem_h
 
+#define anopol_small_allocation_size    static_cast<VkDeviceSize>(256 * 1024)           // 256 KB
+#define anopol_small_block_size         static_cast<VkDeviceSize>(16 * 1024 * 1024)     // 16 MB
+#define anopol_large_block_size         static_cast<VkDeviceSize>(64 * 1024 * 1024)     // 64 MB
+
 namespace anopol::ll {
 
 uint32_t findMemoryType(uint32_t filter, VkMemoryPropertyFlags properties) {
-    
+
     VkPhysicalDeviceMemoryProperties mem;
     vkGetPhysicalDeviceMemoryProperties(context->physicalDevice, &mem);
-    
+
     for (uint32_t i = 0; i < mem.memoryTypeCount; i++) {
-        if (filter & (1 << 0) && (mem.memoryTypes[i].propertyFlags & properties) == properties) return i;
+        if ((filter & (1 << i)) && (mem.memoryTypes[i].propertyFlags & properties) == properties) return i;
     }
     anopol_assert("Couldn't find memory type");
 }
 
+//------------------------------------------------------------------------------------------//
+// Sub-allocator
+//
+// Every buffer and image is placed inside a few large VkDeviceMemory blocks instead of
+// getting its own vkAllocateMemory. Blocks live in pools keyed by memory type, size class
+// and resource kind (linear buffers and optimal images are kept apart so that
+// bufferImageGranularity never has to be considered). Allocations that are larger than
+// half a large block get a dedicated block of their own.
+//------------------------------------------------------------------------------------------//
+
+enum allocationClass {
+    smallAllocation, largeAllocation, dedicatedAllocation
+};
+
+struct allocation {
+    VkDeviceMemory  memory  = VK_NULL_HANDLE;
+    VkDeviceSize    offset  = 0;
+    VkDeviceSize    size    = 0;
+    void*           mapped  = nullptr;
+    uint32_t        pool    = UINT32_MAX;
+    uint32_t        block   = UINT32_MAX;
+};
+
+struct memoryStatistics {
+    uint32_t        blockCount          = 0;
+    uint32_t        dedicatedBlockCount = 0;
+    uint32_t        allocationCount     = 0;
+    VkDeviceSize    bytesReserved       = 0;
+    VkDeviceSize    bytesUsed           = 0;
+    VkDeviceSize    bytesFree           = 0;
+    VkDeviceSize    largestFreeRange    = 0;
+    float           fragmentation       = 0.0f;
+};
+
+struct memoryRange {
+    VkDeviceSize offset;
+    VkDeviceSize size;
+};
+
+struct memoryBlock {
+    VkDeviceMemory              memory      = VK_NULL_HANDLE;
+    VkDeviceSize                size        = 0;
+    VkDeviceSize                used        = 0;
+    void*                       mapped      = nullptr;
+    uint32_t                    allocations = 0;
+    std::vector<memoryRange>    freeRanges;
+};
+
+struct memoryPool {
+    uint32_t                    memoryType;
+    allocationClass             sizeClass;
+    bool                        linear;
+    VkDeviceSize                blockSize;
+    std::vector<memoryBlock>    blocks;
+};
+
+std::vector<memoryPool>             memoryPools;
+std::mutex                          allocatorMutex;
+VkPhysicalDeviceMemoryProperties    allocatorMemoryProperties;
+VkDeviceSize                        nonCoherentAtomSize = 1;
+
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return alignment <= 1 ? value : (value + alignment - 1) / alignment * alignment;
+}
+
+void initializeAllocator() {
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(context->physicalDevice, &properties);
+    vkGetPhysicalDeviceMemoryProperties(context->physicalDevice, &allocatorMemoryProperties);
+
+    nonCoherentAtomSize = std::max<VkDeviceSize>(properties.limits.nonCoherentAtomSize, 1);
+    memoryPools.clear();
+}
+
+VkDeviceSize preferredBlockSize(uint32_t memoryType, allocationClass sizeClass) {
+
+    VkDeviceSize blockSize  = sizeClass == smallAllocation ? anopol_small_block_size : anopol_large_block_size;
+    VkDeviceSize heapSize   = allocatorMemoryProperties.memoryHeaps[allocatorMemoryProperties.memoryTypes[memoryType].heapIndex].size;
+
+    // Small heaps (e.g. the 256 MB host-visible device-local window) get proportionally smaller blocks
+    if (heapSize <= static_cast<VkDeviceSize>(1024) * 1024 * 1024) {
+        blockSize = std::min(blockSize, heapSize / 8);
+    }
+    return blockSize;
+}
+
+uint32_t findMemoryPool(uint32_t memoryType, allocationClass sizeClass, bool linear) {
+
+    for (uint32_t i = 0; i < memoryPools.size(); i++) {
+        const memoryPool& pool = memoryPools[i];
+        if (pool.memoryType == memoryType && pool.sizeClass == sizeClass && pool.linear == linear) return i;
+    }
+
+    memoryPool pool{};
+    pool.memoryType = memoryType;
+    pool.sizeClass  = sizeClass;
+    pool.linear     = linear;
+    pool.blockSize  = preferredBlockSize(memoryType, sizeClass);
+    memoryPools.push_back(pool);
+
+    return static_cast<uint32_t>(memoryPools.size() - 1);
+}
+
+uint32_t allocateBlock(memoryPool& pool, VkDeviceSize size) {
+
+    memoryBlock block{};
+    block.size = size;
+    block.freeRanges.push_back({0, size});
+
+    VkMemoryAllocateInfo allocationInfo{};
+    allocationInfo.sType            = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocationInfo.allocationSize   = size;
+    allocationInfo.memoryTypeIndex  = pool.memoryType;
+
+    if (vkAllocateMemory(context->device, &allocationInfo, nullptr, &block.memory) != VK_SUCCESS) anopol_assert("Failed to allocate memory block");
+
+    // Host visible blocks stay mapped for their whole lifetime, allocations just offset into them
+    if (allocatorMemoryProperties.memoryTypes[pool.memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        if (vkMapMemory(context->device, block.memory, 0, VK_WHOLE_SIZE, 0, &block.mapped) != VK_SUCCESS) anopol_assert("Failed to map memory block");
+    }
+
+    // Reuse released slots so that block indices held by live allocations stay valid
+    for (uint32_t i = 0; i < pool.blocks.size(); i++) {
+        if (pool.blocks[i].memory == VK_NULL_HANDLE) {
+            pool.blocks[i] = block;
+            return i;
+        }
+    }
+    pool.blocks.push_back(block);
+    return static_cast<uint32_t>(pool.blocks.size() - 1);
+}
+
+void releaseBlock(memoryBlock& block) {
+
+    if (block.mapped != nullptr) vkUnmapMemory(context->device, block.memory);
+    vkFreeMemory(context->device, block.memory, nullptr);
+
+    block = memoryBlock();
+}
+
+bool suballocate(memoryBlock& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset) {
+
+    // Best fit: the smallest free range that can hold the aligned allocation
+    size_t best = SIZE_MAX;
+    VkDeviceSize bestWaste = UINT64_MAX;
+
+    for (size_t i = 0; i < block.freeRanges.size(); i++) {
+        const memoryRange& range = block.freeRanges[i];
+        VkDeviceSize aligned = alignUp(range.offset, alignment);
+
+        if (aligned + size > range.offset + range.size) continue;
+
+        VkDeviceSize waste = range.size - size;
+        if (waste < bestWaste) {
+            best = i;
+            bestWaste = waste;
+        }
+    }
+    if (best == SIZE_MAX) return false;
+
+    memoryRange range   = block.freeRanges[best];
+    VkDeviceSize aligned = alignUp(range.offset, alignment);
+
+    block.freeRanges.erase(block.freeRanges.begin() + best);
+
+    // Keep the head (alignment padding) and tail of the range free, sorted by offset
+    std::vector<memoryRange> remaining;
+    if (aligned > range.offset) remaining.push_back({range.offset, aligned - range.offset});
+    if (aligned + size < range.offset + range.size) remaining.push_back({aligned + size, range.offset + range.size - aligned - size});
+
+    block.freeRanges.insert(block.freeRanges.begin() + best, remaining.begin(), remaining.end());
+
+    offset = aligned;
+    return true;
+}
+
+allocation allocateMemory(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool linear) {
+
+    std::lock_guard<std::mutex> lock(allocatorMutex);
+
+    uint32_t memoryType = findMemoryType(requirements.memoryTypeBits, properties);
+
+    VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+    VkMemoryPropertyFlags flags = allocatorMemoryProperties.memoryTypes[memoryType].propertyFlags;
+
+    // Non-coherent ranges are flushed per allocation, so they must not share an atom with a neighbour
+    if ((flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+        alignment = std::max(alignment, nonCoherentAtomSize);
+    }
+    VkDeviceSize size = alignUp(requirements.size, alignment);
+
+    allocationClass sizeClass = size <= anopol_small_allocation_size ? smallAllocation : largeAllocation;
+    if (sizeClass == largeAllocation && size > preferredBlockSize(memoryType, largeAllocation) / 2) {
+        sizeClass = dedicatedAllocation;
+    }
+
+    uint32_t poolIndex = findMemoryPool(memoryType, sizeClass, linear);
+    memoryPool& pool = memoryPools[poolIndex];
+
+    allocation result{};
+    result.pool = poolIndex;
+
+    for (uint32_t i = 0; i < pool.blocks.size() && sizeClass != dedicatedAllocation; i++) {
+        memoryBlock& block = pool.blocks[i];
+        if (block.memory == VK_NULL_HANDLE || block.size - block.used < size) continue;
+
+        if (suballocate(block, size, alignment, result.offset)) {
+            result.block = i;
+            break;
+        }
+    }
+
+    if (result.block == UINT32_MAX) {
+        result.block = allocateBlock(pool, sizeClass == dedicatedAllocation ? size : std::max(pool.blockSize, size));
+        suballocate(pool.blocks[result.block], size, alignment, result.offset);
+    }
+
+    memoryBlock& block = pool.blocks[result.block];
+    block.used += size;
+    block.allocations++;
+
+    result.memory   = block.memory;
+    result.size     = size;
+    result.mapped   = block.mapped != nullptr ? static_cast<char*>(block.mapped) + result.offset : nullptr;
+
+    return result;
+}
+
+void freeAllocation(allocation& memory) {
+
+    if (memory.memory == VK_NULL_HANDLE) return;
+
+    std::lock_guard<std::mutex> lock(allocatorMutex);
+
+    memoryPool& pool = memoryPools[memory.pool];
+    memoryBlock& block = pool.blocks[memory.block];
+
+    block.used -= memory.size;
+    block.allocations--;
+
+    // Insert the range back in offset order and coalesce it with its neighbours
+    auto next = std::lower_bound(block.freeRanges.begin(), block.freeRanges.end(), memory.offset,
+                                 [](const memoryRange& range, VkDeviceSize offset) { return range.offset < offset; });
+
+    next = block.freeRanges.insert(next, {memory.offset, memory.size});
+
+    if (next + 1 != block.freeRanges.end() && next->offset + next->size == (next + 1)->offset) {
+        next->size += (next + 1)->size;
+        block.freeRanges.erase(next + 1);
+    }
+    if (next != block.freeRanges.begin() && (next - 1)->offset + (next - 1)->size == next->offset) {
+        (next - 1)->size += next->size;
+        block.freeRanges.erase(next);
+    }
+
+    if (block.allocations == 0) {
+
+        // Keep one empty block around per pool so alloc/free cycles don't thrash vkAllocateMemory
+        bool otherEmptyBlock = false;
+        for (uint32_t i = 0; i < pool.blocks.size(); i++) {
+            if (i != memory.block && pool.blocks[i].memory != VK_NULL_HANDLE && pool.blocks[i].allocations == 0) otherEmptyBlock = true;
+        }
+        if (pool.sizeClass == dedicatedAllocation || otherEmptyBlock) releaseBlock(block);
+    }
+
+    memory = allocation();
+}
+
+void flushAllocation(const allocation& memory) {
+
+    if (memory.memory == VK_NULL_HANDLE) return;
+
+    std::lock_guard<std::mutex> lock(allocatorMutex);
+    const memoryBlock& block = memoryPools[memory.pool].blocks[memory.block];
+
+    VkDeviceSize start  = memory.offset / nonCoherentAtomSize * nonCoherentAtomSize;
+    VkDeviceSize end    = std::min(alignUp(memory.offset + memory.size, nonCoherentAtomSize), block.size);
+
+    VkMappedMemoryRange range{};
+    range.sType     = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory    = memory.memory;
+    range.offset    = start;
+    range.size      = end == block.size ? VK_WHOLE_SIZE : end - start;
+
+    vkFlushMappedMemoryRanges(context->device, 1, &range);
+}
+
+memoryStatistics queryMemoryStatistics() {
+
+    std::lock_guard<std::mutex> lock(allocatorMutex);
+
+    memoryStatistics statistics{};
+
+    for (const memoryPool& pool : memoryPools) {
+        for (const memoryBlock& block : pool.blocks) {
+            if (block.memory == VK_NULL_HANDLE) continue;
+
+            statistics.blockCount++;
+            if (pool.sizeClass == dedicatedAllocation) statistics.dedicatedBlockCount++;
+
+            statistics.allocationCount  += block.allocations;
+            statistics.bytesReserved    += block.size;
+            statistics.bytesUsed        += block.used;
+
+            for (const memoryRange& range : block.freeRanges) {
+                statistics.bytesFree        += range.size;
+                statistics.largestFreeRange  = std::max(statistics.largestFreeRange, range.size);
+            }
+        }
+    }
+
+    // 0 when all free memory is one contiguous range, approaching 1 as it splinters
+    if (statistics.bytesFree > 0) {
+        statistics.fragmentation = 1.0f - static_cast<float>(statistics.largestFreeRange) / static_cast<float>(statistics.bytesFree);
+    }
+    return statistics;
+}
+
+void destroyAllocator() {
+
+    std::lock_guard<std::mutex> lock(allocatorMutex);
+
+    for (memoryPool& pool : memoryPools) {
+        for (memoryBlock& block : pool.blocks) {
+            if (block.memory != VK_NULL_HANDLE) releaseBlock(block);
+        }
+    }
+    memoryPools.clear();
+}
+
 }
 
 #endif /* mem_h */
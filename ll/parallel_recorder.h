@@ -0,0 +1,216 @@
+//
+//  parallel_recorder.h
+//  anopol
+//
+//  Created by Dmitri Wamback on 2026-10-17.
+//
+
+#ifndef parallel_recorder_h
+#define parallel_recorder_h
+
+namespace anopol::ll {
+
+//------------------------------------------------------------------------------------------//
+// Parallel secondary command buffer recording
+//
+// Every worker owns one command pool per frame in flight. Begin() resets the whole pool
+// set of that frame at once (its fence has already been waited on), so secondaries are
+// handed out linearly and never freed individually. Record() queues a task, Execute()
+// splits the queued tasks across the workers, records each into its own secondary and
+// runs all of them with a single vkCmdExecuteCommands in submission order.
+//------------------------------------------------------------------------------------------//
+
+// Secondaries inherit nothing from the primary, so each one binds this state itself
+struct secondaryState {
+    VkRenderPass                    renderPass      = VK_NULL_HANDLE;
+    VkFramebuffer                   framebuffer     = VK_NULL_HANDLE;
+    uint32_t                        subpass         = 0;
+
+    VkPipeline                      pipeline        = VK_NULL_HANDLE;
+    VkPipelineLayout                pipelineLayout  = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet>    descriptorSets;
+
+    VkViewport                      viewport{};
+    VkRect2D                        scissor{};
+};
+
+typedef std::function<void(VkCommandBuffer)> recordTask;
+
+class ParallelRecorder {
+public:
+    static ParallelRecorder Create(uint32_t workerCount = 0);
+
+    void Begin(uint32_t frame, const secondaryState& state);
+    void Record(recordTask task);
+    void Execute(VkCommandBuffer primaryCommandBuffer);
+    void Destroy();
+
+    uint32_t WorkerCount() const;
+
+private:
+    struct workerPool {
+        VkCommandPool                   commandPool = VK_NULL_HANDLE;
+        std::vector<VkCommandBuffer>    commandBuffers;
+        uint32_t                        used = 0;
+    };
+
+    uint32_t                        workerCount = 1;
+    uint32_t                        frame = 0;
+    std::vector<workerPool>         pools;
+
+    secondaryState                  state;
+    std::vector<recordTask>         tasks;
+    std::vector<VkCommandBuffer>    recorded;
+
+    workerPool& pr_Pool(uint32_t worker);
+    VkCommandBuffer pr_AcquireSecondary(workerPool& pool);
+    void pr_RecordRange(uint32_t worker, size_t first, size_t last);
+};
+
+ParallelRecorder ParallelRecorder::Create(uint32_t workerCount) {
+
+    ParallelRecorder recorder = ParallelRecorder();
+
+    if (workerCount == 0) workerCount = std::max(1u, std::thread::hardware_concurrency());
+    recorder.workerCount = workerCount;
+    recorder.pools.resize(anopol_max_frames * workerCount);
+
+    VkCommandPoolCreateInfo poolCreateInfo{};
+    poolCreateInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolCreateInfo.flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolCreateInfo.queueFamilyIndex = deviceQueueFamilies.graphicsFamily.value();
+
+    for (workerPool& pool : recorder.pools) {
+        if (vkCreateCommandPool(context->device, &poolCreateInfo, nullptr, &pool.commandPool) != VK_SUCCESS) anopol_assert("Failed to create worker command pool");
+    }
+
+    return recorder;
+}
+
+ParallelRecorder::workerPool& ParallelRecorder::pr_Pool(uint32_t worker) {
+    return pools[frame * workerCount + worker];
+}
+
+void ParallelRecorder::Begin(uint32_t frame, const secondaryState& state) {
+
+    this->frame = frame;
+    this->state = state;
+
+    for (uint32_t worker = 0; worker < workerCount; worker++) {
+        workerPool& pool = pr_Pool(worker);
+        if (pool.used == 0) continue;
+
+        vkResetCommandPool(context->device, pool.commandPool, 0);
+        pool.used = 0;
+    }
+
+    tasks.clear();
+}
+
+void ParallelRecorder::Record(recordTask task) {
+    tasks.push_back(std::move(task));
+}
+
+VkCommandBuffer ParallelRecorder::pr_AcquireSecondary(workerPool& pool) {
+
+    if (pool.used == pool.commandBuffers.size()) {
+
+        VkCommandBufferAllocateInfo allocationInfo{};
+        allocationInfo.sType                = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocationInfo.commandPool          = pool.commandPool;
+        allocationInfo.level                = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocationInfo.commandBufferCount   = 1;
+
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(context->device, &allocationInfo, &commandBuffer) != VK_SUCCESS) anopol_assert("Failed to allocate secondary command buffer");
+
+        pool.commandBuffers.push_back(commandBuffer);
+    }
+    return pool.commandBuffers[pool.used++];
+}
+
+void ParallelRecorder::pr_RecordRange(uint32_t worker, size_t first, size_t last) {
+
+    workerPool& pool = pr_Pool(worker);
+
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType       = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass  = state.renderPass;
+    inheritanceInfo.subpass     = state.subpass;
+    inheritanceInfo.framebuffer = state.framebuffer;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType             = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags             = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    beginInfo.pInheritanceInfo  = &inheritanceInfo;
+
+    for (size_t i = first; i < last; i++) {
+
+        VkCommandBuffer commandBuffer = pr_AcquireSecondary(pool);
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, state.pipeline);
+        vkCmdBindDescriptorSets(commandBuffer,
+                                VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                state.pipelineLayout,
+                                0,
+                                static_cast<uint32_t>(state.descriptorSets.size()),
+                                state.descriptorSets.data(),
+                                0,
+                                nullptr);
+        vkCmdSetViewport(commandBuffer, 0, 1, &state.viewport);
+        vkCmdSetScissor(commandBuffer, 0, 1, &state.scissor);
+
+        tasks[i](commandBuffer);
+
+        vkEndCommandBuffer(commandBuffer);
+        recorded[i] = commandBuffer;
+    }
+}
+
+void ParallelRecorder::Execute(VkCommandBuffer primaryCommandBuffer) {
+
+    if (tasks.empty()) return;
+
+    anopol_zone("ParallelRecorder::Execute");
+    recorded.assign(tasks.size(), VK_NULL_HANDLE);
+
+    uint32_t workers = static_cast<uint32_t>(std::min<size_t>(workerCount, tasks.size()));
+    size_t chunkSize = (tasks.size() + workers - 1) / workers;
+
+    // Worker 0 records on the calling thread
+    std::vector<std::future<void>> futures;
+    for (uint32_t worker = 1; worker < workers; worker++) {
+
+        size_t first = worker * chunkSize;
+        size_t last  = std::min(first + chunkSize, tasks.size());
+        if (first >= last) break;
+
+        futures.push_back(std::async(std::launch::async, [this, worker, first, last]() {
+            anopol_zone("record secondaries");
+            pr_RecordRange(worker, first, last);
+        }));
+    }
+    pr_RecordRange(0, 0, std::min(chunkSize, tasks.size()));
+
+    for (std::future<void>& future : futures) future.get();
+
+    vkCmdExecuteCommands(primaryCommandBuffer, static_cast<uint32_t>(recorded.size()), recorded.data());
+    tasks.clear();
+}
+
+uint32_t ParallelRecorder::WorkerCount() const {
+    return workerCount;
+}
+
+void ParallelRecorder::Destroy() {
+
+    for (workerPool& pool : pools) {
+        vkDestroyCommandPool(context->device, pool.commandPool, nullptr);
+    }
+    pools.clear();
+}
+
+}
+
+#endif /* parallel_recorder_h */
@@ -0,0 +1,219 @@
+//
+//  pipeline_cache.h
+//  anopol
+//
+//  Created by Dmitri Wamback on 2026-10-17.
+//
+
+#ifndef pipeline_cache_h
+#define pipeline_cache_h
+
+#define anopol_pipeline_cache_path "anopol_pipeline_cache.bin"
+#define anopol_pipeline_cache_magic 0x43504e41u // "ANPC"
+#define anopol_pipeline_cache_version 1u
+
+namespace anopol::ll {
+
+//------------------------------------------------------------------------------------------//
+// Pipeline cache
+//
+// One VkPipelineCache shared by every pipeline creation. At startup it is seeded from the
+// blob written on the previous shutdown, but only if the blob was produced by the same
+// vendor, device, driver version and pipelineCacheUUID. Otherwise the driver would either
+// reject it or silently ignore it. The blob is written to a temporary file and renamed
+// over the old one so that a crash mid-write never leaves a truncated cache behind.
+//------------------------------------------------------------------------------------------//
+
+struct pipelineCacheHeader {
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    vendorID;
+    uint32_t    deviceID;
+    uint32_t    driverVersion;
+    uint8_t     pipelineCacheUUID[VK_UUID_SIZE];
+    uint64_t    dataSize;
+    uint64_t    checksum;
+};
+
+struct pipelineCacheStatistics {
+    bool        loaded                  = false;
+    size_t      loadedBytes             = 0;
+    size_t      savedBytes              = 0;
+    double      loadMilliseconds        = 0.0;
+    double      creationMilliseconds    = 0.0; // Time spent inside vkCreate*Pipelines
+    uint32_t    pipelinesCreated        = 0;
+};
+
+VkPipelineCache         pipelineCache = VK_NULL_HANDLE;
+std::string             pipelineCachePath;
+pipelineCacheStatistics pipelineCacheStats{};
+
+// FNV-1a, only to catch truncated or corrupted blobs
+uint64_t pipelineCacheChecksum(const char* data, size_t size) {
+
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+pipelineCacheHeader currentPipelineCacheHeader() {
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(context->physicalDevice, &properties);
+
+    pipelineCacheHeader header{};
+    header.magic            = anopol_pipeline_cache_magic;
+    header.version          = anopol_pipeline_cache_version;
+    header.vendorID         = properties.vendorID;
+    header.deviceID         = properties.deviceID;
+    header.driverVersion    = properties.driverVersion;
+    memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+    return header;
+}
+
+// Returns the driver blob stored in the file, or nothing when it belongs to another device or driver
+std::vector<char> readPipelineCacheBlob(const std::string& path) {
+
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) return {};
+
+    size_t fileSize = static_cast<size_t>(file.tellg());
+    if (fileSize < sizeof(pipelineCacheHeader)) return {};
+
+    pipelineCacheHeader stored{};
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(&stored), sizeof(pipelineCacheHeader));
+
+    pipelineCacheHeader current = currentPipelineCacheHeader();
+
+    if (stored.magic            != current.magic ||
+        stored.version          != current.version ||
+        stored.vendorID         != current.vendorID ||
+        stored.deviceID         != current.deviceID ||
+        stored.driverVersion    != current.driverVersion ||
+        memcmp(stored.pipelineCacheUUID, current.pipelineCacheUUID, VK_UUID_SIZE) != 0 ||
+        stored.dataSize         != fileSize - sizeof(pipelineCacheHeader)) return {};
+
+    std::vector<char> data(stored.dataSize);
+    file.read(data.data(), stored.dataSize);
+    if (!file || pipelineCacheChecksum(data.data(), data.size()) != stored.checksum) return {};
+
+    // The driver's own header has to agree as well
+    VkPipelineCacheHeaderVersionOne driverHeader{};
+    if (data.size() < sizeof(driverHeader)) return {};
+    memcpy(&driverHeader, data.data(), sizeof(driverHeader));
+
+    if (driverHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+        driverHeader.vendorID != current.vendorID ||
+        driverHeader.deviceID != current.deviceID ||
+        memcmp(driverHeader.pipelineCacheUUID, current.pipelineCacheUUID, VK_UUID_SIZE) != 0) return {};
+
+    return data;
+}
+
+void initializePipelineCache(const std::string& path = anopol_pipeline_cache_path) {
+
+    auto start = std::chrono::steady_clock::now();
+
+    pipelineCachePath = path;
+    std::vector<char> data = readPipelineCacheBlob(path);
+
+    VkPipelineCacheCreateInfo cacheInfo{};
+    cacheInfo.sType             = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.initialDataSize   = data.size();
+    cacheInfo.pInitialData      = data.empty() ? nullptr : data.data();
+
+    // A blob that passed validation can still be refused by the driver; start empty in that case
+    if (vkCreatePipelineCache(context->device, &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS) {
+
+        cacheInfo.initialDataSize   = 0;
+        cacheInfo.pInitialData      = nullptr;
+        data.clear();
+
+        if (vkCreatePipelineCache(context->device, &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS) anopol_assert("Failed to create pipeline cache");
+    }
+
+    pipelineCacheStats.loaded           = !data.empty();
+    pipelineCacheStats.loadedBytes      = data.size();
+    pipelineCacheStats.loadMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+VkResult createGraphicsPipelines(uint32_t count, const VkGraphicsPipelineCreateInfo* createInfos, VkPipeline* pipelines) {
+
+    auto start = std::chrono::steady_clock::now();
+    VkResult result = vkCreateGraphicsPipelines(context->device, pipelineCache, count, createInfos, nullptr, pipelines);
+
+    pipelineCacheStats.creationMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    pipelineCacheStats.pipelinesCreated     += count;
+
+    return result;
+}
+
+VkResult createComputePipelines(uint32_t count, const VkComputePipelineCreateInfo* createInfos, VkPipeline* pipelines) {
+
+    auto start = std::chrono::steady_clock::now();
+    VkResult result = vkCreateComputePipelines(context->device, pipelineCache, count, createInfos, nullptr, pipelines);
+
+    pipelineCacheStats.creationMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    pipelineCacheStats.pipelinesCreated     += count;
+
+    return result;
+}
+
+void savePipelineCache() {
+
+    if (pipelineCache == VK_NULL_HANDLE || pipelineCachePath.empty()) return;
+
+    size_t dataSize = 0;
+    if (vkGetPipelineCacheData(context->device, pipelineCache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0) return;
+
+    std::vector<char> data(dataSize);
+    if (vkGetPipelineCacheData(context->device, pipelineCache, &dataSize, data.data()) != VK_SUCCESS) return;
+    data.resize(dataSize);
+
+    pipelineCacheHeader header = currentPipelineCacheHeader();
+    header.dataSize = dataSize;
+    header.checksum = pipelineCacheChecksum(data.data(), data.size());
+
+    std::string temporaryPath = pipelineCachePath + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) return;
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(pipelineCacheHeader));
+        file.write(data.data(), data.size());
+        file.flush();
+
+        if (!file) {
+            file.close();
+            std::remove(temporaryPath.c_str());
+            return;
+        }
+    }
+
+#if defined(_WIN32)
+    std::remove(pipelineCachePath.c_str()); // rename does not replace an existing file on Windows
+#endif
+    if (std::rename(temporaryPath.c_str(), pipelineCachePath.c_str()) != 0) {
+        std::remove(temporaryPath.c_str());
+        return;
+    }
+
+    pipelineCacheStats.savedBytes = data.size() + sizeof(pipelineCacheHeader);
+}
+
+void destroyPipelineCache() {
+
+    savePipelineCache();
+
+    vkDestroyPipelineCache(context->device, pipelineCache, nullptr);
+    pipelineCache = VK_NULL_HANDLE;
+}
+
+}
+
+#endif /* pipeline_cache_h */
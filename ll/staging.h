@@ -0,0 +1,376 @@
+//
+//  staging.h
+//  anopol
+//
+//  Created by Dmitri Wamback on 2026-10-17.
+//
+
+#ifndef staging_h
+#define staging_h
+
+#define anopol_staging_ring_size static_cast<VkDeviceSize>(32 * 1024 * 1024) // 32 MB per frame in flight
+
+namespace anopol::ll {
+
+//------------------------------------------------------------------------------------------//
+// Staging ring
+//
+// One persistently mapped host buffer per frame in flight. Writers reserve a range, write
+// into it and add their copy to the current frame's upload recorder. submitUploads()
+// records everything collected into one command buffer and hands it to the transfer
+// queue, which signals
+// the upload timeline with a new value: the uploadToken of everything recorded into it.
+// The graphics submit only waits on a token when it actually reads the uploaded data, and
+// an upload batch only waits on the graphics frames still using a buffer it copies to or
+// from (markGraphicsUse). A frame's ranges are recycled the next time the ring comes back
+// around to it and its token has completed; buffers retired while it was current are
+// freed once the graphics frame that could last have used them has completed too.
+//------------------------------------------------------------------------------------------//
+
+typedef uint64_t uploadToken;
+
+struct stagingRange {
+    VkBuffer        buffer = VK_NULL_HANDLE;
+    VkDeviceSize    offset = 0;
+    void*           mapped = nullptr;
+};
+
+struct retiredBuffer {
+    VkBuffer        buffer;
+    allocation      memory;
+    uint64_t        graphicsValue = 0;  // Graphics timeline value of the last frame that may use it
+};
+
+struct stagingFrame {
+    VkBuffer                    buffer          = VK_NULL_HANDLE;
+    allocation                  memory{};
+    VkDeviceSize                head            = 0;
+
+    VkCommandBuffer             commandBuffer   = VK_NULL_HANDLE;
+    uploadToken                 token           = 0;
+    CommandRecorder             recorder;
+
+    std::vector<retiredBuffer>  retired;
+};
+
+std::array<stagingFrame, anopol_max_frames> stagingFrames;
+uint32_t                                    stagingFrameIndex = 0;
+std::recursive_mutex                        stagingMutex;
+
+VkSemaphore     uploadTimeline      = VK_NULL_HANDLE,
+                graphicsTimeline    = VK_NULL_HANDLE;
+uploadToken     uploadSerial        = 0,
+                completedUploads    = 0;
+uint64_t        graphicsSerial      = 0,
+                completedGraphics   = 0;
+uint64_t        stagedBytes         = 0;    // Everything ever copied through staging, for benchmarks
+
+// Graphics timeline value of the last frame recorded using each buffer staging copies to or
+// from. Buffers without an entry are not used by any frame that is still in flight
+std::unordered_map<VkBuffer, uint64_t>  bufferUses;
+std::vector<retiredBuffer>              deferredRetired;    // Upload done, a frame may still use them
+
+//------------------------------------------------------------------------------------------//
+// Timelines
+//------------------------------------------------------------------------------------------//
+
+VkSemaphore createTimelineSemaphore() {
+
+    VkSemaphoreTypeCreateInfo typeInfo{};
+    typeInfo.sType          = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType  = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue   = 0;
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType     = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext     = &typeInfo;
+
+    VkSemaphore semaphore;
+    if (vkCreateSemaphore(context->device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS) anopol_assert("Failed to create timeline semaphore");
+
+    return semaphore;
+}
+
+bool uploadComplete(uploadToken token) {
+
+    if (token <= completedUploads) return true;
+
+    uint64_t value = 0;
+    vkGetSemaphoreCounterValue(context->device, uploadTimeline, &value);
+    completedUploads = std::max(completedUploads, value);
+
+    return token <= value;
+}
+
+void waitUpload(uploadToken token) {
+
+    if (uploadComplete(token)) return;
+
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType          = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores    = &uploadTimeline;
+    waitInfo.pValues        = &token;
+
+    vkWaitSemaphores(context->device, &waitInfo, UINT64_MAX);
+    completedUploads = std::max(completedUploads, token);
+}
+
+// The token everything recorded so far will complete with, including the batch still being recorded
+uploadToken lastUploadToken() {
+
+    std::lock_guard<std::recursive_mutex> lock(stagingMutex);
+    return stagingFrames[stagingFrameIndex].recorder.Empty() ? uploadSerial : uploadSerial + 1;
+}
+
+// Graphics submits signal this so uploads never overwrite data a submitted frame is still reading
+uint64_t nextGraphicsTimelineValue() {
+
+    std::lock_guard<std::recursive_mutex> lock(stagingMutex);
+    return ++graphicsSerial;
+}
+
+bool graphicsComplete(uint64_t value) {
+
+    if (value <= completedGraphics) return true;
+
+    uint64_t completed = 0;
+    vkGetSemaphoreCounterValue(context->device, graphicsTimeline, &completed);
+    completedGraphics = std::max(completedGraphics, completed);
+
+    return value <= completed;
+}
+
+// Called while recording a frame, for every buffer it reads or writes that uploads may copy
+// to or from; the frame is the one the next nextGraphicsTimelineValue() is handed to
+void markGraphicsUse(VkBuffer buffer) {
+
+    if (buffer == VK_NULL_HANDLE) return;
+
+    std::lock_guard<std::recursive_mutex> lock(stagingMutex);
+    bufferUses[buffer] = graphicsSerial + 1;
+}
+
+//------------------------------------------------------------------------------------------//
+// Ring
+//------------------------------------------------------------------------------------------//
+
+void initializeStaging() {
+
+    uploadTimeline      = createTimelineSemaphore();
+    graphicsTimeline    = createTimelineSemaphore();
+
+    for (stagingFrame& frame : stagingFrames) {
+
+        createBuffer(anopol_staging_ring_size,
+                     VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                     frame.buffer, frame.memory);
+
+        VkCommandBufferAllocateInfo allocationInfo{};
+        allocationInfo.sType                = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocationInfo.level                = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocationInfo.commandPool          = transferCommandPool;
+        allocationInfo.commandBufferCount   = 1;
+
+        if (vkAllocateCommandBuffers(context->device, &allocationInfo, &frame.commandBuffer) != VK_SUCCESS) anopol_assert("Failed to allocate upload command buffer");
+    }
+    stagingFrameIndex = 0;
+}
+
+void freeRetiredBuffers(std::vector<retiredBuffer>& retired) {
+
+    for (retiredBuffer& buffer : retired) {
+        if (graphicsComplete(buffer.graphicsValue)) freeBuffer(buffer.buffer, buffer.memory);
+        else                                        deferredRetired.push_back(buffer);
+    }
+    retired.clear();
+}
+
+void recycleStagingFrame(stagingFrame& frame) {
+
+    waitUpload(frame.token);
+
+    std::vector<retiredBuffer> deferred;
+    deferred.swap(deferredRetired);
+    freeRetiredBuffers(deferred);
+    freeRetiredBuffers(frame.retired);
+
+    frame.head = 0;
+}
+
+// Callers hold stagingMutex while adding to the recorder
+CommandRecorder& uploadRecorder() {
+
+    std::lock_guard<std::recursive_mutex> lock(stagingMutex);
+    return stagingFrames[stagingFrameIndex].recorder;
+}
+
+uploadToken submitUploads(bool wait = false) {
+
+    anopol_zone("submitUploads");
+    std::lock_guard<std::recursive_mutex> lock(stagingMutex);
+    stagingFrame& frame = stagingFrames[stagingFrameIndex];
+
+    if (frame.recorder.Empty() && frame.retired.empty()) return uploadSerial;
+
+    frame.token = ++uploadSerial;
+
+    // Only submitted frames still using a buffer this batch copies to or from are waited on.
+    // The frame being recorded is left out: it may itself wait on this batch
+    uint64_t graphicsWait = 0;
+    frame.recorder.ForEachBufferCopy([&](VkBuffer source, VkBuffer destination) {
+        for (VkBuffer buffer : {source, destination}) {
+            auto use = bufferUses.find(buffer);
+            if (use != bufferUses.end()) graphicsWait = std::max(graphicsWait, use->second);
+        }
+    });
+    graphicsWait = std::min(graphicsWait, graphicsSerial);
+    bool waitGraphics = graphicsWait > 0 && !graphicsComplete(graphicsWait);
+
+    // Uses by completed frames no longer matter
+    for (auto use = bufferUses.begin(); use != bufferUses.end();) {
+        if (use->second <= completedGraphics) use = bufferUses.erase(use);
+        else                                  use++;
+    }
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType                      = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount    = waitGraphics ? 1 : 0;
+    timelineInfo.pWaitSemaphoreValues       = &graphicsWait;
+    timelineInfo.signalSemaphoreValueCount  = 1;
+    timelineInfo.pSignalSemaphoreValues     = &frame.token;
+
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+    VkSubmitInfo submit{};
+    submit.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit.pNext                = &timelineInfo;
+    submit.waitSemaphoreCount   = waitGraphics ? 1 : 0;
+    submit.pWaitSemaphores      = &graphicsTimeline;
+    submit.pWaitDstStageMask    = &waitStage;
+    submit.signalSemaphoreCount = 1;
+    submit.pSignalSemaphores    = &uploadTimeline;
+
+    if (!frame.recorder.Empty()) {
+
+        VkCommandBufferBeginInfo begin{};
+        begin.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        vkResetCommandBuffer(frame.commandBuffer, 0);
+        vkBeginCommandBuffer(frame.commandBuffer, &begin);
+
+        // Orders this batch's writes after the previous batch's writes to the same buffers
+        VkMemoryBarrier barrier{};
+        barrier.sType           = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask   = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask   = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+        vkCmdPipelineBarrier(frame.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+        frame.recorder.Record(frame.commandBuffer);
+        vkEndCommandBuffer(frame.commandBuffer);
+
+        submit.commandBufferCount   = 1;
+        submit.pCommandBuffers      = &frame.commandBuffer;
+    }
+
+    {
+        std::lock_guard<std::mutex> queueLock(hasDedicatedTransferQueue() ? context->transferQueueMutex : context->graphicsQueueMutex);
+        if (vkQueueSubmit(context->transferQueue, 1, &submit, VK_NULL_HANDLE) != VK_SUCCESS) anopol_assert("Failed to submit uploads");
+    }
+
+    uploadToken token = frame.token;
+    if (wait) waitUpload(token);
+
+    stagingFrameIndex = (stagingFrameIndex + 1) % anopol_max_frames;
+    recycleStagingFrame(stagingFrames[stagingFrameIndex]);
+
+    return token;
+}
+
+stagingRange reserveStaging(VkDeviceSize size, VkDeviceSize alignment = 16) {
+
+    std::lock_guard<std::recursive_mutex> lock(stagingMutex);
+    stagedBytes += size;
+
+    // Larger than the whole ring: a one-off buffer that lives until this frame is recycled
+    if (size > anopol_staging_ring_size) {
+
+        retiredBuffer oversized{};
+        createBuffer(size,
+                     VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                     oversized.buffer, oversized.memory);
+
+        stagingFrames[stagingFrameIndex].retired.push_back(oversized);
+        return stagingRange{oversized.buffer, 0, oversized.memory.mapped};
+    }
+
+    VkDeviceSize offset = alignUp(stagingFrames[stagingFrameIndex].head, alignment);
+
+    // Out of space: push what has been recorded so far and continue in the next frame's ring
+    if (offset + size > anopol_staging_ring_size) {
+        submitUploads();
+        offset = 0;
+    }
+
+    stagingFrame& frame = stagingFrames[stagingFrameIndex];
+    frame.head = offset + size;
+
+    return stagingRange{frame.buffer, offset, static_cast<char*>(frame.memory.mapped) + offset};
+}
+
+uploadToken stageBuffer(const void* data, VkDeviceSize size, VkBuffer destination, VkDeviceSize destinationOffset = 0) {
+
+    std::lock_guard<std::recursive_mutex> lock(stagingMutex);
+
+    if (size == 0) return lastUploadToken();
+
+    stagingRange range = reserveStaging(size);
+    memcpy(range.mapped, data, static_cast<size_t>(size));
+
+    uploadRecorder().CopyBuffer(range.buffer, destination, size, range.offset, destinationOffset);
+
+    return lastUploadToken();
+}
+
+void retireBuffer(VkBuffer& buffer, allocation& memory) {
+
+    std::lock_guard<std::recursive_mutex> lock(stagingMutex);
+
+    // Destroyed once the current batch has completed, and the frame being recorded, which may
+    // still have used the buffer, has too
+    stagingFrames[stagingFrameIndex].retired.push_back({buffer, memory, graphicsSerial + 1});
+
+    buffer = VK_NULL_HANDLE;
+    memory = allocation();
+}
+
+void destroyStaging() {
+
+    std::lock_guard<std::recursive_mutex> lock(stagingMutex);
+
+    // The device is idle by now, so nothing retired is still in use
+    for (stagingFrame& frame : stagingFrames) {
+        frame.recorder.Clear();
+        waitUpload(frame.token);
+
+        for (retiredBuffer& retired : frame.retired) freeBuffer(retired.buffer, retired.memory);
+        frame.retired.clear();
+
+        freeBuffer(frame.buffer, frame.memory);
+        vkFreeCommandBuffers(context->device, transferCommandPool, 1, &frame.commandBuffer);
+    }
+    for (retiredBuffer& retired : deferredRetired) freeBuffer(retired.buffer, retired.memory);
+    deferredRetired.clear();
+    bufferUses.clear();
+
+    vkDestroySemaphore(context->device, uploadTimeline, nullptr);
+    vkDestroySemaphore(context->device, graphicsTimeline, nullptr);
+}
+
+}
+
+#endif /* staging_h */
@@ -8,8 +8,35 @@
 #include "anopol.h"
 
 int main(int argc, const char * argv[]) {
+
+    //------------------------------------------------------------------------------------------//
+    // --headless [--frames N] [--duration S] [--width W] [--height H] [--trace file.json] [--zones file.json]
+    // [--shaders folder] [--assets folder]
+    //------------------------------------------------------------------------------------------//
+
+    anopol::runSettings settings{};
+
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if      (argument == "--headless")              settings.headless   = true;
+        else if (argument == "--frames" && hasValue)    settings.frameCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (argument == "--duration" && hasValue)  settings.duration   = std::stod(argv[++i]);
+        else if (argument == "--width" && hasValue)     settings.width      = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (argument == "--height" && hasValue)    settings.height     = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (argument == "--trace" && hasValue)     settings.tracePath  = argv[++i];
+        else if (argument == "--zones" && hasValue)     settings.zoneTracePath = argv[++i];
+        else if (argument == "--shaders" && hasValue)   settings.shaderFolder  = argv[++i];
+        else if (argument == "--assets" && hasValue)    settings.assetFolder   = argv[++i];
+    }
     
-    if (!glfwInit()) return -1;
-    
-    anopol::initialize();
+    anopol::resolveResourceFolders(settings, argv[0]);
+
+    // A headless run always ends on its own
+    if (settings.headless && settings.frameCount == 0 && settings.duration <= 0.0) settings.frameCount = 1000;
+
+    if (!settings.headless && !glfwInit()) return -1;
+
+    anopol::initialize(settings);
 }
@@ -1,4 +1,5 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout (location = 0) out vec4 fragc;
 
@@ -8,6 +9,7 @@ layout (location = 2) in vec3 fragp;
 layout (location = 3) in float time;
 layout (location = 4) in vec2 uv;
 layout (location = 5) in vec3 cameraPosition;
+layout (location = 6) flat in uint material;
 
 
 struct anopolStandardPushConstants {
@@ -24,10 +26,19 @@ layout (push_constant) uniform PushConstant {
     anopolStandardPushConstants object;
 } pushConstants;
 
-layout(set = 1, binding = 0) uniform sampler2D baseTextures[8];
-//layout(set = 1, binding = 1) uniform sampler2D metallic;
-//layout(set = 1, binding = 2) uniform sampler2D roughness;
-//layout(set = 1, binding = 3) uniform sampler2D normalMap;
+struct anopolMaterial {
+    uint albedoIndex;
+    uint metallicIndex;
+    uint roughnessIndex;
+    uint normalIndex;
+    vec4 baseColor;
+};
+
+// The texture table: every registered texture, and the materials indexing into it
+layout(set = 1, binding = 0) uniform sampler2D baseTextures[];
+layout(std430, set = 1, binding = 1) readonly buffer Materials {
+    anopolMaterial materials[];
+};
 
 layout (std140, binding = 2) uniform anopolStandardUniform {
     mat4 projection;
@@ -148,7 +159,9 @@ void main() {
 
     vec3 lightDirection = normalize(lightPosition - fragp);
 
-    vec4 _albedo = textureLod(baseTextures[0], uv * 2, lod) * vec4(color, 1.0);
+    // Neighbouring fragments can belong to different objects of the same draw
+    anopolMaterial m = materials[material];
+    vec4 _albedo = textureLod(baseTextures[nonuniformEXT(m.albedoIndex)], uv * 2, lod) * vec4(color, 1.0) * m.baseColor;
     vec3 albedo = _albedo.rgb;
 
     if (pushConstants.object.physicallyBasedRendering == 0 && distance(cameraPosition, fragp) < 100) {
@@ -44,14 +44,50 @@ layout(std140, binding = 3) readonly buffer BatchingTransformation {
     batchingTransformation batch[];
 };
 
+// Instances of one batched mesh are contiguous; this maps each to its transform
+layout(std430, binding = 5) readonly buffer BatchInstances {
+    uint batchInstances[];
+};
+
+#ifdef ANOPOL_COMPACT_VERTICES
+
+// Per-mesh bounds the positions were quantized in, see src/core/buffer/quantization_table.h
+struct meshQuantization {
+    vec4 center;
+    vec4 extent;
+};
+
+layout(std430, set = 2, binding = 0) readonly buffer Quantization {
+    meshQuantization quantization[];
+};
+
+layout (location = 0) in ivec4 inPosition;      // xyz as fractions of the mesh's bounds, w its slot
+layout (location = 1) in vec2 inOctahedral;
+layout (location = 2) in vec2 UV;
+
+vec3 inVertex;
+vec3 inNormal;
+
+vec3 octahedralDecode(vec2 encoded) {
+    vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+#else
+
 layout (location = 0) in vec3 inVertex;
 layout (location = 1) in vec3 inNormal;
 layout (location = 2) in vec2 UV;
 
+#endif
+
 layout(location = 3) in vec4 instance_model0;
 layout(location = 4) in vec4 instance_model1;
 layout(location = 5) in vec4 instance_model2;
 layout(location = 6) in vec4 instance_model3;
+layout(location = 7) in vec4 instance_color;
 
 layout (location = 0) out vec3 frag;
 layout (location = 1) out vec3 normal;
@@ -60,13 +96,21 @@ layout (location = 3) out float time;
 
 layout (location = 4) out vec2 uv;
 layout (location = 5) out vec3 cameraPosition;
+layout (location = 6) flat out uint material;    // Carried in color.w by the batch and the instances
 
 void main() {
     
+#ifdef ANOPOL_COMPACT_VERTICES
+    meshQuantization bounds = quantization[uint(inPosition.w) & 0xFFFFu];
+    inVertex = bounds.center.xyz + max(vec3(inPosition.xyz) / 32767.0, -1.0) * bounds.extent.xyz;
+    inNormal = octahedralDecode(inOctahedral);
+#endif
+    
     time    = ubo.t/2;
     frag    = vec3(1.0);
     uv      = UV;
     cameraPosition = ubo.cameraPosition;
+    material = 0;
     
     if (pushConstants.object.instanced == 0 && pushConstants.object.batched == 0) {
         gl_Position = ubo.projection * ubo.lookAt * pushConstants.object.model * vec4(inVertex, 1.0);
@@ -77,7 +121,7 @@ void main() {
 
     if (pushConstants.object.batched == 1 && pushConstants.object.instanced == 0) {
 
-        batchingTransformation currentBatch = batch[gl_InstanceIndex];
+        batchingTransformation currentBatch = batch[batchInstances[gl_InstanceIndex]];
         mat4 model = currentBatch.model;
         vec3 color = currentBatch.color.rgb;
 
@@ -85,6 +129,7 @@ void main() {
         normal  = normalize(transpose(inverse(mat3(model))) * inNormal);
         fragp   = (model * vec4(inVertex, 1.0)).xyz;
         frag    = color;
+        material = uint(currentBatch.color.a);
         return;
     }
 
@@ -93,7 +138,8 @@ void main() {
         gl_Position = ubo.projection * ubo.lookAt * m * vec4(inVertex, 1.0);
         normal  = normalize(transpose(inverse(mat3(m))) * inNormal);
         fragp   = (m * vec4(inVertex, 1.0)).xyz;
-        frag    = properties[gl_InstanceIndex].color.rgb;
+        frag    = instance_color.rgb;     // Culled instances are compacted, so gl_InstanceIndex no longer indexes properties
+        material = uint(instance_color.a);
         return;
     }
 }
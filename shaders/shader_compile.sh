@@ -1,2 +1,15 @@
+#!/bin/sh
+# Compiles every shader in main/ into main/spirv/. Rerun after editing any GLSL source and
+# commit the binaries with it: Pipeline::CreatePipeline rejects binaries missing bindings
+# the sources declare.
+set -e
+cd "$(dirname "$0")"
+mkdir -p main/spirv
+
 glslc main/shader.vert -o main/spirv/vert.spv
-glslc main/shader.frag -o main/spirv/frag.spv
\ No newline at end of file
+glslc main/shader.frag -o main/spirv/frag.spv
+glslc main/batch_cull.comp -o main/spirv/cull.spv
+glslc main/hiz_downsample.comp -o main/spirv/hiz.spv
+glslc main/transform_scatter.comp -o main/spirv/scatter.spv
+glslc main/batch_merge.comp -o main/spirv/merge.spv
+glslc -DANOPOL_COMPACT_VERTICES main/shader.vert -o main/spirv/vert_compact.spv
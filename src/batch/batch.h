@@ -11,77 +11,201 @@
 #define max_batch_draw_indirect_size static_cast<int>(2*2*2*2*2*2*2*2*2*2*2*2*2*2*2*2*2)      // 2^18 = 262144
 #define max_batch_indirect_transform_size static_cast<int>(2*2*2*2*2*2*2*2*2*2*2*2*2*2*2*2*2) // 2^18 = 262144
 
+#define anopol_batch_compaction_budget  (4 * 1024 * 1024)   // Bytes of geometry copied per Compact call
+#define anopol_batch_compaction_minimum (1024 * 1024)       // Bytes of holes before compaction starts
+
 namespace anopol::batch {
 
 class Batch {
 public:
     
+    // Spatial chunk: the objects of one grid cell, up to MAX_SUB_BATCH_VERTEX_COUNT unique vertices,
+    // with its own geometry and commands. A cell that outgrows it opens another chunk
     struct SubBatch {
-        std::vector<anopol::render::Vertex> vertices;
-        std::vector<uint32_t>               indices;
-        std::vector<batchDrawInformation>   drawInformation;
-
-        anopol::render::VertexBuffer        vertexBuffer;
-        anopol::render::IndexBuffer         indexBuffer;
-
-        VkBuffer                            drawCommandBuffer = VK_NULL_HANDLE;
-        VkDeviceMemory                      drawCommandBufferMemory = VK_NULL_HANDLE;
-        VkDeviceSize                        drawCommandBufferSize = 0;
-
-        VkCommandBuffer                     commandBuffer;
+        glm::ivec3                          cell;
+        glm::vec3                           boundsMin, boundsMax;   // Around its objects' world spheres
+        
+        std::vector<uint32_t>               meshes;                 // Batch mesh per local mesh
+        std::vector<std::vector<uint32_t>>  meshObjects;            // Transforms per local mesh
+        uint32_t                            vertexCount = 0;
+        uint32_t                            objectCount = 0;
+        
+        anopol::ll::GrowableBuffer          vertexBuffer;
+        anopol::ll::GrowableBuffer          indexBuffer;
+        anopol::ll::GrowableBuffer          drawCommandBuffer;
+        anopol::ll::GrowableBuffer          indexedDrawCommandBuffer;
+        uint32_t                            drawCount = 0;
+        uint32_t                            indexedDrawCount = 0;
+        
+        // Range of instanceIndirectionBuffer this chunk's commands index into
+        uint32_t                            instanceBase = 0;
+        uint32_t                            instanceCapacity = 0;
+        
+        bool                                dirty = false;          // Rebuilt by the next pr_RebuildChunks
     };
     
     struct batchFrame {
-        VkBuffer        drawCommandBuffer;
-        VkDeviceMemory  drawCommandBufferMemory;
-        VkDeviceSize    drawCommandBufferSize = 0;
-
-        VkBuffer        transformBuffer;
-        VkDeviceMemory  transformBufferMemory;
+        anopol::ll::GrowableBuffer  drawCommandBuffer;          // VkDrawIndirectCommand
+        anopol::ll::GrowableBuffer  indexedDrawCommandBuffer;   // VkDrawIndexedIndirectCommand
+        anopol::ll::GrowableBuffer  lateDrawCommandBuffer;      // Written by the late cull, with occlusion culling
+        anopol::ll::GrowableBuffer  lateIndexedDrawCommandBuffer;
+        uint32_t                    drawCount = 0;
+        uint32_t                    indexedDrawCount = 0;
+
+        VkBuffer                transformBuffer = VK_NULL_HANDLE;
+        anopol::ll::allocation  transformBufferMemory{};
         VkDeviceSize    transformBufferSize = 0;
 
         bool            allocatedTransformations = false;
-        bool            allocatedDrawCommands = false;
         bool            empty = true;
         uint32_t        idx;
+        
+        // Transforms already in this frame's buffer; Combine only appends after them
+        size_t          uploadedTransformCount = 0;
+        
+        // GPU culling: visible instances of this frame, grouped by mesh like instanceIndirection
+        VkBuffer                visibleInstanceBuffer = VK_NULL_HANDLE;
+        anopol::ll::allocation  visibleInstanceBufferMemory{};
+        
+        // Objects whose latest transform this frame's buffer is still missing, and the
+        // persistently mapped transformScatterEntry list DynamicUpload writes them through
+        std::vector<uint32_t>   dirtyTransforms;
+        VkBuffer                scatterBuffer = VK_NULL_HANDLE;
+        anopol::ll::allocation  scatterBufferMemory{};
+        VkDeviceSize            scatterBufferSize = 0;
     };
     
-    std::vector<anopol::render::Vertex> batchVertices;
+    std::vector<anopol::render::gpuVertex> batchVertices;  // CPU copy of the merged geometry, empty with the GPU merge
     std::vector<uint32_t> batchIndices;
     std::vector<batchDrawInformation> drawInformation;
     std::vector<batchIndirectTransformation> transformations;
+    std::vector<uint32_t> instanceIndirection;      // Transform index per instance, grouped by mesh
+    std::vector<uint32_t> objectMeshes;             // Mesh index per transform
+    std::vector<glm::vec4> meshSpheres;             // Local bounding sphere per mesh
+    std::vector<uint32_t> meshQuantizations;        // quantizationTable slot per mesh, UINT32_MAX once released
+    boundingSpheres worldSpheres;                   // World bounding sphere per transform, for CPU culling
     
-    anopol::render::VertexBuffer vertexBuffer;
-    anopol::render::IndexBuffer indexBuffer;
+    anopol::ll::GrowableBuffer vertexBuffer;
+    anopol::ll::GrowableBuffer indexBuffer;
     MeshCombineGroup meshCombineGroup;
     
-    std::vector<VkCommandBuffer> batchCommandBuffers;
+    VkBuffer instanceIndirectionBuffer = VK_NULL_HANDLE;
+    anopol::ll::allocation instanceIndirectionBufferMemory{};
+    
     std::vector<SubBatch> subBatches;
     std::vector<VkFence> fences;
+    
+    // Filled by Renderable::MarkTransformDirty; shared so it survives copies of the batch
+    std::shared_ptr<std::vector<uint32_t>> dirtyObjects;
+    
+    anopol::ll::uploadToken pendingUpload = 0;
+    
+    uint32_t combineThreads = 0;                    // Combine's worker count; 0 uses every hardware thread, 1 is serial
+    bool optimizeMeshes = true;                     // Weld and reorder new geometry before it is placed, see mesh_optimize.h
+    anopol::render::meshOptimization optimization;  // Every mesh placed so far, before and after
 
     static Batch Create();
     void Append(anopol::render::Renderable* renderable);
     void Append(anopol::render::Asset* asset);
     void Append(std::vector<anopol::render::Renderable*> renderables);
     void Append(std::vector<anopol::render::Asset*> assets);
+    batchHandle Handle(const anopol::render::Renderable* renderable) const;
+    bool Valid(batchHandle handle) const;
+    void Remove(batchHandle handle);
+    void Remove(anopol::render::Renderable* renderable);
+    void Compact(VkDeviceSize budget = anopol_batch_compaction_budget);
+    bool Compacting() const { return compaction.active; }
+    size_t LiveObjects() const { return liveObjects; }
+    VkDeviceSize GeometryBytes() const;                 // Vertex and index heaps, holes included
     void Dealloc();
     void Combine(int currentFrame);
     void UpdateTransforms(batchFrame& frame, uint32_t idx);
-    void Cull();
-    void Render(VkPipelineLayout pipelineLayout, VkCommandBuffer commandBuffer, VkRenderPass renderPass, VkFramebuffer framebuffer, uint32_t currentFrame);
+    void EnableGpuCulling(VkShaderModule shader);
+    void EnableCpuCulling();
+    void EnableChunking(float cellSize);
+    bool Chunking() const { return chunkSize > 0.0f; }
+    void EnableGpuMerge(VkShaderModule shader);
+    bool GpuMerging() const { return merger.Enabled(); }
+    void Merge(VkCommandBuffer commandBuffer, uint32_t currentFrame);
+    void UpdateObject(uint32_t object);
+    uint32_t PrepareDynamicUpload(uint32_t currentFrame);
+    bool GpuCulling() const { return culler.Enabled(); }
+    bool OcclusionCulling() const { return culler.Occlusion(); }
+    void Cull(VkCommandBuffer commandBuffer, uint32_t currentFrame, const anopol::camera::Camera& camera);
+    void CullLate(VkCommandBuffer commandBuffer, uint32_t currentFrame);
+    void Render(anopol::ll::ParallelRecorder& recorder, VkPipelineLayout pipelineLayout, uint32_t currentFrame);
+    void RenderLate(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t currentFrame);
     batchFrame& GetBatchFrame(int frame);
-    VkCommandBuffer GetSecondaryCommandBuffer(int frame);
+    VkBuffer InstanceBuffer(uint32_t frame) const;
+    VkBuffer DrawCountBuffer(uint32_t frame) const;     // VK_NULL_HANDLE unless GPU culling
+    void MarkGraphicsUse(uint32_t currentFrame) const;  // Buffers this frame uses, so uploads wait for it
     
 private:
     batchFrame frames[anopol_max_frames];
-    bool    vertexBufferAllocated, indexBufferAllocated, framesAllocated, commandBuffersInitialized = false;
+    bool    framesAllocated, commandBuffersInitialized = false;
     bool    everyObjectCulled = false;
-    int     processed;
-    size_t  uploadedTransformCount = 0;
+    uint32_t drawMeshCount = 0, indexedDrawMeshCount = 0;
+    GpuCuller culler;
+    bool    cpuCulling = false;
+    GpuMerger merger;
+    bool    mergeRecorded = false;                  // By this frame, so Compact leaves the buffers alone until it ran
+    VkDeviceSize mergeVertexBytes = 0, mergeIndexBytes = 0;    // What the queued merge needs, grown to by Merge()
+    uint8_t withheldDrawFrames = 0;                 // Bit per frame whose draw commands left out meshes still to be merged
+    std::vector<uint8_t>  visibilityMasks;         // Reused by the CPU cull every frame
+    std::vector<uint32_t> visibleInstances;
+    float   chunkSize = 0.0f;                       // Grid cell edge; 0 keeps the batch in one piece
+    uint32_t instanceRangeEnd = 0;                  // End of the last chunk instance range handed out
+    std::unordered_map<uint64_t, std::vector<uint32_t>> cellChunks;     // Chunks per packed cell
+    std::vector<uint32_t> objectChunks;             // Chunk per transform
+    std::vector<uint32_t> visibleChunks;            // Written by Cull, drawn by Render
+    std::vector<uint8_t>  objectDirtyFrames;        // Bit per frame whose dirtyTransforms holds the object
+    
+    // Removal: released transform slots are refilled by Append, released geometry by new meshes
+    BatchHeap vertexHeap, indexHeap;                // Over vertexBuffer / indexBuffer and their CPU copies
+    std::vector<uint32_t> objectGenerations;        // Bumped by Remove, per transform
+    std::vector<uint32_t> objectPositions;          // Index into its mesh's objects
+    uint32_t pendingInstanceMesh = UINT32_MAX;      // Lowest mesh that lost objects since the last Combine
+    size_t   liveObjects = 0;
+    
+    struct batchCompaction {
+        bool                        active = false;
+        anopol::ll::GrowableBuffer  vertexBuffer, indexBuffer;     // Replace the batch's when done
+        uint32_t                    cursor = 0;                     // Next mesh to copy
+        uint32_t                    vertexEnd = 0, indexEnd = 0;
+        std::vector<uint32_t>       firstVertex, firstIndex;        // New placement per mesh, UINT32_MAX until copied
+        std::vector<batchRange>     abandonedVertices, abandonedIndices;    // Copied, then released
+    } compaction;
+    
     void pr_AllocateFrame(int frameidx);
+    void pr_WriteDrawCommands(batchFrame& frame);
+    void pr_QueueTransform(uint32_t object);
+    void pr_PlaceMeshes(const std::vector<uint32_t>& createdMeshes, uint32_t threads);
+    void pr_ReleaseMesh(uint32_t mesh);
+    void pr_BeginCompaction();
+    VkDeviceSize pr_CompactMesh(uint32_t mesh);
+    bool pr_CompactStep(VkDeviceSize budget);
+    void pr_FinishCompaction();
+    void pr_UpdateInstances(uint32_t firstChangedMesh);
+    void pr_UpdateCullMeshes();
+    void pr_CreateVisibleInstanceBuffers();
+    void pr_CullOnCpu(batchFrame& frame, const anopol::camera::Camera& camera);
+    glm::ivec3 pr_ChunkCell(uint32_t object) const;
+    uint32_t pr_CreateChunk(const glm::ivec3& cell);
+    void pr_AssignChunk(uint32_t object);
+    void pr_DetachFromChunk(uint32_t object);
+    void pr_UpdateChunkBounds(SubBatch& chunk);
+    void pr_RepackInstanceRanges();
+    void pr_RebuildChunk(SubBatch& chunk);
+    void pr_RebuildChunks();
+    void pr_CullChunks(const anopol::camera::Camera& camera);
+    void pr_AppendDrawCommand(const batchDrawInformation& drawInfo, uint32_t firstInstance, uint32_t instanceCount,
+                              std::vector<VkDrawIndirectCommand>& drawCommands, std::vector<VkDrawIndexedIndirectCommand>& indexedDrawCommands);
+    void pr_RecordDraw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, VkBuffer vertices, VkBuffer drawCommands, uint32_t drawCount,
+                       VkBuffer indices = VK_NULL_HANDLE, VkBuffer indexedDrawCommands = VK_NULL_HANDLE, uint32_t indexedDrawCount = 0,
+                       VkBuffer drawCounts = VK_NULL_HANDLE, VkDeviceSize drawCountOffset = anopol_cull_early_counts);
     
     VkBuffer redundantBuffer;
-    VkDeviceMemory redundantBufferMemory;
+    anopol::ll::allocation redundantBufferMemory;
 };
 
 Batch Batch::Create() {
@@ -89,27 +213,26 @@ Batch Batch::Create() {
     Batch batch = Batch();
     
     // ----------------------------------------------------------------------------- //
-    // Create secondary command buffers
+    // Create index and vertex buffers, and the per-frame indirect buffers
     // ----------------------------------------------------------------------------- //
     
-    batch.batchCommandBuffers.resize(anopol_max_frames);
+    batch.vertexBuffer = anopol::ll::GrowableBuffer::Create(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    batch.indexBuffer  = anopol::ll::GrowableBuffer::Create(VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
     
     for (int i = 0; i < anopol_max_frames; i++) {
-        VkCommandBufferAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        allocInfo.commandPool = anopol::ll::commandPool;
-        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
-        allocInfo.commandBufferCount = 1;
-        vkAllocateCommandBuffers(context->device, &allocInfo, &batch.batchCommandBuffers[i]);
+        // Storage as well, the cull pass writes the commands
+        batch.frames[i].drawCommandBuffer        = anopol::ll::GrowableBuffer::Create(VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+        batch.frames[i].indexedDrawCommandBuffer = anopol::ll::GrowableBuffer::Create(VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+        batch.frames[i].lateDrawCommandBuffer        = anopol::ll::GrowableBuffer::Create(VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+        batch.frames[i].lateIndexedDrawCommandBuffer = anopol::ll::GrowableBuffer::Create(VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
     }
     
-    
-    // ----------------------------------------------------------------------------- //
-    // Create index and vertex buffers
-    // ----------------------------------------------------------------------------- //
-    
-    batch.vertexBuffer = anopol::render::VertexBuffer();
-    batch.indexBuffer = anopol::render::IndexBuffer();
+    // Fixed size like the transform buffers, so the descriptor written once stays valid
+    anopol::ll::createBuffer(sizeof(uint32_t) * max_batch_indirect_transform_size,
+                             VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                             batch.instanceIndirectionBuffer,
+                             batch.instanceIndirectionBufferMemory);
     
     
     // ----------------------------------------------------------------------------- //
@@ -117,57 +240,22 @@ Batch Batch::Create() {
     // ----------------------------------------------------------------------------- //
     
     batch.meshCombineGroup = MeshCombineGroup();
-    batch.processed = 0;
+    batch.dirtyObjects = std::make_shared<std::vector<uint32_t>>();
     
     
     // ----------------------------------------------------------------------------- //
     // Create a redundant buffer (for instancing)
     // ----------------------------------------------------------------------------- //
     
-    VkBufferCreateInfo bufferInfo{};
-    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    bufferInfo.size = sizeof(glm::vec4) * 5;
-    bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-    if (vkCreateBuffer(context->device, &bufferInfo, nullptr, &batch.redundantBuffer) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create dummy vertex buffer!");
-    }
-
-    VkMemoryRequirements memRequirements;
-    vkGetBufferMemoryRequirements(context->device, batch.redundantBuffer, &memRequirements);
-
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-
-
-    VkPhysicalDeviceMemoryProperties memProperties;
-    vkGetPhysicalDeviceMemoryProperties(context->physicalDevice, &memProperties);
-
-    bool memTypeFound = false;
-    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-        if ((memRequirements.memoryTypeBits & (1 << i)) &&
-            (memProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) == VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
-            allocInfo.memoryTypeIndex = i;
-            memTypeFound = true;
-            break;
-        }
-    }
-    if (!memTypeFound) {
-        throw std::runtime_error("failed to find suitable memory type for dummy buffer!");
-    }
-
-    if (vkAllocateMemory(context->device, &allocInfo, nullptr, &batch.redundantBufferMemory) != VK_SUCCESS) {
-        throw std::runtime_error("failed to allocate dummy buffer memory!");
-    }
-
-    vkBindBufferMemory(context->device, batch.redundantBuffer, batch.redundantBufferMemory, 0);
-
-    void* data;
-    vkMapMemory(context->device, batch.redundantBufferMemory, 0, bufferInfo.size, 0, &data);
-    memset(data, 0, static_cast<size_t>(bufferInfo.size));
-    vkUnmapMemory(context->device, batch.redundantBufferMemory);
+    VkDeviceSize redundantBufferSize = sizeof(glm::vec4) * 5;
+    
+    anopol::ll::createBuffer(redundantBufferSize,
+                             VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                             batch.redundantBuffer,
+                             batch.redundantBufferMemory);
+    
+    memset(batch.redundantBufferMemory.mapped, 0, static_cast<size_t>(redundantBufferSize));
     
     return batch;
 }
@@ -195,120 +283,171 @@ void Batch::Append(std::vector<anopol::render::Asset*> assets) {
 
 // ----------------------------------------------------------------------------- //
 // Combine all the renderables into 1 vertex buffer
+// Only renderables appended since the last call are processed and uploaded; what is
+// already on the GPU stays where it is. Appends may refill removed objects' transform
+// slots and new geometry the holes removed meshes left, see Remove
 // ----------------------------------------------------------------------------- //
 
 void Batch::Combine(int currentFrame = -1) {
     
+    anopol_zone("Batch::Combine");
+    
+    const std::vector<uint32_t>& pending = meshCombineGroup.pending;
+    std::vector<anopol::render::Renderable*>& renderables = meshCombineGroup.renderables;
+    
+    uint32_t threads = combineThreads == 0 ? std::max(1u, std::thread::hardware_concurrency()) : combineThreads;
+    
+    size_t firstNewObject = objectMeshes.size();
+    uint32_t firstChangedMesh = pendingInstanceMesh;
+    
+    std::vector<uint32_t> combined, dropped, createdMeshes;
+    combined.reserve(pending.size());
+    
     // ----------------------------------------------------------------------------- //
-    // Create VkFence
+    // Every per-object array is sized once. New slots are the ones past the end, and
+    // stay dead entries if they were removed before ever being combined
     // ----------------------------------------------------------------------------- //
     
-    VkFence fence = VK_NULL_HANDLE;
-    VkFenceCreateInfo fenceCreateInfo = {};
-    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    if (vkCreateFence(context->device, &fenceCreateInfo, nullptr, &fence) != VK_SUCCESS) {
-        anopol_assert("Failed to create fence");
-    }
+    size_t objectCount = renderables.size();
     
-    uint32_t vertexOffset = 0, indexOffset = 0, vertexCount = 0;
-    size_t previousProcessed = processed;
-    size_t currentCount = meshCombineGroup.renderables.size();
+    transformations.resize(objectCount, { glm::mat4(0.0f), glm::vec4(0.0f) });
+    objectDirtyFrames.resize(objectCount, 0);
+    objectGenerations.resize(objectCount, 0);
+    objectPositions.resize(objectCount, 0);
+    objectMeshes.resize(objectCount, anopol_cull_removed_object);
+    worldSpheres.Resize(objectCount);
     
-    bool isInFrustum = true;
-    int culledAmount = 0;
+    // ----------------------------------------------------------------------------- //
+    // Transforms and geometry hashes only read their own renderable, so they are
+    // computed on the workers. Everything is kept; visibility is decided per frame by Cull()
+    // ----------------------------------------------------------------------------- //
     
-    anopol::camera::Frustum frustum = anopol::camera::CreateFrustumPlanes(anopol::camera::camera);
-    SubBatch currentSubBatch;
+    std::vector<uint64_t> hashes(pending.size());
+    
+    combineRanges(pending.size(), threads, anopol_combine_objects_per_task, [&](size_t, size_t start, size_t end) {
+        for (size_t k = start; k < end; k++) {
+            
+            uint32_t i = pending[k];
+            const anopol::render::Renderable* renderable = renderables[i];
+            if (renderable == nullptr) continue;
+            
+            glm::mat4 model = anopol::modelMatrix(renderable->position, renderable->scale, renderable->rotation);
+            transformations[i] = { model, glm::vec4(renderable->color, static_cast<float>(renderable->material)) };
+            hashes[k] = hashGeometry(renderable);
+        }
+    });
     
     // ----------------------------------------------------------------------------- //
-    // Go through each non-processed renderable in the meshCombineGroup
+    // Mesh identification and instance lists share state, so they stay in order on
+    // this thread. Geometry already in the batch only gains an instance
     // ----------------------------------------------------------------------------- //
     
-    for (size_t i = previousProcessed; i < currentCount; i++) {
+    for (size_t k = 0; k < pending.size(); k++) {
         
-        anopol::render::Renderable* renderable = meshCombineGroup.renderables[i];
+        uint32_t i = pending[k];
+        anopol::render::Renderable* renderable = renderables[i];
         
-        // Frustum Culling
+        if (renderable == nullptr) {
+            dropped.push_back(i);
+            continue;
+        }
         
-        //float radius = renderable->ComputeBoundingSphereRadius();
-        glm::mat4 model = anopol::modelMatrix(renderable->position, renderable->scale, renderable->rotation);
+        // A refilled slot is already in the frames' transform buffers, DynamicUpload rewrites it
+        if (i < firstNewObject) pr_QueueTransform(i);
         
-        //if (!anopol::camera::isSphereInFrustum(renderable->position, renderable->scale, model, radius, frustum)) {
-            //continue;
-        //}
+        renderable->batchObject       = i;
+        renderable->batchDirtyObjects = dirtyObjects;
+        renderable->transformDirty    = false;
         
-        // Calculate offsets
-        vertexCount = static_cast<uint32_t>(renderable->vertices.size());
+        combined.push_back(i);
+        liveObjects++;
         
-        uint32_t currentVertexOffset = vertexOffset;
-        uint32_t currentIndexOffset = indexOffset;
-
-        batchDrawInformation drawInfo{};
-        transformations.push_back({ model, glm::vec4(renderable->color, 1.0f) });
+        bool created;
+        uint32_t mesh = meshCombineGroup.Identify(renderable, created, hashes[k]);
         
-        // ----------------------------------------------------------------------------- //
-        // Determining if the added model is indexed or not
-        // ----------------------------------------------------------------------------- //
+        std::vector<uint32_t>& objects = meshCombineGroup.meshes[mesh].objects;
+        objectPositions[i] = static_cast<uint32_t>(objects.size());
+        objects.push_back(i);
+        objectMeshes[i] = mesh;
+        firstChangedMesh = std::min(firstChangedMesh, mesh);
         
-        if (!renderable->isIndexed || renderable->indexBuffer.bufferSize == 0) {
-            drawInfo.drawType = nonIndexed;
-            drawInfo.firstVertex = currentVertexOffset;
-            drawInfo.vertexCount = static_cast<uint32_t>(renderable->vertices.size());
-            drawInfo.object = static_cast<uint32_t>(i);
-        }
-        else {
-            drawInfo.drawType = indexed;
-
-            for (uint32_t index : renderable->indices) {
-                batchIndices.push_back(index + currentVertexOffset);
-            }
-
-            drawInfo.firstIndex   = currentIndexOffset;
-            drawInfo.indexCount   = static_cast<uint32_t>(renderable->indices.size());
-            drawInfo.vertexOffset = currentVertexOffset;
-            drawInfo.object       = static_cast<uint32_t>(i);
-
-            indexOffset += static_cast<uint32_t>(renderable->indices.size());
+        if (created) createdMeshes.push_back(mesh);
+    }
+    
+    meshCombineGroup.pending.clear();
+    for (uint32_t slot : dropped) meshCombineGroup.Release(slot);
+    pendingInstanceMesh = UINT32_MAX;
+    
+    // ----------------------------------------------------------------------------- //
+    // New geometry is placed, then copied and bounded on the workers
+    // ----------------------------------------------------------------------------- //
+    
+    pr_PlaceMeshes(createdMeshes, threads);
+    
+    // Local bounding spheres placed by each object's transform when culling
+    combineRanges(combined.size(), threads, anopol_combine_objects_per_task, [&](size_t, size_t start, size_t end) {
+        for (size_t k = start; k < end; k++) {
+            uint32_t object = combined[k];
+            glm::vec4 sphere = worldBoundingSphere(meshSpheres[objectMeshes[object]], transformations[object].model);
+            worldSpheres.Set(object, glm::vec3(sphere), sphere.w);
         }
-        vertexOffset += renderable->vertices.size();
-        
-        drawInformation.push_back(drawInfo);
-        
-#if defined(__APPLE__) && defined(APPLE_USE_METAL_GPU_HELPERS)
-        // to implement metal shader
-        batchVertices.insert(batchVertices.end(), renderable->vertices.begin(), renderable->vertices.end());
-#elif defined(__APPLE__) && defined(APPLE_USE_OPENCL_GPU_HELPERS)
+    });
+    
+    // Span of batchVertices / batchIndices written by new meshes, uploaded in one piece
+    uint32_t vertexBegin = UINT32_MAX, vertexEnd = 0;
+    uint32_t indexBegin  = UINT32_MAX, indexEnd  = 0;
+    
+    for (uint32_t mesh : createdMeshes) {
         
-#else
-        batchVertices.insert(batchVertices.end(), renderable->vertices.begin(), renderable->vertices.end());
-#endif
-    }
+        const batchDrawInformation& placed = drawInformation[mesh];
+        vertexBegin = std::min(vertexBegin, meshFirstVertex(placed));
+        vertexEnd   = std::max(vertexEnd, meshFirstVertex(placed) + placed.vertexCount);
         
-    processed = static_cast<uint32_t>(meshCombineGroup.renderables.size());
-    /*
-    for (anopol::render::Asset* asset : meshCombineGroup.assets) {
-        for (anopol::render::Asset::Mesh mesh : asset->meshes) {
-            batchDrawInformation drawInfo;
-            drawInfo.drawType = indexed;
-            
-            drawInformation.push_back(drawInfo);
-            for (anopol::render::Vertex vertex : mesh.vertices) {
-                batchVertices.push_back(vertex);
-            }
+        if (placed.drawType == indexed) {
+            indexBegin = std::min(indexBegin, placed.firstIndex);
+            indexEnd   = std::max(indexEnd, placed.firstIndex + placed.indexCount);
         }
     }
-     */
     
     //------------------------------------------------------------------------------------------//
     // Allocating Vertex Buffer
     //------------------------------------------------------------------------------------------//
     
-    if (culledAmount == meshCombineGroup.renderables.size()) return;
-    vertexBuffer.alloc(batchVertices);
+    if (meshCombineGroup.renderables.empty()) return;
+    
+    // Chunks copy their geometry out of batchVertices / batchIndices; only the chunks that
+    // gained or lost objects are rebuilt
+    if (Chunking()) {
+        for (uint32_t object : combined) pr_AssignChunk(object);
+        pr_RebuildChunks();
+    }
+    else if (merger.Enabled()) {
+        
+        // Merge() grows the buffers and fills the new ranges on the GPU. Growing here would copy
+        // on the upload queue, ahead of a merge already recorded into this frame
+        if (vertexEnd > vertexBegin) mergeVertexBytes = std::max<VkDeviceSize>(mergeVertexBytes, sizeof(anopol::render::gpuVertex) * vertexEnd);
+        if (indexEnd > indexBegin)   mergeIndexBytes  = std::max<VkDeviceSize>(mergeIndexBytes, sizeof(uint32_t) * indexEnd);
+        
+        if (firstChangedMesh != UINT32_MAX) pr_UpdateInstances(firstChangedMesh);
+    }
+    else {
+        if (vertexEnd > vertexBegin) {
+            vertexBuffer.Write(sizeof(anopol::render::gpuVertex) * vertexBegin, batchVertices.data() + vertexBegin,
+                               sizeof(anopol::render::gpuVertex) * (vertexEnd - vertexBegin));
+        }
+        if (indexEnd > indexBegin) {
+            indexBuffer.Write(sizeof(uint32_t) * indexBegin, batchIndices.data() + indexBegin, sizeof(uint32_t) * (indexEnd - indexBegin));
+        }
+        
+        if (firstChangedMesh != UINT32_MAX) pr_UpdateInstances(firstChangedMesh);
+    }
     
-    if (batchIndices.size() > 0 && !indexBufferAllocated) {
-        indexBuffer.alloc(batchIndices);
-        indexBufferAllocated = true;
+    if (culler.Enabled()) {
+        culler.AppendObjects(objectMeshes.data() + firstNewObject, objectMeshes.size() - firstNewObject);
+        for (uint32_t object : combined) {
+            if (object < firstNewObject) culler.SetObjectMesh(object, objectMeshes[object]);
+        }
+        if (firstChangedMesh != UINT32_MAX) pr_UpdateCullMeshes();
     }
     
     if (currentFrame == -1) {
@@ -320,21 +459,242 @@ void Batch::Combine(int currentFrame = -1) {
         pr_AllocateFrame(currentFrame);
     }
     
-    //------------------------------------------------------------------------------------------//
-    // Submitting VkFence
-    //------------------------------------------------------------------------------------------//
+    // Copies are recorded into the staging ring and go out with the next submitUploads()
+    pendingUpload = anopol::ll::lastUploadToken();
+}
+
+// Places new meshes' geometry. Without holes in the heaps every mesh goes past the end, at
+// the prefix sum of the counts of the meshes before it; otherwise each takes the first hole
+// that fits. Indices stay local to the mesh; the command's vertexOffset rebases them
+void Batch::pr_PlaceMeshes(const std::vector<uint32_t>& createdMeshes, uint32_t threads) {
+    
+    if (createdMeshes.empty()) return;
+    
+    anopol_zone("Batch::pr_PlaceMeshes");
+    
+    const std::vector<MeshCombineGroup::sharedMesh>& meshes = meshCombineGroup.meshes;
+    
+    // ----------------------------------------------------------------------------- //
+    // What is placed is a copy of the source's geometry, optimized on the workers; the
+    // renderable keeps its own, so later renderables still match it in Identify
+    // ----------------------------------------------------------------------------- //
+    
+    struct placedGeometry {
+        std::vector<anopol::render::Vertex> vertices;
+        std::vector<uint32_t>               indices;    // Empty for non-indexed geometry
+    };
+    
+    std::vector<placedGeometry> geometries(createdMeshes.size());
+    std::vector<anopol::render::meshOptimization> optimizations(createdMeshes.size());
+    
+    combineRanges(createdMeshes.size(), threads, anopol_combine_meshes_per_task, [&](size_t, size_t start, size_t end) {
+        for (size_t m = start; m < end; m++) {
+            
+            const anopol::render::Renderable* source = meshes[createdMeshes[m]].source;
+            placedGeometry& geometry = geometries[m];
+            
+            geometry.vertices = source->vertices;
+            if (isIndexedGeometry(source)) geometry.indices = source->indices;
+            
+            if (optimizeMeshes) optimizations[m] = anopol::render::optimizeMesh(geometry.vertices, geometry.indices);
+        }
+    });
+    
+    for (const anopol::render::meshOptimization& result : optimizations) optimization.Add(result);
+    
+    auto vertexCount = [&](size_t m) -> uint64_t {
+        return geometries[m].vertices.size();
+    };
+    auto indexCount = [&](size_t m) -> uint64_t {
+        return geometries[m].indices.size();
+    };
+    
+    std::vector<uint64_t> firstVertices, firstIndices;
+    
+    if (vertexHeap.FreeCount() == 0 && indexHeap.FreeCount() == 0) {
+        
+        uint64_t vertices = combineExclusiveScan(createdMeshes.size(), threads, anopol_combine_objects_per_task, vertexCount, firstVertices);
+        uint64_t indices  = combineExclusiveScan(createdMeshes.size(), threads, anopol_combine_objects_per_task, indexCount, firstIndices);
+        
+        if (vertexHeap.End() + vertices > UINT32_MAX || indexHeap.End() + indices > UINT32_MAX) anopol_assert("Batch geometry does not fit 32-bit offsets");
+        
+        uint64_t vertexBase = vertexHeap.Allocate(static_cast<uint32_t>(vertices));
+        uint64_t indexBase  = indexHeap.Allocate(static_cast<uint32_t>(indices));
+        
+        for (uint64_t& first : firstVertices) first += vertexBase;
+        for (uint64_t& first : firstIndices)  first += indexBase;
+    }
+    else {
+        firstVertices.resize(createdMeshes.size());
+        firstIndices.resize(createdMeshes.size());
+        
+        for (size_t m = 0; m < createdMeshes.size(); m++) {
+            firstVertices[m] = vertexHeap.Allocate(static_cast<uint32_t>(vertexCount(m)));
+            firstIndices[m]  = indexHeap.Allocate(static_cast<uint32_t>(indexCount(m)));
+        }
+    }
+    
+    // ----------------------------------------------------------------------------- //
+    // Determining if the added model is indexed or not
+    // ----------------------------------------------------------------------------- //
+    
+    if (meshSpheres.size() < meshes.size())       meshSpheres.resize(meshes.size());
+    if (meshQuantizations.size() < meshes.size()) meshQuantizations.resize(meshes.size(), UINT32_MAX);
     
-    vkResetFences(context->device, 1, &fence);
+    std::vector<anopol::render::meshQuantization> quantizations(createdMeshes.size());
     
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    vkQueueSubmit(context->graphicsQueue, 1, &submitInfo, fence);
+    for (size_t m = 0; m < createdMeshes.size(); m++) {
+        
+        uint32_t mesh = createdMeshes[m];
+        const anopol::render::Renderable* source = meshes[mesh].source;
+        const placedGeometry& geometry = geometries[m];
+        
+        // Compact vertices are quantized in their mesh's bounds, which the shader finds through the slot
+        if (anopol::render::quantizedVertices) quantizations[m] = anopol::render::quantizeBounds(geometry.vertices);
+        meshQuantizations[mesh] = anopol::render::quantizationTable.Register(quantizations[m]);
+        
+        batchDrawInformation drawInfo{};
+        drawInfo.vertexCount = static_cast<uint32_t>(geometry.vertices.size());
+        drawInfo.object      = source->batchObject;
+        
+        if (geometry.indices.empty()) {
+            drawInfo.drawType    = nonIndexed;
+            drawInfo.firstVertex = static_cast<uint32_t>(firstVertices[m]);
+            drawMeshCount++;
+        }
+        else {
+            drawInfo.drawType     = indexed;
+            drawInfo.firstIndex   = static_cast<uint32_t>(firstIndices[m]);
+            drawInfo.indexCount   = static_cast<uint32_t>(geometry.indices.size());
+            drawInfo.vertexOffset = static_cast<uint32_t>(firstVertices[m]);
+            indexedDrawMeshCount++;
+        }
+        
+        // drawInformation[mesh] always describes meshCombineGroup.meshes[mesh]
+        if (mesh < drawInformation.size()) drawInformation[mesh] = drawInfo;
+        else                               drawInformation.push_back(drawInfo);
+    }
+    
+    // With the GPU merge the geometry is staged as it is and copied into place by Merge()
+    bool mirrored = !merger.Enabled();
+    
+    if (mirrored) {
+        if (batchVertices.size() < vertexHeap.End()) batchVertices.resize(vertexHeap.End());
+        if (batchIndices.size() < indexHeap.End())   batchIndices.resize(indexHeap.End());
+    }
+    else {
+        for (size_t m = 0; m < createdMeshes.size(); m++) {
+            merger.Queue(createdMeshes[m], geometries[m].vertices, geometries[m].indices, quantizations[m], meshQuantizations[createdMeshes[m]],
+                         static_cast<uint32_t>(firstVertices[m]), static_cast<uint32_t>(firstIndices[m]));
+        }
+    }
+    
+    // Every mesh owns its own ranges, so the copies never overlap
+    combineRanges(createdMeshes.size(), threads, anopol_combine_meshes_per_task, [&](size_t, size_t start, size_t end) {
+        for (size_t m = start; m < end; m++) {
+            
+            uint32_t mesh = createdMeshes[m];
+            const placedGeometry& geometry = geometries[m];
+            
+            meshSpheres[mesh] = localBoundingSphere(geometry.vertices);
+            if (!mirrored) continue;
+            
+            anopol::render::packVertices(geometry.vertices.data(), geometry.vertices.size(), quantizations[m], meshQuantizations[mesh],
+                                         batchVertices.data() + firstVertices[m]);
+            std::copy(geometry.indices.begin(), geometry.indices.end(), batchIndices.begin() + firstIndices[m]);
+        }
+    });
+}
+
+
+//------------------------------------------------------------------------------------------//
+// GPU merge
+// Without chunking, new geometry can be copied into the batch's buffers by a compute
+// dispatch instead of through CPU copies of the whole batch, see gpu_merge.h
+//------------------------------------------------------------------------------------------//
+
+void Batch::EnableGpuMerge(VkShaderModule shader) {
+    
+    if (merger.Enabled() || Chunking()) return;
+    if (!objectMeshes.empty()) anopol_assert("The GPU merge must be enabled before the first Combine");
+    
+    merger.Initialize(shader);
+}
+
+// Once per frame after the fence wait, before Compact and anything that reads the geometry.
+// Meshes combined later in a frame are merged, and drawn, from the next frame's Merge
+void Batch::Merge(VkCommandBuffer commandBuffer, uint32_t currentFrame) {
+    
+    if (merger.Pending()) {
+        
+        // On the frame's command buffer, so the copy into the grown buffers follows every
+        // merge recorded into the old ones
+        vertexBuffer.Reserve(mergeVertexBytes, commandBuffer);
+        vertexBuffer.size = std::max(vertexBuffer.size, mergeVertexBytes);
+        indexBuffer.Reserve(mergeIndexBytes, commandBuffer);
+        indexBuffer.size  = std::max(indexBuffer.size, mergeIndexBytes);
+        
+        merger.Dispatch(commandBuffer, currentFrame, vertexBuffer.buffer, indexBuffer.buffer);
+        mergeRecorded    = true;
+        mergeVertexBytes = 0;
+        mergeIndexBytes  = 0;
+    }
     
-    vkWaitForFences(context->device, 1, &fence, VK_TRUE, UINT64_MAX);
-    vkDestroyFence(context->device, fence, nullptr);
+    if (withheldDrawFrames & (1u << currentFrame)) {
+        withheldDrawFrames &= static_cast<uint8_t>(~(1u << currentFrame));
+        if (!frames[currentFrame].empty) pr_WriteDrawCommands(frames[currentFrame]);
+    }
+}
+
+
+//------------------------------------------------------------------------------------------//
+// Instance indirection
+// Each mesh's instances are contiguous; meshes before the first one that gained objects
+// keep their ranges, so only the tail from there on is rebuilt and uploaded
+//------------------------------------------------------------------------------------------//
 
+void Batch::pr_UpdateInstances(uint32_t firstChangedMesh) {
+    
+    size_t first = firstChangedMesh == 0 ? 0 : drawInformation[firstChangedMesh - 1].firstInstance + drawInformation[firstChangedMesh - 1].instanceCount;
+    instanceIndirection.resize(first);
+    
+    for (size_t mesh = firstChangedMesh; mesh < meshCombineGroup.meshes.size(); mesh++) {
+        
+        const std::vector<uint32_t>& objects = meshCombineGroup.meshes[mesh].objects;
+        
+        drawInformation[mesh].firstInstance = static_cast<uint32_t>(instanceIndirection.size());
+        drawInformation[mesh].instanceCount = static_cast<uint32_t>(objects.size());
+        instanceIndirection.insert(instanceIndirection.end(), objects.begin(), objects.end());
+    }
+    
+    if (instanceIndirection.size() > max_batch_indirect_transform_size) {
+        throw std::runtime_error("Batch has more objects than max_batch_indirect_transform_size");
+    }
+    
+    anopol::ll::stageBuffer(instanceIndirection.data() + first,
+                            sizeof(uint32_t) * (instanceIndirection.size() - first),
+                            instanceIndirectionBuffer,
+                            sizeof(uint32_t) * first);
 }
 
+void Batch::pr_UpdateCullMeshes() {
+    
+    std::vector<cullMesh> meshes(drawInformation.size());
+    
+    for (size_t mesh = 0; mesh < drawInformation.size(); mesh++) {
+        
+        const batchDrawInformation& drawInfo = drawInformation[mesh];
+        bool isIndexed = drawInfo.drawType == indexed;
+        
+        meshes[mesh].sphere         = meshSpheres[mesh];
+        meshes[mesh].first          = isIndexed ? drawInfo.firstIndex : drawInfo.firstVertex;
+        meshes[mesh].count          = isIndexed ? drawInfo.indexCount : drawInfo.vertexCount;
+        meshes[mesh].vertexOffset   = isIndexed ? static_cast<int32_t>(drawInfo.vertexOffset) : 0;
+        meshes[mesh].firstInstance  = drawInfo.firstInstance;
+        meshes[mesh].indexed        = isIndexed ? 1 : 0;
+    }
+    culler.SetMeshes(meshes);
+}
 
 //------------------------------------------------------------------------------------------//
 // Allocating Frames
@@ -342,101 +702,81 @@ void Batch::Combine(int currentFrame = -1) {
 
 void Batch::pr_AllocateFrame(int frameidx) {
     
+    anopol_zone("Batch::pr_AllocateFrame");
     
     // Grab the frame at index frameidx
     batchFrame& frame = frames[frameidx];
 
-    std::vector<VkDrawIndirectCommand> drawCommands;
-
-    if (drawInformation.empty() || transformations.empty()) {
+    if (drawInformation.empty() || liveObjects == 0) {
         frame.empty = true;
         return;
     }
     frame.empty = false;
+    
+    // Cull() writes this frame's commands, on the GPU or the CPU; chunks keep their own
+    if (!culler.Enabled() && !cpuCulling && !Chunking()) pr_WriteDrawCommands(frame);
 
-    for (anopol::batch::batchDrawInformation drawInfo : drawInformation) {
-        VkDrawIndirectCommand command{};
-        command.vertexCount = drawInfo.vertexCount;
-        command.instanceCount = 1;
-        command.firstVertex = drawInfo.firstVertex;
-        command.firstInstance = drawInfo.object;
-        drawCommands.push_back(command);
-    }
+    UpdateTransforms(frame, frameidx);
+}
 
-    VkDeviceSize bufferSize = sizeof(VkDrawIndirectCommand) * drawCommands.size();
-    if (bufferSize == 0) {
-        frame.empty = true;
-        return;
-    }
+// One command per unique mesh, so the whole list is small enough to rewrite; instance
+// counts of existing meshes change whenever objects are appended or removed, and removed
+// meshes drop out. Indexed and non-indexed meshes go to separate streams, each drawn with
+// its own indirect call
+void Batch::pr_WriteDrawCommands(batchFrame& frame) {
+    
+    std::vector<VkDrawIndirectCommand> drawCommands;
+    std::vector<VkDrawIndexedIndirectCommand> indexedDrawCommands;
 
-    if (!frame.allocatedDrawCommands || bufferSize > frame.drawCommandBufferSize) {
-        // Clean up old buffer
-        if (frame.allocatedDrawCommands) {
-            vkDestroyBuffer(context->device, frame.drawCommandBuffer, nullptr);
-            vkFreeMemory(context->device, frame.drawCommandBufferMemory, nullptr);
+    uint32_t frameidx = static_cast<uint32_t>(&frame - frames);
+    withheldDrawFrames &= static_cast<uint8_t>(~(1u << frameidx));
+    
+    for (uint32_t mesh = 0; mesh < drawInformation.size(); mesh++) {
+        const anopol::batch::batchDrawInformation& drawInfo = drawInformation[mesh];
+        if (drawInfo.instanceCount == 0) continue;
+        
+        // Its geometry is written by the next Merge and may lie past the end of the buffers
+        if (merger.Pending() && merger.Queued(mesh)) {
+            withheldDrawFrames |= static_cast<uint8_t>(1u << frameidx);
+            continue;
         }
-
-        // Create new buffer
-        VkBufferCreateInfo bufferInfo{};
-        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-        bufferInfo.size = bufferSize;
-        bufferInfo.usage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-        vkCreateBuffer(context->device, &bufferInfo, nullptr, &frame.drawCommandBuffer);
-
-        VkMemoryRequirements memRequirements;
-        vkGetBufferMemoryRequirements(context->device, frame.drawCommandBuffer, &memRequirements);
-
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = anopol::ll::findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-        vkAllocateMemory(context->device, &allocInfo, nullptr, &frame.drawCommandBufferMemory);
-        vkBindBufferMemory(context->device, frame.drawCommandBuffer, frame.drawCommandBufferMemory, 0);
-
-        frame.drawCommandBufferSize = bufferSize;
-        frame.allocatedDrawCommands = true;
+        pr_AppendDrawCommand(drawInfo, drawInfo.firstInstance, drawInfo.instanceCount, drawCommands, indexedDrawCommands);
     }
 
-    VkBuffer staging;
-    VkDeviceMemory stagingMemory;
-
-    anopol::ll::createBuffer(bufferSize,
-                             VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                             staging, stagingMemory);
-
-    void* data;
-    vkMapMemory(context->device, stagingMemory, 0, bufferSize, 0, &data);
-    memcpy(data, drawCommands.data(), bufferSize);
-    vkUnmapMemory(context->device, stagingMemory);
-
-    VkFence fence;
-    VkFenceCreateInfo fenceCreateInfo{};
-    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    vkCreateFence(context->device, &fenceCreateInfo, nullptr, &fence);
-
-    VkCommandBuffer commandBuffer = anopol::ll::beginSingleCommandBuffer();
-
-    VkBufferCopy copyRegion{};
-    copyRegion.size = bufferSize;
-    vkCmdCopyBuffer(commandBuffer, staging, frame.drawCommandBuffer, 1, &copyRegion);
-
-    anopol::ll::endSingleCommandBuffer(commandBuffer, fence);
-    vkWaitForFences(context->device, 1, &fence, VK_TRUE, UINT64_MAX);
-
-    vkDestroyBuffer(context->device, staging, nullptr);
-    vkFreeMemory(context->device, stagingMemory, nullptr);
-    vkDestroyFence(context->device, fence, nullptr);
+    frame.drawCommandBuffer.Write(0, drawCommands.data(), sizeof(VkDrawIndirectCommand) * drawCommands.size());
+    frame.indexedDrawCommandBuffer.Write(0, indexedDrawCommands.data(), sizeof(VkDrawIndexedIndirectCommand) * indexedDrawCommands.size());
+    
+    frame.drawCount        = static_cast<uint32_t>(drawCommands.size());
+    frame.indexedDrawCount = static_cast<uint32_t>(indexedDrawCommands.size());
+}
 
-    UpdateTransforms(frame, frameidx);
+void Batch::pr_AppendDrawCommand(const batchDrawInformation& drawInfo, uint32_t firstInstance, uint32_t instanceCount,
+                                 std::vector<VkDrawIndirectCommand>& drawCommands, std::vector<VkDrawIndexedIndirectCommand>& indexedDrawCommands) {
+    
+    if (drawInfo.drawType == indexed) {
+        VkDrawIndexedIndirectCommand command{};
+        command.indexCount = drawInfo.indexCount;
+        command.instanceCount = instanceCount;
+        command.firstIndex = drawInfo.firstIndex;
+        command.vertexOffset = static_cast<int32_t>(drawInfo.vertexOffset);
+        command.firstInstance = firstInstance;
+        indexedDrawCommands.push_back(command);
+        return;
+    }
+    
+    VkDrawIndirectCommand command{};
+    command.vertexCount = drawInfo.vertexCount;
+    command.instanceCount = instanceCount;
+    command.firstVertex = drawInfo.firstVertex;
+    command.firstInstance = firstInstance;
+    drawCommands.push_back(command);
 }
 
 
 void Batch::UpdateTransforms(batchFrame& frame, uint32_t idx) {
     
+    anopol_zone("Batch::UpdateTransforms");
+    
     VkDeviceSize bufferSize = sizeof(batchIndirectTransformation) * max_batch_indirect_transform_size;
         
     if (!frame.allocatedTransformations) {
@@ -450,37 +790,117 @@ void Batch::UpdateTransforms(batchFrame& frame, uint32_t idx) {
         frame.allocatedTransformations = true;
     }
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    
-    anopol::ll::createBuffer(bufferSize,
-                             VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                             stagingBuffer,
-                             stagingBufferMemory);
-    
     if (transformations.empty() || bufferSize == 0) {
         throw std::runtime_error("Transformations are empty; cannot memcpy");
     }
+    if (transformations.size() > max_batch_indirect_transform_size) {
+        throw std::runtime_error("Batch has more objects than max_batch_indirect_transform_size");
+    }
+    
+    // Only transforms appended since this frame was last updated are staged
+    size_t first = frame.uploadedTransformCount;
+    
+    anopol::ll::stageBuffer(transformations.data() + first,
+                            sizeof(batchIndirectTransformation) * (transformations.size() - first),
+                            frame.transformBuffer,
+                            sizeof(batchIndirectTransformation) * first);
+    
+    frame.uploadedTransformCount = transformations.size();
+}
+
+// Re-reads a combined renderable's position, scale, rotation, color and material. Every frame
+// queues the transform for its next DynamicUpload; a chunked batch moves the object to the
+// chunk of its new cell, rebuilding only the chunks involved
+void Batch::UpdateObject(uint32_t object) {
+    
+    anopol_zone("Batch::UpdateObject");
+    
+    if (object >= transformations.size() || objectMeshes[object] == anopol_cull_removed_object) anopol_assert("UpdateObject needs an object that has been combined");
+    
+    anopol::render::Renderable* renderable = meshCombineGroup.renderables[object];
+    glm::mat4 model = anopol::modelMatrix(renderable->position, renderable->scale, renderable->rotation);
+    
+    transformations[object] = { model, glm::vec4(renderable->color, static_cast<float>(renderable->material)) };
+    
+    glm::vec4 sphere = worldBoundingSphere(meshSpheres[objectMeshes[object]], model);
+    worldSpheres.Set(object, glm::vec3(sphere), sphere.w);
+    
+    pr_QueueTransform(object);
+    
+    if (Chunking()) {
+        SubBatch& chunk = subBatches[objectChunks[object]];
+        
+        if (pr_ChunkCell(object) != chunk.cell) {
+            pr_DetachFromChunk(object);
+            pr_AssignChunk(object);
+            pr_RebuildChunks();
+        }
+        else {
+            pr_UpdateChunkBounds(chunk);
+        }
+    }
+}
 
-    void* data;
-    if (vkMapMemory(context->device, stagingBufferMemory, 0, bufferSize, 0, &data) != VK_SUCCESS || data == nullptr) {
-        throw std::runtime_error("Failed to map memory for transformations");
+void Batch::pr_QueueTransform(uint32_t object) {
+    
+    for (int i = 0; i < anopol_max_frames; i++) {
+        if (objectDirtyFrames[object] & (1u << i)) continue;
+        objectDirtyFrames[object] |= static_cast<uint8_t>(1u << i);
+        frames[i].dirtyTransforms.push_back(object);
     }
+}
 
-    memcpy(data, transformations.data(), sizeof(batchIndirectTransformation) * transformations.size());
-    vkUnmapMemory(context->device, stagingBufferMemory);
+// Applies what renderables marked dirty, then writes this frame's missing transforms into its
+// scatter list and returns how many there are. The frame's fence has been waited on, so its
+// scatter buffer is free to overwrite; objects the frame has not uploaded yet are skipped,
+// UpdateTransforms stages them whole with their latest transform
+uint32_t Batch::PrepareDynamicUpload(uint32_t currentFrame) {
+    
+    anopol_zone("Batch::PrepareDynamicUpload");
+    
+    if (dirtyObjects) {
+        for (uint32_t object : *dirtyObjects) {
+            
+            // Removed since it was marked, or its slot already holds a renderable not combined yet
+            anopol::render::Renderable* renderable = meshCombineGroup.renderables[object];
+            if (renderable == nullptr || renderable->batchObject != object) continue;
+            
+            renderable->transformDirty = false;
+            UpdateObject(object);
+        }
+        dirtyObjects->clear();
+    }
+    
+    batchFrame& frame = frames[currentFrame];
+    if (frame.dirtyTransforms.empty()) return 0;
     
-    VkCommandBuffer commandBuffer = anopol::ll::beginSingleCommandBuffer();
+    VkDeviceSize required = sizeof(transformScatterEntry) * frame.dirtyTransforms.size();
+    if (required > frame.scatterBufferSize) {
+        
+        if (frame.scatterBuffer != VK_NULL_HANDLE) anopol::ll::retireBuffer(frame.scatterBuffer, frame.scatterBufferMemory);
+        frame.scatterBufferSize = std::max(required, frame.scatterBufferSize * 2);
+        
+        anopol::ll::createBuffer(frame.scatterBufferSize,
+                                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                 frame.scatterBuffer,
+                                 frame.scatterBufferMemory);
+    }
     
-    VkBufferCopy copyRegion{};
-    copyRegion.size = bufferSize;
-    vkCmdCopyBuffer(commandBuffer, stagingBuffer, frame.transformBuffer, 1, &copyRegion);
+    transformScatterEntry* entries = static_cast<transformScatterEntry*>(frame.scatterBufferMemory.mapped);
+    uint32_t count = 0;
     
-    anopol::ll::endSingleCommandBuffer(commandBuffer);
+    for (uint32_t object : frame.dirtyTransforms) {
+        objectDirtyFrames[object] &= static_cast<uint8_t>(~(1u << currentFrame));
+        if (object >= frame.uploadedTransformCount) continue;
+        
+        entries[count].object         = object;
+        entries[count].transformation = transformations[object];
+        count++;
+    }
+    frame.dirtyTransforms.clear();
     
-    vkDestroyBuffer(context->device, stagingBuffer, nullptr);
-    vkFreeMemory(context->device, stagingBufferMemory, nullptr);
+    return count;
 }
 
 Batch::batchFrame& Batch::GetBatchFrame(int frame) {
@@ -490,6 +910,7 @@ Batch::batchFrame& Batch::GetBatchFrame(int frame) {
 
 void Batch::Dealloc() {
     for (anopol::render::Renderable* renderable : meshCombineGroup.renderables) {
+        if (renderable == nullptr) continue;
         renderable->vertexBuffer.dealloc();
         renderable->indexBuffer.dealloc();
     }
@@ -499,47 +920,202 @@ void Batch::Dealloc() {
             mesh.indexBuffer.dealloc();
         }
     }
-    vertexBuffer.dealloc();
-    indexBuffer.dealloc();
+    // In reverse, so the next batch is handed the slots back in the same order
+    for (auto slot = meshQuantizations.rbegin(); slot != meshQuantizations.rend(); slot++) {
+        if (*slot != UINT32_MAX) anopol::render::quantizationTable.Release(*slot);
+    }
+    meshQuantizations.clear();
     
-    vkDestroyBuffer(context->device, redundantBuffer, nullptr);
-    vkFreeMemory(context->device, redundantBufferMemory, nullptr);
+    vertexBuffer.Destroy();
+    indexBuffer.Destroy();
+    compaction.vertexBuffer.Destroy();
+    compaction.indexBuffer.Destroy();
+    for (SubBatch& chunk : subBatches) {
+        chunk.vertexBuffer.Destroy();
+        chunk.indexBuffer.Destroy();
+        chunk.drawCommandBuffer.Destroy();
+        chunk.indexedDrawCommandBuffer.Destroy();
+    }
+    anopol::ll::freeBuffer(instanceIndirectionBuffer, instanceIndirectionBufferMemory);
+    
+    anopol::ll::freeBuffer(redundantBuffer, redundantBufferMemory);
     
     for (int i = 0; i < anopol_max_frames; i++) {
-        vkDestroyBuffer(context->device, frames[i].drawCommandBuffer, nullptr);
-        vkFreeMemory(context->device, frames[i].drawCommandBufferMemory, nullptr);
+        frames[i].drawCommandBuffer.Destroy();
+        frames[i].indexedDrawCommandBuffer.Destroy();
+        frames[i].lateDrawCommandBuffer.Destroy();
+        frames[i].lateIndexedDrawCommandBuffer.Destroy();
+        if (frames[i].allocatedTransformations) anopol::ll::freeBuffer(frames[i].transformBuffer, frames[i].transformBufferMemory);
+        if (frames[i].visibleInstanceBuffer != VK_NULL_HANDLE) anopol::ll::freeBuffer(frames[i].visibleInstanceBuffer, frames[i].visibleInstanceBufferMemory);
+        if (frames[i].scatterBuffer != VK_NULL_HANDLE) anopol::ll::freeBuffer(frames[i].scatterBuffer, frames[i].scatterBufferMemory);
+    }
+    culler.Destroy();
+    merger.Destroy();
+}
+
+
+//------------------------------------------------------------------------------------------//
+// Culling
+// GPU culling needs drawIndirectCount. CPU culling is the fallback without it, and for tools
+// that have CPU time to spare; it uploads the visible instances and commands every frame.
+// Only GPU culling tests occlusion, once the Hi-Z pyramid is enabled. A chunked batch culls
+// whole chunks instead, see below.
+// With none enabled the batch draws every instance
+//------------------------------------------------------------------------------------------//
+
+void Batch::pr_CreateVisibleInstanceBuffers() {
+    
+    for (int i = 0; i < anopol_max_frames; i++) {
+        if (frames[i].visibleInstanceBuffer != VK_NULL_HANDLE) continue;
         
-        vkDestroyBuffer(context->device, frames[i].transformBuffer, nullptr);
-        vkFreeMemory(context->device, frames[i].transformBufferMemory, nullptr);
+        anopol::ll::createBuffer(sizeof(uint32_t) * max_batch_indirect_transform_size,
+                                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                 frames[i].visibleInstanceBuffer,
+                                 frames[i].visibleInstanceBufferMemory);
     }
 }
 
-void Batch::Cull() {
+void Batch::EnableGpuCulling(VkShaderModule shader) {
+    
+    if (culler.Enabled() || cpuCulling || Chunking()) return;
+    
+    culler.Initialize(shader);
+    if (!culler.Enabled()) return;
     
+    pr_CreateVisibleInstanceBuffers();
+    
+    // Whatever was combined before culling was enabled
+    culler.AppendObjects(objectMeshes.data(), objectMeshes.size());
+    if (!drawInformation.empty()) pr_UpdateCullMeshes();
 }
 
-void Batch::Render(VkPipelineLayout pipelineLayout, VkCommandBuffer commandBuffer, VkRenderPass renderPass, VkFramebuffer framebuffer, uint32_t currentFrame) {
+void Batch::EnableCpuCulling() {
+    
+    if (culler.Enabled() || cpuCulling || Chunking()) return;
+    
+    pr_CreateVisibleInstanceBuffers();
+    cpuCulling = true;
+}
+
+VkBuffer Batch::InstanceBuffer(uint32_t frame) const {
+    return culler.Enabled() || cpuCulling ? frames[frame].visibleInstanceBuffer : instanceIndirectionBuffer;
+}
+
+VkBuffer Batch::DrawCountBuffer(uint32_t frame) const {
+    return culler.Enabled() ? culler.DrawCountBuffer(frame) : VK_NULL_HANDLE;
+}
+
+void Batch::MarkGraphicsUse(uint32_t currentFrame) const {
+    
+    const batchFrame& frame = frames[currentFrame];
+    
+    for (VkBuffer buffer : {vertexBuffer.buffer, indexBuffer.buffer, instanceIndirectionBuffer, redundantBuffer,
+                            compaction.vertexBuffer.buffer, compaction.indexBuffer.buffer,
+                            frame.drawCommandBuffer.buffer, frame.indexedDrawCommandBuffer.buffer,
+                            frame.lateDrawCommandBuffer.buffer, frame.lateIndexedDrawCommandBuffer.buffer,
+                            frame.transformBuffer, frame.visibleInstanceBuffer}) {
+        anopol::ll::markGraphicsUse(buffer);
+    }
+    for (const SubBatch& chunk : subBatches) {
+        for (VkBuffer buffer : {chunk.vertexBuffer.buffer, chunk.indexBuffer.buffer, chunk.drawCommandBuffer.buffer, chunk.indexedDrawCommandBuffer.buffer}) {
+            anopol::ll::markGraphicsUse(buffer);
+        }
+    }
+    
+    culler.MarkGraphicsUse(currentFrame);
+}
+
+void Batch::Cull(VkCommandBuffer commandBuffer, uint32_t currentFrame, const anopol::camera::Camera& camera) {
+    
+    if (Chunking()) {
+        pr_CullChunks(camera);
+        return;
+    }
+    
+    batchFrame& frame = frames[currentFrame];
+    if (frame.empty) return;
+    
+    if (cpuCulling) {
+        pr_CullOnCpu(frame, camera);
+        return;
+    }
+    if (!culler.Enabled()) return;
+    
+    // Room for every mesh to be visible; the count buffer says how many were written
+    frame.drawCommandBuffer.Reserve(sizeof(VkDrawIndirectCommand) * std::max(drawMeshCount, 1u));
+    frame.indexedDrawCommandBuffer.Reserve(sizeof(VkDrawIndexedIndirectCommand) * std::max(indexedDrawMeshCount, 1u));
+    frame.lateDrawCommandBuffer.Reserve(sizeof(VkDrawIndirectCommand) * std::max(drawMeshCount, 1u));
+    frame.lateIndexedDrawCommandBuffer.Reserve(sizeof(VkDrawIndexedIndirectCommand) * std::max(indexedDrawMeshCount, 1u));
+    frame.drawCount        = drawMeshCount;
+    frame.indexedDrawCount = indexedDrawMeshCount;
     
-    VkCommandBufferInheritanceInfo inheritanceInfo{};
-    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
-    inheritanceInfo.renderPass = renderPass;
-    inheritanceInfo.subpass = 0;
-    inheritanceInfo.framebuffer = framebuffer;
-    inheritanceInfo.occlusionQueryEnable = VK_FALSE;
-    inheritanceInfo.queryFlags = 0;
-    inheritanceInfo.pipelineStatistics = 0;
+    cullTargets targets{};
+    targets.transforms              = frame.transformBuffer;
+    targets.visibleInstances        = frame.visibleInstanceBuffer;
+    targets.drawCommands            = frame.drawCommandBuffer.buffer;
+    targets.indexedDrawCommands     = frame.indexedDrawCommandBuffer.buffer;
+    targets.lateDrawCommands        = frame.lateDrawCommandBuffer.buffer;
+    targets.lateIndexedDrawCommands = frame.lateIndexedDrawCommandBuffer.buffer;
+    
+    culler.Dispatch(commandBuffer, currentFrame, camera.cameraProjection * camera.cameraLookAt, static_cast<uint32_t>(frame.uploadedTransformCount), targets);
+}
 
-    VkCommandBufferBeginInfo beginInfo{};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
-    beginInfo.pInheritanceInfo = &inheritanceInfo;
+// After the early pass has been drawn and the Hi-Z pyramid rebuilt from it
+void Batch::CullLate(VkCommandBuffer commandBuffer, uint32_t currentFrame) {
+    
+    if (frames[currentFrame].empty) return;
+    culler.DispatchLate(commandBuffer, currentFrame);
+}
 
-    vkBeginCommandBuffer(batchCommandBuffers[currentFrame], &beginInfo);
+void Batch::pr_CullOnCpu(batchFrame& frame, const anopol::camera::Camera& camera) {
+    
+    anopol_zone("Batch::pr_CullOnCpu");
+    
+    std::array<glm::vec4, 6> planes = anopol::camera::PlaneEquations(anopol::camera::CreateFrustumPlanes(camera));
+    cullSpheres(planes, worldSpheres, visibilityMasks);
+    
+    // Compact the survivors mesh by mesh, so each mesh's visible instances stay contiguous
+    size_t objectCount = frame.uploadedTransformCount;
+    visibleInstances.clear();
     
+    std::vector<VkDrawIndirectCommand> drawCommands;
+    std::vector<VkDrawIndexedIndirectCommand> indexedDrawCommands;
+    
+    for (size_t mesh = 0; mesh < drawInformation.size(); mesh++) {
+        
+        uint32_t firstInstance = static_cast<uint32_t>(visibleInstances.size());
+        
+        for (uint32_t object : meshCombineGroup.meshes[mesh].objects) {
+            if (object >= objectCount) continue;
+            if (visibilityMasks[object / anopol_cull_lanes] & (1u << (object % anopol_cull_lanes))) visibleInstances.push_back(object);
+        }
+        
+        uint32_t instanceCount = static_cast<uint32_t>(visibleInstances.size()) - firstInstance;
+        if (instanceCount > 0) pr_AppendDrawCommand(drawInformation[mesh], firstInstance, instanceCount, drawCommands, indexedDrawCommands);
+    }
+    
+    if (!visibleInstances.empty()) {
+        anopol::ll::stageBuffer(visibleInstances.data(), sizeof(uint32_t) * visibleInstances.size(), frame.visibleInstanceBuffer, 0);
+    }
+    frame.drawCommandBuffer.Write(0, drawCommands.data(), sizeof(VkDrawIndirectCommand) * drawCommands.size());
+    frame.indexedDrawCommandBuffer.Write(0, indexedDrawCommands.data(), sizeof(VkDrawIndexedIndirectCommand) * indexedDrawCommands.size());
     
-    VkBuffer buffers[] = { vertexBuffer.vertexBuffer, redundantBuffer };
+    frame.drawCount        = static_cast<uint32_t>(drawCommands.size());
+    frame.indexedDrawCount = static_cast<uint32_t>(indexedDrawCommands.size());
+    
+    // This frame's draws read what was just staged
+    pendingUpload = anopol::ll::lastUploadToken();
+}
+
+// With drawCounts set, drawCount and indexedDrawCount are upper bounds and the actual counts
+// are read on the GPU from drawCounts (drawCountOffset and the uint after it)
+void Batch::pr_RecordDraw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, VkBuffer vertices, VkBuffer drawCommands, uint32_t drawCount,
+                          VkBuffer indices, VkBuffer indexedDrawCommands, uint32_t indexedDrawCount, VkBuffer drawCounts, VkDeviceSize drawCountOffset) {
+    
+    VkBuffer buffers[] = { vertices, redundantBuffer };
     VkDeviceSize offsets[] = { 0, 0 };
-    vkCmdBindVertexBuffers(batchCommandBuffers[currentFrame], 0, 2, buffers, offsets);
+    vkCmdBindVertexBuffers(commandBuffer, 0, 2, buffers, offsets);
         
     anopol::render::anopolStandardPushConstants standardPushConstants{};
     standardPushConstants.scale             = glm::vec4(glm::vec3(0), 1.0f);
@@ -557,16 +1133,634 @@ void Batch::Render(VkPipelineLayout pipelineLayout, VkCommandBuffer commandBuffe
     
     standardPushConstants.model = model;
     
-    vkCmdPushConstants(batchCommandBuffers[currentFrame],
+    vkCmdPushConstants(commandBuffer,
                        pipelineLayout,
                        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
                        0,
                        sizeof(anopol::render::anopolStandardPushConstants),
                        &standardPushConstants);
-    vkCmdDrawIndirect(batchCommandBuffers[currentFrame], GetBatchFrame(currentFrame).drawCommandBuffer, 0, static_cast<uint32_t>(transformations.size()), sizeof(VkDrawIndirectCommand));
     
-    vkEndCommandBuffer(batchCommandBuffers[currentFrame]);
-    vkCmdExecuteCommands(commandBuffer, 1, &batchCommandBuffers[currentFrame]);
+    if (drawCount > 0) {
+        if (drawCounts != VK_NULL_HANDLE) vkCmdDrawIndirectCount(commandBuffer, drawCommands, 0, drawCounts, drawCountOffset, drawCount, sizeof(VkDrawIndirectCommand));
+        else                              vkCmdDrawIndirect(commandBuffer, drawCommands, 0, drawCount, sizeof(VkDrawIndirectCommand));
+    }
+    
+    if (indexedDrawCount > 0 && indices != VK_NULL_HANDLE) {
+        vkCmdBindIndexBuffer(commandBuffer, indices, 0, VK_INDEX_TYPE_UINT32);
+        if (drawCounts != VK_NULL_HANDLE) vkCmdDrawIndexedIndirectCount(commandBuffer, indexedDrawCommands, 0, drawCounts, drawCountOffset + sizeof(uint32_t), indexedDrawCount, sizeof(VkDrawIndexedIndirectCommand));
+        else                              vkCmdDrawIndexedIndirect(commandBuffer, indexedDrawCommands, 0, indexedDrawCount, sizeof(VkDrawIndexedIndirectCommand));
+    }
+}
+
+void Batch::Render(anopol::ll::ParallelRecorder& recorder, VkPipelineLayout pipelineLayout, uint32_t currentFrame) {
+    
+    // ----------------------------------------------------------------------------- //
+    // Visible chunks are split evenly across the workers, one task per run of chunks
+    // ----------------------------------------------------------------------------- //
+    
+    if (Chunking()) {
+        if (visibleChunks.empty()) return;
+        
+        size_t tasks = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), visibleChunks.size());
+        size_t chunksPerTask = (visibleChunks.size() + tasks - 1) / tasks;
+        
+        for (size_t first = 0; first < visibleChunks.size(); first += chunksPerTask) {
+            size_t last = std::min(first + chunksPerTask, visibleChunks.size());
+            
+            recorder.Record([this, pipelineLayout, first, last](VkCommandBuffer commandBuffer) {
+                uint32_t scope = anopol::ll::gpuProfiler.Begin(commandBuffer, "batch");
+                for (size_t i = first; i < last; i++) {
+                    const SubBatch& chunk = subBatches[visibleChunks[i]];
+                    pr_RecordDraw(commandBuffer, pipelineLayout, chunk.vertexBuffer.buffer, chunk.drawCommandBuffer.buffer, chunk.drawCount,
+                                  chunk.indexBuffer.buffer, chunk.indexedDrawCommandBuffer.buffer, chunk.indexedDrawCount);
+                }
+                anopol::ll::gpuProfiler.End(commandBuffer, scope);
+            });
+        }
+        return;
+    }
+    
+    const batchFrame& frame = GetBatchFrame(currentFrame);
+    
+    VkBuffer drawCommands        = frame.drawCommandBuffer.buffer;
+    VkBuffer indexedDrawCommands = frame.indexedDrawCommandBuffer.buffer;
+    uint32_t drawCount           = frame.drawCount;
+    uint32_t indexedDrawCount    = frame.indexedDrawCount;
+    VkBuffer drawCounts          = DrawCountBuffer(currentFrame);
+    
+    if (frame.empty || drawCount + indexedDrawCount == 0) return;
+    
+    recorder.Record([this, pipelineLayout, drawCommands, drawCount, indexedDrawCommands, indexedDrawCount, drawCounts](VkCommandBuffer commandBuffer) {
+        uint32_t scope = anopol::ll::gpuProfiler.Begin(commandBuffer, "batch");
+        pr_RecordDraw(commandBuffer, pipelineLayout, vertexBuffer.buffer, drawCommands, drawCount, indexBuffer.buffer, indexedDrawCommands, indexedDrawCount, drawCounts);
+        anopol::ll::gpuProfiler.End(commandBuffer, scope);
+    });
+}
+
+// Recorded inline into the late render pass; the pipeline and descriptor sets are already bound
+void Batch::RenderLate(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t currentFrame) {
+    
+    const batchFrame& frame = GetBatchFrame(currentFrame);
+    if (!culler.Occlusion() || frame.empty || frame.drawCount + frame.indexedDrawCount == 0) return;
+    
+    pr_RecordDraw(commandBuffer, pipelineLayout, vertexBuffer.buffer, frame.lateDrawCommandBuffer.buffer, frame.drawCount,
+                  indexBuffer.buffer, frame.lateIndexedDrawCommandBuffer.buffer, frame.indexedDrawCount,
+                  culler.DrawCountBuffer(currentFrame), anopol_cull_late_counts);
+}
+
+
+//------------------------------------------------------------------------------------------//
+// Spatial chunks
+// Objects are binned by the grid cell of their world sphere's center. Each chunk copies the
+// unique geometry of its meshes out of batchVertices / batchIndices into its own buffers and
+// owns a range of instanceIndirectionBuffer, so adding, moving or removing an object only
+// rebuilds the chunks it touches. Chunks are frustum culled as a whole on the CPU; their
+// commands are static and draw every instance
+//------------------------------------------------------------------------------------------//
+
+uint64_t chunkKey(const glm::ivec3& cell) {
+    return (static_cast<uint64_t>(cell.x & 0x1FFFFF) << 42) | (static_cast<uint64_t>(cell.y & 0x1FFFFF) << 21) | static_cast<uint64_t>(cell.z & 0x1FFFFF);
+}
+
+// Before any culling is enabled and before the first Combine; chunks replace per-object culling
+void Batch::EnableChunking(float cellSize) {
+    
+    if (cellSize <= 0.0f) anopol_assert("Chunk cell size must be positive");
+    if (culler.Enabled() || cpuCulling || merger.Enabled() || !objectMeshes.empty()) anopol_assert("Chunking must be enabled before culling, the GPU merge and the first Combine");
+    
+    chunkSize = cellSize;
+}
+
+glm::ivec3 Batch::pr_ChunkCell(uint32_t object) const {
+    glm::vec3 center(worldSpheres.x[object], worldSpheres.y[object], worldSpheres.z[object]);
+    return glm::ivec3(glm::floor(center / chunkSize));
+}
+
+uint32_t Batch::pr_CreateChunk(const glm::ivec3& cell) {
+    
+    SubBatch chunk{};
+    chunk.cell = cell;
+    chunk.vertexBuffer             = anopol::ll::GrowableBuffer::Create(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    chunk.indexBuffer              = anopol::ll::GrowableBuffer::Create(VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+    chunk.drawCommandBuffer        = anopol::ll::GrowableBuffer::Create(VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+    chunk.indexedDrawCommandBuffer = anopol::ll::GrowableBuffer::Create(VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+    
+    subBatches.push_back(chunk);
+    return static_cast<uint32_t>(subBatches.size() - 1);
+}
+
+void Batch::pr_AssignChunk(uint32_t object) {
+    
+    uint32_t mesh = objectMeshes[object];
+    uint32_t meshVertices = drawInformation[mesh].vertexCount;
+    glm::ivec3 cell = pr_ChunkCell(object);
+    
+    std::vector<uint32_t>& cellList = cellChunks[chunkKey(cell)];
+    
+    uint32_t chunkIndex = UINT32_MAX;
+    size_t local = 0;
+    
+    // A chunk of the cell that already has the mesh only gains an instance
+    for (uint32_t candidate : cellList) {
+        const std::vector<uint32_t>& meshes = subBatches[candidate].meshes;
+        auto found = std::find(meshes.begin(), meshes.end(), mesh);
+        if (found == meshes.end()) continue;
+        
+        chunkIndex = candidate;
+        local = static_cast<size_t>(found - meshes.begin());
+        break;
+    }
+    
+    // Otherwise the first one with room for the geometry; an empty chunk takes a mesh of any size
+    if (chunkIndex == UINT32_MAX) {
+        for (uint32_t candidate : cellList) {
+            const SubBatch& chunk = subBatches[candidate];
+            if (!chunk.meshes.empty() && chunk.vertexCount + meshVertices > MAX_SUB_BATCH_VERTEX_COUNT) continue;
+            
+            chunkIndex = candidate;
+            break;
+        }
+        if (chunkIndex == UINT32_MAX) {
+            chunkIndex = pr_CreateChunk(cell);
+            cellList.push_back(chunkIndex);
+        }
+        
+        SubBatch& chunk = subBatches[chunkIndex];
+        local = chunk.meshes.size();
+        chunk.meshes.push_back(mesh);
+        chunk.meshObjects.emplace_back();
+        chunk.vertexCount += meshVertices;
+    }
+    
+    SubBatch& chunk = subBatches[chunkIndex];
+    chunk.meshObjects[local].push_back(object);
+    chunk.objectCount++;
+    chunk.dirty = true;
+    
+    if (objectChunks.size() <= object) objectChunks.resize(object + 1, UINT32_MAX);
+    objectChunks[object] = chunkIndex;
+}
+
+// An emptied chunk stays registered to its cell and is refilled before a new one opens
+void Batch::pr_DetachFromChunk(uint32_t object) {
+    
+    SubBatch& chunk = subBatches[objectChunks[object]];
+    uint32_t mesh = objectMeshes[object];
+    
+    size_t local = static_cast<size_t>(std::find(chunk.meshes.begin(), chunk.meshes.end(), mesh) - chunk.meshes.begin());
+    std::vector<uint32_t>& objects = chunk.meshObjects[local];
+    objects.erase(std::find(objects.begin(), objects.end(), object));
+    
+    if (objects.empty()) {
+        chunk.vertexCount -= drawInformation[mesh].vertexCount;
+        chunk.meshes.erase(chunk.meshes.begin() + local);
+        chunk.meshObjects.erase(chunk.meshObjects.begin() + local);
+    }
+    chunk.objectCount--;
+    chunk.dirty = true;
+    
+    objectChunks[object] = UINT32_MAX;
+}
+
+void Batch::pr_UpdateChunkBounds(SubBatch& chunk) {
+    
+    chunk.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+    chunk.boundsMax = glm::vec3(std::numeric_limits<float>::lowest());
+    
+    for (const std::vector<uint32_t>& objects : chunk.meshObjects) {
+        for (uint32_t object : objects) {
+            glm::vec3 center(worldSpheres.x[object], worldSpheres.y[object], worldSpheres.z[object]);
+            chunk.boundsMin = glm::min(chunk.boundsMin, center - worldSpheres.radius[object]);
+            chunk.boundsMax = glm::max(chunk.boundsMax, center + worldSpheres.radius[object]);
+        }
+    }
+}
+
+// Ranges abandoned by chunks that grew are reclaimed by packing every chunk again at its exact size
+void Batch::pr_RepackInstanceRanges() {
+    
+    instanceRangeEnd = 0;
+    
+    for (SubBatch& chunk : subBatches) {
+        chunk.instanceBase     = instanceRangeEnd;
+        chunk.instanceCapacity = chunk.objectCount;
+        chunk.dirty            = true;
+        instanceRangeEnd      += chunk.objectCount;
+    }
+    
+    if (instanceRangeEnd > max_batch_indirect_transform_size) {
+        throw std::runtime_error("Batch has more objects than max_batch_indirect_transform_size");
+    }
+}
+
+void Batch::pr_RebuildChunks() {
+    
+    anopol_zone("Batch::pr_RebuildChunks");
+    
+    // Ranges grow by doubling, so objects trickling into a chunk rarely move it
+    for (SubBatch& chunk : subBatches) {
+        if (!chunk.dirty || chunk.objectCount <= chunk.instanceCapacity) continue;
+        
+        uint32_t capacity = std::max(chunk.objectCount, chunk.instanceCapacity * 2);
+        if (instanceRangeEnd + capacity > max_batch_indirect_transform_size) {
+            pr_RepackInstanceRanges();
+            break;
+        }
+        chunk.instanceBase     = instanceRangeEnd;
+        chunk.instanceCapacity = capacity;
+        instanceRangeEnd      += capacity;
+    }
+    
+    for (SubBatch& chunk : subBatches) {
+        if (chunk.dirty) pr_RebuildChunk(chunk);
+    }
+    
+    pendingUpload = anopol::ll::lastUploadToken();
+}
+
+void Batch::pr_RebuildChunk(SubBatch& chunk) {
+    
+    std::vector<anopol::render::gpuVertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<uint32_t> instances;
+    std::vector<VkDrawIndirectCommand> drawCommands;
+    std::vector<VkDrawIndexedIndirectCommand> indexedDrawCommands;
+    
+    vertices.reserve(chunk.vertexCount);
+    instances.reserve(chunk.objectCount);
+    
+    for (size_t local = 0; local < chunk.meshes.size(); local++) {
+        
+        // The batch-wide offsets say where to copy from, the rebased ones go in the commands
+        const batchDrawInformation& source = drawInformation[chunk.meshes[local]];
+        batchDrawInformation drawInfo = source;
+        
+        uint32_t firstVertex = source.drawType == indexed ? source.vertexOffset : source.firstVertex;
+        
+        if (source.drawType == indexed) {
+            drawInfo.firstIndex   = static_cast<uint32_t>(indices.size());
+            drawInfo.vertexOffset = static_cast<uint32_t>(vertices.size());
+            indices.insert(indices.end(), batchIndices.begin() + source.firstIndex, batchIndices.begin() + source.firstIndex + source.indexCount);
+        }
+        else {
+            drawInfo.firstVertex = static_cast<uint32_t>(vertices.size());
+        }
+        vertices.insert(vertices.end(), batchVertices.begin() + firstVertex, batchVertices.begin() + firstVertex + source.vertexCount);
+        
+        const std::vector<uint32_t>& objects = chunk.meshObjects[local];
+        uint32_t firstInstance = chunk.instanceBase + static_cast<uint32_t>(instances.size());
+        instances.insert(instances.end(), objects.begin(), objects.end());
+        
+        pr_AppendDrawCommand(drawInfo, firstInstance, static_cast<uint32_t>(objects.size()), drawCommands, indexedDrawCommands);
+    }
+    
+    chunk.vertexBuffer.Write(0, vertices.data(), sizeof(anopol::render::gpuVertex) * vertices.size());
+    chunk.indexBuffer.Write(0, indices.data(), sizeof(uint32_t) * indices.size());
+    chunk.drawCommandBuffer.Write(0, drawCommands.data(), sizeof(VkDrawIndirectCommand) * drawCommands.size());
+    chunk.indexedDrawCommandBuffer.Write(0, indexedDrawCommands.data(), sizeof(VkDrawIndexedIndirectCommand) * indexedDrawCommands.size());
+    
+    if (!instances.empty()) {
+        anopol::ll::stageBuffer(instances.data(), sizeof(uint32_t) * instances.size(), instanceIndirectionBuffer, sizeof(uint32_t) * chunk.instanceBase);
+    }
+    
+    chunk.drawCount        = static_cast<uint32_t>(drawCommands.size());
+    chunk.indexedDrawCount = static_cast<uint32_t>(indexedDrawCommands.size());
+    chunk.dirty            = false;
+    
+    pr_UpdateChunkBounds(chunk);
+}
+
+// Box against the six planes: only the corner furthest along each plane's normal is tested
+void Batch::pr_CullChunks(const anopol::camera::Camera& camera) {
+    
+    anopol_zone("Batch::pr_CullChunks");
+    
+    std::array<glm::vec4, 6> planes = anopol::camera::PlaneEquations(anopol::camera::CreateFrustumPlanes(camera));
+    visibleChunks.clear();
+    
+    for (size_t i = 0; i < subBatches.size(); i++) {
+        
+        const SubBatch& chunk = subBatches[i];
+        if (chunk.drawCount + chunk.indexedDrawCount == 0) continue;
+        
+        bool inside = true;
+        for (const glm::vec4& plane : planes) {
+            glm::vec3 corner = glm::mix(chunk.boundsMin, chunk.boundsMax, glm::step(glm::vec3(0.0f), glm::vec3(plane)));
+            if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) {
+                inside = false;
+                break;
+            }
+        }
+        if (inside) visibleChunks.push_back(static_cast<uint32_t>(i));
+    }
+}
+
+
+//------------------------------------------------------------------------------------------//
+// Removal
+// Remove takes an object out of its mesh's instances at once and hands its transform slot
+// back to MeshCombineGroup, so the next Append reuses it; the slot's index never changes,
+// which is what keeps handles stable. A mesh left without objects frees its vertex and index
+// ranges to the heaps and stops producing draw commands. Instance ranges, chunks and frame
+// commands catch up at the next Combine
+//------------------------------------------------------------------------------------------//
+
+batchHandle Batch::Handle(const anopol::render::Renderable* renderable) const {
+    
+    uint32_t object = renderable->batchObject;
+    if (object >= objectGenerations.size() || meshCombineGroup.renderables[object] != renderable) {
+        anopol_assert("Handle needs a renderable combined into this batch");
+    }
+    return { object, objectGenerations[object] };
+}
+
+bool Batch::Valid(batchHandle handle) const {
+    return handle.object < objectGenerations.size()
+        && objectGenerations[handle.object] == handle.generation
+        && objectMeshes[handle.object] != anopol_cull_removed_object;
+}
+
+void Batch::Remove(batchHandle handle) {
+    
+    anopol_zone("Batch::Remove");
+    
+    if (!Valid(handle)) anopol_assert("Remove needs a handle to an object still in the batch");
+    
+    uint32_t object = handle.object;
+    uint32_t mesh = objectMeshes[object];
+    anopol::render::Renderable* renderable = meshCombineGroup.renderables[object];
+    MeshCombineGroup::sharedMesh& shared = meshCombineGroup.meshes[mesh];
+    
+    if (Chunking()) pr_DetachFromChunk(object);
+    
+    // Instances of a mesh are unordered, so the last one takes the removed one's place
+    uint32_t position = objectPositions[object];
+    shared.objects[position] = shared.objects.back();
+    objectPositions[shared.objects[position]] = position;
+    shared.objects.pop_back();
+    
+    if (shared.objects.empty())             pr_ReleaseMesh(mesh);
+    else if (shared.source == renderable)   shared.source = meshCombineGroup.renderables[shared.objects.front()];
+    
+    objectMeshes[object] = anopol_cull_removed_object;
+    objectGenerations[object]++;
+    worldSpheres.Set(object, glm::vec3(0.0f), std::numeric_limits<float>::lowest());
+    culler.SetObjectMesh(object, anopol_cull_removed_object);
+    
+    pendingInstanceMesh = std::min(pendingInstanceMesh, mesh);
+    liveObjects--;
+    
+    renderable->batchObject = UINT32_MAX;
+    renderable->batchDirtyObjects.reset();
+    renderable->transformDirty = false;
+    meshCombineGroup.Release(object);
+    
+    pendingUpload = anopol::ll::lastUploadToken();
+}
+
+// A renderable appended but not combined yet is dropped by the next Combine
+void Batch::Remove(anopol::render::Renderable* renderable) {
+    
+    if (renderable->batchObject != UINT32_MAX) {
+        Remove(Handle(renderable));
+        return;
+    }
+    
+    for (uint32_t slot : meshCombineGroup.pending) {
+        if (meshCombineGroup.renderables[slot] != renderable) continue;
+        meshCombineGroup.renderables[slot] = nullptr;
+        return;
+    }
+    anopol_assert("Remove needs a renderable appended to this batch");
+}
+
+void Batch::pr_ReleaseMesh(uint32_t mesh) {
+    
+    batchDrawInformation& drawInfo = drawInformation[mesh];
+    
+    vertexHeap.Free(meshFirstVertex(drawInfo), drawInfo.vertexCount);
+    if (drawInfo.drawType == indexed) {
+        indexHeap.Free(drawInfo.firstIndex, drawInfo.indexCount);
+        indexedDrawMeshCount--;
+    }
+    else {
+        drawMeshCount--;
+    }
+    drawInfo.instanceCount = 0;
+    merger.Cancel(mesh);
+    
+    if (meshQuantizations[mesh] != UINT32_MAX) anopol::render::quantizationTable.Release(std::exchange(meshQuantizations[mesh], UINT32_MAX));
+    
+    // Already copied by a running compaction: its new range is released when that finishes
+    if (compaction.active && mesh < compaction.firstVertex.size() && compaction.firstVertex[mesh] != UINT32_MAX) {
+        compaction.abandonedVertices.push_back({ compaction.firstVertex[mesh], drawInfo.vertexCount });
+        if (drawInfo.drawType == indexed) compaction.abandonedIndices.push_back({ compaction.firstIndex[mesh], drawInfo.indexCount });
+        
+        compaction.firstVertex[mesh] = UINT32_MAX;
+        compaction.firstIndex[mesh]  = UINT32_MAX;
+    }
+    
+    // Ranges that reached the end are gone from the heap; the buffers keep their capacity until compacted
+    if (!merger.Enabled()) {
+        batchVertices.resize(vertexHeap.End());
+        batchIndices.resize(indexHeap.End());
+    }
+    
+    meshCombineGroup.ReleaseMesh(mesh);
+}
+
+VkDeviceSize Batch::GeometryBytes() const {
+    return sizeof(anopol::render::gpuVertex) * vertexHeap.End() + sizeof(uint32_t) * indexHeap.End();
+}
+
+
+//------------------------------------------------------------------------------------------//
+// Compaction
+// Once holes make up a quarter of the geometry, every live mesh is copied, packed, into new
+// vertex and index buffers on the GPU, budget bytes per Compact call, while the batch keeps
+// drawing from the old ones. Meshes placed or released meanwhile are caught up by the last
+// call, which remaps drawInformation, rewrites the mesh list and commands, and retires the
+// old buffers. A chunked batch only keeps batchVertices / batchIndices, so it is packed on
+// the CPU in one call
+//------------------------------------------------------------------------------------------//
+
+// Once per frame, before Cull
+void Batch::Compact(VkDeviceSize budget) {
+    
+    anopol_zone("Batch::Compact");
+    
+    // The copies below go out before this frame's merge runs, and would read unmerged ranges
+    if (merger.Pending() || std::exchange(mergeRecorded, false)) return;
+    
+    if (!compaction.active) {
+        VkDeviceSize holes = sizeof(anopol::render::gpuVertex) * vertexHeap.FreeCount() + sizeof(uint32_t) * indexHeap.FreeCount();
+        if (holes < anopol_batch_compaction_minimum || holes * 4 < GeometryBytes()) return;
+        
+        pr_BeginCompaction();
+    }
+    
+    if (pr_CompactStep(Chunking() ? std::numeric_limits<VkDeviceSize>::max() : budget)) pr_FinishCompaction();
+}
+
+void Batch::pr_BeginCompaction() {
+    
+    compaction.active    = true;
+    compaction.cursor    = 0;
+    compaction.vertexEnd = 0;
+    compaction.indexEnd  = 0;
+    compaction.firstVertex.assign(meshCombineGroup.meshes.size(), UINT32_MAX);
+    compaction.firstIndex.assign(meshCombineGroup.meshes.size(), UINT32_MAX);
+    compaction.abandonedVertices.clear();
+    compaction.abandonedIndices.clear();
+    
+    if (Chunking()) return;
+    
+    compaction.vertexBuffer = anopol::ll::GrowableBuffer::Create(vertexBuffer.usage,
+                                                                 sizeof(anopol::render::gpuVertex) * (vertexHeap.End() - vertexHeap.FreeCount()));
+    compaction.indexBuffer  = anopol::ll::GrowableBuffer::Create(indexBuffer.usage,
+                                                                 sizeof(uint32_t) * (indexHeap.End() - indexHeap.FreeCount()));
+}
+
+// Returns the bytes copied
+VkDeviceSize Batch::pr_CompactMesh(uint32_t mesh) {
+    
+    const batchDrawInformation& drawInfo = drawInformation[mesh];
+    bool isIndexed = drawInfo.drawType == indexed;
+    
+    VkDeviceSize vertexBytes = sizeof(anopol::render::gpuVertex) * drawInfo.vertexCount;
+    VkDeviceSize indexBytes  = isIndexed ? sizeof(uint32_t) * drawInfo.indexCount : 0;
+    
+    if (!Chunking()) {
+        std::lock_guard<std::recursive_mutex> lock(anopol::ll::stagingMutex);
+        
+        compaction.vertexBuffer.Reserve(sizeof(anopol::render::gpuVertex) * compaction.vertexEnd + vertexBytes);
+        anopol::ll::uploadRecorder().CopyBuffer(vertexBuffer.buffer, compaction.vertexBuffer.buffer, vertexBytes,
+                                                sizeof(anopol::render::gpuVertex) * meshFirstVertex(drawInfo),
+                                                sizeof(anopol::render::gpuVertex) * compaction.vertexEnd);
+        compaction.vertexBuffer.size = sizeof(anopol::render::gpuVertex) * compaction.vertexEnd + vertexBytes;
+        
+        if (isIndexed) {
+            compaction.indexBuffer.Reserve(sizeof(uint32_t) * compaction.indexEnd + indexBytes);
+            anopol::ll::uploadRecorder().CopyBuffer(indexBuffer.buffer, compaction.indexBuffer.buffer, indexBytes,
+                                                    sizeof(uint32_t) * drawInfo.firstIndex,
+                                                    sizeof(uint32_t) * compaction.indexEnd);
+            compaction.indexBuffer.size = sizeof(uint32_t) * compaction.indexEnd + indexBytes;
+        }
+    }
+    
+    compaction.firstVertex[mesh] = compaction.vertexEnd;
+    compaction.vertexEnd += drawInfo.vertexCount;
+    
+    if (isIndexed) {
+        compaction.firstIndex[mesh] = compaction.indexEnd;
+        compaction.indexEnd += drawInfo.indexCount;
+    }
+    
+    return vertexBytes + indexBytes;
+}
+
+// Returns true once the cursor has passed every mesh
+bool Batch::pr_CompactStep(VkDeviceSize budget) {
+    
+    size_t meshCount = meshCombineGroup.meshes.size();
+    compaction.firstVertex.resize(meshCount, UINT32_MAX);
+    compaction.firstIndex.resize(meshCount, UINT32_MAX);
+    
+    // Earlier copies in this batch may have written the ranges read here
+    if (!Chunking()) {
+        std::lock_guard<std::recursive_mutex> lock(anopol::ll::stagingMutex);
+        anopol::ll::uploadRecorder().Barrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+    }
+    
+    VkDeviceSize copied = 0;
+    
+    while (compaction.cursor < meshCount && copied < budget) {
+        uint32_t mesh = compaction.cursor++;
+        if (meshCombineGroup.meshes[mesh].source == nullptr || compaction.firstVertex[mesh] != UINT32_MAX) continue;
+        
+        copied += pr_CompactMesh(mesh);
+    }
+    
+    return compaction.cursor >= meshCount;
+}
+
+void Batch::pr_FinishCompaction() {
+    
+    anopol_zone("Batch::pr_FinishCompaction");
+    
+    // Meshes placed into slots the cursor had already passed
+    for (uint32_t mesh = 0; mesh < meshCombineGroup.meshes.size(); mesh++) {
+        if (meshCombineGroup.meshes[mesh].source != nullptr && compaction.firstVertex[mesh] == UINT32_MAX) pr_CompactMesh(mesh);
+    }
+    
+    // ----------------------------------------------------------------------------- //
+    // Remap the live meshes and pack the CPU copies, if kept, the same way
+    // ----------------------------------------------------------------------------- //
+    
+    bool mirrored = !merger.Enabled();
+    std::vector<anopol::render::gpuVertex> vertices(mirrored ? compaction.vertexEnd : 0);
+    std::vector<uint32_t> indices(mirrored ? compaction.indexEnd : 0);
+    
+    for (uint32_t mesh = 0; mesh < meshCombineGroup.meshes.size(); mesh++) {
+        if (meshCombineGroup.meshes[mesh].source == nullptr) continue;
+        
+        batchDrawInformation& drawInfo = drawInformation[mesh];
+        uint32_t firstVertex = meshFirstVertex(drawInfo);
+        if (mirrored) {
+            std::copy(batchVertices.begin() + firstVertex, batchVertices.begin() + firstVertex + drawInfo.vertexCount,
+                      vertices.begin() + compaction.firstVertex[mesh]);
+        }
+        
+        if (drawInfo.drawType == indexed) {
+            if (mirrored) {
+                std::copy(batchIndices.begin() + drawInfo.firstIndex, batchIndices.begin() + drawInfo.firstIndex + drawInfo.indexCount,
+                          indices.begin() + compaction.firstIndex[mesh]);
+            }
+            drawInfo.firstIndex   = compaction.firstIndex[mesh];
+            drawInfo.vertexOffset = compaction.firstVertex[mesh];
+        }
+        else {
+            drawInfo.firstVertex = compaction.firstVertex[mesh];
+        }
+    }
+    
+    vertexHeap.Reset(compaction.vertexEnd);
+    indexHeap.Reset(compaction.indexEnd);
+    for (const batchRange& range : compaction.abandonedVertices) vertexHeap.Free(range.first, range.count);
+    for (const batchRange& range : compaction.abandonedIndices)  indexHeap.Free(range.first, range.count);
+    
+    if (mirrored) {
+        vertices.resize(vertexHeap.End());
+        indices.resize(indexHeap.End());
+        batchVertices.swap(vertices);
+        batchIndices.swap(indices);
+    }
+    
+    compaction.active = false;
+    
+    if (Chunking()) return;
+    
+    // ----------------------------------------------------------------------------- //
+    // Swap in the packed buffers; the old ones go once this upload batch has completed
+    // ----------------------------------------------------------------------------- //
+    
+    anopol::ll::retireBuffer(vertexBuffer.buffer, vertexBuffer.memory);
+    anopol::ll::retireBuffer(indexBuffer.buffer, indexBuffer.memory);
+    vertexBuffer = compaction.vertexBuffer;
+    indexBuffer  = compaction.indexBuffer;
+    compaction.vertexBuffer = anopol::ll::GrowableBuffer();
+    compaction.indexBuffer  = anopol::ll::GrowableBuffer();
+    
+    if (culler.Enabled()) {
+        pr_UpdateCullMeshes();
+    }
+    else if (!cpuCulling) {
+        for (int i = 0; i < anopol_max_frames; i++) {
+            if (!frames[i].empty) pr_WriteDrawCommands(frames[i]);
+        }
+    }
+    
+    pendingUpload = anopol::ll::lastUploadToken();
 }
 
 
@@ -0,0 +1,102 @@
+//
+//  batch_heap.h
+//  anopol
+//
+//  Created by Dmitri Wamback on 2026-10-17.
+//
+
+#ifndef batch_heap_h
+#define batch_heap_h
+
+namespace anopol::batch {
+
+//------------------------------------------------------------------------------------------//
+// Batch heap
+//
+// Hands out [first, first + count) ranges of a buffer counted in elements (vertices or
+// indices). Freed ranges are kept sorted and merged with their neighbours, and Allocate
+// takes the first one that is large enough before growing the end. A free range that
+// reaches the end pulls the end back instead of staying a hole.
+//------------------------------------------------------------------------------------------//
+
+typedef struct batchRange {
+    uint32_t first;
+    uint32_t count;
+} batchRange;
+
+class BatchHeap {
+public:
+    uint32_t Allocate(uint32_t count);
+    void Free(uint32_t first, uint32_t count);
+    void Reset(uint32_t end);
+
+    uint32_t End() const { return end; }
+    uint32_t FreeCount() const { return freeCount; }    // In holes below End()
+
+private:
+    std::vector<batchRange> freeRanges;                 // Sorted by first, never touching
+    uint32_t end = 0, freeCount = 0;
+};
+
+uint32_t BatchHeap::Allocate(uint32_t count) {
+
+    if (count == 0) return 0;
+
+    for (size_t i = 0; i < freeRanges.size(); i++) {
+
+        batchRange& range = freeRanges[i];
+        if (range.count < count) continue;
+
+        uint32_t first = range.first;
+        range.first += count;
+        range.count -= count;
+        if (range.count == 0) freeRanges.erase(freeRanges.begin() + i);
+
+        freeCount -= count;
+        return first;
+    }
+
+    uint32_t first = end;
+    end += count;
+    return first;
+}
+
+void BatchHeap::Free(uint32_t first, uint32_t count) {
+
+    if (count == 0) return;
+
+    auto next = std::lower_bound(freeRanges.begin(), freeRanges.end(), first,
+                                 [](const batchRange& range, uint32_t value) { return range.first < value; });
+    size_t i = static_cast<size_t>(next - freeRanges.begin());
+
+    freeRanges.insert(next, {first, count});
+    freeCount += count;
+
+    if (i + 1 < freeRanges.size() && freeRanges[i].first + freeRanges[i].count == freeRanges[i + 1].first) {
+        freeRanges[i].count += freeRanges[i + 1].count;
+        freeRanges.erase(freeRanges.begin() + i + 1);
+    }
+    if (i > 0 && freeRanges[i - 1].first + freeRanges[i - 1].count == freeRanges[i].first) {
+        freeRanges[i - 1].count += freeRanges[i].count;
+        freeRanges.erase(freeRanges.begin() + i);
+    }
+
+    const batchRange& last = freeRanges.back();
+    if (last.first + last.count == end) {
+        end = last.first;
+        freeCount -= last.count;
+        freeRanges.pop_back();
+    }
+}
+
+// Everything below end in use, as after a compaction
+void BatchHeap::Reset(uint32_t end) {
+
+    freeRanges.clear();
+    this->end = end;
+    freeCount = 0;
+}
+
+}
+
+#endif /* batch_heap_h */
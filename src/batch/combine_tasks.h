@@ -0,0 +1,94 @@
+//
+//  combine_tasks.h
+//  anopol
+//
+//  Created by Dmitri Wamback on 2026-10-17.
+//
+
+#ifndef combine_tasks_h
+#define combine_tasks_h
+
+#define anopol_combine_objects_per_task 2048    // Transforms and spheres; smaller tasks cost more to launch than to run
+#define anopol_combine_meshes_per_task  16      // Unique meshes, each copying all of its vertices
+
+namespace anopol::batch {
+
+//------------------------------------------------------------------------------------------//
+// Combine tasks
+//
+// Batch::Combine splits its per-object and per-mesh work into contiguous ranges, one per
+// task, so every task writes a disjoint part of arrays sized up front. The first range
+// runs on the calling thread. With one thread everything runs inline, which is the
+// serial path the combine benchmark compares against.
+//------------------------------------------------------------------------------------------//
+
+size_t combineTaskCount(size_t count, uint32_t threads, size_t minimumPerTask) {
+    size_t tasks = (count + minimumPerTask - 1) / minimumPerTask;
+    return std::max<size_t>(1, std::min<size_t>(threads, tasks));
+}
+
+// body(task, start, end) for every range of [0, count), waiting for all of them
+template<typename Body>
+void combineRanges(size_t count, uint32_t threads, size_t minimumPerTask, Body&& body) {
+
+    size_t tasks = combineTaskCount(count, threads, minimumPerTask);
+    size_t chunkSize = (count + tasks - 1) / tasks;
+
+    if (tasks <= 1) {
+        body(size_t(0), size_t(0), count);
+        return;
+    }
+
+    std::vector<std::future<void>> futures;
+    futures.reserve(tasks - 1);
+
+    for (size_t task = 1; task < tasks; task++) {
+        size_t start = std::min(task * chunkSize, count);
+        size_t end = std::min(start + chunkSize, count);
+
+        futures.push_back(std::async(std::launch::async, [&body, task, start, end]() {
+            anopol_zone("Batch::Combine task");
+            body(task, start, end);
+        }));
+    }
+    body(size_t(0), size_t(0), std::min(chunkSize, count));
+
+    for (auto& future : futures) future.get();
+}
+
+// offsets[i] = countAt(0) + ... + countAt(i - 1), returning the total. Each task sums its
+// range, the few range totals are scanned in order, then each task writes its offsets
+template<typename CountAt>
+uint64_t combineExclusiveScan(size_t count, uint32_t threads, size_t minimumPerTask, CountAt&& countAt, std::vector<uint64_t>& offsets) {
+
+    offsets.resize(count);
+
+    std::vector<uint64_t> taskBases(combineTaskCount(count, threads, minimumPerTask), 0);
+
+    combineRanges(count, threads, minimumPerTask, [&](size_t task, size_t start, size_t end) {
+        uint64_t sum = 0;
+        for (size_t i = start; i < end; i++) sum += countAt(i);
+        taskBases[task] = sum;
+    });
+
+    uint64_t total = 0;
+    for (uint64_t& base : taskBases) {
+        uint64_t sum = base;
+        base = total;
+        total += sum;
+    }
+
+    combineRanges(count, threads, minimumPerTask, [&](size_t task, size_t start, size_t end) {
+        uint64_t offset = taskBases[task];
+        for (size_t i = start; i < end; i++) {
+            offsets[i] = offset;
+            offset += countAt(i);
+        }
+    });
+
+    return total;
+}
+
+}
+
+#endif /* combine_tasks_h */
@@ -0,0 +1,195 @@
+//
+//  cpu_cull.h
+//  anopol
+//
+//  Created by Dmitri Wamback on 2026-10-17.
+//
+
+#ifndef cpu_cull_h
+#define cpu_cull_h
+
+#define anopol_cull_lanes               8
+#define anopol_cull_blocks_per_task     1024    // 8192 spheres; smaller tasks cost more to launch than to test
+
+namespace anopol::batch {
+
+//------------------------------------------------------------------------------------------//
+// CPU culling
+//
+// World-space bounding spheres kept as structure of arrays, so eight spheres are tested
+// against a plane with one multiply-add per component (AVX, two NEON registers, or a
+// plain loop the compiler can vectorize). The arrays are padded to whole blocks of eight;
+// padding lanes have a radius that no plane accepts, so they always come out culled.
+//------------------------------------------------------------------------------------------//
+
+struct boundingSpheres {
+    std::vector<float> x, y, z, radius;
+    size_t count = 0;
+
+    void Push(const glm::vec3& center, float sphereRadius);
+    void Set(size_t i, const glm::vec3& center, float sphereRadius);
+    void Resize(size_t newCount);
+    size_t Blocks() const { return (count + anopol_cull_lanes - 1) / anopol_cull_lanes; }
+};
+
+void boundingSpheres::Push(const glm::vec3& center, float sphereRadius) {
+
+    if (count % anopol_cull_lanes == 0) {
+        size_t padded = count + anopol_cull_lanes;
+        x.resize(padded, 0.0f);
+        y.resize(padded, 0.0f);
+        z.resize(padded, 0.0f);
+        radius.resize(padded, std::numeric_limits<float>::lowest());
+    }
+    x[count]        = center.x;
+    y[count]        = center.y;
+    z[count]        = center.z;
+    radius[count]   = sphereRadius;
+    count++;
+}
+
+void boundingSpheres::Set(size_t i, const glm::vec3& center, float sphereRadius) {
+    x[i]        = center.x;
+    y[i]        = center.y;
+    z[i]        = center.z;
+    radius[i]   = sphereRadius;
+}
+
+// Grows to newCount spheres; the new ones start out culled, like the padding lanes
+void boundingSpheres::Resize(size_t newCount) {
+
+    size_t padded = (newCount + anopol_cull_lanes - 1) / anopol_cull_lanes * anopol_cull_lanes;
+    x.resize(padded, 0.0f);
+    y.resize(padded, 0.0f);
+    z.resize(padded, 0.0f);
+    radius.resize(padded, std::numeric_limits<float>::lowest());
+    count = newCount;
+}
+
+// Center of the bounds and the distance to the farthest vertex; not minimal, but cheap and
+// shared by every culling path
+glm::vec4 localBoundingSphere(const std::vector<anopol::render::Vertex>& vertices) {
+
+    glm::vec3 min = vertices.empty() ? glm::vec3(0.0f) : vertices[0].vertex;
+    glm::vec3 max = min;
+    for (const anopol::render::Vertex& vertex : vertices) {
+        min = glm::min(min, vertex.vertex);
+        max = glm::max(max, vertex.vertex);
+    }
+    glm::vec3 center = (min + max) * 0.5f;
+    float radius = 0.0f;
+    for (const anopol::render::Vertex& vertex : vertices) {
+        radius = std::max(radius, glm::distance(center, vertex.vertex));
+    }
+    return glm::vec4(center, radius);
+}
+
+// A local sphere placed by a model matrix, its radius grown by the largest axis scale
+glm::vec4 worldBoundingSphere(const glm::vec4& sphere, const glm::mat4& model) {
+
+    float maxScale = std::max({glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))});
+    return glm::vec4(glm::vec3(model * glm::vec4(glm::vec3(sphere), 1.0f)), sphere.w * maxScale);
+}
+
+// Bit i is set when sphere block * 8 + i is on the inner side of (or touching) all six planes
+uint8_t cullSphereBlock(const std::array<glm::vec4, 6>& planes, const boundingSpheres& spheres, size_t block) {
+
+    size_t first = block * anopol_cull_lanes;
+
+#if defined(__AVX__)
+    __m256 x = _mm256_loadu_ps(&spheres.x[first]);
+    __m256 y = _mm256_loadu_ps(&spheres.y[first]);
+    __m256 z = _mm256_loadu_ps(&spheres.z[first]);
+    __m256 negativeRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&spheres.radius[first]));
+
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+    for (const glm::vec4& plane : planes) {
+        __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.x), x),
+                                                      _mm256_mul_ps(_mm256_set1_ps(plane.y), y)),
+                                        _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.z), z),
+                                                      _mm256_set1_ps(plane.w)));
+        inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+    }
+    return static_cast<uint8_t>(_mm256_movemask_ps(inside));
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const uint32_t weights[4] = { 1, 2, 4, 8 };
+    uint32x4_t bits = vld1q_u32(weights);
+    uint8_t mask = 0;
+
+    for (size_t half = 0; half < 2; half++) {
+
+        size_t lane = first + half * 4;
+        float32x4_t x = vld1q_f32(&spheres.x[lane]);
+        float32x4_t y = vld1q_f32(&spheres.y[lane]);
+        float32x4_t z = vld1q_f32(&spheres.z[lane]);
+        float32x4_t negativeRadius = vnegq_f32(vld1q_f32(&spheres.radius[lane]));
+
+        uint32x4_t inside = vdupq_n_u32(0xFFFFFFFF);
+
+        for (const glm::vec4& plane : planes) {
+            float32x4_t distance = vdupq_n_f32(plane.w);
+            distance = vmlaq_n_f32(distance, x, plane.x);
+            distance = vmlaq_n_f32(distance, y, plane.y);
+            distance = vmlaq_n_f32(distance, z, plane.z);
+            inside = vandq_u32(inside, vcgeq_f32(distance, negativeRadius));
+        }
+        mask |= static_cast<uint8_t>(vaddvq_u32(vandq_u32(inside, bits)) << (half * 4));
+    }
+    return mask;
+
+#else
+    bool inside[anopol_cull_lanes];
+    for (size_t lane = 0; lane < anopol_cull_lanes; lane++) inside[lane] = true;
+
+    for (const glm::vec4& plane : planes) {
+        for (size_t lane = 0; lane < anopol_cull_lanes; lane++) {
+            size_t i = first + lane;
+            float distance = plane.x * spheres.x[i] + plane.y * spheres.y[i] + plane.z * spheres.z[i] + plane.w;
+            inside[lane] = inside[lane] && distance >= -spheres.radius[i];
+        }
+    }
+
+    uint8_t mask = 0;
+    for (size_t lane = 0; lane < anopol_cull_lanes; lane++) {
+        if (inside[lane]) mask |= static_cast<uint8_t>(1u << lane);
+    }
+    return mask;
+#endif
+}
+
+// One mask per block of eight spheres, blocks split evenly across the hardware threads
+void cullSpheres(const std::array<glm::vec4, 6>& planes, const boundingSpheres& spheres, std::vector<uint8_t>& masks) {
+
+    anopol_zone("cullSpheres");
+
+    size_t blocks = spheres.Blocks();
+    masks.resize(blocks);
+
+    size_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    size_t tasks = std::min(hardwareThreads, (blocks + anopol_cull_blocks_per_task - 1) / anopol_cull_blocks_per_task);
+
+    if (tasks <= 1) {
+        for (size_t block = 0; block < blocks; block++) masks[block] = cullSphereBlock(planes, spheres, block);
+        return;
+    }
+
+    size_t chunkSize = (blocks + tasks - 1) / tasks;
+    std::vector<std::future<void>> futures;
+
+    for (size_t task = 0; task < tasks; task++) {
+        size_t start = task * chunkSize;
+        size_t end = std::min(start + chunkSize, blocks);
+
+        futures.push_back(std::async(std::launch::async, [start, end, &planes, &spheres, &masks]() {
+            anopol_zone("cullSpheres task");
+            for (size_t block = start; block < end; block++) masks[block] = cullSphereBlock(planes, spheres, block);
+        }));
+    }
+    for (auto& future : futures) future.get();
+}
+
+}
+
+#endif /* cpu_cull_h */
@@ -8,10 +8,190 @@
 #ifndef dynamic_upload_h
 #define dynamic_upload_h
 
+#define anopol_scatter_workgroup_size 64
+
 namespace anopol::batch {
 
-void DynamicUpload(Batch* batch) {
-    
+//------------------------------------------------------------------------------------------//
+// Dynamic upload
+//
+// Moving objects are written into the frame's transform buffer on the graphics queue, ahead
+// of culling: the batch fills a persistently mapped list of (object, transform) entries for
+// the frame, and one compute dispatch scatters them into place. Nothing goes through the
+// staging ring, so animating objects never makes the frame wait on the transfer queue.
+// Without the compiled shader the entries are copied with one region each instead.
+//------------------------------------------------------------------------------------------//
+
+class TransformScatter {
+public:
+    void Initialize(VkShaderModule shader);
+    void Dispatch(VkCommandBuffer commandBuffer, uint32_t frame, VkBuffer entries, const transformScatterEntry* mapped, uint32_t count, VkBuffer transforms);
+    void Destroy();
+
+    bool Enabled() const { return pipeline != VK_NULL_HANDLE; }
+
+private:
+    VkDescriptorPool        descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSetLayout   descriptorSetLayout = VK_NULL_HANDLE;
+    VkDescriptorSet         descriptorSets[anopol_max_frames];
+    VkPipelineLayout        pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline              pipeline = VK_NULL_HANDLE;
+
+    std::vector<VkBufferCopy> copies;      // Fallback regions, reused every frame
+};
+
+void TransformScatter::Initialize(VkShaderModule shader) {
+
+    if (shader == VK_NULL_HANDLE) return;
+
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+    for (uint32_t i = 0; i < bindings.size(); i++) {
+        bindings[i].binding         = i;
+        bindings[i].descriptorCount = 1;
+        bindings[i].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings    = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(context->device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) anopol_assert("Failed to create scatter descriptor set layout");
+
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type               = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSize.descriptorCount    = static_cast<uint32_t>(bindings.size()) * anopol_max_frames;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType          = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount  = 1;
+    poolInfo.pPoolSizes     = &poolSize;
+    poolInfo.maxSets        = anopol_max_frames;
+
+    if (vkCreateDescriptorPool(context->device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) anopol_assert("Failed to create scatter descriptor pool");
+
+    std::array<VkDescriptorSetLayout, anopol_max_frames> layouts;
+    layouts.fill(descriptorSetLayout);
+
+    VkDescriptorSetAllocateInfo allocationInfo{};
+    allocationInfo.sType                = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocationInfo.descriptorPool       = descriptorPool;
+    allocationInfo.descriptorSetCount   = anopol_max_frames;
+    allocationInfo.pSetLayouts          = layouts.data();
+
+    if (vkAllocateDescriptorSets(context->device, &allocationInfo, descriptorSets) != VK_SUCCESS) anopol_assert("Failed to allocate scatter descriptor sets");
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags    = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset        = 0;
+    pushConstantRange.size          = sizeof(uint32_t);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType                    = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount           = 1;
+    pipelineLayoutInfo.pSetLayouts              = &descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount   = 1;
+    pipelineLayoutInfo.pPushConstantRanges      = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(context->device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) anopol_assert("Failed to create scatter pipeline layout");
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType          = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType    = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage    = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module   = shader;
+    pipelineInfo.stage.pName    = "main";
+    pipelineInfo.layout         = pipelineLayout;
+
+    if (anopol::ll::createComputePipelines(1, &pipelineInfo, &pipeline) != VK_SUCCESS) anopol_assert("Couldn't create scatter pipeline");
+}
+
+// Recorded before anything reads the transforms this frame: the cull passes and the vertex shader
+void TransformScatter::Dispatch(VkCommandBuffer commandBuffer, uint32_t frame, VkBuffer entries, const transformScatterEntry* mapped, uint32_t count, VkBuffer transforms) {
+
+    if (count == 0) return;
+
+    anopol_zone("TransformScatter::Dispatch");
+    uint32_t scope = anopol::ll::gpuProfiler.Begin(commandBuffer, "transform scatter");
+
+    VkMemoryBarrier barrier{};
+    barrier.sType           = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.dstAccessMask   = VK_ACCESS_SHADER_READ_BIT;
+
+    VkPipelineStageFlags srcStage;
+
+    if (Enabled()) {
+
+        // The scatter buffer may have been replaced since this frame slot last ran
+        std::array<VkDescriptorBufferInfo, 2> bufferInfos = {{
+            { entries,      0, VK_WHOLE_SIZE },
+            { transforms,   0, VK_WHOLE_SIZE }
+        }};
+
+        std::array<VkWriteDescriptorSet, 2> writes{};
+        for (uint32_t i = 0; i < writes.size(); i++) {
+            writes[i].sType             = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].dstSet            = descriptorSets[frame];
+            writes[i].dstBinding        = i;
+            writes[i].descriptorType    = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[i].descriptorCount   = 1;
+            writes[i].pBufferInfo       = &bufferInfos[i];
+        }
+        vkUpdateDescriptorSets(context->device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[frame], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &count);
+        vkCmdDispatch(commandBuffer, (count + anopol_scatter_workgroup_size - 1) / anopol_scatter_workgroup_size, 1, 1);
+
+        srcStage                = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        barrier.srcAccessMask   = VK_ACCESS_SHADER_WRITE_BIT;
+    }
+    else {
+
+        copies.resize(count);
+
+        for (uint32_t i = 0; i < count; i++) {
+            copies[i].srcOffset = sizeof(transformScatterEntry) * i + offsetof(transformScatterEntry, transformation);
+            copies[i].dstOffset = sizeof(batchIndirectTransformation) * mapped[i].object;
+            copies[i].size      = sizeof(batchIndirectTransformation);
+        }
+
+        vkCmdCopyBuffer(commandBuffer, entries, transforms, count, copies.data());
+
+        srcStage                = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        barrier.srcAccessMask   = VK_ACCESS_TRANSFER_WRITE_BIT;
+    }
+
+    vkCmdPipelineBarrier(commandBuffer, srcStage, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0,
+                         1, &barrier, 0, nullptr, 0, nullptr);
+
+    anopol::ll::gpuProfiler.End(commandBuffer, scope);
+}
+
+void TransformScatter::Destroy() {
+
+    if (!Enabled()) return;
+
+    vkDestroyPipeline(context->device, pipeline, nullptr);
+    vkDestroyPipelineLayout(context->device, pipelineLayout, nullptr);
+    vkDestroyDescriptorPool(context->device, descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(context->device, descriptorSetLayout, nullptr);
+    pipeline = VK_NULL_HANDLE;
+}
+
+TransformScatter transformScatter;
+
+// Once per frame after the fence wait, before the batch is culled or drawn
+void DynamicUpload(Batch* batch, VkCommandBuffer commandBuffer, uint32_t currentFrame) {
+
+    uint32_t count = batch->PrepareDynamicUpload(currentFrame);
+    if (count == 0) return;
+
+    const Batch::batchFrame& frame = batch->GetBatchFrame(currentFrame);
+    transformScatter.Dispatch(commandBuffer, currentFrame, frame.scatterBuffer,
+                              static_cast<const transformScatterEntry*>(frame.scatterBufferMemory.mapped), count, frame.transformBuffer);
 }
 
 }
@@ -0,0 +1,465 @@
+//
+//  gpu_cull.h
+//  anopol
+//
+//  Created by Dmitri Wamback on 2026-10-17.
+//
+
+#ifndef gpu_cull_h
+#define gpu_cull_h
+
+namespace anopol::batch {
+
+//------------------------------------------------------------------------------------------//
+// GPU culling
+//
+// Two compute passes over the batch, recorded before the render pass:
+//  0. one thread per object tests its bounding sphere against the frustum and appends the
+//     survivors to its mesh's instance range
+//  1. one thread per mesh writes a draw command for every mesh with visible instances and
+//     bumps the draw count; the batch then draws with vkCmdDraw(Indexed)IndirectCount
+// Nothing is read back, so the CPU cost is the same whatever the camera sees.
+//
+// With the Hi-Z pyramid built, pass 0 also tests against last frame's depth and sets aside
+// what it hides. After the early pass has been drawn and the pyramid rebuilt from it,
+// DispatchLate retests those objects (pass 2) and compacts the ones that came back into
+// a second command stream (pass 3), drawn by a late pass on top. Objects revealed this
+// frame are not dropped for a frame; they are drawn late instead.
+//------------------------------------------------------------------------------------------//
+
+// std430 layout, mirrors batch_cull.comp
+typedef struct cullMesh {
+    glm::vec4   sphere;         // Local center, radius
+    uint32_t    first;          // First vertex or first index
+    uint32_t    count;          // Vertex or index count
+    int32_t     vertexOffset;
+    uint32_t    firstInstance;
+    uint32_t    indexed;
+    uint32_t    pad[3];
+} cullMesh;
+
+typedef struct cullPushConstants {
+    uint32_t    objectCount;
+    uint32_t    meshCount;
+    uint32_t    pass;
+    uint32_t    flags;
+} cullPushConstants;
+
+// std140, per frame
+typedef struct cullUniform {
+    glm::vec4   planes[6];
+    glm::mat4   viewProjection;
+    glm::mat4   previousViewProjection;
+    glm::vec4   pyramidSize;            // Width, height, levels
+} cullUniform;
+
+// Transform indices for the batch, whole transforms for instanced assets that feed them
+// straight to the vertex input
+enum cullOutput {
+    cullIndices     = 0,
+    cullTransforms  = 1
+};
+
+typedef struct cullTargets {
+    VkBuffer    transforms;
+    VkBuffer    visibleInstances;           // Per visible instance, grouped by mesh; see cullOutput
+    VkBuffer    drawCommands;
+    VkBuffer    indexedDrawCommands;
+    VkBuffer    lateDrawCommands;           // Objects the late pass found
+    VkBuffer    lateIndexedDrawCommands;
+} cullTargets;
+
+#define anopol_cull_workgroup_size          64
+#define anopol_cull_storage_binding_count   12
+#define anopol_cull_binding_count           14      // Storage buffers, the uniform, the pyramid
+
+#define anopol_cull_copy_transforms         1u
+#define anopol_cull_occlusion               2u
+
+// Mesh index of a removed object; pass 0 skips it
+#define anopol_cull_removed_object          0xFFFFFFFFu
+
+// Offsets into the draw count buffer
+#define anopol_cull_early_counts            0
+#define anopol_cull_late_counts             (sizeof(uint32_t) * 2)
+
+class GpuCuller {
+public:
+
+    static bool Supported();
+
+    // The Hi-Z pyramid has to exist first; its image is bound even while occlusion is off
+    void Initialize(VkShaderModule shader, cullOutput output = cullIndices);
+    void SetMeshes(const std::vector<cullMesh>& meshes);
+    void AppendObjects(const uint32_t* objectMeshes, size_t count);
+    void SetObjectMesh(uint32_t object, uint32_t mesh);
+    void Dispatch(VkCommandBuffer commandBuffer, uint32_t frame, const glm::mat4& viewProjection, uint32_t objectCount, const cullTargets& targets);
+    void DispatchLate(VkCommandBuffer commandBuffer, uint32_t frame);
+    void MarkGraphicsUse(uint32_t frame) const;
+    void Destroy();
+
+    bool Enabled() const { return enabled; }
+    bool Occlusion() const { return enabled && anopol::ll::hizPyramid.Enabled(); }
+    VkBuffer DrawCountBuffer(uint32_t frame) const { return drawCountBuffers[frame]; }
+
+private:
+    bool enabled = false;
+    cullOutput output = cullIndices;
+    uint32_t meshCount = 0;
+    uint32_t dispatchedObjects[anopol_max_frames] = {};                 // By the early pass, for the late one
+
+    anopol::ll::GrowableBuffer objectMeshBuffer;                        // Mesh index per object
+    anopol::ll::GrowableBuffer meshBuffer;                              // cullMesh per mesh
+    anopol::ll::GrowableBuffer instanceCountBuffers[anopol_max_frames]; // Visible instances per mesh, then the early pass's
+    anopol::ll::GrowableBuffer rejectedBuffers[anopol_max_frames];      // Count, then the objects occluded in pass 0
+
+    VkBuffer                drawCountBuffers[anopol_max_frames];        // Early counts at 0 and 4, late at 8 and 12
+    anopol::ll::allocation  drawCountBufferMemory[anopol_max_frames];
+    VkBuffer                uniformBuffers[anopol_max_frames];
+    anopol::ll::allocation  uniformBufferMemory[anopol_max_frames];
+
+    VkDescriptorPool        descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSetLayout   descriptorSetLayout = VK_NULL_HANDLE;
+    VkDescriptorSet         descriptorSets[anopol_max_frames];
+    VkPipelineLayout        pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline              pipeline = VK_NULL_HANDLE;
+
+    void pr_Barrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+};
+
+bool GpuCuller::Supported() {
+    return anopol::ll::drawIndirectCountSupported;
+}
+
+void GpuCuller::Initialize(VkShaderModule shader, cullOutput output) {
+
+    if (!Supported()) return;
+    if (anopol::ll::hizPyramid.image == VK_NULL_HANDLE) anopol_assert("The Hi-Z pyramid must be initialized before GPU culling");
+
+    this->output = output;
+
+    //------------------------------------------------------------------------------------------//
+    // Buffers
+    //------------------------------------------------------------------------------------------//
+
+    objectMeshBuffer = anopol::ll::GrowableBuffer::Create(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    meshBuffer       = anopol::ll::GrowableBuffer::Create(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+    for (int i = 0; i < anopol_max_frames; i++) {
+        instanceCountBuffers[i] = anopol::ll::GrowableBuffer::Create(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+        rejectedBuffers[i]      = anopol::ll::GrowableBuffer::Create(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+        anopol::ll::createBuffer(sizeof(uint32_t) * 4,
+                                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                 drawCountBuffers[i],
+                                 drawCountBufferMemory[i]);
+
+        anopol::ll::createBuffer(sizeof(cullUniform),
+                                 VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                 uniformBuffers[i],
+                                 uniformBufferMemory[i]);
+    }
+
+    //------------------------------------------------------------------------------------------//
+    // Descriptors: storage buffers, then the uniform and the pyramid, see batch_cull.comp
+    //------------------------------------------------------------------------------------------//
+
+    std::array<VkDescriptorSetLayoutBinding, anopol_cull_binding_count> bindings{};
+    for (uint32_t i = 0; i < anopol_cull_binding_count; i++) {
+        bindings[i].binding         = i;
+        bindings[i].descriptorCount = 1;
+        bindings[i].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    bindings[anopol_cull_storage_binding_count].descriptorType      = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    bindings[anopol_cull_storage_binding_count + 1].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings    = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(context->device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) anopol_assert("Failed to create cull descriptor set layout");
+
+    std::array<VkDescriptorPoolSize, 3> poolSizes{};
+    poolSizes[0].type               = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[0].descriptorCount    = anopol_cull_storage_binding_count * anopol_max_frames;
+    poolSizes[1].type               = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[1].descriptorCount    = anopol_max_frames;
+    poolSizes[2].type               = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[2].descriptorCount    = anopol_max_frames;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType          = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount  = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes     = poolSizes.data();
+    poolInfo.maxSets        = anopol_max_frames;
+
+    if (vkCreateDescriptorPool(context->device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) anopol_assert("Failed to create cull descriptor pool");
+
+    std::array<VkDescriptorSetLayout, anopol_max_frames> layouts;
+    layouts.fill(descriptorSetLayout);
+
+    VkDescriptorSetAllocateInfo allocationInfo{};
+    allocationInfo.sType                = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocationInfo.descriptorPool       = descriptorPool;
+    allocationInfo.descriptorSetCount   = anopol_max_frames;
+    allocationInfo.pSetLayouts          = layouts.data();
+
+    if (vkAllocateDescriptorSets(context->device, &allocationInfo, descriptorSets) != VK_SUCCESS) anopol_assert("Failed to allocate cull descriptor sets");
+
+    //------------------------------------------------------------------------------------------//
+    // Pipeline
+    //------------------------------------------------------------------------------------------//
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags    = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset        = 0;
+    pushConstantRange.size          = sizeof(cullPushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType                    = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount           = 1;
+    pipelineLayoutInfo.pSetLayouts              = &descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount   = 1;
+    pipelineLayoutInfo.pPushConstantRanges      = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(context->device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) anopol_assert("Failed to create cull pipeline layout");
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType          = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType    = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage    = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module   = shader;
+    pipelineInfo.stage.pName    = "main";
+    pipelineInfo.layout         = pipelineLayout;
+
+    if (anopol::ll::createComputePipelines(1, &pipelineInfo, &pipeline) != VK_SUCCESS) anopol_assert("Couldn't create cull pipeline");
+
+    enabled = true;
+}
+
+// Mesh ranges shift whenever an earlier mesh gains instances, so the whole (small) list is rewritten
+void GpuCuller::SetMeshes(const std::vector<cullMesh>& meshes) {
+
+    if (!enabled) return;
+
+    meshBuffer.Write(0, meshes.data(), sizeof(cullMesh) * meshes.size());
+    meshCount = static_cast<uint32_t>(meshes.size());
+}
+
+void GpuCuller::AppendObjects(const uint32_t* objectMeshes, size_t count) {
+
+    if (!enabled) return;
+
+    objectMeshBuffer.Append(objectMeshes, sizeof(uint32_t) * count);
+}
+
+// For objects already appended: a reused slot, or anopol_cull_removed_object
+void GpuCuller::SetObjectMesh(uint32_t object, uint32_t mesh) {
+
+    if (!enabled) return;
+
+    objectMeshBuffer.Write(sizeof(uint32_t) * object, &mesh, sizeof(uint32_t));
+}
+
+void GpuCuller::pr_Barrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+
+    VkMemoryBarrier barrier{};
+    barrier.sType           = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask   = srcAccess;
+    barrier.dstAccessMask   = dstAccess;
+
+    vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void GpuCuller::Dispatch(VkCommandBuffer commandBuffer, uint32_t frame, const glm::mat4& viewProjection, uint32_t objectCount, const cullTargets& targets) {
+
+    dispatchedObjects[frame] = 0;
+
+    if (!enabled || objectCount == 0 || meshCount == 0) return;
+
+    anopol_zone("GpuCuller::Dispatch");
+
+    const anopol::ll::HiZPyramid& pyramid = anopol::ll::hizPyramid;
+
+    anopol::ll::GrowableBuffer& instanceCounts = instanceCountBuffers[frame];
+    anopol::ll::GrowableBuffer& rejected = rejectedBuffers[frame];
+    instanceCounts.Reserve(sizeof(uint32_t) * meshCount * 2);
+    rejected.Reserve(sizeof(uint32_t) * (objectCount + 1));
+
+    // Only occlusion against a pyramid that holds a frame; the first frame draws everything early
+    bool occlusion = pyramid.Enabled() && pyramid.built;
+
+    cullUniform uniform{};
+    std::array<glm::vec4, 6> planes = anopol::camera::ExtractFrustumPlanes(viewProjection);
+    std::copy(planes.begin(), planes.end(), uniform.planes);
+    uniform.viewProjection          = viewProjection;
+    uniform.previousViewProjection  = pyramid.viewProjection;
+    uniform.pyramidSize             = glm::vec4(pyramid.width, pyramid.height, pyramid.levels, 0.0f);
+    memcpy(uniformBufferMemory[frame].mapped, &uniform, sizeof(cullUniform));
+
+    //------------------------------------------------------------------------------------------//
+    // Growable buffers may have moved since this frame slot last ran; its fence has been
+    // waited on, so the set can be rewritten. The output the shader doesn't write is bound
+    // to the one it does, only to keep the binding valid
+    //------------------------------------------------------------------------------------------//
+
+    VkBuffer visibleInstances = output == cullIndices ? targets.visibleInstances : targets.drawCommands;
+    VkBuffer visibleTransforms = output == cullTransforms ? targets.visibleInstances : targets.transforms;
+
+    std::array<VkDescriptorBufferInfo, anopol_cull_binding_count - 1> bufferInfos = {{
+        { targets.transforms,               0, VK_WHOLE_SIZE },
+        { objectMeshBuffer.buffer,          0, VK_WHOLE_SIZE },
+        { meshBuffer.buffer,                0, VK_WHOLE_SIZE },
+        { instanceCounts.buffer,            0, VK_WHOLE_SIZE },
+        { visibleInstances,                 0, VK_WHOLE_SIZE },
+        { targets.drawCommands,             0, VK_WHOLE_SIZE },
+        { targets.indexedDrawCommands,      0, VK_WHOLE_SIZE },
+        { drawCountBuffers[frame],          0, VK_WHOLE_SIZE },
+        { targets.lateDrawCommands,         0, VK_WHOLE_SIZE },
+        { targets.lateIndexedDrawCommands,  0, VK_WHOLE_SIZE },
+        { rejected.buffer,                  0, VK_WHOLE_SIZE },
+        { visibleTransforms,                0, VK_WHOLE_SIZE },
+        { uniformBuffers[frame],            0, sizeof(cullUniform) }
+    }};
+
+    VkDescriptorImageInfo pyramidInfo{};
+    pyramidInfo.sampler     = pyramid.sampler;
+    pyramidInfo.imageView   = pyramid.view;
+    pyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    std::array<VkWriteDescriptorSet, anopol_cull_binding_count> writes{};
+    for (uint32_t i = 0; i < anopol_cull_binding_count; i++) {
+        writes[i].sType             = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet            = descriptorSets[frame];
+        writes[i].dstBinding        = i;
+        writes[i].descriptorType    = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[i].descriptorCount   = 1;
+        if (i < bufferInfos.size()) writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    writes[anopol_cull_storage_binding_count].descriptorType        = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    writes[anopol_cull_storage_binding_count + 1].descriptorType    = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writes[anopol_cull_storage_binding_count + 1].pImageInfo        = &pyramidInfo;
+
+    vkUpdateDescriptorSets(context->device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+    //------------------------------------------------------------------------------------------//
+    // Record
+    //------------------------------------------------------------------------------------------//
+
+    uint32_t scope = anopol::ll::gpuProfiler.Begin(commandBuffer, "cull");
+
+    // The previous draw of this frame slot has finished reading the commands (fence), so only
+    // the counters need clearing
+    vkCmdFillBuffer(commandBuffer, instanceCounts.buffer, 0, sizeof(uint32_t) * meshCount * 2, 0);
+    vkCmdFillBuffer(commandBuffer, drawCountBuffers[frame], 0, sizeof(uint32_t) * 4, 0);
+    vkCmdFillBuffer(commandBuffer, rejected.buffer, 0, sizeof(uint32_t), 0);
+    pr_Barrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+               VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[frame], 0, nullptr);
+
+    cullPushConstants pushConstants{};
+    pushConstants.objectCount   = objectCount;
+    pushConstants.meshCount     = meshCount;
+    pushConstants.flags         = (output == cullTransforms ? anopol_cull_copy_transforms : 0) | (occlusion ? anopol_cull_occlusion : 0);
+
+    // Pass 0: per object
+    pushConstants.pass = 0;
+    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(cullPushConstants), &pushConstants);
+    vkCmdDispatch(commandBuffer, (objectCount + anopol_cull_workgroup_size - 1) / anopol_cull_workgroup_size, 1, 1);
+
+    pr_Barrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+               VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    // Pass 1: per mesh
+    pushConstants.pass = 1;
+    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(cullPushConstants), &pushConstants);
+    vkCmdDispatch(commandBuffer, (meshCount + anopol_cull_workgroup_size - 1) / anopol_cull_workgroup_size, 1, 1);
+
+    // Instanced assets read the compacted transforms as vertex attributes
+    pr_Barrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+               VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+               VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    anopol::ll::gpuProfiler.End(commandBuffer, scope);
+
+    dispatchedObjects[frame] = objectCount;
+}
+
+// Recorded after hizPyramid.Build, outside any render pass. Pass 2 finds nothing to retest
+// when pass 0 ran without occlusion, so the late counts stay zero
+void GpuCuller::DispatchLate(VkCommandBuffer commandBuffer, uint32_t frame) {
+
+    if (!Occlusion() || dispatchedObjects[frame] == 0) return;
+
+    anopol_zone("GpuCuller::DispatchLate");
+
+    uint32_t scope = anopol::ll::gpuProfiler.Begin(commandBuffer, "late cull");
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[frame], 0, nullptr);
+
+    cullPushConstants pushConstants{};
+    pushConstants.objectCount   = dispatchedObjects[frame];
+    pushConstants.meshCount     = meshCount;
+    pushConstants.flags         = (output == cullTransforms ? anopol_cull_copy_transforms : 0) | anopol_cull_occlusion;
+
+    // Pass 2: per rejected object; the list is at most as long as the object count
+    pushConstants.pass = 2;
+    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(cullPushConstants), &pushConstants);
+    vkCmdDispatch(commandBuffer, (dispatchedObjects[frame] + anopol_cull_workgroup_size - 1) / anopol_cull_workgroup_size, 1, 1);
+
+    pr_Barrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+               VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    // Pass 3: per mesh
+    pushConstants.pass = 3;
+    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(cullPushConstants), &pushConstants);
+    vkCmdDispatch(commandBuffer, (meshCount + anopol_cull_workgroup_size - 1) / anopol_cull_workgroup_size, 1, 1);
+
+    pr_Barrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+               VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+               VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+
+    anopol::ll::gpuProfiler.End(commandBuffer, scope);
+}
+
+void GpuCuller::MarkGraphicsUse(uint32_t frame) const {
+
+    if (!enabled) return;
+
+    for (VkBuffer buffer : {objectMeshBuffer.buffer, meshBuffer.buffer, instanceCountBuffers[frame].buffer, rejectedBuffers[frame].buffer, drawCountBuffers[frame]}) {
+        anopol::ll::markGraphicsUse(buffer);
+    }
+}
+
+void GpuCuller::Destroy() {
+
+    if (!enabled) return;
+
+    objectMeshBuffer.Destroy();
+    meshBuffer.Destroy();
+
+    for (int i = 0; i < anopol_max_frames; i++) {
+        instanceCountBuffers[i].Destroy();
+        rejectedBuffers[i].Destroy();
+        anopol::ll::freeBuffer(drawCountBuffers[i], drawCountBufferMemory[i]);
+        anopol::ll::freeBuffer(uniformBuffers[i], uniformBufferMemory[i]);
+    }
+
+    vkDestroyPipeline(context->device, pipeline, nullptr);
+    vkDestroyPipelineLayout(context->device, pipelineLayout, nullptr);
+    vkDestroyDescriptorPool(context->device, descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(context->device, descriptorSetLayout, nullptr);
+
+    enabled = false;
+}
+
+}
+
+#endif /* gpu_cull_h */
@@ -0,0 +1,296 @@
+//
+//  gpu_merge.h
+//  anopol
+//
+//  Created by Dmitri Wamback on 2026-10-17.
+//
+
+#ifndef gpu_merge_h
+#define gpu_merge_h
+
+#define anopol_merge_workgroup_size 64
+#define anopol_merge_max_groups     65535       // maxComputeWorkGroupCount[0] every device supports
+
+namespace anopol::batch {
+
+//------------------------------------------------------------------------------------------//
+// GPU merge
+//
+// New meshes' geometry is staged packed, as it comes, into source buffers, and one compute
+// dispatch on the frame's command buffer copies every mesh to the range the batch placed it
+// at. The batch then keeps no CPU copy of its merged geometry. Placement stays with the
+// batch's heaps rather than atomics in the shader, so draw commands, compaction and Remove
+// know where every mesh is without reading anything back.
+// The port of batchMergeVertices in mtl_batch_compute.metal, for every platform
+//------------------------------------------------------------------------------------------//
+
+// std430 layout, mirrors batch_merge.comp
+typedef struct RenderableInformation {
+    uint32_t    sourceVertex;       // In the staged sources
+    uint32_t    sourceIndex;
+    uint32_t    vertexCount;
+    uint32_t    indexCount;
+    uint32_t    firstVertex;        // In the batch's buffers
+    uint32_t    firstIndex;
+    uint32_t    isIndexed;
+    uint32_t    mesh;
+} RenderableInformation;
+
+typedef struct mergePushConstants {
+    uint32_t    firstRenderable;
+    uint32_t    vertexWords;
+} mergePushConstants;
+
+class GpuMerger {
+public:
+    void Initialize(VkShaderModule shader);
+    void Queue(uint32_t mesh, const std::vector<anopol::render::Vertex>& vertices, const std::vector<uint32_t>& indices,
+               const anopol::render::meshQuantization& quantization, uint32_t slot, uint32_t firstVertex, uint32_t firstIndex);
+    void Cancel(uint32_t mesh);
+    void Dispatch(VkCommandBuffer commandBuffer, uint32_t frame, VkBuffer vertices, VkBuffer indices);
+    void Destroy();
+
+    bool Enabled() const { return pipeline != VK_NULL_HANDLE; }
+    bool Pending() const { return !queued.empty(); }
+    bool Queued(uint32_t mesh) const;
+
+private:
+    std::vector<RenderableInformation> queued;
+
+    // Queue fills one set of sources while frames that dispatched the others may still read them
+    anopol::ll::GrowableBuffer  sourceVertices[anopol_max_frames], sourceIndices[anopol_max_frames];
+    uint32_t                    queueSet = 0;
+    VkBuffer                    renderableBuffers[anopol_max_frames];  // Persistently mapped, written by Dispatch
+    anopol::ll::allocation      renderableBufferMemory[anopol_max_frames];
+    VkDeviceSize                renderableBufferSizes[anopol_max_frames] = {};
+
+    VkDescriptorPool        descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSetLayout   descriptorSetLayout = VK_NULL_HANDLE;
+    VkDescriptorSet         descriptorSets[anopol_max_frames];
+    VkPipelineLayout        pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline              pipeline = VK_NULL_HANDLE;
+};
+
+void GpuMerger::Initialize(VkShaderModule shader) {
+
+    if (shader == VK_NULL_HANDLE || Enabled()) return;
+
+    std::array<VkDescriptorSetLayoutBinding, 5> bindings{};
+    for (uint32_t i = 0; i < bindings.size(); i++) {
+        bindings[i].binding         = i;
+        bindings[i].descriptorCount = 1;
+        bindings[i].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings    = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(context->device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) anopol_assert("Failed to create merge descriptor set layout");
+
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type               = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSize.descriptorCount    = static_cast<uint32_t>(bindings.size()) * anopol_max_frames;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType          = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount  = 1;
+    poolInfo.pPoolSizes     = &poolSize;
+    poolInfo.maxSets        = anopol_max_frames;
+
+    if (vkCreateDescriptorPool(context->device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) anopol_assert("Failed to create merge descriptor pool");
+
+    std::array<VkDescriptorSetLayout, anopol_max_frames> layouts;
+    layouts.fill(descriptorSetLayout);
+
+    VkDescriptorSetAllocateInfo allocationInfo{};
+    allocationInfo.sType                = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocationInfo.descriptorPool       = descriptorPool;
+    allocationInfo.descriptorSetCount   = anopol_max_frames;
+    allocationInfo.pSetLayouts          = layouts.data();
+
+    if (vkAllocateDescriptorSets(context->device, &allocationInfo, descriptorSets) != VK_SUCCESS) anopol_assert("Failed to allocate merge descriptor sets");
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags    = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset        = 0;
+    pushConstantRange.size          = sizeof(mergePushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType                    = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount           = 1;
+    pipelineLayoutInfo.pSetLayouts              = &descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount   = 1;
+    pipelineLayoutInfo.pPushConstantRanges      = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(context->device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) anopol_assert("Failed to create merge pipeline layout");
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType          = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType    = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage    = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module   = shader;
+    pipelineInfo.stage.pName    = "main";
+    pipelineInfo.layout         = pipelineLayout;
+
+    if (anopol::ll::createComputePipelines(1, &pipelineInfo, &pipeline) != VK_SUCCESS) anopol_assert("Couldn't create merge pipeline");
+
+    // Created up front so there is always a buffer to bind
+    for (int i = 0; i < anopol_max_frames; i++) {
+        sourceVertices[i] = anopol::ll::GrowableBuffer::Create(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, anopol_growable_buffer_min_capacity);
+        sourceIndices[i]  = anopol::ll::GrowableBuffer::Create(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, anopol_growable_buffer_min_capacity);
+        renderableBuffers[i] = VK_NULL_HANDLE;
+    }
+}
+
+// Stages the geometry, in the layout the batch's vertex buffer holds, for the next Dispatch to
+// copy to firstVertex / firstIndex. Empty indices for non-indexed geometry
+void GpuMerger::Queue(uint32_t mesh, const std::vector<anopol::render::Vertex>& vertices, const std::vector<uint32_t>& indices,
+                      const anopol::render::meshQuantization& quantization, uint32_t slot, uint32_t firstVertex, uint32_t firstIndex) {
+
+    bool isIndexed = !indices.empty();
+    anopol::ll::GrowableBuffer& vertexSource = sourceVertices[queueSet];
+
+    RenderableInformation renderable{};
+    renderable.sourceVertex = static_cast<uint32_t>(vertexSource.size / sizeof(anopol::render::gpuVertex));
+    renderable.sourceIndex  = static_cast<uint32_t>(sourceIndices[queueSet].size / sizeof(uint32_t));
+    renderable.vertexCount  = static_cast<uint32_t>(vertices.size());
+    renderable.indexCount   = isIndexed ? static_cast<uint32_t>(indices.size()) : 0;
+    renderable.firstVertex  = firstVertex;
+    renderable.firstIndex   = firstIndex;
+    renderable.isIndexed    = isIndexed ? 1 : 0;
+    renderable.mesh         = mesh;
+
+    if (anopol::render::quantizedVertices) {
+        std::vector<anopol::render::gpuVertex> packed(renderable.vertexCount);
+        anopol::render::packVertices(vertices.data(), renderable.vertexCount, quantization, slot, packed.data());
+        vertexSource.Append(packed.data(), sizeof(anopol::render::gpuVertex) * renderable.vertexCount);
+    }
+    else {
+        vertexSource.Append(vertices.data(), sizeof(anopol::render::gpuVertex) * renderable.vertexCount);
+    }
+    if (isIndexed) sourceIndices[queueSet].Append(indices.data(), sizeof(uint32_t) * renderable.indexCount);
+
+    queued.push_back(renderable);
+}
+
+// The mesh was released before its copy ran; its ranges may already be handed out again
+void GpuMerger::Cancel(uint32_t mesh) {
+    for (RenderableInformation& renderable : queued) {
+        if (renderable.mesh != mesh) continue;
+        renderable.vertexCount = 0;
+        renderable.indexCount  = 0;
+    }
+}
+
+bool GpuMerger::Queued(uint32_t mesh) const {
+    for (const RenderableInformation& renderable : queued) {
+        if (renderable.mesh == mesh) return true;
+    }
+    return false;
+}
+
+// Recorded before anything reads the batch's geometry this frame. Later Queues fill the next
+// set of sources, so a spawn later in this frame cannot overwrite what this dispatch reads;
+// refilling this set waits for this frame, which marks it used
+void GpuMerger::Dispatch(VkCommandBuffer commandBuffer, uint32_t frame, VkBuffer vertices, VkBuffer indices) {
+
+    if (queued.empty()) return;
+
+    anopol_zone("GpuMerger::Dispatch");
+    uint32_t scope = anopol::ll::gpuProfiler.Begin(commandBuffer, "batch merge");
+
+    VkDeviceSize required = sizeof(RenderableInformation) * queued.size();
+    if (required > renderableBufferSizes[frame]) {
+
+        if (renderableBuffers[frame] != VK_NULL_HANDLE) anopol::ll::retireBuffer(renderableBuffers[frame], renderableBufferMemory[frame]);
+        renderableBufferSizes[frame] = std::max(required, renderableBufferSizes[frame] * 2);
+
+        anopol::ll::createBuffer(renderableBufferSizes[frame],
+                                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                 renderableBuffers[frame],
+                                 renderableBufferMemory[frame]);
+    }
+    memcpy(renderableBufferMemory[frame].mapped, queued.data(), static_cast<size_t>(required));
+
+    // The batch's buffers may have grown since this frame slot last ran. Without indexed
+    // geometry the batch has no index buffer; nothing writes binding 4 then
+    std::array<VkDescriptorBufferInfo, 5> bufferInfos = {{
+        { renderableBuffers[frame],         0, VK_WHOLE_SIZE },
+        { sourceVertices[queueSet].buffer,  0, VK_WHOLE_SIZE },
+        { sourceIndices[queueSet].buffer,   0, VK_WHOLE_SIZE },
+        { vertices,                         0, VK_WHOLE_SIZE },
+        { indices != VK_NULL_HANDLE ? indices : vertices, 0, VK_WHOLE_SIZE }
+    }};
+
+    std::array<VkWriteDescriptorSet, 5> writes{};
+    for (uint32_t i = 0; i < writes.size(); i++) {
+        writes[i].sType             = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet            = descriptorSets[frame];
+        writes[i].dstBinding        = i;
+        writes[i].descriptorType    = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[i].descriptorCount   = 1;
+        writes[i].pBufferInfo       = &bufferInfos[i];
+    }
+    vkUpdateDescriptorSets(context->device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+    // Earlier frames may still be drawing from the holes this merge refills
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                         0, nullptr, 0, nullptr, 0, nullptr);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[frame], 0, nullptr);
+
+    mergePushConstants constants{};
+    constants.vertexWords = sizeof(anopol::render::gpuVertex) / sizeof(uint32_t);
+
+    uint32_t count = static_cast<uint32_t>(queued.size());
+    for (uint32_t first = 0; first < count; first += anopol_merge_max_groups) {
+        constants.firstRenderable = first;
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(mergePushConstants), &constants);
+        vkCmdDispatch(commandBuffer, std::min<uint32_t>(count - first, anopol_merge_max_groups), 1, 1);
+    }
+
+    VkMemoryBarrier barrier{};
+    barrier.sType           = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask   = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask   = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0,
+                         1, &barrier, 0, nullptr, 0, nullptr);
+
+    anopol::ll::markGraphicsUse(sourceVertices[queueSet].buffer);
+    anopol::ll::markGraphicsUse(sourceIndices[queueSet].buffer);
+
+    queued.clear();
+    queueSet = (queueSet + 1) % anopol_max_frames;
+    sourceVertices[queueSet].size = 0;
+    sourceIndices[queueSet].size  = 0;
+
+    anopol::ll::gpuProfiler.End(commandBuffer, scope);
+}
+
+void GpuMerger::Destroy() {
+
+    if (!Enabled()) return;
+
+    for (int i = 0; i < anopol_max_frames; i++) {
+        sourceVertices[i].Destroy();
+        sourceIndices[i].Destroy();
+        if (renderableBuffers[i] != VK_NULL_HANDLE) anopol::ll::freeBuffer(renderableBuffers[i], renderableBufferMemory[i]);
+    }
+
+    vkDestroyPipeline(context->device, pipeline, nullptr);
+    vkDestroyPipelineLayout(context->device, pipelineLayout, nullptr);
+    vkDestroyDescriptorPool(context->device, descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(context->device, descriptorSetLayout, nullptr);
+    pipeline = VK_NULL_HANDLE;
+    queued.clear();
+}
+
+}
+
+#endif /* gpu_merge_h */
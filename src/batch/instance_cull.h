@@ -0,0 +1,160 @@
+//
+//  instance_cull.h
+//  anopol
+//
+//  Created by Dmitri Wamback on 2026-10-17.
+//
+
+#ifndef instance_cull_h
+#define instance_cull_h
+
+namespace anopol::batch {
+
+//------------------------------------------------------------------------------------------//
+// Instance culling
+//
+// Runs the batch's GPU culler over an instanced asset: every instance is an object of the
+// asset's single mesh. The surviving transforms are copied, compacted, into a per-frame
+// buffer that takes the place of the instance buffer as vertex binding 1, and the asset is
+// drawn with one vkCmdDrawIndexedIndirectCount per pass.
+//------------------------------------------------------------------------------------------//
+
+class InstanceCuller {
+public:
+    anopol::ll::uploadToken pendingUpload = 0;
+
+    static InstanceCuller Create(anopol::render::Asset* asset, VkShaderModule shader);
+    void Cull(VkCommandBuffer commandBuffer, uint32_t currentFrame, const glm::mat4& viewProjection);
+    void CullLate(VkCommandBuffer commandBuffer, uint32_t currentFrame);
+    void Draw(VkCommandBuffer commandBuffer, uint32_t currentFrame, bool late) const;
+    void MarkGraphicsUse(uint32_t currentFrame) const;
+    void Destroy();
+
+    bool Enabled() const { return culler.Enabled(); }
+    bool Occlusion() const { return culler.Occlusion(); }
+    VkBuffer InstanceBuffer(uint32_t frame) const { return frames[frame].visibleTransforms.buffer; }
+
+private:
+    struct instanceFrame {
+        anopol::ll::GrowableBuffer  visibleTransforms;      // instanceProperties, early pass first
+        anopol::ll::GrowableBuffer  drawCommand;            // One VkDrawIndexedIndirectCommand
+        anopol::ll::GrowableBuffer  lateDrawCommand;
+    };
+
+    anopol::render::Asset*  asset = nullptr;
+    GpuCuller               culler;
+    size_t                  registeredInstances = 0;    // Objects the culler knows about
+    instanceFrame           frames[anopol_max_frames];
+
+    void pr_RegisterInstances();
+};
+
+InstanceCuller InstanceCuller::Create(anopol::render::Asset* asset, VkShaderModule shader) {
+
+    InstanceCuller instanceCuller = InstanceCuller();
+    instanceCuller.asset = asset;
+
+    if (shader == VK_NULL_HANDLE || !asset->IsInstanced() || asset->meshes.empty()) return instanceCuller;
+
+    instanceCuller.culler.Initialize(shader, cullTransforms);
+    if (!instanceCuller.culler.Enabled()) return instanceCuller;
+
+    for (int i = 0; i < anopol_max_frames; i++) {
+        instanceCuller.frames[i].visibleTransforms = anopol::ll::GrowableBuffer::Create(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+        instanceCuller.frames[i].drawCommand       = anopol::ll::GrowableBuffer::Create(VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                                                                       sizeof(VkDrawIndexedIndirectCommand));
+        instanceCuller.frames[i].lateDrawCommand   = anopol::ll::GrowableBuffer::Create(VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                                                                       sizeof(VkDrawIndexedIndirectCommand));
+    }
+
+    // Only the first mesh is drawn, so it is the only one culled
+    const anopol::render::Asset::Mesh& mesh = asset->meshes[0];
+
+    cullMesh culled{};
+    culled.sphere       = localBoundingSphere(mesh.vertices);
+    culled.first        = 0;
+    culled.count        = static_cast<uint32_t>(mesh.indices.size());
+    culled.indexed      = 1;
+    instanceCuller.culler.SetMeshes({ culled });
+
+    instanceCuller.pr_RegisterInstances();
+    return instanceCuller;
+}
+
+// Instances pushed after Create only need their mesh index
+void InstanceCuller::pr_RegisterInstances() {
+
+    size_t instanceCount = asset->GetInstances()->instances.size();
+    if (instanceCount <= registeredInstances) return;
+
+    std::vector<uint32_t> objectMeshes(instanceCount - registeredInstances, 0);
+    culler.AppendObjects(objectMeshes.data(), objectMeshes.size());
+
+    registeredInstances = instanceCount;
+    pendingUpload = anopol::ll::lastUploadToken();
+}
+
+void InstanceCuller::Cull(VkCommandBuffer commandBuffer, uint32_t currentFrame, const glm::mat4& viewProjection) {
+
+    if (!culler.Enabled()) return;
+
+    pr_RegisterInstances();
+
+    instanceFrame& frame = frames[currentFrame];
+    frame.visibleTransforms.Reserve(sizeof(anopol::render::instanceProperties) * std::max<size_t>(registeredInstances, 1));
+
+    // The asset has no non-indexed geometry; those bindings only need a valid buffer
+    cullTargets targets{};
+    targets.transforms              = asset->GetInstances()->instanceBuffer;
+    targets.visibleInstances        = frame.visibleTransforms.buffer;
+    targets.drawCommands            = frame.drawCommand.buffer;
+    targets.indexedDrawCommands     = frame.drawCommand.buffer;
+    targets.lateDrawCommands        = frame.lateDrawCommand.buffer;
+    targets.lateIndexedDrawCommands = frame.lateDrawCommand.buffer;
+
+    culler.Dispatch(commandBuffer, currentFrame, viewProjection, static_cast<uint32_t>(registeredInstances), targets);
+}
+
+void InstanceCuller::CullLate(VkCommandBuffer commandBuffer, uint32_t currentFrame) {
+    culler.DispatchLate(commandBuffer, currentFrame);
+}
+
+// Expects the mesh's vertex and index buffers bound, and InstanceBuffer() at binding 1
+void InstanceCuller::Draw(VkCommandBuffer commandBuffer, uint32_t currentFrame, bool late) const {
+
+    if (registeredInstances == 0) return;
+
+    const instanceFrame& frame = frames[currentFrame];
+
+    vkCmdDrawIndexedIndirectCount(commandBuffer,
+                                  late ? frame.lateDrawCommand.buffer : frame.drawCommand.buffer, 0,
+                                  culler.DrawCountBuffer(currentFrame),
+                                  (late ? anopol_cull_late_counts : anopol_cull_early_counts) + sizeof(uint32_t),
+                                  1, sizeof(VkDrawIndexedIndirectCommand));
+}
+
+void InstanceCuller::MarkGraphicsUse(uint32_t currentFrame) const {
+
+    const instanceFrame& frame = frames[currentFrame];
+
+    for (VkBuffer buffer : {frame.visibleTransforms.buffer, frame.drawCommand.buffer, frame.lateDrawCommand.buffer}) {
+        anopol::ll::markGraphicsUse(buffer);
+    }
+    culler.MarkGraphicsUse(currentFrame);
+}
+
+void InstanceCuller::Destroy() {
+
+    if (!culler.Enabled()) return;
+
+    for (int i = 0; i < anopol_max_frames; i++) {
+        frames[i].visibleTransforms.Destroy();
+        frames[i].drawCommand.Destroy();
+        frames[i].lateDrawCommand.Destroy();
+    }
+    culler.Destroy();
+}
+
+}
+
+#endif /* instance_cull_h */
@@ -12,8 +12,18 @@ namespace anopol::batch {
 
 class MeshCombineGroup {
 public:
+    // One entry per distinct geometry; every object drawing it is an instance
+    struct sharedMesh {
+        uint64_t                    hash;
+        anopol::render::Renderable* source;     // A live renderable with this geometry, nullptr once released
+        std::vector<uint32_t>       objects;    // Indices into the batch transforms
+    };
+    
+    // Slot per object, nullptr where one was released; Append refills those first
     std::vector<anopol::render::Renderable*> renderables;
     std::vector<anopol::render::Asset*> assets;
+    std::vector<sharedMesh> meshes;
+    std::vector<uint32_t> pending;              // Slots appended since the last Combine
     
     static MeshCombineGroup Create();
     void Append(anopol::render::Renderable* renderable);
@@ -21,14 +31,79 @@ public:
     void Append(std::vector<anopol::render::Renderable*>& renderables);
     void Append(std::vector<anopol::render::Asset*>& assets);
     void Reserve(uint32_t renderableCount, uint32_t assetCount);
+    uint32_t Identify(anopol::render::Renderable* renderable, bool& created);
+    uint32_t Identify(anopol::render::Renderable* renderable, bool& created, uint64_t hash);
+    void Release(uint32_t slot);
+    void ReleaseMesh(uint32_t mesh);
+    
+private:
+    std::unordered_map<uint64_t, std::vector<uint32_t>> meshLookup;   // Hash to candidate meshes
+    std::vector<uint32_t> freeSlots, freeMeshes;
 };
 
+//------------------------------------------------------------------------------------------//
+// Geometry hashing
+//------------------------------------------------------------------------------------------//
+
+// The batch keeps its own index buffer, so a renderable's GPU index buffer does not matter here
+bool isIndexedGeometry(const anopol::render::Renderable* renderable) {
+    return renderable->isIndexed && !renderable->indices.empty();
+}
+
+uint64_t hashGeometry(const anopol::render::Renderable* renderable) {
+    
+    // FNV-1a over positions, normals, UVs and indices
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+    };
+    
+    for (const anopol::render::Vertex& vertex : renderable->vertices) {
+        mix(&vertex.vertex, sizeof(vertex.vertex));
+        mix(&vertex.normal, sizeof(vertex.normal));
+        mix(&vertex.uv,     sizeof(vertex.uv));
+    }
+    bool indexed = isIndexedGeometry(renderable);
+    mix(&indexed, sizeof(indexed));
+    if (indexed) mix(renderable->indices.data(), sizeof(uint32_t) * renderable->indices.size());
+    
+    return hash;
+}
+
+bool sameGeometry(const anopol::render::Renderable* a, const anopol::render::Renderable* b) {
+    
+    if (a->vertices.size() != b->vertices.size() || a->indices.size() != b->indices.size()) return false;
+    if (isIndexedGeometry(a) != isIndexedGeometry(b)) return false;
+    
+    for (size_t i = 0; i < a->vertices.size(); i++) {
+        const anopol::render::Vertex& va = a->vertices[i];
+        const anopol::render::Vertex& vb = b->vertices[i];
+        if (va.vertex != vb.vertex || va.normal != vb.normal || va.uv != vb.uv) return false;
+    }
+    return a->indices == b->indices;
+}
+
 MeshCombineGroup MeshCombineGroup::Create() {
     return MeshCombineGroup();
 }
 
 void MeshCombineGroup::Append(anopol::render::Renderable* renderable) {
-    renderables.push_back(renderable);
+    
+    uint32_t slot = static_cast<uint32_t>(renderables.size());
+    
+    if (!freeSlots.empty()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+        renderables[slot] = renderable;
+    }
+    else {
+        renderables.push_back(renderable);
+    }
+    pending.push_back(slot);
 }
 
 void MeshCombineGroup::Append(anopol::render::Asset* asset) {
@@ -37,7 +112,8 @@ void MeshCombineGroup::Append(anopol::render::Asset* asset) {
 
 void MeshCombineGroup::Append(std::vector<anopol::render::Renderable*>& renderables) {
     this->renderables.reserve(this->renderables.size() + renderables.size());
-    this->renderables.insert(this->renderables.end(), renderables.begin(), renderables.end());
+    pending.reserve(pending.size() + renderables.size());
+    for (anopol::render::Renderable* renderable : renderables) Append(renderable);
 }
 
 void MeshCombineGroup::Append(std::vector<anopol::render::Asset*>& assets) {
@@ -48,9 +124,64 @@ void MeshCombineGroup::Append(std::vector<anopol::render::Asset*>& assets) {
 
 void MeshCombineGroup::Reserve(uint32_t renderableCount, uint32_t assetCount) {
     renderables.reserve(renderableCount);
+    pending.reserve(renderableCount);
     assets.reserve(assetCount);
 }
 
+// Returns the shared mesh with the same geometry as renderable, adding one if none exists yet
+uint32_t MeshCombineGroup::Identify(anopol::render::Renderable* renderable, bool& created) {
+    return Identify(renderable, created, hashGeometry(renderable));
+}
+
+// With the hashGeometry of renderable already computed, as Combine does on its worker threads
+uint32_t MeshCombineGroup::Identify(anopol::render::Renderable* renderable, bool& created, uint64_t hash) {
+    
+    std::vector<uint32_t>& candidates = meshLookup[hash];
+    
+    // Hash collisions fall through to a full comparison
+    for (uint32_t candidate : candidates) {
+        if (meshes[candidate].source == renderable || sameGeometry(meshes[candidate].source, renderable)) {
+            created = false;
+            return candidate;
+        }
+    }
+    
+    // Released meshes are reused before the list grows, so drawInformation stays as long as the peak
+    uint32_t mesh = static_cast<uint32_t>(meshes.size());
+    
+    if (!freeMeshes.empty()) {
+        mesh = freeMeshes.back();
+        freeMeshes.pop_back();
+        meshes[mesh] = {hash, renderable, {}};
+    }
+    else {
+        meshes.push_back({hash, renderable, {}});
+    }
+    candidates.push_back(mesh);
+    
+    created = true;
+    return mesh;
+}
+
+// The slot, and the batch transform behind it, goes to the next Append
+void MeshCombineGroup::Release(uint32_t slot) {
+    
+    renderables[slot] = nullptr;
+    freeSlots.push_back(slot);
+}
+
+// Once the last object of the mesh is gone
+void MeshCombineGroup::ReleaseMesh(uint32_t mesh) {
+    
+    std::vector<uint32_t>& candidates = meshLookup[meshes[mesh].hash];
+    candidates.erase(std::find(candidates.begin(), candidates.end(), mesh));
+    if (candidates.empty()) meshLookup.erase(meshes[mesh].hash);
+    
+    meshes[mesh].source = nullptr;
+    meshes[mesh].objects.clear();
+    freeMeshes.push_back(mesh);
+}
+
 }
 
 
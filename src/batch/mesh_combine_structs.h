@@ -24,17 +24,37 @@ typedef struct batchDrawInformation {
     uint32_t object;
     
     uint32_t firstVertex;
-    uint32_t vertexCount;
+    uint32_t vertexCount;      // Set for indexed meshes too, chunks copy their vertices by it
+    
+    uint32_t firstInstance;     // Into the batch instance indirection
+    uint32_t instanceCount;
     
     uint32_t texture;
     
 } batchDrawInformation;
 
+uint32_t meshFirstVertex(const batchDrawInformation& drawInfo) {
+    return drawInfo.drawType == indexed ? drawInfo.vertexOffset : drawInfo.firstVertex;
+}
+
+// Names one combined object. The transform slot is reused after Remove, the generation is not
+typedef struct batchHandle {
+    uint32_t object     = UINT32_MAX;
+    uint32_t generation = 0;
+} batchHandle;
+
 typedef struct batchIndirectTransformation {
     glm::mat4 model;
-    glm::vec4 color;
+    glm::vec4 color;        // rgb, and the material index in w
 };
 
+// std430 layout, mirrors transform_scatter.comp
+typedef struct transformScatterEntry {
+    uint32_t                    object;
+    uint32_t                    pad[3];
+    batchIndirectTransformation transformation;
+} transformScatterEntry;
+
 }
 
 #endif /* mesh_combine_structs_h */
@@ -65,7 +65,7 @@ void Camera::initialize() {
     camera.far             = 1000.0f;
     
     int width, height;
-    glfwGetWindowSize(context->window, &width, &height);
+    anopol::ll::surfaceSize(width, height);
     camera.aspect = (float)width/(float)height;
     
     camera.cameraProjection = glm::perspective(camera.fov, camera.aspect, camera.near, camera.far);
@@ -105,7 +105,7 @@ void Camera::update(glm::vec4 movement) {
         cameraLookAt = glm::lookAt(cameraPosition, cameraPosition + lookDirection, glm::vec3(0.0, 1.0, 0.0));
         
         int width, height;
-        glfwGetWindowSize(context->window, &width, &height);
+        anopol::ll::surfaceSize(width, height);
         aspect = (float)width/(float)height;
         
         cameraProjection = glm::perspective(fov, aspect, near, far);
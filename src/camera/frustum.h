@@ -39,7 +39,7 @@ struct Sphere {
     }
 };
 
-Frustum CreateFrustumPlanes(Camera camera) {
+Frustum CreateFrustumPlanes(const Camera& camera) {
     Frustum frustum;
     
     float zNear = camera.near;
@@ -61,7 +61,38 @@ Frustum CreateFrustumPlanes(Camera camera) {
     return frustum;
 }
 
-bool isSphereInFrustum(glm::vec3 position, glm::vec3 scale, glm::mat4 model, float radius, const Frustum& frustum) {
+// The same planes as (normal, distance) with dot(normal, p) + distance signed, like ExtractFrustumPlanes
+std::array<glm::vec4, 6> PlaneEquations(const Frustum& frustum) {
+    
+    const Plane* planes[6] = { &frustum.left, &frustum.right, &frustum.bottom, &frustum.top, &frustum.near, &frustum.far };
+    
+    std::array<glm::vec4, 6> equations;
+    for (int i = 0; i < 6; i++) {
+        equations[i] = glm::vec4(planes[i]->normal, -planes[i]->distance);
+    }
+    return equations;
+}
+
+// Gribb-Hartmann planes of a view-projection matrix as (normal, distance), normalized so that
+// dot(normal, p) + distance is the signed distance of p; inside is positive. Order: left,
+// right, bottom, top, near, far
+std::array<glm::vec4, 6> ExtractFrustumPlanes(const glm::mat4& viewProjection) {
+    
+    glm::mat4 rows = glm::transpose(viewProjection);
+    
+    std::array<glm::vec4, 6> planes = {
+        rows[3] + rows[0], rows[3] - rows[0],
+        rows[3] + rows[1], rows[3] - rows[1],
+        rows[3] + rows[2], rows[3] - rows[2]
+    };
+    
+    for (glm::vec4& plane : planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return planes;
+}
+
+bool isSphereInFrustum(const glm::vec3& position, const glm::vec3& scale, const glm::mat4& model, float radius, const Frustum& frustum) {
     
     const glm::vec3 globalCenter = position;
     const float maxScale = std::max(std::max(scale.x, scale.y), scale.z);
@@ -27,9 +27,10 @@ public:
     
     std::vector<Mesh> meshes;
     glm::vec3 position, rotation, scale;
+    meshOptimization optimization;      // ACMR of the meshes as imported and as uploaded
     
     static Asset* Create(std::string assetPath);
-    void PushInstance(glm::vec3 position, glm::vec3 scale, glm::vec3 rotation, glm::vec3 color);
+    void PushInstance(glm::vec3 position, glm::vec3 scale, glm::vec3 rotation, glm::vec3 color, uint32_t material = 0);
     void AllocInstances();
     bool IsInstanced();
     
@@ -43,6 +44,8 @@ private:
 
 Asset* Asset::Create(std::string assetPath) {
     
+    anopol_zone("Asset::Create");
+    
     Assimp::Importer importer;
     const aiScene *scene = importer.ReadFile(assetPath.c_str(),
                                              aiProcess_Triangulate |
@@ -116,6 +119,9 @@ void Asset::ProcessMesh(aiMesh *mesh, const aiScene *scene) {
         }
     }
     
+    // Assimp hands faces over in file order; points and lines are left as they are
+    if (mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE) optimization.Add(optimizeMesh(m_vertices, m_indices));
+    
     m_mesh.vertices = m_vertices;
     m_mesh.indices = m_indices;
     
@@ -126,13 +132,13 @@ void Asset::ProcessMesh(aiMesh *mesh, const aiScene *scene) {
     meshes.push_back(m_mesh);
 }
 
-void Asset::PushInstance(glm::vec3 position, glm::vec3 scale, glm::vec3 rotation, glm::vec3 color) {
+void Asset::PushInstance(glm::vec3 position, glm::vec3 scale, glm::vec3 rotation, glm::vec3 color, uint32_t material) {
     
     if (instanceBuffer == nullptr) {
         instanceBuffer = new InstanceBuffer();
         instanceBuffer->alloc(1000000);
     }
-    instanceBuffer->appendInstance(position, scale, rotation, color);
+    instanceBuffer->appendInstance(position, scale, rotation, color, material);
 }
 
 void Asset::AllocInstances() {
@@ -13,10 +13,13 @@ namespace anopol::render {
 class IndexBuffer {
 public:
     VkBuffer indexBuffer                = VK_NULL_HANDLE;
-    VkDeviceMemory indexBufferMemory    = VK_NULL_HANDLE;
+    anopol::ll::allocation indexBufferMemory{};
     VkDeviceSize bufferSize             = 0;
+    anopol::ll::uploadToken pendingUpload = 0;
+    VkIndexType indexType               = VK_INDEX_TYPE_UINT32;
     std::vector<uint32_t> indices;
     
+    // 16-bit on the GPU when every index fits, which is any mesh of up to 65536 vertices
     void alloc(std::vector<uint32_t> indices);
     void dealloc();
 };
@@ -26,27 +29,16 @@ void IndexBuffer::alloc(std::vector<uint32_t> indices) {
     this->indices = indices;
     
     VkBuffer oldBuffer = indexBuffer;
-    VkDeviceMemory oldMemory = indexBufferMemory;
+    anopol::ll::allocation oldMemory = indexBufferMemory;
 
-    VkFence copyFence;
-    VkFenceCreateInfo fenceInfo{};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.flags = 0;
-    vkCreateFence(context->device, &fenceInfo, nullptr, &copyFence);
-
-    VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
-
-    VkBuffer staging;
-    VkDeviceMemory stagingMemory;
-    anopol::ll::createBuffer(bufferSize,
-                             VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                             staging, stagingMemory);
-
-    void* data;
-    vkMapMemory(context->device, stagingMemory, 0, bufferSize, 0, &data);
-    memcpy(data, indices.data(), (size_t)bufferSize);
-    vkUnmapMemory(context->device, stagingMemory);
+    bool narrow = std::all_of(indices.begin(), indices.end(), [](uint32_t index) { return index <= UINT16_MAX; });
+    indexType = narrow ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+    
+    std::vector<uint16_t> narrowIndices;
+    if (narrow) narrowIndices.assign(indices.begin(), indices.end());
+    
+    const void* data = narrow ? static_cast<const void*>(narrowIndices.data()) : static_cast<const void*>(indices.data());
+    VkDeviceSize bufferSize = (narrow ? sizeof(uint16_t) : sizeof(uint32_t)) * indices.size();
 
     anopol::ll::createBuffer(bufferSize,
                              VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
@@ -54,25 +46,15 @@ void IndexBuffer::alloc(std::vector<uint32_t> indices) {
                              indexBuffer,
                              indexBufferMemory);
 
-    anopol::ll::memCopyBuffer(staging, indexBuffer, bufferSize, copyFence);
-
-    vkWaitForFences(context->device, 1, &copyFence, VK_TRUE, UINT64_MAX);
-    vkDestroyFence(context->device, copyFence, nullptr);
-
-    vkDestroyBuffer(context->device, staging, nullptr);
-    vkFreeMemory(context->device, stagingMemory, nullptr);
+    pendingUpload = anopol::ll::stageBuffer(data, bufferSize, indexBuffer);
 
     if (oldBuffer != VK_NULL_HANDLE) {
-        vkDestroyBuffer(context->device, oldBuffer, nullptr);
-    }
-    if (oldMemory != VK_NULL_HANDLE) {
-        vkFreeMemory(context->device, oldMemory, nullptr);
+        anopol::ll::retireBuffer(oldBuffer, oldMemory);
     }
 }
 
 void IndexBuffer::dealloc() {
-    vkDestroyBuffer(context->device, indexBuffer, nullptr);
-    vkFreeMemory(context->device, indexBufferMemory, nullptr);
+    anopol::ll::freeBuffer(indexBuffer, indexBufferMemory);
 }
 
 }
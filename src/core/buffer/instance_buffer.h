@@ -15,24 +15,39 @@ struct instanceProperties {
     glm::vec4 modelRow1;
     glm::vec4 modelRow2;
     glm::vec4 modelRow3;
-    glm::vec4 color;
+    glm::vec4 color;        // rgb, and the material index in w
 };
 
+// Per-instance input next to the vertices, after their three attributes
+using instanceLayout = vertexLayout<instanceProperties, 1, VK_VERTEX_INPUT_RATE_INSTANCE,
+    vertexAttribute<3, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(instanceProperties, modelRow0)>,
+    vertexAttribute<4, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(instanceProperties, modelRow1)>,
+    vertexAttribute<5, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(instanceProperties, modelRow2)>,
+    vertexAttribute<6, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(instanceProperties, modelRow3)>,
+    vertexAttribute<7, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(instanceProperties, color)>>;
+
+// Instances alone, for pipelines without vertices
+using instanceOnlyLayout = vertexLayout<instanceProperties, 0, VK_VERTEX_INPUT_RATE_INSTANCE,
+    vertexAttribute<0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(instanceProperties, modelRow0)>,
+    vertexAttribute<1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(instanceProperties, modelRow1)>,
+    vertexAttribute<2, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(instanceProperties, modelRow2)>,
+    vertexAttribute<3, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(instanceProperties, modelRow3)>>;
+
 class InstanceBuffer {
 public:
     VkBuffer instanceBuffer;
-    VkDeviceMemory instanceBufferMemory;
+    anopol::ll::allocation instanceBufferMemory;
     void* instanceBufferMemoryMapped;
     std::vector<instanceProperties> instances{};
     
     void alloc(size_t initialSize);
     void dealloc();
     
-    void appendInstance(glm::vec3 position, glm::vec3 scale, glm::vec3 rotation, glm::vec3 color);
+    void appendInstance(glm::vec3 position, glm::vec3 scale, glm::vec3 rotation, glm::vec3 color, uint32_t material = 0);
     void allocInstances();
 
     static VkVertexInputBindingDescription GetBindingDescription();
-    static std::array<VkVertexInputAttributeDescription, 4> GetAttributeDescriptions();
+    static std::array<VkVertexInputAttributeDescription, 5> GetAttributeDescriptions();
     
 private:
     size_t maxInstances;
@@ -41,20 +56,11 @@ private:
 };
 
 VkVertexInputBindingDescription InstanceBuffer::GetBindingDescription() {
-    return VkVertexInputBindingDescription {
-        .binding = 1,
-        .stride = sizeof(instanceProperties),
-        .inputRate = VK_VERTEX_INPUT_RATE_INSTANCE
-    };
+    return instanceLayout::BindingDescription();
 }
 
-std::array<VkVertexInputAttributeDescription, 4> InstanceBuffer::GetAttributeDescriptions() {
-    return {
-        VkVertexInputAttributeDescription {3, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(instanceProperties, modelRow0)},
-        VkVertexInputAttributeDescription {4, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(instanceProperties, modelRow1)},
-        VkVertexInputAttributeDescription {5, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(instanceProperties, modelRow2)},
-        VkVertexInputAttributeDescription {6, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(instanceProperties, modelRow3)},
-    };
+std::array<VkVertexInputAttributeDescription, 5> InstanceBuffer::GetAttributeDescriptions() {
+    return instanceLayout::AttributeDescriptions();
 }
 
 void InstanceBuffer::alloc(size_t initialSize) {
@@ -67,15 +73,14 @@ void InstanceBuffer::alloc(size_t initialSize) {
         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
         instanceBuffer, instanceBufferMemory);
 
-    vkMapMemory(context->device, instanceBufferMemory, 0, VK_WHOLE_SIZE, 0, &instanceBufferMemoryMapped);
+    instanceBufferMemoryMapped = instanceBufferMemory.mapped;
 }
 
 void InstanceBuffer::dealloc() {
-    vkDestroyBuffer(context->device, instanceBuffer, nullptr);
-    vkFreeMemory(context->device, instanceBufferMemory, nullptr);
+    anopol::ll::freeBuffer(instanceBuffer, instanceBufferMemory);
 }
 
-void InstanceBuffer::appendInstance(glm::vec3 position, glm::vec3 scale, glm::vec3 rotation, glm::vec3 color) {
+void InstanceBuffer::appendInstance(glm::vec3 position, glm::vec3 scale, glm::vec3 rotation, glm::vec3 color, uint32_t material) {
     
     instanceProperties instance{};
     glm::mat4 model = modelMatrix(position, scale, rotation);
@@ -83,7 +88,7 @@ void InstanceBuffer::appendInstance(glm::vec3 position, glm::vec3 scale, glm::ve
     instance.modelRow1 = model[1];
     instance.modelRow2 = model[2];
     instance.modelRow3 = model[3];
-    instance.color = glm::vec4(color, 1.0f);
+    instance.color = glm::vec4(color, static_cast<float>(material));
     
     instances.push_back(instance);
     
@@ -103,14 +108,13 @@ void InstanceBuffer::resize() {
     VkDeviceSize bufferSize = sizeof(instanceProperties) * maxInstances;
     
     VkBuffer newBuffer;
-    VkDeviceMemory newMemory;
+    anopol::ll::allocation newMemory;
     
     anopol::ll::createBuffer(bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                             VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
                              newBuffer, newMemory);
     
-    void* newMemoryMapped;
-    vkMapMemory(context->device, newMemory, 0, VK_WHOLE_SIZE, 0, &newMemoryMapped);
+    void* newMemoryMapped = newMemory.mapped;
     
     memcpy(newMemoryMapped, instances.data(), sizeof(instanceProperties) * instances.size());
     
@@ -122,14 +126,7 @@ void InstanceBuffer::resize() {
 }
 
 void InstanceBuffer::flush() {
-    
-    VkMappedMemoryRange range{};
-    range.sType     = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-    range.memory    = instanceBufferMemory;
-    range.offset    = 0;
-    range.size      = VK_WHOLE_SIZE;
-    
-    vkFlushMappedMemoryRanges(context->device, 1, &range);
+    anopol::ll::flushAllocation(instanceBufferMemory);
 }
 
 }
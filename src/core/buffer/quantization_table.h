@@ -0,0 +1,140 @@
+//
+//  quantization_table.h
+//  anopol
+//
+//  Created by Dmitri Wamback on 2026-10-17.
+//
+
+#ifndef quantization_table_h
+#define quantization_table_h
+
+namespace anopol::render {
+
+//------------------------------------------------------------------------------------------//
+// Quantization table
+//
+// The bounds every mesh stored as CompactVertex was quantized in, one slot per mesh. Each
+// vertex carries its mesh's slot, so the vertex shader dequantizes batched meshes drawn by
+// one indirect call as easily as an asset's. Fixed size like the material buffer, so its
+// descriptor is written once. Bound as set 2 of the main pipeline
+//------------------------------------------------------------------------------------------//
+
+class QuantizationTable {
+public:
+    void Initialize();
+    uint32_t Register(const meshQuantization& quantization);
+    void Release(uint32_t slot);
+    void MarkGraphicsUse() const { anopol::ll::markGraphicsUse(quantizationBuffer); }
+    void Destroy();
+
+    VkDescriptorSetLayout Layout() const { return descriptorSetLayout; }
+    VkDescriptorSet Set() const { return descriptorSet; }
+
+    anopol::ll::uploadToken pendingUpload = 0;
+
+private:
+    VkDescriptorPool        descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSetLayout   descriptorSetLayout = VK_NULL_HANDLE;
+    VkDescriptorSet         descriptorSet = VK_NULL_HANDLE;
+
+    VkBuffer                quantizationBuffer = VK_NULL_HANDLE;
+    anopol::ll::allocation  quantizationBufferMemory;
+
+    uint32_t slotCount = 0;
+    std::vector<uint32_t> freeSlots;
+};
+
+void QuantizationTable::Initialize() {
+
+    VkDescriptorSetLayoutBinding binding{};
+    binding.binding         = 0;
+    binding.descriptorCount = 1;
+    binding.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    binding.stageFlags      = VK_SHADER_STAGE_VERTEX_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings    = &binding;
+
+    if (vkCreateDescriptorSetLayout(context->device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) anopol_assert("Failed to create quantization table descriptor set layout");
+
+    VkDescriptorPoolSize poolSize{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 };
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType          = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount  = 1;
+    poolInfo.pPoolSizes     = &poolSize;
+    poolInfo.maxSets        = 1;
+
+    if (vkCreateDescriptorPool(context->device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) anopol_assert("Failed to create quantization table descriptor pool");
+
+    VkDescriptorSetAllocateInfo allocationInfo{};
+    allocationInfo.sType                = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocationInfo.descriptorPool       = descriptorPool;
+    allocationInfo.descriptorSetCount   = 1;
+    allocationInfo.pSetLayouts          = &descriptorSetLayout;
+
+    if (vkAllocateDescriptorSets(context->device, &allocationInfo, &descriptorSet) != VK_SUCCESS) anopol_assert("Failed to allocate quantization table descriptor set");
+
+    // Only a placeholder without quantized vertices; the set is still bound
+    VkDeviceSize size = sizeof(meshQuantization) * (quantizedVertices ? anopol_max_quantized_meshes : 1);
+
+    anopol::ll::createBuffer(size,
+                             VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                             quantizationBuffer, quantizationBufferMemory);
+
+    VkDescriptorBufferInfo bufferInfo{ quantizationBuffer, 0, VK_WHOLE_SIZE };
+
+    VkWriteDescriptorSet write{};
+    write.sType             = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet            = descriptorSet;
+    write.dstBinding        = 0;
+    write.descriptorType    = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write.descriptorCount   = 1;
+    write.pBufferInfo       = &bufferInfo;
+
+    vkUpdateDescriptorSets(context->device, 1, &write, 0, nullptr);
+}
+
+// Returns the slot the mesh's vertices carry. Without quantized vertices nothing is stored
+uint32_t QuantizationTable::Register(const meshQuantization& quantization) {
+
+    if (!quantizedVertices) return 0;
+
+    uint32_t slot;
+    if (!freeSlots.empty()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    }
+    else {
+        if (slotCount >= anopol_max_quantized_meshes) anopol_assert("Quantization table is full");
+        slot = slotCount++;
+    }
+
+    pendingUpload = std::max(pendingUpload, anopol::ll::stageBuffer(&quantization, sizeof(meshQuantization), quantizationBuffer, sizeof(meshQuantization) * slot));
+    return slot;
+}
+
+// Frames still drawing the mesh keep reading the slot until a new mesh's bounds are staged
+// into it, which only happens after they complete
+void QuantizationTable::Release(uint32_t slot) {
+    if (quantizedVertices) freeSlots.push_back(slot);
+}
+
+void QuantizationTable::Destroy() {
+
+    if (descriptorPool == VK_NULL_HANDLE) return;
+
+    anopol::ll::freeBuffer(quantizationBuffer, quantizationBufferMemory);
+    vkDestroyDescriptorPool(context->device, descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(context->device, descriptorSetLayout, nullptr);
+    descriptorPool = VK_NULL_HANDLE;
+}
+
+QuantizationTable quantizationTable;
+
+}
+
+#endif /* quantization_table_h */
@@ -23,7 +23,7 @@ anopolStandardUniform asu{};
 class UniformBuffer {
 public:
     std::vector<VkBuffer>       uniformBuffer = std::vector<VkBuffer>();
-    std::vector<VkDeviceMemory> uniformBufferMemory;
+    std::vector<anopol::ll::allocation> uniformBufferMemory;
     std::vector<void*>          uniformBufferMapped;
     
     static UniformBuffer Create();
@@ -47,7 +47,7 @@ UniformBuffer UniformBuffer::Create() {
                                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
                                  buffer.uniformBuffer[i], buffer.uniformBufferMemory[i]);
         
-        vkMapMemory(context->device, buffer.uniformBufferMemory[i], 0, bufferSize, 0, &buffer.uniformBufferMapped[i]);
+        buffer.uniformBufferMapped[i] = buffer.uniformBufferMemory[i].mapped;
     }
     
     return buffer;
@@ -68,11 +68,8 @@ void UniformBuffer::Update(int currentFrame) {
 
 void UniformBuffer::dealloc() {
     
-    for (VkBuffer buffer : uniformBuffer) {
-        vkDestroyBuffer(context->device, buffer, nullptr);
-    }
-    for (VkDeviceMemory deviceMemory : uniformBufferMemory) {
-        vkFreeMemory(context->device, deviceMemory, nullptr);
+    for (size_t i = 0; i < uniformBuffer.size(); i++) {
+        anopol::ll::freeBuffer(uniformBuffer[i], uniformBufferMemory[i]);
     }
 }
 
@@ -12,10 +12,13 @@ namespace anopol::render {
 
 class VertexBuffer {
 public:
-    VkBuffer vertexBuffer;
-    VkDeviceMemory vertexBufferMemory;
-    VkDeviceSize bufferSize;
+    VkBuffer vertexBuffer                       = VK_NULL_HANDLE;
+    anopol::ll::allocation vertexBufferMemory{};
+    VkDeviceSize bufferSize                     = 0;
+    anopol::ll::uploadToken pendingUpload       = 0;
+    uint32_t quantization                       = UINT32_MAX;   // Slot in the quantization table, with compact vertices
     
+    // Packed into gpuVertex on the way up
     void alloc(std::vector<Vertex> vertices);
     void dealloc();
 };
@@ -23,27 +26,17 @@ public:
 void VertexBuffer::alloc(std::vector<Vertex> vertices) {
     
     VkBuffer oldBuffer = vertexBuffer;
-    VkDeviceMemory oldMemory = vertexBufferMemory;
+    anopol::ll::allocation oldMemory = vertexBufferMemory;
 
-    VkFence copyFence;
-    VkFenceCreateInfo fenceInfo{};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.flags = 0;
-    vkCreateFence(context->device, &fenceInfo, nullptr, &copyFence);
-
-    VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
-
-    VkBuffer staging;
-    VkDeviceMemory stagingMemory;
-    anopol::ll::createBuffer(bufferSize,
-                             VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                             staging, stagingMemory);
+    if (quantization != UINT32_MAX) quantizationTable.Release(quantization);
+    
+    meshQuantization bounds = quantizedVertices ? quantizeBounds(vertices) : meshQuantization{};
+    quantization = quantizationTable.Register(bounds);
+    
+    std::vector<gpuVertex> packed(vertices.size());
+    packVertices(vertices.data(), vertices.size(), bounds, quantization, packed.data());
 
-    void* data;
-    vkMapMemory(context->device, stagingMemory, 0, bufferSize, 0, &data);
-    memcpy(data, vertices.data(), (size_t)bufferSize);
-    vkUnmapMemory(context->device, stagingMemory);
+    VkDeviceSize bufferSize = sizeof(gpuVertex) * packed.size();
 
     anopol::ll::createBuffer(bufferSize,
                              VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
@@ -51,26 +44,19 @@ void VertexBuffer::alloc(std::vector<Vertex> vertices) {
                              vertexBuffer,
                              vertexBufferMemory);
 
-    anopol::ll::memCopyBuffer(staging, vertexBuffer, bufferSize, copyFence);
-
-    vkWaitForFences(context->device, 1, &copyFence, VK_TRUE, UINT64_MAX);
-    vkDestroyFence(context->device, copyFence, nullptr);
-
-    vkDestroyBuffer(context->device, staging, nullptr);
-    vkFreeMemory(context->device, stagingMemory, nullptr);
+    pendingUpload = std::max(anopol::ll::stageBuffer(packed.data(), bufferSize, vertexBuffer), quantizationTable.pendingUpload);
 
     if (oldBuffer != VK_NULL_HANDLE) {
-        vkDestroyBuffer(context->device, oldBuffer, nullptr);
-    }
-    if (oldMemory != VK_NULL_HANDLE) {
-        vkFreeMemory(context->device, oldMemory, nullptr);
+        anopol::ll::retireBuffer(oldBuffer, oldMemory);
     }
 }
 
 void VertexBuffer::dealloc() {
     
-    vkDestroyBuffer(context->device, vertexBuffer, nullptr);
-    vkFreeMemory(context->device, vertexBufferMemory, nullptr);
+    anopol::ll::freeBuffer(vertexBuffer, vertexBufferMemory);
+    
+    if (quantization != UINT32_MAX) quantizationTable.Release(quantization);
+    quantization = UINT32_MAX;
 }
 
 }
@@ -0,0 +1,364 @@
+//
+//  mesh_optimize.h
+//  anopol
+//
+//  Created by Dmitri Wamback on 2026-10-17.
+//
+
+#ifndef mesh_optimize_h
+#define mesh_optimize_h
+
+#define anopol_vertex_cache_size            16      // FIFO post-transform cache the ACMR is measured against
+#define anopol_vertex_cache_scoring_size    32      // LRU cache the triangle order is scored against
+#define anopol_overdraw_threshold           1.05f   // ACMR the overdraw order may cost, relative to the cache order
+
+namespace anopol::render {
+
+//------------------------------------------------------------------------------------------//
+// Mesh optimization
+//
+// Runs on import and when the batch places new geometry:
+//   1. duplicate vertices are welded into an index buffer
+//   2. triangles are ordered for the post-transform vertex cache (Forsyth)
+//   3. clusters of that order are sorted outside-in to cut overdraw, as long as the cache
+//      order costs less than anopol_overdraw_threshold
+//   4. vertices are ordered by first use, for fetch locality
+// ACMR is cache misses per triangle: 3 for a triangle soup, about 0.5 at best for a grid
+//------------------------------------------------------------------------------------------//
+
+// Summed over every mesh optimized, so it reports a whole asset or batch
+typedef struct meshOptimization {
+    uint32_t meshes         = 0;
+    uint64_t triangles      = 0;
+    uint64_t verticesBefore = 0, verticesAfter = 0;
+    uint64_t missesBefore   = 0, missesAfter   = 0;
+
+    float AcmrBefore() const { return triangles == 0 ? 0.0f : static_cast<float>(missesBefore) / triangles; }
+    float AcmrAfter() const  { return triangles == 0 ? 0.0f : static_cast<float>(missesAfter) / triangles; }
+
+    void Add(const meshOptimization& other) {
+        meshes         += other.meshes;
+        triangles      += other.triangles;
+        verticesBefore += other.verticesBefore;
+        verticesAfter  += other.verticesAfter;
+        missesBefore   += other.missesBefore;
+        missesAfter    += other.missesAfter;
+    }
+} meshOptimization;
+
+// A vertex is in a FIFO cache if it went in within the last cacheSize misses
+uint64_t vertexCacheMisses(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize = anopol_vertex_cache_size) {
+
+    std::vector<uint32_t> timestamps(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+    uint64_t misses = 0;
+
+    for (uint32_t index : indices) {
+        if (time - timestamps[index] > cacheSize) {
+            timestamps[index] = time++;
+            misses++;
+        }
+    }
+    return misses;
+}
+
+float averageCacheMissRatio(const std::vector<uint32_t>& indices, size_t vertexCount) {
+    return indices.size() < 3 ? 0.0f : static_cast<float>(vertexCacheMisses(indices, vertexCount)) / (indices.size() / 3);
+}
+
+//------------------------------------------------------------------------------------------//
+// Welding
+//------------------------------------------------------------------------------------------//
+
+// Only bitwise identical vertices are merged, so nothing the shaders read changes
+void weldVertices(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+
+    auto hashVertex = [](const Vertex& vertex) {
+        uint64_t hash = 14695981039346656037ull;
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&vertex);
+        for (size_t i = 0; i < sizeof(Vertex); i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    };
+
+    // Open addressing over the welded vertices, at most half full
+    size_t tableSize = 1;
+    while (tableSize < vertices.size() * 2) tableSize <<= 1;
+    std::vector<uint32_t> table(tableSize, UINT32_MAX);
+
+    std::vector<Vertex> welded;
+    std::vector<uint32_t> remap(vertices.size());
+    welded.reserve(vertices.size());
+
+    for (size_t i = 0; i < vertices.size(); i++) {
+
+        size_t slot = hashVertex(vertices[i]) & (tableSize - 1);
+        while (table[slot] != UINT32_MAX && std::memcmp(&welded[table[slot]], &vertices[i], sizeof(Vertex)) != 0) {
+            slot = (slot + 1) & (tableSize - 1);
+        }
+        if (table[slot] == UINT32_MAX) {
+            table[slot] = static_cast<uint32_t>(welded.size());
+            welded.push_back(vertices[i]);
+        }
+        remap[i] = table[slot];
+    }
+
+    for (uint32_t& index : indices) index = remap[index];
+    vertices.swap(welded);
+}
+
+//------------------------------------------------------------------------------------------//
+// Vertex cache order
+// Greedy: the next triangle is the best scored one touching the cache, where vertices score
+// higher the more recently they were used and the fewer triangles they have left
+//------------------------------------------------------------------------------------------//
+
+float forsythVertexScore(int32_t cachePosition, uint32_t liveTriangles) {
+
+    if (liveTriangles == 0) return -1.0f;
+
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        // The last triangle's vertices score a little lower, so it is not picked again right away
+        if (cachePosition < 3) score = 0.75f;
+        else score = std::pow(1.0f - static_cast<float>(cachePosition - 3) / (anopol_vertex_cache_scoring_size - 3), 1.5f);
+    }
+    return score + 2.0f * std::pow(static_cast<float>(liveTriangles), -0.5f);
+}
+
+std::vector<uint32_t> optimizeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount) {
+
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) return indices;
+
+    // Triangles per vertex; the live ones are kept at the front of each vertex's range
+    std::vector<uint32_t> liveTriangles(vertexCount, 0), offsets(vertexCount + 1, 0), adjacency(triangleCount * 3);
+    for (size_t i = 0; i < triangleCount * 3; i++) liveTriangles[indices[i]]++;
+    for (size_t v = 0; v < vertexCount; v++) offsets[v + 1] = offsets[v] + liveTriangles[v];
+
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++) {
+        for (int k = 0; k < 3; k++) adjacency[fill[indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+    }
+
+    std::vector<int32_t> cachePositions(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount), triangleScores(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+
+    for (size_t v = 0; v < vertexCount; v++) vertexScores[v] = forsythVertexScore(-1, liveTriangles[v]);
+
+    uint32_t best = 0;
+    for (size_t t = 0; t < triangleCount; t++) {
+        triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+        if (triangleScores[t] > triangleScores[best]) best = static_cast<uint32_t>(t);
+    }
+
+    std::array<uint32_t, anopol_vertex_cache_scoring_size + 3> cache, nextCache;
+    uint32_t cacheCount = 0;
+
+    std::vector<uint32_t> result;
+    result.reserve(triangleCount * 3);
+    size_t cursor = 0;
+
+    for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++) {
+
+        // Nothing in the cache has triangles left: start over at the next one in input order
+        if (best == UINT32_MAX) {
+            while (emitted[cursor]) cursor++;
+            best = static_cast<uint32_t>(cursor);
+        }
+
+        uint32_t triangle = best;
+        const uint32_t* corners = &indices[triangle * 3];
+        emitted[triangle] = true;
+        result.insert(result.end(), corners, corners + 3);
+
+        for (int k = 0; k < 3; k++) {
+            uint32_t vertex = corners[k];
+            uint32_t* live = &adjacency[offsets[vertex]];
+            uint32_t* found = std::find(live, live + liveTriangles[vertex], triangle);
+            std::swap(*found, live[--liveTriangles[vertex]]);
+        }
+
+        // The triangle's vertices go to the front, the rest shift back
+        uint32_t nextCount = 0;
+        for (int k = 0; k < 3; k++) nextCache[nextCount++] = corners[k];
+        for (uint32_t i = 0; i < cacheCount; i++) {
+            uint32_t vertex = cache[i];
+            if (vertex != corners[0] && vertex != corners[1] && vertex != corners[2]) nextCache[nextCount++] = vertex;
+        }
+
+        for (uint32_t i = 0; i < nextCount; i++) {
+            uint32_t vertex = nextCache[i];
+            cachePositions[vertex] = i < anopol_vertex_cache_scoring_size ? static_cast<int32_t>(i) : -1;
+            vertexScores[vertex] = forsythVertexScore(cachePositions[vertex], liveTriangles[vertex]);
+        }
+
+        // Only triangles of vertices whose score changed can become the best
+        best = UINT32_MAX;
+        float bestScore = -1.0f;
+
+        for (uint32_t i = 0; i < nextCount; i++) {
+            uint32_t vertex = nextCache[i];
+            for (uint32_t j = 0; j < liveTriangles[vertex]; j++) {
+                uint32_t t = adjacency[offsets[vertex] + j];
+                triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+                if (triangleScores[t] > bestScore) {
+                    bestScore = triangleScores[t];
+                    best = t;
+                }
+            }
+        }
+
+        cacheCount = std::min<uint32_t>(nextCount, anopol_vertex_cache_scoring_size);
+        std::copy(nextCache.begin(), nextCache.begin() + cacheCount, cache.begin());
+    }
+
+    return result;
+}
+
+//------------------------------------------------------------------------------------------//
+// Overdraw order
+// The cache order is cut into clusters where it starts cold, or where a cluster has already
+// paid for its misses; clusters facing away from the mesh's centre are drawn first, so
+// they occlude the inner ones. Clusters keep their own order, which bounds the ACMR cost
+//------------------------------------------------------------------------------------------//
+
+std::vector<uint32_t> optimizeOverdraw(const std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, float threshold = anopol_overdraw_threshold) {
+
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount < 2) return indices;
+
+    uint64_t misses = vertexCacheMisses(indices, vertices.size());
+    float targetAcmr = threshold * static_cast<float>(misses) / triangleCount;
+
+    std::vector<uint32_t> clusterStarts;
+    std::vector<uint32_t> timestamps(vertices.size(), 0);
+    uint32_t time = anopol_vertex_cache_size + 1, clusterMisses = 0, clusterTriangles = 0;
+
+    for (size_t t = 0; t < triangleCount; t++) {
+
+        uint32_t triangleMisses = 0;
+        for (int k = 0; k < 3; k++) {
+            uint32_t vertex = indices[t * 3 + k];
+            if (time - timestamps[vertex] > anopol_vertex_cache_size) {
+                timestamps[vertex] = time++;
+                triangleMisses++;
+            }
+        }
+
+        bool cold = triangleMisses == 3;
+        bool paid = clusterTriangles > 0 && static_cast<float>(clusterMisses) / clusterTriangles <= targetAcmr;
+        if (t == 0 || cold || paid) {
+            clusterStarts.push_back(static_cast<uint32_t>(t));
+            clusterMisses = clusterTriangles = 0;
+        }
+        clusterMisses += triangleMisses;
+        clusterTriangles++;
+    }
+
+    if (clusterStarts.size() < 2) return indices;
+    clusterStarts.push_back(static_cast<uint32_t>(triangleCount));
+
+    auto corner = [&](size_t t, int k) { return vertices[indices[t * 3 + k]].vertex; };
+
+    // Area weighted centroids; a cross product's length is twice its triangle's area
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+
+    size_t clusterCount = clusterStarts.size() - 1;
+    std::vector<glm::vec3> centroids(clusterCount), normals(clusterCount);
+
+    for (size_t cluster = 0; cluster < clusterCount; cluster++) {
+
+        glm::vec3 centroid(0.0f), normal(0.0f);
+        float area = 0.0f;
+
+        for (size_t t = clusterStarts[cluster]; t < clusterStarts[cluster + 1]; t++) {
+            glm::vec3 a = corner(t, 0), b = corner(t, 1), c = corner(t, 2);
+            glm::vec3 cross = glm::cross(b - a, c - a);
+            float weight = glm::length(cross);
+
+            centroid += (a + b + c) / 3.0f * weight;
+            normal   += cross;
+            area     += weight;
+        }
+
+        meshCentroid += centroid;
+        meshArea     += area;
+        centroids[cluster] = area > 0.0f ? centroid / area : corner(clusterStarts[cluster], 0);
+        normals[cluster]   = glm::length(normal) > 0.0f ? glm::normalize(normal) : glm::vec3(0.0f);
+    }
+    if (meshArea > 0.0f) meshCentroid /= meshArea;
+
+    std::vector<float> keys(clusterCount);
+    std::vector<uint32_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++) {
+        keys[c]  = glm::dot(centroids[c] - meshCentroid, normals[c]);
+        order[c] = static_cast<uint32_t>(c);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return keys[a] > keys[b]; });
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    for (uint32_t c : order) {
+        result.insert(result.end(), indices.begin() + clusterStarts[c] * 3, indices.begin() + clusterStarts[c + 1] * 3);
+    }
+
+    // Cold cluster starts cost more than the estimate when they follow each other
+    if (vertexCacheMisses(result, vertices.size()) > static_cast<uint64_t>(threshold * misses)) return indices;
+    return result;
+}
+
+//------------------------------------------------------------------------------------------//
+// Vertex fetch order
+//------------------------------------------------------------------------------------------//
+
+// Vertices in the order the indices first use them; unused vertices are dropped
+void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+
+    std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+    std::vector<Vertex> ordered;
+    ordered.reserve(vertices.size());
+
+    for (uint32_t& index : indices) {
+        if (remap[index] == UINT32_MAX) {
+            remap[index] = static_cast<uint32_t>(ordered.size());
+            ordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(ordered);
+}
+
+// Non-indexed geometry comes back indexed. Anything that is not a triangle list is left alone
+meshOptimization optimizeMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+
+    meshOptimization statistics{};
+    if (vertices.empty() || (indices.empty() ? vertices.size() : indices.size()) % 3 != 0) return statistics;
+
+    if (indices.empty()) {
+        indices.resize(vertices.size());
+        for (size_t i = 0; i < indices.size(); i++) indices[i] = static_cast<uint32_t>(i);
+    }
+
+    statistics.meshes         = 1;
+    statistics.triangles      = indices.size() / 3;
+    statistics.verticesBefore = vertices.size();
+    statistics.missesBefore   = vertexCacheMisses(indices, vertices.size());
+
+    weldVertices(vertices, indices);
+    indices = optimizeVertexCache(indices, vertices.size());
+    indices = optimizeOverdraw(indices, vertices);
+    optimizeVertexFetch(vertices, indices);
+
+    statistics.verticesAfter  = vertices.size();
+    statistics.missesAfter    = vertexCacheMisses(indices, vertices.size());
+    return statistics;
+}
+
+}
+
+#endif /* mesh_optimize_h */
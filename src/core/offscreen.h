@@ -19,9 +19,10 @@ public:
 private:
     VkRenderPass renderPass;
     std::vector<VkImage>          colorImages;
-    std::vector<VkDeviceMemory>   colorImageMemory;
+    std::vector<anopol::ll::allocation> colorImageMemory;
     std::vector<VkImageView>      colorImageViews;
     std::vector<VkFramebuffer>    framebuffers;
+    uint32_t                      offscreenScope = UINT32_MAX;
 };
 
 OffscreenRendering OffscreenRendering::Create() {
@@ -70,7 +71,7 @@ OffscreenRendering OffscreenRendering::Create() {
     subpass.pColorAttachments       = &colorAttachmentRef;
     subpass.pDepthStencilAttachment = &depthAttachmentRef;
 
-    // --- SUBPASS DEPENDENCY (to external) ---
+    // --- SUBPASS DEPENDENCY (from external) ---
     VkSubpassDependency dependency{};
     dependency.srcSubpass    = VK_SUBPASS_EXTERNAL;
     dependency.dstSubpass    = 0;
@@ -78,9 +79,20 @@ OffscreenRendering OffscreenRendering::Create() {
     dependency.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
     dependency.dstStageMask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
     dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    
+    // --- SUBPASS DEPENDENCY (to external) ---
+    // The render pass itself moves the color target to SHADER_READ_ONLY_OPTIMAL on the way out
+    VkSubpassDependency sampleDependency{};
+    sampleDependency.srcSubpass    = 0;
+    sampleDependency.dstSubpass    = VK_SUBPASS_EXTERNAL;
+    sampleDependency.srcStageMask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    sampleDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    sampleDependency.dstStageMask  = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    sampleDependency.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
     // --- RENDERPASS CREATE INFO ---
     std::array<VkAttachmentDescription, 2> attachments = { colorAttachment, depthAttachment };
+    std::array<VkSubpassDependency, 2> dependencies = { dependency, sampleDependency };
 
     VkRenderPassCreateInfo renderPassInfo{};
     renderPassInfo.sType           = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -88,8 +100,8 @@ OffscreenRendering OffscreenRendering::Create() {
     renderPassInfo.pAttachments    = attachments.data();
     renderPassInfo.subpassCount    = 1;
     renderPassInfo.pSubpasses      = &subpass;
-    renderPassInfo.dependencyCount = 1;
-    renderPassInfo.pDependencies   = &dependency;
+    renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+    renderPassInfo.pDependencies   = dependencies.data();
 
     if (vkCreateRenderPass(context->device, &renderPassInfo, nullptr, &offscreen.renderPass) != VK_SUCCESS) {
         anopol_assert("Failed to create render pass");
@@ -156,10 +168,11 @@ void OffscreenRendering::Render(anopol::batch::Batch batch, VkCommandBuffer comm
     renderPassInfo.clearValueCount   = 2;
     renderPassInfo.pClearValues      = clearValues;
 
+    offscreenScope = anopol::ll::gpuProfiler.Begin(commandBuffer, "offscreen");
     vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
     
     VkDeviceSize offsets[] = {0};
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &batch.vertexBuffer.vertexBuffer, offsets);
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &batch.vertexBuffer.buffer, offsets);
         
     anopol::render::anopolStandardPushConstants standardPushConstants{};
     standardPushConstants.scale             = glm::vec4(glm::vec3(0), 1.0f);
@@ -182,21 +195,29 @@ void OffscreenRendering::Render(anopol::batch::Batch batch, VkCommandBuffer comm
                        0,
                        sizeof(anopol::render::anopolStandardPushConstants),
                        &standardPushConstants);
-    vkCmdDrawIndirect(commandBuffer, batch.GetBatchFrame(currentFrame).drawCommandBuffer, 0, static_cast<uint32_t>(batch.transformations.size()), sizeof(VkDrawIndirectCommand));
+    
+    const anopol::batch::Batch::batchFrame& frame = batch.GetBatchFrame(currentFrame);
+    VkBuffer drawCounts = batch.DrawCountBuffer(currentFrame);     // Commands written by the cull pass
+    
+    if (frame.drawCount > 0) {
+        if (drawCounts != VK_NULL_HANDLE) vkCmdDrawIndirectCount(commandBuffer, frame.drawCommandBuffer.buffer, 0, drawCounts, 0, frame.drawCount, sizeof(VkDrawIndirectCommand));
+        else                              vkCmdDrawIndirect(commandBuffer, frame.drawCommandBuffer.buffer, 0, frame.drawCount, sizeof(VkDrawIndirectCommand));
+    }
+    if (frame.indexedDrawCount > 0) {
+        vkCmdBindIndexBuffer(commandBuffer, batch.indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+        if (drawCounts != VK_NULL_HANDLE) vkCmdDrawIndexedIndirectCount(commandBuffer, frame.indexedDrawCommandBuffer.buffer, 0, drawCounts, sizeof(uint32_t), frame.indexedDrawCount, sizeof(VkDrawIndexedIndirectCommand));
+        else                              vkCmdDrawIndexedIndirect(commandBuffer, frame.indexedDrawCommandBuffer.buffer, 0, frame.indexedDrawCount, sizeof(VkDrawIndexedIndirectCommand));
+    }
     
     End(commandBuffer, currentFrame);
 }
 
 void OffscreenRendering::End(VkCommandBuffer commandBuffer, uint32_t currentFrame) {
     
+    // No separate transition: finalLayout and the outgoing subpass dependency leave the
+    // color target readable by later passes recorded into this same frame command buffer
     vkCmdEndRenderPass(commandBuffer);
-
-    anopol::ll::imageLayoutTransition(
-        colorImages[currentFrame],
-        context->format,
-        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-    );
+    anopol::ll::gpuProfiler.End(commandBuffer, offscreenScope);
 }
 
 
@@ -217,10 +238,7 @@ void OffscreenRendering::Free() {
 
     for (size_t i = 0; i < colorImages.size(); ++i) {
         if (colorImages[i] != VK_NULL_HANDLE) {
-            vkDestroyImage(context->device, colorImages[i], nullptr);
-        }
-        if (colorImageMemory[i] != VK_NULL_HANDLE) {
-            vkFreeMemory(context->device, colorImageMemory[i], nullptr);
+            anopol::ll::freeImage(colorImages[i], colorImageMemory[i]);
         }
     }
     colorImages.clear();
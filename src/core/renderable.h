@@ -19,11 +19,19 @@ public:
     bool isIndexed, collisionEnabled = true;
     
     glm::vec3 position, rotation, scale, color;
+    uint32_t material = 0;      // Index into the texture table's materials
     
     static Renderable* Create();
     std::vector<Vertex> GetColliderVertices(bool withNormals);
     float ComputeBoundingSphereRadius();
     float boundingSphereRadius;
+    
+    // Set by the batch that combines this renderable. After changing position, rotation, scale,
+    // color or material, MarkTransformDirty queues it for that batch's next DynamicUpload
+    uint32_t batchObject = UINT32_MAX;
+    std::shared_ptr<std::vector<uint32_t>> batchDirtyObjects;
+    bool transformDirty = false;
+    void MarkTransformDirty();
 private:
     glm::vec3 lastPosition, lastRotation, lastScale;
     glm::mat4 currentModel;
@@ -136,6 +144,15 @@ std::vector<Vertex> Renderable::GetColliderVertices(bool withNormals = false) {
     return projectedVertices;
 }
 
+// Main thread only; queued once until the batch picks it up
+void Renderable::MarkTransformDirty() {
+    
+    if (transformDirty || !batchDirtyObjects) return;
+    
+    transformDirty = true;
+    batchDirtyObjects->push_back(batchObject);
+}
+
 float Renderable::ComputeBoundingSphereRadius() {
     
     float radius = 0;
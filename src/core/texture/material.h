@@ -10,11 +10,13 @@
 
 namespace anopol::render {
 
+// Indices into the texture table, read per fragment from the material buffer (std430, 32 bytes)
 struct Material {
-    uint32_t albedoIndex;
-    uint32_t metallicIndex;
-    uint32_t roughnessIndex;
-    uint32_t normalIndex;
+    uint32_t albedoIndex    = 0;
+    uint32_t metallicIndex  = 0;
+    uint32_t roughnessIndex = 0;
+    uint32_t normalIndex    = 0;
+    glm::vec4 baseColor     = glm::vec4(1.0f);
 };
 
 }
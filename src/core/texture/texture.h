@@ -15,17 +15,20 @@ public:
     VkImageView textureImageView;
     VkImage textureImage;
     VkSampler sampler;
+    anopol::ll::uploadToken pendingUpload = 0;
     
     static Texture LoadTexture(const char* path);
     void Dealloc();
     
 private:
-    VkDeviceMemory textureImageMemory;
+    anopol::ll::allocation textureImageMemory;
 };
 
 
 Texture Texture::LoadTexture(const char* path) {
     
+    anopol_zone("Texture::LoadTexture");
+    
     Texture texture = Texture();
     
     int width, height, channels;
@@ -33,21 +36,16 @@ Texture Texture::LoadTexture(const char* path) {
     
     VkDeviceSize imageSize = uint64_t(width) * uint64_t(height) * 4 * sizeof(float);
     
-    VkBuffer staging;
-    VkDeviceMemory stagingMemory;
-    
-    anopol::ll::createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging, stagingMemory);
+    std::lock_guard<std::recursive_mutex> lock(anopol::ll::stagingMutex);
     
-    void *data;
-    vkMapMemory(context->device, stagingMemory, 0, imageSize, 0, &data);
-    memcpy(data, pixels, static_cast<size_t>(imageSize));
-    vkUnmapMemory(context->device, stagingMemory);
+    anopol::ll::stagingRange staging = anopol::ll::reserveStaging(imageSize);
+    memcpy(staging.mapped, pixels, static_cast<size_t>(imageSize));
     
     stbi_image_free(pixels);
     
     VkImage textureImage;
     VkImageView textureImageView;
-    VkDeviceMemory textureImageMemory;
+    anopol::ll::allocation textureImageMemory;
     
     anopol::ll::createImage(width, height,
                             VK_FORMAT_R32G32B32A32_SFLOAT,
@@ -57,12 +55,13 @@ Texture Texture::LoadTexture(const char* path) {
                             textureImage,
                             textureImageMemory);
     
-    anopol::ll::imageLayoutTransition(textureImage, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-    anopol::ll::memCopyBufferToImage(staging, textureImage, static_cast<uint32_t>(width), static_cast<uint32_t>(height));
-    anopol::ll::imageLayoutTransition(textureImage, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    anopol::ll::CommandRecorder& recorder = anopol::ll::uploadRecorder();
+    
+    recorder.Transition(textureImage, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    recorder.CopyBufferToImage(staging.buffer, staging.offset, textureImage, static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+    recorder.Transition(textureImage, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, true);
     
-    vkDestroyBuffer(context->device, staging, nullptr);
-    vkFreeMemory(context->device, stagingMemory, nullptr);
+    texture.pendingUpload = anopol::ll::lastUploadToken();
     
     VkImageViewCreateInfo imageViewCreateInfo{};
     imageViewCreateInfo.sType                           = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -107,9 +106,8 @@ Texture Texture::LoadTexture(const char* path) {
 
 void Texture::Dealloc() {
     vkDestroySampler(context->device, sampler, nullptr);
-    vkDestroyImage(context->device, textureImage, nullptr);
     vkDestroyImageView(context->device, textureImageView, nullptr);
-    vkFreeMemory(context->device, textureImageMemory, nullptr);
+    anopol::ll::freeImage(textureImage, textureImageMemory);
 }
 
 }
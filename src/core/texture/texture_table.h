@@ -0,0 +1,192 @@
+//
+//  texture_table.h
+//  anopol
+//
+//  Created by Dmitri Wamback on 2026-10-17.
+//
+
+#ifndef texture_table_h
+#define texture_table_h
+
+namespace anopol::render::texture {
+
+//------------------------------------------------------------------------------------------//
+// Texture table
+//
+// One descriptor set holding every texture the scene uses in a single partially bound
+// sampler array, and a buffer of materials that index into it. Objects carry a material
+// index instead of a bound texture, so batched and instanced geometry with different
+// textures still draws in one indirect call. Where the device allows updating descriptors
+// after bind, textures can be registered at any time; otherwise only before the first frame
+//------------------------------------------------------------------------------------------//
+
+class TextureTable {
+public:
+    void Initialize();
+    uint32_t Register(const Texture& texture);
+    uint32_t RegisterMaterial(const Material& material);
+    void UpdateMaterial(uint32_t index, const Material& material);
+    void MarkGraphicsUse() const { anopol::ll::markGraphicsUse(materialBuffer); }
+    void Destroy();
+
+    VkDescriptorSetLayout Layout() const { return descriptorSetLayout; }
+    VkDescriptorSet Set() { bound = true; return descriptorSet; }
+    uint32_t Capacity() const { return capacity; }
+
+    anopol::ll::uploadToken pendingUpload = 0;
+
+private:
+    VkDescriptorPool        descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSetLayout   descriptorSetLayout = VK_NULL_HANDLE;
+    VkDescriptorSet         descriptorSet = VK_NULL_HANDLE;
+
+    // Fixed size like the transform buffers, so the descriptor written once stays valid
+    VkBuffer                materialBuffer = VK_NULL_HANDLE;
+    anopol::ll::allocation  materialBufferMemory;
+
+    uint32_t capacity = 0, textureCount = 0, materialCount = 0;
+    bool bound = false;
+};
+
+void TextureTable::Initialize() {
+
+    VkPhysicalDeviceVulkan12Properties vulkan12Properties{};
+    vulkan12Properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+
+    VkPhysicalDeviceProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &vulkan12Properties;
+    vkGetPhysicalDeviceProperties2(context->physicalDevice, &properties);
+
+    // The global set's texture binding counts against the same per-stage limit
+    uint32_t limit = anopol::ll::bindlessUpdateAfterBind
+        ? std::min(vulkan12Properties.maxPerStageDescriptorUpdateAfterBindSamplers, vulkan12Properties.maxPerStageDescriptorUpdateAfterBindSampledImages)
+        : std::min(properties.properties.limits.maxPerStageDescriptorSamplers, properties.properties.limits.maxPerStageDescriptorSampledImages);
+    capacity = std::min<uint32_t>(anopol_max_bindless_textures, limit > anopol_max_textures ? limit - anopol_max_textures : 1);
+
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+    bindings[0].binding         = 0;
+    bindings[0].descriptorCount = capacity;
+    bindings[0].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[0].stageFlags      = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    bindings[1].binding         = 1;
+    bindings[1].descriptorCount = 1;
+    bindings[1].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[1].stageFlags      = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    // Unregistered slots are never read, and registering one does not disturb frames in flight
+    std::array<VkDescriptorBindingFlags, 2> bindingFlags = {
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
+        0
+    };
+    if (anopol::ll::bindlessUpdateAfterBind) {
+        bindingFlags[0] |= VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+    }
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+    bindingFlagsInfo.sType          = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    bindingFlagsInfo.bindingCount   = static_cast<uint32_t>(bindingFlags.size());
+    bindingFlagsInfo.pBindingFlags  = bindingFlags.data();
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext        = &bindingFlagsInfo;
+    layoutInfo.flags        = anopol::ll::bindlessUpdateAfterBind ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT : 0;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings    = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(context->device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) anopol_assert("Failed to create texture table descriptor set layout");
+
+    std::array<VkDescriptorPoolSize, 2> poolSizes = {{
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,    capacity },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,            1 }
+    }};
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType          = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags          = anopol::ll::bindlessUpdateAfterBind ? VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT : 0;
+    poolInfo.poolSizeCount  = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes     = poolSizes.data();
+    poolInfo.maxSets        = 1;
+
+    if (vkCreateDescriptorPool(context->device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) anopol_assert("Failed to create texture table descriptor pool");
+
+    VkDescriptorSetAllocateInfo allocationInfo{};
+    allocationInfo.sType                = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocationInfo.descriptorPool       = descriptorPool;
+    allocationInfo.descriptorSetCount   = 1;
+    allocationInfo.pSetLayouts          = &descriptorSetLayout;
+
+    if (vkAllocateDescriptorSets(context->device, &allocationInfo, &descriptorSet) != VK_SUCCESS) anopol_assert("Failed to allocate texture table descriptor set");
+
+    anopol::ll::createBuffer(sizeof(Material) * anopol_max_materials,
+                             VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                             materialBuffer, materialBufferMemory);
+
+    VkDescriptorBufferInfo bufferInfo{ materialBuffer, 0, VK_WHOLE_SIZE };
+
+    VkWriteDescriptorSet write{};
+    write.sType             = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet            = descriptorSet;
+    write.dstBinding        = 1;
+    write.descriptorType    = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write.descriptorCount   = 1;
+    write.pBufferInfo       = &bufferInfo;
+
+    vkUpdateDescriptorSets(context->device, 1, &write, 0, nullptr);
+}
+
+// Returns the texture's index in the table. The texture must outlive the table
+uint32_t TextureTable::Register(const Texture& texture) {
+
+    if (textureCount >= capacity) anopol_assert("Texture table is full");
+    if (bound && !anopol::ll::bindlessUpdateAfterBind) anopol_assert("This device can't register textures after the texture table is bound");
+
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.imageLayout   = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    imageInfo.imageView     = texture.textureImageView;
+    imageInfo.sampler       = texture.sampler;
+
+    VkWriteDescriptorSet write{};
+    write.sType             = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet            = descriptorSet;
+    write.dstBinding        = 0;
+    write.dstArrayElement   = textureCount;
+    write.descriptorType    = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.descriptorCount   = 1;
+    write.pImageInfo        = &imageInfo;
+
+    vkUpdateDescriptorSets(context->device, 1, &write, 0, nullptr);
+
+    pendingUpload = std::max(pendingUpload, texture.pendingUpload);
+    return textureCount++;
+}
+
+// Returns the index objects store in their material field
+uint32_t TextureTable::RegisterMaterial(const Material& material) {
+
+    if (materialCount >= anopol_max_materials) anopol_assert("Material buffer is full");
+
+    UpdateMaterial(materialCount, material);
+    return materialCount++;
+}
+
+void TextureTable::UpdateMaterial(uint32_t index, const Material& material) {
+    pendingUpload = std::max(pendingUpload, anopol::ll::stageBuffer(&material, sizeof(Material), materialBuffer, sizeof(Material) * index));
+}
+
+void TextureTable::Destroy() {
+
+    if (descriptorPool == VK_NULL_HANDLE) return;
+
+    anopol::ll::freeBuffer(materialBuffer, materialBufferMemory);
+    vkDestroyDescriptorPool(context->device, descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(context->device, descriptorSetLayout, nullptr);
+    descriptorPool = VK_NULL_HANDLE;
+}
+
+}
+
+#endif /* texture_table_h */
@@ -8,46 +8,105 @@
 #ifndef vertex_h
 #define vertex_h
 
+// Define ANOPOL_COMPACT_VERTICES before including anopol.h to store vertices on the GPU as
+// CompactVertex; the shaders are then loaded from their compact variants
+//#define ANOPOL_COMPACT_VERTICES
+
+#define anopol_max_quantized_meshes 65536   // Slots in a CompactVertex's position w
+
 namespace anopol::render {
+
+// What the CPU side works with: collisions, hashing, bounds, and the layout the GPU copy is packed from
 struct Vertex {
-    
     glm::vec3 vertex;
     glm::vec3 normal;
     glm::vec2 uv;
-    uint32_t instanceID;
-    
-    static VkVertexInputBindingDescription getBindingDescription() {
-        
-        VkVertexInputBindingDescription binding{};
-        binding.binding = 0;
-        binding.stride = sizeof(Vertex);
-        binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-        
-        return binding;
+};
+
+// Per-mesh bounds a CompactVertex position is quantized in. std430, mirrors shader.vert
+typedef struct meshQuantization {
+    glm::vec4 center;       // xyz, w unused
+    glm::vec4 extent;       // Half size per axis, never 0
+} meshQuantization;
+
+meshQuantization quantizeBounds(const std::vector<Vertex>& vertices) {
+
+    glm::vec3 minimum(std::numeric_limits<float>::max()), maximum(std::numeric_limits<float>::lowest());
+    for (const Vertex& vertex : vertices) {
+        minimum = glm::min(minimum, vertex.vertex);
+        maximum = glm::max(maximum, vertex.vertex);
     }
-    
-    static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescription() {
-        
-        std::array<VkVertexInputAttributeDescription, 3> attributes{};
-        
-        attributes[0].binding   = 0;
-        attributes[0].location  = 0;
-        attributes[0].format    = VK_FORMAT_R32G32B32_SFLOAT;
-        attributes[0].offset    = offsetof(Vertex, vertex);
-        
-        attributes[1].binding   = 0;
-        attributes[1].location  = 1;
-        attributes[1].format    = VK_FORMAT_R32G32B32_SFLOAT;
-        attributes[1].offset    = offsetof(Vertex, normal);
-        
-        attributes[2].binding   = 0;
-        attributes[2].location  = 2;
-        attributes[2].format    = VK_FORMAT_R32G32_SFLOAT;
-        attributes[2].offset    = offsetof(Vertex, uv);
-        
-        return attributes;
+    if (vertices.empty()) minimum = maximum = glm::vec3(0.0f);
+
+    return { glm::vec4((minimum + maximum) * 0.5f, 0.0f), glm::vec4(glm::max((maximum - minimum) * 0.5f, glm::vec3(1e-6f)), 0.0f) };
+}
+
+// Unit vector to the octahedron folded onto [-1, 1]^2
+glm::vec2 octahedralEncode(glm::vec3 normal) {
+
+    float length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+    if (length == 0.0f) return glm::vec2(0.0f);
+
+    glm::vec2 encoded = glm::vec2(normal) / length;
+    if (normal.z < 0.0f) {
+        glm::vec2 sign(encoded.x >= 0.0f ? 1.0f : -1.0f, encoded.y >= 0.0f ? 1.0f : -1.0f);
+        encoded = (1.0f - glm::abs(glm::vec2(encoded.y, encoded.x))) * sign;
+    }
+    return encoded;
+}
+
+// 16 bytes against Vertex's 32: positions as 16-bit fractions of the mesh's bounds, normals
+// octahedral in two 16-bit snorms, UVs as half floats
+struct CompactVertex {
+    int16_t  position[4];   // xyz, then the mesh's quantization slot
+    uint32_t normal;        // packSnorm2x16
+    uint32_t uv;            // packHalf2x16
+
+    static CompactVertex Pack(const Vertex& source, const meshQuantization& quantization, uint32_t slot) {
+
+        glm::vec3 fraction = glm::clamp((source.vertex - glm::vec3(quantization.center)) / glm::vec3(quantization.extent), -1.0f, 1.0f);
+
+        CompactVertex vertex{};
+        for (int i = 0; i < 3; i++) vertex.position[i] = static_cast<int16_t>(std::round(fraction[i] * 32767.0f));
+        vertex.position[3] = static_cast<int16_t>(static_cast<uint16_t>(slot));
+        vertex.normal      = glm::packSnorm2x16(octahedralEncode(source.normal));
+        vertex.uv          = glm::packHalf2x16(source.uv);
+        return vertex;
     }
 };
+
+using standardVertexLayout = vertexLayout<Vertex, 0, VK_VERTEX_INPUT_RATE_VERTEX,
+    vertexAttribute<0, VK_FORMAT_R32G32B32_SFLOAT,      offsetof(Vertex, vertex)>,
+    vertexAttribute<1, VK_FORMAT_R32G32B32_SFLOAT,      offsetof(Vertex, normal)>,
+    vertexAttribute<2, VK_FORMAT_R32G32_SFLOAT,         offsetof(Vertex, uv)>>;
+
+using compactVertexLayout = vertexLayout<CompactVertex, 0, VK_VERTEX_INPUT_RATE_VERTEX,
+    vertexAttribute<0, VK_FORMAT_R16G16B16A16_SINT,     offsetof(CompactVertex, position)>,
+    vertexAttribute<1, VK_FORMAT_R16G16_SNORM,          offsetof(CompactVertex, normal)>,
+    vertexAttribute<2, VK_FORMAT_R16G16_SFLOAT,         offsetof(CompactVertex, uv)>>;
+
+// What vertex buffers hold, and the vertex input the pipelines read it with
+#if defined(ANOPOL_COMPACT_VERTICES)
+using gpuVertex         = CompactVertex;
+using gpuVertexLayout   = compactVertexLayout;
+constexpr bool quantizedVertices = true;
+#else
+using gpuVertex         = Vertex;
+using gpuVertexLayout   = standardVertexLayout;
+constexpr bool quantizedVertices = false;
+#endif
+
+static_assert(sizeof(gpuVertex) % sizeof(uint32_t) == 0, "The batch merge copies vertices as words");
+
+// slot is ignored without quantized vertices
+void packVertices(const Vertex* source, size_t count, const meshQuantization& quantization, uint32_t slot, gpuVertex* destination) {
+#if defined(ANOPOL_COMPACT_VERTICES)
+    for (size_t i = 0; i < count; i++) destination[i] = CompactVertex::Pack(source[i], quantization, slot);
+#else
+    std::copy(source, source + count, destination);
+#endif
+}
+
 }
 
 #endif /* vertex_h */
@@ -0,0 +1,63 @@
+//
+//  vertex_layout.h
+//  anopol
+//
+//  Created by Dmitri Wamback on 2026-10-17.
+//
+
+#ifndef vertex_layout_h
+#define vertex_layout_h
+
+namespace anopol::render {
+
+//------------------------------------------------------------------------------------------//
+// Vertex layouts
+//
+// A layout names the struct a vertex binding reads and its attributes as template
+// arguments, so the binding and attribute descriptions are built at compile time from the
+// struct itself. A pipeline's vertex input is the attributes of its layouts joined together
+//------------------------------------------------------------------------------------------//
+
+template<uint32_t Location, VkFormat Format, uint32_t Offset>
+struct vertexAttribute {
+    static constexpr VkVertexInputAttributeDescription Describe(uint32_t binding) {
+        return VkVertexInputAttributeDescription { Location, binding, Format, Offset };
+    }
+};
+
+template<typename Type, uint32_t Binding, VkVertexInputRate InputRate, typename... Attributes>
+struct vertexLayout {
+
+    using type = Type;
+    static constexpr uint32_t binding        = Binding;
+    static constexpr uint32_t attributeCount = sizeof...(Attributes);
+
+    static constexpr VkVertexInputBindingDescription BindingDescription() {
+        return VkVertexInputBindingDescription { Binding, static_cast<uint32_t>(sizeof(Type)), InputRate };
+    }
+
+    static constexpr std::array<VkVertexInputAttributeDescription, sizeof...(Attributes)> AttributeDescriptions() {
+        return {{ Attributes::Describe(Binding)... }};
+    }
+};
+
+template<typename... Layouts>
+std::vector<VkVertexInputBindingDescription> vertexBindings() {
+    return { Layouts::BindingDescription()... };
+}
+
+template<typename... Layouts>
+std::vector<VkVertexInputAttributeDescription> vertexAttributes() {
+
+    std::vector<VkVertexInputAttributeDescription> attributes;
+    attributes.reserve((Layouts::attributeCount + ...));
+
+    auto append = [&](const auto& descriptions) { attributes.insert(attributes.end(), descriptions.begin(), descriptions.end()); };
+    (append(Layouts::AttributeDescriptions()), ...);
+
+    return attributes;
+}
+
+}
+
+#endif /* vertex_layout_h */
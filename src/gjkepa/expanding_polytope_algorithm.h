@@ -16,6 +16,14 @@ struct collision {
     bool collided;
 };
 
+// Iterations spent by the last query on this thread, read by the collision benchmark
+struct collisionCounters {
+    uint32_t gjkIterations;
+    uint32_t epaIterations;
+};
+
+thread_local collisionCounters lastCollisionCounters{};
+
 std::pair<std::vector<glm::vec4>, size_t> GetNormal(std::vector<glm::vec3>& polytope, std::vector<size_t> indices) {
     
     std::vector<glm::vec4> normals;
@@ -77,7 +85,10 @@ collision EPA(Simplex& simplex, std::vector<anopol::render::Vertex> colliderA, s
     glm::vec3 min;
     float mindst = FLT_MAX;
     
+    uint32_t iterations = 0;
+    
     for(int k = 0; k < 100; k++) {
+        iterations++;
         min = glm::vec3(normals[minTriangle]);
         mindst = normals[minTriangle].w;
         
@@ -141,6 +152,8 @@ collision EPA(Simplex& simplex, std::vector<anopol::render::Vertex> colliderA, s
         
     }
      
+    lastCollisionCounters.epaIterations = iterations;
+    
     collisionDetection.normal = min;
     collisionDetection.depth = std::min(mindst + 0.001f, 1e2f);
     collisionDetection.collided = true;
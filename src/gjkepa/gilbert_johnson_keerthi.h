@@ -127,17 +127,14 @@ bool HandleSimplex(Simplex& simplex, glm::vec3& direction) {
 // GJK
 //------------------------------------------------------------------------------------------//
 
-collision GJKCollision(anopol::render::Renderable* a, anopol::render::Renderable* b) {
+// Runs GJK on two point clouds and leaves the terminating simplex behind for EPA
+bool GJKSimplex(const std::vector<anopol::render::Vertex>& colliderVerticesA, const std::vector<anopol::render::Vertex>& colliderVerticesB, Simplex& simplex, glm::vec3 initialDirectionB = glm::vec3(1.0f, 0.0f, 0.0f)) {
     
-    std::vector<anopol::render::Vertex> colliderVerticesA = a->GetColliderVertices();
-    std::vector<anopol::render::Vertex> colliderVerticesB = b->GetColliderVertices();
-    
-    collision collisionInformation{};
-    collisionInformation.collided = false;
+    lastCollisionCounters = {};
     
-    glm::vec3 support = Support(colliderVerticesA, glm::vec3(1.0f, 0.0f, 0.0f)) - Support(colliderVerticesB, glm::vec3(1.0f, 0.0f, 0.0f));
+    glm::vec3 support = Support(colliderVerticesA, glm::vec3(1.0f, 0.0f, 0.0f)) - Support(colliderVerticesB, initialDirectionB);
     
-    Simplex simplex;
+    simplex = Simplex();
     simplex.pushFront(support);
     
     glm::vec3 direction = -support;
@@ -150,18 +147,35 @@ collision GJKCollision(anopol::render::Renderable* a, anopol::render::Renderable
         //RenderDebugLine(va, vb, shader);
 
         if (glm::dot(support, direction) <= 0.0f) {
-            return collisionInformation;
+            lastCollisionCounters.gjkIterations = i + 1;
+            return false;
         }
 
         simplex.pushFront(support);
 
         if (HandleSimplex(simplex, direction)) {
-            collisionInformation = EPA(simplex, a->GetColliderVertices(), b->GetColliderVertices());
-            return collisionInformation;
+            lastCollisionCounters.gjkIterations = i + 1;
+            return true;
         }
     }
 
-    std::cout << "Terminated: Max iterations reached. No collision detected.\n";
+    // Ran out of iterations: treated as no collision, gjkIterations == 100 tells the benchmarks
+    lastCollisionCounters.gjkIterations = 100;
+    return false;
+}
+
+collision GJKCollision(anopol::render::Renderable* a, anopol::render::Renderable* b) {
+    
+    std::vector<anopol::render::Vertex> colliderVerticesA = a->GetColliderVertices();
+    std::vector<anopol::render::Vertex> colliderVerticesB = b->GetColliderVertices();
+    
+    collision collisionInformation{};
+    collisionInformation.collided = false;
+    
+    Simplex simplex;
+    if (GJKSimplex(colliderVerticesA, colliderVerticesB, simplex)) {
+        collisionInformation = EPA(simplex, colliderVerticesA, colliderVerticesB);
+    }
     return collisionInformation;
 }
 
@@ -173,31 +187,10 @@ collision GJKCollisionWithCamera(anopol::render::Renderable* a, glm::vec3 desire
     std::vector<anopol::render::Vertex> colliderVerticesA = a->GetColliderVertices();
     std::vector<anopol::render::Vertex> colliderVerticesB = anopol::camera::camera.GetColliderVertices(desiredPosition);
     
-    glm::vec3 support = Support(colliderVerticesA, glm::vec3(1.0f, 0.0f, 0.0f)) - Support(colliderVerticesB, -glm::vec3(1.0f, 0.0f, 0.0f));
-    
     Simplex simplex;
-    simplex.pushFront(support);
-    
-    glm::vec3 direction = -support;
-    
-    for (int i = 0; i < 100; i++) {
-        glm::vec3 va = Support(colliderVerticesA,  direction);
-        glm::vec3 vb = Support(colliderVerticesB, -direction);
-        support = va - vb;
-
-        if (glm::dot(support, direction) <= 0.0f) {
-            return collisionInformation;
-        }
-
-        simplex.pushFront(support);
-
-        if (HandleSimplex(simplex, direction)) {
-            collisionInformation = EPA(simplex, a->GetColliderVertices(), anopol::camera::camera.GetColliderVertices(desiredPosition));
-            return collisionInformation;
-        }
+    if (GJKSimplex(colliderVerticesA, colliderVerticesB, simplex, -glm::vec3(1.0f, 0.0f, 0.0f))) {
+        collisionInformation = EPA(simplex, colliderVerticesA, colliderVerticesB);
     }
-
-    std::cout << "Terminated: Max iterations reached. No collision detected.\n";
     return collisionInformation;
 }
 
@@ -15,6 +15,8 @@ void CollideAndRaycastBatch(anopol::batch::Batch batch) {
     while (true) {
         for (anopol::render::Renderable* r : batch.meshCombineGroup.renderables) {
             
+            if (r == nullptr) continue;
+            
             anopol::collision::collision col = anopol::collision::GJKCollisionWithCamera(r);
             if (col.collided) {
                 if (glm::dot(col.normal, r->position - anopol::camera::camera.cameraPosition) > 0) {
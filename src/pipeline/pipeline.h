@@ -10,6 +10,25 @@
 
 namespace anopol::pipeline {
 
+// Procedural scene built by InitializePipeline; the defaults reproduce the original debug scene
+struct sceneWorkload {
+    uint32_t    renderableCount     = 200 * 200;    // Batched cubes laid out on a square grid
+    float       renderableSpacing   = 15.0f;
+    uint32_t    assetCount          = 1;
+    uint32_t    instancesPerAsset   = 10 * 10;      // Laid out on a square grid per asset
+    std::string assetFolder;                        // Relative paths below, and the textures, are inside it
+    std::string assetPath           = "models/Nova Scotia.obj";
+    uint32_t    seed                = 0;            // Seeds rand() for rotations and colors
+    float       chunkSize           = 0.0f;         // Batch chunk cell edge; 0 keeps one batch with per-object culling
+    uint32_t    animatedCount       = 0;            // Batched renderables moved every frame through DynamicUpload
+};
+
+struct frameStatistics {
+    double              collisionMilliseconds   = 0.0;  // Camera collision in the last Bind
+    double              initialCombineMilliseconds = 0.0;
+    std::vector<double> combineMilliseconds;            // Every Combine issued by SpawnRenderable
+};
+
 class Pipeline {
 public:
     
@@ -29,6 +48,7 @@ public:
     int currentFrame = 0;
     
     VkRenderPass defaultRenderpass;
+    VkRenderPass lateRenderpass = VK_NULL_HANDLE;    // Loads what the main pass left, for objects revealed by the late cull
     
     anopol::render::UniformBuffer   uniformBufferMemory;
     anopol::render::InstanceBuffer* instanceBuffer;
@@ -38,54 +58,73 @@ public:
     std::vector<VkSemaphore>        imageSemaphores    = std::vector<VkSemaphore>(),
                                     renderSemaphores   = std::vector<VkSemaphore>();
     std::vector<VkFence>            inFlightFences     = std::vector<VkFence>();
+    anopol::ll::ParallelRecorder    secondaryRecorder;
     
     pipeline*                       anopolMainPipeline;
     pipelineConfigurations          anopolPipelineConfigurations{};
-    VkDescriptorSetLayout           samplerDescriptorSetLayout;
-    
-    VkDescriptorSet                 samplerDescriptorSet;
+    anopol::render::texture::TextureTable textureTable;
     
     std::map<std::string, VkPipelineShaderStageCreateInfo> shaderModules;
     
     std::vector<anopol::render::Renderable*>    debugRenderables = std::vector<anopol::render::Renderable*>();
     std::vector<anopol::render::Asset*>         assets = std::vector<anopol::render::Asset*>();
+    std::vector<anopol::batch::InstanceCuller>  instanceCullers;    // One per asset
     
     anopol::batch::Batch testBatch;
     anopol::render::texture::Texture texture, texture2;
     
+    frameStatistics statistics;
+    
     //------------------------------------------------------------------------------------------//
     // Methods
     //------------------------------------------------------------------------------------------//
     
-    static Pipeline CreatePipeline(std::string shaderFolder);
+    static Pipeline CreatePipeline(std::string shaderFolder, sceneWorkload workload = sceneWorkload());
     
     static VkShaderModule CreateShaderModule(std::vector<char> shaderSource);
     static std::vector<char> LoadShaderContent(std::string path);
+    static VkShaderModule LoadOptionalShader(const std::string& path, const char* fallback);
+    static void RequireBindings(const std::string& path, const std::vector<char>& spirv, std::initializer_list<std::pair<uint32_t, uint32_t>> bindings);
     
     void Bind(std::string name);
+    anopol::render::Renderable* SpawnRenderable(glm::vec3 position);
+    void DespawnRenderable(anopol::render::Renderable* renderable);
     void CleanUp();
     
 private:
     
-    VkShaderModule vert, frag;
+    VkShaderModule vert, frag, cull = VK_NULL_HANDLE, hiz = VK_NULL_HANDLE, scatter = VK_NULL_HANDLE, merge = VK_NULL_HANDLE;
     bool isLeftMouseButtonDown = false;
     
     anopol::render::OffscreenRendering offscreen;
+    sceneWorkload workload;
     
     void InitializePipeline();
     void InitializeShadowDepthPass();
     void CreateSynchronizedObjects();
     void CreateCommandBuffers();
     void RenderScene(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t cascade);
+    void RecordAsset(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, size_t index, uint32_t frame, bool late);
     VkGraphicsPipelineCreateInfo InitializePipelineInfo();
 };
 
 
-Pipeline Pipeline::CreatePipeline(std::string shaderFolder) {
+Pipeline Pipeline::CreatePipeline(std::string shaderFolder, sceneWorkload workload) {
     Pipeline pipeline = Pipeline();
+    pipeline.workload = workload;
+    
+    // Compact vertices are read by a build of the vertex shader that dequantizes them
+    std::string vertexShader = shaderFolder + (anopol::render::quantizedVertices ? "/spirv/vert_compact.spv" : "/spirv/vert.spv");
+    std::string fragmentShader = shaderFolder+"/spirv/frag.spv";
+    std::vector<char> vertexSource = LoadShaderContent(vertexShader), fragmentSource = LoadShaderContent(fragmentShader);
+    
+    // Binaries compiled before the GLSL gained these would bind the wrong resources
+    RequireBindings(vertexShader, vertexSource, {{0, 5}});
+    if (anopol::render::quantizedVertices) RequireBindings(vertexShader, vertexSource, {{2, 0}});  // The quantization table
+    RequireBindings(fragmentShader, fragmentSource, {{1, 0}, {1, 1}});     // Bindless textures and the material buffer
     
-    VkShaderModule vert = CreateShaderModule(LoadShaderContent(shaderFolder+"/spirv/vert.spv")),
-                   frag = CreateShaderModule(LoadShaderContent(shaderFolder+"/spirv/frag.spv"));
+    VkShaderModule vert = CreateShaderModule(vertexSource),
+                   frag = CreateShaderModule(fragmentSource);
     
     VkPipelineShaderStageCreateInfo vertex{}, fragment{};
     
@@ -107,6 +146,25 @@ Pipeline Pipeline::CreatePipeline(std::string shaderFolder) {
     
     pipeline.vert = vert;
     pipeline.frag = frag;
+    
+    // Optional: without the compiled cull shader (or drawIndirectCount) the batch is culled on the CPU
+    if (!anopol::batch::GpuCuller::Supported()) {
+        std::cerr << "drawIndirectCount is not supported, the batch is culled on the CPU\n";
+    }
+    else {
+        pipeline.cull = LoadOptionalShader(shaderFolder+"/spirv/cull.spv", "the batch is culled on the CPU");
+        
+        // Occlusion culling on top, when the Hi-Z downsample is compiled as well
+        if (pipeline.cull != VK_NULL_HANDLE) {
+            pipeline.hiz = LoadOptionalShader(shaderFolder+"/spirv/hiz.spv", "Hi-Z occlusion culling is off");
+        }
+    }
+    
+    // Optional as well: moved objects are copied region by region without it
+    pipeline.scatter = LoadOptionalShader(shaderFolder+"/spirv/scatter.spv", "moved objects are copied region by region");
+    
+    // And the merge
+    pipeline.merge = LoadOptionalShader(shaderFolder+"/spirv/merge.spv", "new geometry is copied on the CPU and uploaded");
 
     pipeline.anopolMainPipeline = static_cast<struct pipeline*>(malloc(1 * sizeof(struct pipeline)));
     
@@ -123,7 +181,7 @@ Pipeline Pipeline::CreatePipeline(std::string shaderFolder) {
 std::vector<char> Pipeline::LoadShaderContent(std::string path) {
     std::ifstream file(path, std::ios::ate | std::ios::binary);
     
-    if (!file.is_open()) anopol_assert("Failed to open shader file");
+    if (!file.is_open()) anopol_assert("Failed to open shader file " + path + "; compile the shaders with shaders/shader_compile.sh");
     
     size_t fileSize = (size_t)file.tellg();
     std::vector<char> buffer(fileSize);
@@ -134,6 +192,26 @@ std::vector<char> Pipeline::LoadShaderContent(std::string path) {
         
     return buffer;
 }
+// A missing binary turns its feature off, and says so
+VkShaderModule Pipeline::LoadOptionalShader(const std::string& path, const char* fallback) {
+    
+    if (!std::ifstream(path).good()) {
+        std::cerr << path << " not found, " << fallback << "; compile the shaders with shaders/shader_compile.sh\n";
+        return VK_NULL_HANDLE;
+    }
+    return CreateShaderModule(LoadShaderContent(path));
+}
+void Pipeline::RequireBindings(const std::string& path, const std::vector<char>& spirv, std::initializer_list<std::pair<uint32_t, uint32_t>> bindings) {
+    
+    std::set<std::pair<uint32_t, uint32_t>> declared = spirvDescriptorBindings(spirv);
+    
+    for (const std::pair<uint32_t, uint32_t>& binding : bindings) {
+        if (declared.count(binding) == 0) {
+            anopol_assert(path + " has no set " + std::to_string(binding.first) + " binding " + std::to_string(binding.second) +
+                          ", it is older than its GLSL source; recompile the shaders with shaders/shader_compile.sh");
+        }
+    }
+}
 VkShaderModule Pipeline::CreateShaderModule(std::vector<char> shaderSource) {
     
     VkShaderModule shaderModule;
@@ -181,48 +259,92 @@ void Pipeline::InitializePipeline() {
     //------------------------------------------------------------------------------------------//
     
     testBatch = anopol::batch::Batch::Create();
+    if (workload.chunkSize > 0.0f) testBatch.EnableChunking(workload.chunkSize);
+    
+    if (cull != VK_NULL_HANDLE) {
+        anopol::ll::hizPyramid.Initialize(hiz);
+        if (hiz != VK_NULL_HANDLE) vkDestroyShaderModule(context->device, hiz, nullptr);
+        hiz = VK_NULL_HANDLE;
+        
+        testBatch.EnableGpuCulling(cull);
+    }
+    if (!testBatch.GpuCulling()) testBatch.EnableCpuCulling();
+    
+    anopol::batch::transformScatter.Initialize(scatter);
+    if (scatter != VK_NULL_HANDLE) vkDestroyShaderModule(context->device, scatter, nullptr);
+    scatter = VK_NULL_HANDLE;
+    
+    testBatch.EnableGpuMerge(merge);
+    if (merge != VK_NULL_HANDLE) vkDestroyShaderModule(context->device, merge, nullptr);
+    merge = VK_NULL_HANDLE;
     
     offscreen = anopol::render::OffscreenRendering::Create();
     
-    int length = 200;
+    if (workload.seed != 0) srand(workload.seed);
+    
+    int length = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(workload.renderableCount))));
     int idx = 0;
     
-    testBatch.meshCombineGroup.Reserve(length * length, 0);
+    testBatch.meshCombineGroup.Reserve(workload.renderableCount, 0);
     
     for (int i = 0; i < length; i++) {
-        for (int j = 0; j < length; j++) {
+        for (int j = 0; j < length && idx < static_cast<int>(workload.renderableCount); j++) {
             anopol::render::Renderable* renderable = anopol::render::Renderable::Create();
-            renderable->position = glm::vec3((i - length/2) * 15.f, 0, (j - length/2) * 15.f);
+            renderable->position = glm::vec3((i - length/2) * workload.renderableSpacing, 0, (j - length/2) * workload.renderableSpacing);
             renderable->scale    = glm::vec3(10.0f, 10.f, 10.0f);
             renderable->rotation = glm::vec3(rand()%360);
             renderable->color    = glm::vec3(rand()%255/255.0f, rand()%255/255.0f, rand()%255/255.0f);
+            renderable->material = idx % 7 == 0 ? 1 : 0;    // Mixed textures within the one indirect draw
                         
             testBatch.Append(renderable);
             idx++;
         }
     }
-    anopol::render::Asset* testAsset = anopol::render::Asset::Create("/Users/dmitriwamback/Documents/Projects/nova scotia/nova scotia/models/Nova Scotia.obj");
-    testBatch.Combine();
     
-    int instance_size = 10;
+    if (!testBatch.meshCombineGroup.renderables.empty()) {
+        auto combineStart = std::chrono::steady_clock::now();
+        testBatch.Combine();
+        statistics.initialCombineMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - combineStart).count();
+    }
     
-    for (int i = 0; i < instance_size; i++) {
-        for (int j = 0; j < instance_size; j++) {
-            
-            float x = (i - instance_size / 2) * 40.0f;
-            float z = (j - instance_size / 2) * 40.0f;
-            
-            //float y = floor(math::overlapNoise((x + 0.01f) / 32.25f, (z + 0.01f) / 32.25f, 0.4, 1.8, 10, 1039.3f * 10.0f));
-                        
-            testAsset->PushInstance(glm::vec3(x, 15, z), glm::vec3(0.1f, 1.0f, 1.0f), glm::vec3(180.f, 180.f, 270.f) , glm::vec3(1.0f, 0.0f, 0.7f));
+    int instance_size = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(workload.instancesPerAsset))));
+    
+    auto assetFile = [&](const std::string& path) {
+        return workload.assetFolder.empty() || std::filesystem::path(path).is_absolute() ? path : (std::filesystem::path(workload.assetFolder) / path).string();
+    };
+    
+    for (uint32_t m = 0; m < workload.assetCount; m++) {
+        
+        anopol::render::Asset* testAsset = anopol::render::Asset::Create(assetFile(workload.assetPath));
+        int instances = 0;
+        
+        for (int i = 0; i < instance_size; i++) {
+            for (int j = 0; j < instance_size && instances < static_cast<int>(workload.instancesPerAsset); j++) {
+                
+                float x = (i - instance_size / 2) * 40.0f;
+                float z = (j - instance_size / 2) * 40.0f;
+                
+                //float y = floor(math::overlapNoise((x + 0.01f) / 32.25f, (z + 0.01f) / 32.25f, 0.4, 1.8, 10, 1039.3f * 10.0f));
+                
+                testAsset->PushInstance(glm::vec3(x, 15 + 30.0f * m, z), glm::vec3(0.1f, 1.0f, 1.0f), glm::vec3(180.f, 180.f, 270.f) , glm::vec3(1.0f, 0.0f, 0.7f));
+                instances++;
+            }
         }
+        testAsset->AllocInstances();
+        assets.push_back(testAsset);
     }
-    testAsset->AllocInstances();
+    if (assets.empty()) anopol_assert("The scene needs at least one asset for the instance descriptor");
     
-    texture = anopol::render::texture::Texture::LoadTexture("/Users/dmitriwamback/Documents/Projects/anopol/anopol/textures/wall.jpg");
-    texture2 = anopol::render::texture::Texture::LoadTexture("/Users/dmitriwamback/Documents/Projects/anopol/anopol/textures/diamondplate.jpg");
+    // Instances are culled on the GPU alongside the batch, or not at all
+    for (anopol::render::Asset* asset : assets) {
+        instanceCullers.push_back(anopol::batch::InstanceCuller::Create(asset, cull));
+    }
+    if (cull != VK_NULL_HANDLE) vkDestroyShaderModule(context->device, cull, nullptr);
+    cull = VK_NULL_HANDLE;
+    anopol::render::Asset* testAsset = assets[0];
     
-    assets.push_back(testAsset);
+    texture = anopol::render::texture::Texture::LoadTexture(assetFile("textures/wall.jpg"));
+    texture2 = anopol::render::texture::Texture::LoadTexture(assetFile("textures/diamondplate.jpg"));
     
     //------------------------------------------------------------------------------------------//
     // Creating Uniform Buffers and Instance Buffers
@@ -264,7 +386,12 @@ void Pipeline::InitializePipeline() {
         const anopol::batch::Batch::batchFrame& frame = testBatch.GetBatchFrame(static_cast<uint32_t>(i));
         transformDescriptorBufferInfo.buffer = frame.transformBuffer;
         transformDescriptorBufferInfo.offset = 0;
-        transformDescriptorBufferInfo.range  = sizeof(anopol::batch::batchIndirectTransformation) * testBatch.drawInformation.size();
+        transformDescriptorBufferInfo.range  = VK_WHOLE_SIZE;   // Covers objects appended after the descriptors are written
+        
+        VkDescriptorBufferInfo batchInstanceDescriptorBufferInfo{};
+        batchInstanceDescriptorBufferInfo.buffer = testBatch.InstanceBuffer(static_cast<uint32_t>(i));
+        batchInstanceDescriptorBufferInfo.offset = 0;
+        batchInstanceDescriptorBufferInfo.range  = VK_WHOLE_SIZE;
         
         VkDescriptorImageInfo textureInfo{};
         textureInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
@@ -299,61 +426,28 @@ void Pipeline::InitializePipeline() {
         GLOBAL_PIPELINE_DESCRIPTOR_SETS[3].descriptorCount = 1;
         GLOBAL_PIPELINE_DESCRIPTOR_SETS[3].pImageInfo      = &textureInfo;
         
-        vkUpdateDescriptorSets(context->device, 4, GLOBAL_PIPELINE_DESCRIPTOR_SETS.data(), 0, nullptr);
+        GLOBAL_PIPELINE_DESCRIPTOR_SETS[4].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        GLOBAL_PIPELINE_DESCRIPTOR_SETS[4].dstSet          = ANOPOL_DESCRIPTOR_SETS->descriptorSets[i];
+        GLOBAL_PIPELINE_DESCRIPTOR_SETS[4].dstBinding      = 5;
+        GLOBAL_PIPELINE_DESCRIPTOR_SETS[4].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        GLOBAL_PIPELINE_DESCRIPTOR_SETS[4].descriptorCount = 1;
+        GLOBAL_PIPELINE_DESCRIPTOR_SETS[4].pBufferInfo     = &batchInstanceDescriptorBufferInfo;
+        
+        vkUpdateDescriptorSets(context->device, static_cast<uint32_t>(GLOBAL_PIPELINE_DESCRIPTOR_SETS.size()), GLOBAL_PIPELINE_DESCRIPTOR_SETS.data(), 0, nullptr);
     }
     
     //------------------------------------------------------------------------------------------//
-    // Create Sampler and Allocate Texture Slots
+    // Texture Table and Materials
     //------------------------------------------------------------------------------------------//
     
-    VkDescriptorSetLayoutBinding samplerLayoutBinding{};
-    samplerLayoutBinding.binding = 0;
-    samplerLayoutBinding.descriptorCount = anopol_max_textures;
-    samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-    samplerLayoutBinding.pImmutableSamplers = nullptr;
-        
-    VkDescriptorSetLayoutCreateInfo samplerLayoutInfo{};
-    samplerLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    samplerLayoutInfo.bindingCount = 1;
-    samplerLayoutInfo.pBindings = &samplerLayoutBinding;
-
-    vkCreateDescriptorSetLayout(context->device, &samplerLayoutInfo, nullptr, &samplerDescriptorSetLayout);
+    textureTable.Initialize();
     
+    anopol::render::Material wall, diamondPlate;
+    wall.albedoIndex            = textureTable.Register(texture);
+    diamondPlate.albedoIndex    = textureTable.Register(texture2);
     
-    VkDescriptorSetAllocateInfo samplerAllocInfo{};
-    samplerAllocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    samplerAllocInfo.descriptorPool     = ANOPOL_DESCRIPTOR_SETS->descriptorPool;
-    samplerAllocInfo.descriptorSetCount = 1;
-    samplerAllocInfo.pSetLayouts        = &samplerDescriptorSetLayout;
-
-    if (vkAllocateDescriptorSets(context->device, &samplerAllocInfo, &samplerDescriptorSet) != VK_SUCCESS)
-        anopol_assert("Failed to allocate sampler descriptor set!");
-
-    // Update sampler descriptor set
-    VkDescriptorImageInfo samplerImageInfo{};
-    samplerImageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    samplerImageInfo.imageView   = texture.textureImageView;
-    samplerImageInfo.sampler     = texture.sampler;
-    
-    std::vector<VkDescriptorImageInfo> imageInfos(anopol_max_textures);
-    for (uint32_t i = 0; i < anopol_max_textures; ++i) {
-        imageInfos[i].sampler = texture.sampler;
-        imageInfos[i].imageView = texture.textureImageView;
-        imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    }
-    imageInfos[1].sampler = texture2.sampler;
-    imageInfos[1].imageView = texture2.textureImageView;
-
-    VkWriteDescriptorSet samplerWrite{};
-    samplerWrite.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    samplerWrite.dstSet          = samplerDescriptorSet;
-    samplerWrite.dstBinding      = 0;
-    samplerWrite.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    samplerWrite.descriptorCount = anopol_max_textures;
-    samplerWrite.pImageInfo      = imageInfos.data();
-
-    vkUpdateDescriptorSets(context->device, 1, &samplerWrite, 0, nullptr);
+    textureTable.RegisterMaterial(wall);
+    textureTable.RegisterMaterial(diamondPlate);
     
     
     //------------------------------------------------------------------------------------------//
@@ -362,7 +456,8 @@ void Pipeline::InitializePipeline() {
     
     std::vector<VkDescriptorSetLayout> setLayouts = {
         GLOBAL_ANOPOL_DESCRIPTOR_SET_LAYOUT,
-        samplerDescriptorSetLayout
+        textureTable.Layout(),
+        anopol::render::quantizationTable.Layout()
     };
     
     
@@ -390,7 +485,7 @@ void Pipeline::InitializePipeline() {
     colorAttachment.stencilLoadOp   = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.stencilStoreOp  = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachment.initialLayout   = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout     = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    colorAttachment.finalLayout     = context->headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
     
     VkAttachmentReference colorAttachmentRef{};
     colorAttachmentRef.attachment   = 0;
@@ -399,9 +494,9 @@ void Pipeline::InitializePipeline() {
     VkAttachmentDescription depth{};
     depth.format                    = anopol::ll::findDepthFormat();
     depth.samples                   = VK_SAMPLE_COUNT_1_BIT;
-    depth.loadOp                    = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depth.loadOp                    = VK_ATTACHMENT_LOAD_OP_CLEAR;
     depth.stencilLoadOp             = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    depth.storeOp                   = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depth.storeOp                   = VK_ATTACHMENT_STORE_OP_STORE;     // Read by the Hi-Z build and the late pass
     depth.stencilStoreOp            = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     depth.initialLayout             = VK_IMAGE_LAYOUT_UNDEFINED;
     depth.finalLayout               = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
@@ -446,6 +541,36 @@ void Pipeline::InitializePipeline() {
     
     if (vkCreateRenderPass(context->device, &renderpassInfo, nullptr, &defaultRenderpass) != VK_SUCCESS) anopol_assert("Failed to create RenderPass!");
     
+    //------------------------------------------------------------------------------------------//
+    // Late pass: same attachments, loaded instead of cleared, so the main pipeline and the
+    // framebuffers stay compatible with it
+    //------------------------------------------------------------------------------------------//
+    
+    if (anopol::ll::hizPyramid.Enabled()) {
+        
+        std::array<VkAttachmentDescription, 2> lateAttachments = {colorAttachment, depth};
+        lateAttachments[0].loadOp           = VK_ATTACHMENT_LOAD_OP_LOAD;
+        lateAttachments[0].initialLayout    = colorAttachment.finalLayout;
+        lateAttachments[1].loadOp           = VK_ATTACHMENT_LOAD_OP_LOAD;
+        lateAttachments[1].storeOp          = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        lateAttachments[1].initialLayout    = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        
+        VkSubpassDependency lateDependency{};
+        lateDependency.srcSubpass       = VK_SUBPASS_EXTERNAL;
+        lateDependency.dstSubpass       = 0;
+        lateDependency.srcStageMask     = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        lateDependency.dstStageMask     = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        lateDependency.srcAccessMask    = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        lateDependency.dstAccessMask    = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                                          VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        
+        VkRenderPassCreateInfo lateRenderpassInfo = renderpassInfo;
+        lateRenderpassInfo.pAttachments     = lateAttachments.data();
+        lateRenderpassInfo.pDependencies    = &lateDependency;
+        
+        if (vkCreateRenderPass(context->device, &lateRenderpassInfo, nullptr, &lateRenderpass) != VK_SUCCESS) anopol_assert("Failed to create the late RenderPass!");
+    }
+    
     for (size_t i = 0; i < anopol::ll::swapchainImageViews.size(); i++) {
 
         VkImageView attachments[] = {anopol::ll::swapchainImageViews[i], anopol::ll::depthImageView};
@@ -484,7 +609,7 @@ void Pipeline::InitializePipeline() {
 
     pipelineInfo.pStages = shaderStages;
 
-    if (vkCreateGraphicsPipelines(context->device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &anopolMainPipeline->pipeline) != VK_SUCCESS) anopol_assert("Couldn't create VkPipeline");
+    if (anopol::ll::createGraphicsPipelines(1, &pipelineInfo, &anopolMainPipeline->pipeline) != VK_SUCCESS) anopol_assert("Couldn't create VkPipeline");
     
     vkDestroyShaderModule(context->device, vert, nullptr);
     vkDestroyShaderModule(context->device, frag, nullptr);
@@ -506,6 +631,9 @@ void Pipeline::CreateCommandBuffers() {
                                 &commandBufferAllocationInfo,
                                 commandBuffers.data()) != VK_SUCCESS) anopol_assert("Couldn't create command buffer");
     
+    // Per-worker, per-frame pools for the secondaries recorded inside the render pass
+    secondaryRecorder = anopol::ll::ParallelRecorder::Create();
+    
     //------------------------------------------------------------------------------------------//
     // Creating Semaphores and Fences
     //------------------------------------------------------------------------------------------//
@@ -529,6 +657,8 @@ void Pipeline::CreateCommandBuffers() {
 
 void Pipeline::Bind(std::string name) {
     
+    anopol_zone("Pipeline::Bind");
+    
     //------------------------------------------------------------------------------------------//
     // Binding
     //------------------------------------------------------------------------------------------//
@@ -542,12 +672,18 @@ void Pipeline::Bind(std::string name) {
     beginInfo.flags = 0;
     beginInfo.pInheritanceInfo = nullptr;
     
-    vkAcquireNextImageKHR(context->device, context->swapchain, UINT64_MAX, imageSemaphores[currentFrame], VK_NULL_HANDLE, &anopolPipelineConfigurations.imageIndex);
+    // Headless frames render into the ring target owned by this frame slot
+    if (context->headless)  anopolPipelineConfigurations.imageIndex = currentFrame;
+    else                    vkAcquireNextImageKHR(context->device, context->swapchain, UINT64_MAX, imageSemaphores[currentFrame], VK_NULL_HANDLE, &anopolPipelineConfigurations.imageIndex);
     vkResetFences(context->device, 1, &inFlightFences[currentFrame]);
     vkResetCommandBuffer(commandBuffers[currentFrame], 0);
 
     if (vkBeginCommandBuffer(commandBuffers[currentFrame], &beginInfo) != VK_SUCCESS) anopol_assert("Couldn't begin command buffer");
     
+    // Reads back this frame slot's previous timestamps (its fence was just waited on) and resets the pool
+    anopol::ll::gpuProfiler.BeginFrame(commandBuffers[currentFrame], currentFrame);
+    uint32_t frameScope = anopol::ll::gpuProfiler.Begin(commandBuffers[currentFrame], "frame");
+    
     //------------------------------------------------------------------------------------------//
     // Preparing Render Pass
     //------------------------------------------------------------------------------------------//
@@ -559,49 +695,78 @@ void Pipeline::Bind(std::string name) {
     renderPassBeginInfo.renderArea.offset   = {0, 0};
     renderPassBeginInfo.renderArea.extent   = context->extent;
 
-    VkClearValue clearColor = {{{0.4f, 0.7f, 1.0f, 1.0f}}};
-    renderPassBeginInfo.clearValueCount = 1;
-    renderPassBeginInfo.pClearValues = &clearColor;
+    std::array<VkClearValue, 2> clearValues{};
+    clearValues[0].color        = {{0.4f, 0.7f, 1.0f, 1.0f}};
+    clearValues[1].depthStencil = {1.0f, 0};
+    renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+    renderPassBeginInfo.pClearValues = clearValues.data();
     
     anopolMainPipeline->viewport.width = static_cast<uint32_t>(context->extent.width);
     anopolMainPipeline->viewport.height = static_cast<uint32_t>(context->extent.height);
     anopolMainPipeline->viewport.x = 0.0f;
 
+    //------------------------------------------------------------------------------------------//
+    // Moved objects and new geometry land in this frame's buffers before anything reads them
+    //------------------------------------------------------------------------------------------//
+    
+    auto& batched = testBatch.meshCombineGroup.renderables;
+    uint32_t animated = std::min(workload.animatedCount, static_cast<uint32_t>(batched.size()));
+    for (uint32_t i = 0; i < animated; i++) {
+        if (batched[i] == nullptr) continue;
+        batched[i]->position.y = 5.0f * sin(debugTime * 0.5f + i * 0.1f);
+        batched[i]->MarkTransformDirty();
+    }
+    
+    anopol::batch::DynamicUpload(&testBatch, commandBuffers[currentFrame], currentFrame);
+    testBatch.Merge(commandBuffers[currentFrame], currentFrame);
+    testBatch.Compact();
+    
+    //------------------------------------------------------------------------------------------//
+    // Culling (writes this frame's batch draw commands, so it runs outside the render pass)
+    //------------------------------------------------------------------------------------------//
+    
+    testBatch.Cull(commandBuffers[currentFrame], currentFrame, anopol::camera::camera);
+    for (anopol::batch::InstanceCuller& instanceCuller : instanceCullers) {
+        instanceCuller.Cull(commandBuffers[currentFrame], currentFrame, anopol::camera::camera.cameraProjection * anopol::camera::camera.cameraLookAt);
+    }
+    
+    // Timestamps cannot be written in the primary while the subpass takes secondaries, so this brackets the pass from outside
+    uint32_t mainPassScope = anopol::ll::gpuProfiler.Begin(commandBuffers[currentFrame], "main pass");
     vkCmdBeginRenderPass(commandBuffers[currentFrame], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
-    vkCmdBindPipeline(commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, anopolMainPipeline->pipeline);
     
-    VkDescriptorSet descriptorSets[] = {
+    // The subpass is recorded entirely in secondaries, each of which binds this state itself
+    anopol::ll::secondaryState passState{};
+    passState.renderPass        = defaultRenderpass;
+    passState.framebuffer       = framebuffers[anopolPipelineConfigurations.imageIndex];
+    passState.pipeline          = anopolMainPipeline->pipeline;
+    passState.pipelineLayout    = anopolMainPipeline->pipelineLayout;
+    passState.descriptorSets    = {
         ANOPOL_DESCRIPTOR_SETS->descriptorSets[currentFrame],
-        samplerDescriptorSet
+        textureTable.Set(),
+        anopol::render::quantizationTable.Set()
     };
+    passState.viewport          = anopolMainPipeline->viewport;
+    passState.scissor           = anopolMainPipeline->scissor;
     
-    vkCmdBindDescriptorSets(commandBuffers[currentFrame],
-                            VK_PIPELINE_BIND_POINT_GRAPHICS,
-                            anopolMainPipeline->pipelineLayout,
-                            0,
-                            2,
-                            descriptorSets,
-                            0,
-                            nullptr);
-    vkCmdSetViewport(commandBuffers[currentFrame], 0, 1, &anopolMainPipeline->viewport);
-    vkCmdSetScissor(commandBuffers[currentFrame], 0, 1, &anopolMainPipeline->scissor);
+    secondaryRecorder.Begin(currentFrame, passState);
     
-    //testBatch.Cull();
-        
     //------------------------------------------------------------------------------------------//
     // Camera-Renderable Collision
     //------------------------------------------------------------------------------------------//
     
+    auto collisionStart = std::chrono::steady_clock::now();
+    
     int hardwareThreads = std::thread::hardware_concurrency();
     auto& renderables = testBatch.meshCombineGroup.renderables;
     int total = (int)renderables.size();
-    uint32_t maxThreads = std::min(hardwareThreads, total);
+    uint32_t maxThreads = std::max(1, std::min(hardwareThreads, total));     // An empty batch still gets one (empty) task
     int chunkSize = (total + maxThreads - 1) / maxThreads;
 
     glm::vec3 totalPush(0.0f);
     const int maxIterations = 5;
 
     for (int iter = 0; iter < maxIterations; ++iter) {
+        anopol_zone("collision iteration");
         glm::vec3 accumulatedMTV(0.0f);
         float totalDepth = 0.0f;
 
@@ -612,12 +777,13 @@ void Pipeline::Bind(std::string name) {
             int end = std::min(start + chunkSize, total);
             
             futures.push_back(std::async(std::launch::async, [start, end, &renderables]() {
+                anopol_zone("collision task");
                 std::vector<CameraAdjustment> adjustments;
                 
                 for (int j = start; j < end; ++j) {
                     auto* r = renderables[j];
                     
-                    if (!r->collisionEnabled) continue;
+                    if (r == nullptr || !r->collisionEnabled) continue;
                     if (glm::distance(r->position, anopol::camera::camera.cameraPosition) > r->ComputeBoundingSphereRadius() + 2.0f) continue;
                     
                     auto col = anopol::collision::GJKCollisionWithCamera(r);
@@ -646,19 +812,13 @@ void Pipeline::Bind(std::string name) {
         }
     }
     anopol::camera::camera.updateLookAt();
+    statistics.collisionMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - collisionStart).count();
         
-    if (glfwGetMouseButton(context->window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS && !isLeftMouseButtonDown) {
-        anopol::render::Renderable* renderable = anopol::render::Renderable::Create();
-        renderable->position = anopol::camera::camera.cameraPosition + anopol::camera::camera.mouseRay*14.0f;
-        renderable->scale    = glm::vec3(5.0f, 5.0f, 5.0f);
-        renderable->rotation = glm::vec3(rand()%360);
-        renderable->color    = glm::vec3(rand()%255/255.0f);
-                    
-        testBatch.Append(renderable);
-        testBatch.Combine();
+    if (!context->headless && glfwGetMouseButton(context->window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS && !isLeftMouseButtonDown) {
+        SpawnRenderable(anopol::camera::camera.cameraPosition + anopol::camera::camera.mouseRay*14.0f);
         isLeftMouseButtonDown = true;
     }
-    if (glfwGetMouseButton(context->window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_RELEASE && isLeftMouseButtonDown) {
+    if (!context->headless && glfwGetMouseButton(context->window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_RELEASE && isLeftMouseButtonDown) {
         isLeftMouseButtonDown = false;
     }
         
@@ -668,95 +828,154 @@ void Pipeline::Bind(std::string name) {
     // Rendering Batch
     //------------------------------------------------------------------------------------------//
     
-    testBatch.Render(anopolMainPipeline->pipelineLayout, commandBuffers[currentFrame], defaultRenderpass, framebuffers[anopolPipelineConfigurations.imageIndex], currentFrame);
+    testBatch.Render(secondaryRecorder, anopolMainPipeline->pipelineLayout, currentFrame);
     
     //------------------------------------------------------------------------------------------//
     // Rendering Models / Instancing
     //------------------------------------------------------------------------------------------//
     
-    for (anopol::render::Asset* a : assets) {
-        
-        //------------------------------------------------------------------------------------------//
-        // Push Constants
-        //------------------------------------------------------------------------------------------//
+    VkPipelineLayout pipelineLayout = anopolMainPipeline->pipelineLayout;
+    
+    uint32_t frame = static_cast<uint32_t>(currentFrame);
+    
+    for (size_t i = 0; i < assets.size(); i++) {
+        secondaryRecorder.Record([this, i, frame, pipelineLayout](VkCommandBuffer commandBuffer) {
+            uint32_t assetScope = anopol::ll::gpuProfiler.Begin(commandBuffer, "assets");
+            RecordAsset(commandBuffer, pipelineLayout, i, frame, false);
+            anopol::ll::gpuProfiler.End(commandBuffer, assetScope);
+        });
+    }
+    
+    // Records every queued task across the workers and executes them in one go
+    secondaryRecorder.Execute(commandBuffers[currentFrame]);
+    
+    vkCmdEndRenderPass(commandBuffers[currentFrame]);
+    anopol::ll::gpuProfiler.End(commandBuffers[currentFrame], mainPassScope);
+    
+    //------------------------------------------------------------------------------------------//
+    // Occlusion: rebuild the Hi-Z pyramid from what was just drawn, retest what the early cull
+    // hid, and draw what came back on top. The pyramid is kept for next frame's early cull
+    //------------------------------------------------------------------------------------------//
+    
+    if (lateRenderpass != VK_NULL_HANDLE) {
         
-        anopol::render::anopolStandardPushConstants standardPushConstants{};
-        standardPushConstants.scale             = glm::vec4(glm::vec3(0.75f), 1.0f);
-        standardPushConstants.position          = glm::vec4(glm::vec3(10.0f), 1.0f);
-        standardPushConstants.rotation          = glm::vec4(glm::vec3(0.0f, 0.0f, 0.0f), 1.0f);
+        anopol::ll::hizPyramid.Build(commandBuffers[currentFrame], anopol::camera::camera.cameraProjection * anopol::camera::camera.cameraLookAt);
         
-        glm::mat4 model = modelMatrix(standardPushConstants.position,
-                                      standardPushConstants.scale,
-                                      standardPushConstants.rotation);
+        testBatch.CullLate(commandBuffers[currentFrame], currentFrame);
+        for (anopol::batch::InstanceCuller& instanceCuller : instanceCullers) instanceCuller.CullLate(commandBuffers[currentFrame], currentFrame);
         
-        standardPushConstants.model = model;
+        uint32_t latePassScope = anopol::ll::gpuProfiler.Begin(commandBuffers[currentFrame], "late pass");
         
-        std::vector<VkBuffer> vertexBuffers = std::vector<VkBuffer>();
+        renderPassBeginInfo.renderPass      = lateRenderpass;
+        renderPassBeginInfo.clearValueCount = 0;
+        renderPassBeginInfo.pClearValues    = nullptr;
         
-        if (a->IsInstanced()) {
-            standardPushConstants.instanced = true;
-        }
-        standardPushConstants.physicallyBasedRendering = true;
+        // Few draws, so they are recorded inline rather than through the workers
+        vkCmdBeginRenderPass(commandBuffers[currentFrame], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
         
-        anopol::render::Asset::Mesh mesh = a->meshes[0];
+        vkCmdBindPipeline(commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, passState.pipeline);
+        vkCmdBindDescriptorSets(commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0,
+                                static_cast<uint32_t>(passState.descriptorSets.size()), passState.descriptorSets.data(), 0, nullptr);
+        vkCmdSetViewport(commandBuffers[currentFrame], 0, 1, &passState.viewport);
+        vkCmdSetScissor(commandBuffers[currentFrame], 0, 1, &passState.scissor);
         
-        vertexBuffers.push_back(mesh.vertexBuffer.vertexBuffer);
-        if (a->IsInstanced()) {
-            vertexBuffers.push_back(a->GetInstances()->instanceBuffer);
+        testBatch.RenderLate(commandBuffers[currentFrame], pipelineLayout, currentFrame);
+        for (size_t i = 0; i < assets.size(); i++) {
+            if (instanceCullers[i].Occlusion()) RecordAsset(commandBuffers[currentFrame], pipelineLayout, i, frame, true);
         }
         
-        std::vector<VkDeviceSize> offsets(vertexBuffers.size(), 0);
-        
-        vkCmdPushConstants(commandBuffers[currentFrame],
-                           anopolMainPipeline->pipelineLayout,
-                           VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-                           0,
-                           sizeof(anopol::render::anopolStandardPushConstants),
-                           &standardPushConstants);
-        
-        //------------------------------------------------------------------------------------------//
-        // Rendering
-        //------------------------------------------------------------------------------------------//
-        
-        vkCmdBindVertexBuffers(commandBuffers[currentFrame], 0, static_cast<uint32_t>(vertexBuffers.size()), vertexBuffers.data(), offsets.data());
-        vkCmdBindIndexBuffer(commandBuffers[currentFrame], mesh.indexBuffer.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-        vkCmdDrawIndexed(commandBuffers[currentFrame], static_cast<uint32_t>(mesh.indices.size()), static_cast<uint32_t>(a->IsInstanced() ? a->GetInstances()->instances.size() : 1), 0, 0, 0);
+        vkCmdEndRenderPass(commandBuffers[currentFrame]);
+        anopol::ll::gpuProfiler.End(commandBuffers[currentFrame], latePassScope);
     }
     
-    vkCmdEndRenderPass(commandBuffers[currentFrame]);
-    
     
     //offscreen.Render(testBatch, commandBuffers[currentFrame], anopolMainPipeline->pipelineLayout, currentFrame);
     
     
+    anopol::ll::gpuProfiler.End(commandBuffers[currentFrame], frameScope);
+    
     if (vkEndCommandBuffer(commandBuffers[currentFrame]) != VK_SUCCESS) anopol_assert("Failed to record command buffer");
     
     //------------------------------------------------------------------------------------------//
     // Submitting
     //------------------------------------------------------------------------------------------//
     
-    VkSemaphore waitSemaphores[] = {imageSemaphores[currentFrame]};
-    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+    // Uploads from here on wait for this frame only if they copy to or from one of these
+    testBatch.MarkGraphicsUse(currentFrame);
+    textureTable.MarkGraphicsUse();
+    anopol::render::quantizationTable.MarkGraphicsUse();
+    for (anopol::render::Asset* a : assets) {
+        anopol::ll::markGraphicsUse(a->meshes[0].vertexBuffer.vertexBuffer);
+        anopol::ll::markGraphicsUse(a->meshes[0].indexBuffer.indexBuffer);
+    }
+    for (const anopol::batch::InstanceCuller& instanceCuller : instanceCullers) instanceCuller.MarkGraphicsUse(currentFrame);
+    
+    // Staged copies recorded this frame go to the transfer queue ahead of the draws
+    anopol::ll::submitUploads();
+    
+    // Only wait on the upload timeline when this frame reads data that is still in flight
+    anopol::ll::uploadToken requiredUpload = std::max({testBatch.pendingUpload, textureTable.pendingUpload, anopol::render::quantizationTable.pendingUpload});
+    for (anopol::render::Asset* a : assets) {
+        requiredUpload = std::max({requiredUpload, a->meshes[0].vertexBuffer.pendingUpload, a->meshes[0].indexBuffer.pendingUpload});
+    }
+    for (const anopol::batch::InstanceCuller& instanceCuller : instanceCullers) {
+        requiredUpload = std::max(requiredUpload, instanceCuller.pendingUpload);
+    }
+    
+    std::vector<VkSemaphore>            waitSemaphores;
+    std::vector<VkPipelineStageFlags>   waitStages;
+    std::vector<uint64_t>               waitValues;
+    
+    if (!context->headless) {
+        waitSemaphores.push_back(imageSemaphores[currentFrame]);
+        waitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+        waitValues.push_back(0);
+    }
+    
+    if (!anopol::ll::uploadComplete(requiredUpload)) {
+        waitSemaphores.push_back(anopol::ll::uploadTimeline);
+        waitStages.push_back(VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT);
+        waitValues.push_back(requiredUpload);
+    }
+    
+    // Nothing waits on the render semaphore without a present, so headless frames only signal the timeline
+    VkSemaphore signal[] = {renderSemaphores[currentFrame], anopol::ll::graphicsTimeline};
+    uint64_t signalValues[] = {0, anopol::ll::nextGraphicsTimelineValue()};
+    uint32_t signalOffset = context->headless ? 1 : 0;
+    
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType                      = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount    = static_cast<uint32_t>(waitValues.size());
+    timelineInfo.pWaitSemaphoreValues       = waitValues.data();
+    timelineInfo.signalSemaphoreValueCount  = 2 - signalOffset;
+    timelineInfo.pSignalSemaphoreValues     = signalValues + signalOffset;
+    
     VkSubmitInfo submitInfo{};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = waitSemaphores;
-    submitInfo.pWaitDstStageMask = waitStages;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+    submitInfo.pWaitSemaphores = waitSemaphores.data();
+    submitInfo.pWaitDstStageMask = waitStages.data();
 
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
 
-    VkSemaphore signal[] = {renderSemaphores[currentFrame]};
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = signal;
+    submitInfo.signalSemaphoreCount = 2 - signalOffset;
+    submitInfo.pSignalSemaphores = signal + signalOffset;
         
-    if (vkQueueSubmit(context->presentQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
-        anopol_assert("Failed to submit the draw command");
+    {
+        std::lock_guard<std::mutex> queueLock(context->graphicsQueueMutex);
+        if (vkQueueSubmit(context->graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
+            anopol_assert("Failed to submit the draw command");
+        }
     }
     
     //------------------------------------------------------------------------------------------//
     // Presenting
     //------------------------------------------------------------------------------------------//
+    
+    if (context->headless) return;
 
     VkPresentInfoKHR presentInfo{};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -771,6 +990,93 @@ void Pipeline::Bind(std::string name) {
     vkQueuePresentKHR(context->presentQueue, &presentInfo);
 }
 
+anopol::render::Renderable* Pipeline::SpawnRenderable(glm::vec3 position) {
+    
+    anopol::render::Renderable* renderable = anopol::render::Renderable::Create();
+    renderable->position = position;
+    renderable->scale    = glm::vec3(5.0f, 5.0f, 5.0f);
+    renderable->rotation = glm::vec3(rand()%360);
+    renderable->color    = glm::vec3(rand()%255/255.0f);
+    
+    auto combineStart = std::chrono::steady_clock::now();
+    
+    testBatch.Append(renderable);
+    testBatch.Combine();
+    
+    statistics.combineMilliseconds.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - combineStart).count());
+    return renderable;
+}
+
+// The batch stops drawing it with the frame recorded next; its slot goes to the next spawn
+void Pipeline::DespawnRenderable(anopol::render::Renderable* renderable) {
+    
+    testBatch.Remove(renderable);
+    testBatch.Combine();
+    
+    renderable->vertexBuffer.dealloc();
+    renderable->indexBuffer.dealloc();
+    delete renderable;
+}
+
+//------------------------------------------------------------------------------------------//
+// Asset drawing, shared by the main pass (secondaries) and the late pass (inline)
+//------------------------------------------------------------------------------------------//
+
+void Pipeline::RecordAsset(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, size_t index, uint32_t frame, bool late) {
+    
+    anopol::render::Asset* a = assets[index];
+    const anopol::batch::InstanceCuller& instanceCuller = instanceCullers[index];
+    
+    //------------------------------------------------------------------------------------------//
+    // Push Constants
+    //------------------------------------------------------------------------------------------//
+    
+    anopol::render::anopolStandardPushConstants standardPushConstants{};
+    standardPushConstants.scale             = glm::vec4(glm::vec3(0.75f), 1.0f);
+    standardPushConstants.position          = glm::vec4(glm::vec3(10.0f), 1.0f);
+    standardPushConstants.rotation          = glm::vec4(glm::vec3(0.0f, 0.0f, 0.0f), 1.0f);
+    
+    glm::mat4 model = modelMatrix(standardPushConstants.position,
+                                  standardPushConstants.scale,
+                                  standardPushConstants.rotation);
+    
+    standardPushConstants.model = model;
+    
+    std::vector<VkBuffer> vertexBuffers = std::vector<VkBuffer>();
+    
+    if (a->IsInstanced()) {
+        standardPushConstants.instanced = true;
+    }
+    standardPushConstants.physicallyBasedRendering = true;
+    
+    const anopol::render::Asset::Mesh& mesh = a->meshes[0];
+    
+    vertexBuffers.push_back(mesh.vertexBuffer.vertexBuffer);
+    if (a->IsInstanced()) {
+        // Culled instances come from this frame's compacted copy
+        vertexBuffers.push_back(instanceCuller.Enabled() ? instanceCuller.InstanceBuffer(frame) : a->GetInstances()->instanceBuffer);
+    }
+    
+    std::vector<VkDeviceSize> offsets(vertexBuffers.size(), 0);
+    
+    vkCmdPushConstants(commandBuffer,
+                       pipelineLayout,
+                       VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+                       0,
+                       sizeof(anopol::render::anopolStandardPushConstants),
+                       &standardPushConstants);
+    
+    //------------------------------------------------------------------------------------------//
+    // Rendering
+    //------------------------------------------------------------------------------------------//
+    
+    vkCmdBindVertexBuffers(commandBuffer, 0, static_cast<uint32_t>(vertexBuffers.size()), vertexBuffers.data(), offsets.data());
+    vkCmdBindIndexBuffer(commandBuffer, mesh.indexBuffer.indexBuffer, 0, mesh.indexBuffer.indexType);
+    
+    if (instanceCuller.Enabled()) instanceCuller.Draw(commandBuffer, frame, late);
+    else                          vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(mesh.indices.size()), static_cast<uint32_t>(a->IsInstanced() ? a->GetInstances()->instances.size() : 1), 0, 0, 0);
+}
+
 void Pipeline::InitializeShadowDepthPass() {
     
 }
@@ -795,10 +1101,15 @@ void Pipeline::CleanUp() {
     vkDestroyPipeline(context->device, anopolMainPipeline->pipeline, nullptr);
     vkDestroyPipelineLayout(context->device, anopolMainPipeline->pipelineLayout, nullptr);
     vkDestroyRenderPass(context->device, defaultRenderpass, nullptr);
+    if (lateRenderpass != VK_NULL_HANDLE) vkDestroyRenderPass(context->device, lateRenderpass, nullptr);
     
     vkFreeCommandBuffers(context->device, ll::commandPool, anopol_max_frames, commandBuffers.data());
+    secondaryRecorder.Destroy();
     
     testBatch.Dealloc();
+    for (anopol::batch::InstanceCuller& instanceCuller : instanceCullers) instanceCuller.Destroy();
+    anopol::ll::hizPyramid.Destroy();
+    anopol::batch::transformScatter.Destroy();
     offscreen.Free();
     
     for (anopol::render::Renderable* renderable : debugRenderables) {
@@ -814,10 +1125,10 @@ void Pipeline::CleanUp() {
         if(asset->IsInstanced()) asset->GetInstances()->dealloc();
     }
     uniformBufferMemory.dealloc();
+    textureTable.Destroy();
     texture.Dealloc();
     texture2.Dealloc();
     
-    vkDestroyDescriptorSetLayout(context->device, samplerDescriptorSetLayout, nullptr);
     
     for (size_t i = 0; i < anopol_max_frames; i++) {
         vkDestroySemaphore(context->device, renderSemaphores[i], nullptr);
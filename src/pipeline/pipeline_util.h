@@ -68,49 +68,23 @@ pipelineConfigurations CreatePipelineConfigurations(PipelineType type, PipelineR
     
     config.dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};;
     
-    VkVertexInputBindingDescription vertexBindingDescription = anopol::render::Vertex::getBindingDescription();
-    VkVertexInputBindingDescription instanceBindingDescription = anopol::render::InstanceBuffer::GetBindingDescription();
-    
     //------------------------------------------------------------------------------------------//
-    // Set vertex attributes based off of PipelineType
+    // Set vertex attributes based off of PipelineType, from the layouts of what is bound
     //------------------------------------------------------------------------------------------//
     
+    using namespace anopol::render;
+    
     if (type == InstanceAndStandard) {
-        config.attributes = {
-            VkVertexInputAttributeDescription {0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(anopol::render::Vertex, vertex)},
-            VkVertexInputAttributeDescription {1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(anopol::render::Vertex, normal)},
-            VkVertexInputAttributeDescription {2, 0, VK_FORMAT_R32G32_SFLOAT,    offsetof(anopol::render::Vertex, uv)},
-            VkVertexInputAttributeDescription {3, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(anopol::render::instanceProperties, modelRow0)},
-            VkVertexInputAttributeDescription {4, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(anopol::render::instanceProperties, modelRow1)},
-            VkVertexInputAttributeDescription {5, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(anopol::render::instanceProperties, modelRow2)},
-            VkVertexInputAttributeDescription {6, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(anopol::render::instanceProperties, modelRow3)},
-        };
-        
-        config.bindings = {
-            vertexBindingDescription,
-            instanceBindingDescription
-        };
+        config.attributes = vertexAttributes<gpuVertexLayout, instanceLayout>();
+        config.bindings   = vertexBindings<gpuVertexLayout, instanceLayout>();
     }
     else if (type == Instance) {
-        config.attributes = {
-            VkVertexInputAttributeDescription {0, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(anopol::render::instanceProperties, modelRow0)},
-            VkVertexInputAttributeDescription {1, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(anopol::render::instanceProperties, modelRow1)},
-            VkVertexInputAttributeDescription {2, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(anopol::render::instanceProperties, modelRow2)},
-            VkVertexInputAttributeDescription {3, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(anopol::render::instanceProperties, modelRow3)}
-        };
-        config.bindings = {
-            instanceBindingDescription
-        };
+        config.attributes = vertexAttributes<instanceOnlyLayout>();
+        config.bindings   = vertexBindings<instanceOnlyLayout>();
     }
     else if (type == Standard || type == Tessellation) {
-        config.attributes = {
-            VkVertexInputAttributeDescription {0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(anopol::render::Vertex, vertex)},
-            VkVertexInputAttributeDescription {1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(anopol::render::Vertex, normal)},
-            VkVertexInputAttributeDescription {2, 0, VK_FORMAT_R32G32_SFLOAT,    offsetof(anopol::render::Vertex, uv)},
-        };
-        config.bindings = {
-            vertexBindingDescription,
-        };
+        config.attributes = vertexAttributes<gpuVertexLayout>();
+        config.bindings   = vertexBindings<gpuVertexLayout>();
     }
     
     config.viewport = *viewport;
@@ -239,6 +213,37 @@ pipelineConfigurations CreatePipelineConfigurations(PipelineType type, PipelineR
     
     return config;
 }
+
+// (set, binding) of every resource a SPIR-V module declares, read from its OpDecorate DescriptorSet
+// and Binding decorations. Lets a binary be checked against what the code binds for it
+std::set<std::pair<uint32_t, uint32_t>> spirvDescriptorBindings(const std::vector<char>& spirv) {
+    
+    const uint32_t opDecorate = 71, decorationBinding = 33, decorationDescriptorSet = 34;
+    
+    std::vector<uint32_t> words(spirv.size() / sizeof(uint32_t));
+    memcpy(words.data(), spirv.data(), words.size() * sizeof(uint32_t));
+    
+    std::set<std::pair<uint32_t, uint32_t>> bindings;
+    if (words.size() < 5 || words[0] != 0x07230203) return bindings;
+    
+    std::unordered_map<uint32_t, uint32_t> sets, bindingNumbers;
+    for (size_t i = 5; i < words.size();) {
+        uint32_t wordCount = words[i] >> 16, opcode = words[i] & 0xFFFF;
+        if (wordCount == 0 || i + wordCount > words.size()) break;
+        
+        if (opcode == opDecorate && wordCount >= 4) {
+            if (words[i + 2] == decorationDescriptorSet) sets[words[i + 1]]           = words[i + 3];
+            if (words[i + 2] == decorationBinding)       bindingNumbers[words[i + 1]] = words[i + 3];
+        }
+        i += wordCount;
+    }
+    
+    for (const auto& [target, binding] : bindingNumbers) {
+        auto set = sets.find(target);
+        bindings.insert({set == sets.end() ? 0 : set->second, binding});
+    }
+    return bindings;
+}
     
 }
 
@@ -12,17 +12,17 @@ namespace anopol::pipeline {
 
 class Scene {
 public:
-    static Scene Create();
+    static Scene Create(const std::string& shaderFolder);
     void RenderScene();
 private:
     Pipeline batchingPipeline, shadowPipeline, gBufferPipeline, instancePipeline;
     Pipeline debugPipeline;
 };
 
-Scene Scene::Create() {
+Scene Scene::Create(const std::string& shaderFolder) {
     Scene scene = Scene();
     
-    scene.debugPipeline = Pipeline::CreatePipeline("/Users/dmitriwamback/Documents/Projects/anopol/anopol/shaders/main");
+    scene.debugPipeline = Pipeline::CreatePipeline(shaderFolder);
     
     
     
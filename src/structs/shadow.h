@@ -18,7 +18,7 @@ struct shadow {
 
 struct shadowImage {
     VkImage                 shadowImage;
-    VkDeviceMemory          mem;
+    anopol::ll::allocation  mem;
     VkImageView             shadowImageView;
     VkSampler               sampler;
 };